@@ -40,10 +40,12 @@ static const uint16_t modbus_crc_table[256] = {
     0x8201,0x42C0,0x4380,0x8341,0x4100,0x81C1,0x8081,0x4040
 };
 
-static inline uint16_t modbus_crc16(const uint8_t *data, uint16_t len)
-{
-    uint16_t crc = 0xFFFF;
+// Continue a running CRC over more bytes. Start from MODBUS_CRC16_INIT.
+// Feeding a whole frame including its trailing CRC bytes yields 0 when the frame is intact.
+#define MODBUS_CRC16_INIT 0xFFFF
 
+static inline uint16_t modbus_crc16_update(uint16_t crc, const uint8_t *data, uint16_t len)
+{
     while (len--)
     {
         uint8_t idx = (uint8_t)(crc ^ *data++);
@@ -52,4 +54,9 @@ static inline uint16_t modbus_crc16(const uint8_t *data, uint16_t len)
     return crc;
 }
 
+static inline uint16_t modbus_crc16(const uint8_t *data, uint16_t len)
+{
+    return modbus_crc16_update(MODBUS_CRC16_INIT, data, len);
+}
+
 #endif /* CRC16_H */
@@ -2,41 +2,265 @@
 
 #include "NilanRegisters.h"
 
-#define NILAN_MAX_REG_ADDR 2002 // Largest register address in nilan_registers
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
-// address -> reg-id maps, 0xFFFF = "no register here"
-static uint16_t input_map[NILAN_MAX_REG_ADDR + 1];
-static uint16_t holding_map[NILAN_MAX_REG_ADDR + 1];
+#include "nilan_poll_plan.h"
 
-nilan_reg_state_t nilan_reg_state[NILAN_REGID_COUNT] = {0};
+// Register value store, struct-of-arrays: 8 bytes per register instead of a
+// padded 12-byte struct. valid is implied by gen != 0.
+static uint16_t reg_raw[NILAN_REGID_COUNT];
+static uint16_t reg_gen[NILAN_REGID_COUNT];
+static uint32_t reg_ts[NILAN_REGID_COUNT];
 
-void nilan_update_state_range(uint8_t reg_type,
-                              uint16_t start_addr,
-                              uint16_t qty,
-                              const uint16_t *regs,
-                              uint32_t timestamp_ms)
+// Registers holding a restored value that hasn't been confirmed by a read yet.
+static uint32_t reg_stale[(NILAN_REGID_COUNT + 31) / 32];
+
+// Sequence lock per poll block: odd while the bus task is writing the block.
+static uint32_t block_seq[NILAN_POLL_BLOCK_COUNT];
+
+// Keeps the writer from being preempted mid-block, so a reader on the same
+// core never spins on an odd sequence. Readers don't take it.
+static portMUX_TYPE store_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// A reader that keeps losing to the writer backs off after this many tries.
+#define NILAN_STORE_READ_SPINS 8
+
+static inline void store_begin(size_t block)
 {
-    uint16_t end_addr = start_addr + qty; // exclusive
+    uint32_t seq = __atomic_load_n(&block_seq[block], __ATOMIC_RELAXED);
+    __atomic_store_n(&block_seq[block], seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // odd seq is visible before any data
+}
 
-    for (int id = 0; id < NILAN_REGID_COUNT; ++id)
+static inline void store_end(size_t block)
+{
+    uint32_t seq = __atomic_load_n(&block_seq[block], __ATOMIC_RELAXED);
+    __atomic_store_n(&block_seq[block], seq + 1, __ATOMIC_RELEASE); // data before even seq
+}
+
+static inline void store_one(size_t id, uint16_t raw, uint32_t timestamp_ms)
+{
+    uint32_t bit = 1u << (id % 32);
+    bool was_stale = (__atomic_load_n(&reg_stale[id / 32], __ATOMIC_RELAXED) & bit) != 0;
+    if (was_stale)
     {
-        const nilan_reg_meta_t *meta = &nilan_registers[id];
+        __atomic_fetch_and(&reg_stale[id / 32], ~bit, __ATOMIC_RELAXED);
+    }
 
-        if (meta->reg_type != reg_type)
+    uint16_t gen = __atomic_load_n(&reg_gen[id], __ATOMIC_RELAXED);
+    if (gen == 0 || was_stale || __atomic_load_n(&reg_raw[id], __ATOMIC_RELAXED) != raw)
+    {
+        gen = (uint16_t)(gen + 1);
+        if (gen == 0)
         {
-            continue;
+            gen = 1; // 0 is reserved for "never read"
         }
+        __atomic_store_n(&reg_raw[id], raw, __ATOMIC_RELAXED);
+        __atomic_store_n(&reg_gen[id], gen, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&reg_ts[id], timestamp_ms, __ATOMIC_RELAXED);
+}
+
+// Seqlock read of count registers that all live in block. Returns false if any is unread.
+static bool load_consistent(size_t block, const nilan_reg_id_t *ids, size_t count, nilan_reg_value_t *out)
+{
+    for (int attempt = 0;; ++attempt)
+    {
+        uint32_t seq = __atomic_load_n(&block_seq[block], __ATOMIC_ACQUIRE);
 
-        if (meta->addr < start_addr || meta->addr >= end_addr)
+        if ((seq & 1u) == 0)
         {
-            continue;
+            for (size_t i = 0; i < count; ++i)
+            {
+                out[i].raw = __atomic_load_n(&reg_raw[ids[i]], __ATOMIC_RELAXED);
+                out[i].gen = __atomic_load_n(&reg_gen[ids[i]], __ATOMIC_RELAXED);
+                out[i].timestamp_ms = __atomic_load_n(&reg_ts[ids[i]], __ATOMIC_RELAXED);
+            }
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE); // data loads before the re-check
+            if (__atomic_load_n(&block_seq[block], __ATOMIC_RELAXED) == seq)
+            {
+                break;
+            }
         }
 
-        uint16_t offset = meta->addr - start_addr;
+        if (attempt >= NILAN_STORE_READ_SPINS)
+        {
+            vTaskDelay(1); // writer is busy on the other core; let it finish
+            attempt = 0;
+        }
+    }
 
-        nilan_reg_state[id].raw = regs[offset];
-        nilan_reg_state[id].timestamp_ms = timestamp_ms;
-        nilan_reg_state[id].valid = 1;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (out[i].gen == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool nilan_reg_read(nilan_reg_id_t id, nilan_reg_value_t *out)
+{
+    if ((size_t)id >= NILAN_REGID_COUNT || out == NULL)
+    {
+        return false;
+    }
+    return load_consistent(nilan_poll_reg_block[id], &id, 1, out);
+}
+
+bool nilan_reg_read_many(const nilan_reg_id_t *ids, size_t count, nilan_reg_value_t *out)
+{
+    if (ids == NULL || out == NULL || count == 0)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if ((size_t)ids[i] >= NILAN_REGID_COUNT ||
+            nilan_poll_reg_block[ids[i]] != nilan_poll_reg_block[ids[0]])
+        {
+            return false;
+        }
+    }
+
+    return load_consistent(nilan_poll_reg_block[ids[0]], ids, count, out);
+}
+
+uint16_t nilan_reg_raw(nilan_reg_id_t id)
+{
+    return ((size_t)id < NILAN_REGID_COUNT) ? __atomic_load_n(&reg_raw[id], __ATOMIC_RELAXED) : 0;
+}
+
+uint16_t nilan_reg_gen(nilan_reg_id_t id)
+{
+    return ((size_t)id < NILAN_REGID_COUNT) ? __atomic_load_n(&reg_gen[id], __ATOMIC_ACQUIRE) : 0;
+}
+
+void nilan_reg_store_block(size_t block_index, const uint16_t *regs, uint32_t timestamp_ms)
+{
+    const nilan_poll_block_t *blk = &nilan_poll_blocks[block_index];
+    const nilan_poll_map_entry_t *map = &nilan_poll_map[blk->map_first];
+
+    taskENTER_CRITICAL(&store_lock);
+    store_begin(block_index);
+
+    for (uint8_t i = 0; i < blk->map_count; i++)
+    {
+        store_one(map[i].id, regs[map[i].offset], timestamp_ms);
+    }
+
+    store_end(block_index);
+    taskEXIT_CRITICAL(&store_lock);
+}
+
+void nilan_reg_restore(nilan_reg_id_t id, uint16_t raw)
+{
+    if (id >= NILAN_REGID_COUNT)
+    {
+        return;
+    }
+
+    reg_raw[id] = raw;
+    reg_gen[id] = 1;
+    reg_ts[id] = 0;
+    __atomic_fetch_or(&reg_stale[id / 32], 1u << (id % 32), __ATOMIC_RELEASE);
+}
+
+bool nilan_reg_is_stale(nilan_reg_id_t id)
+{
+    if (id >= NILAN_REGID_COUNT)
+    {
+        return false;
+    }
+
+    return (__atomic_load_n(&reg_stale[id / 32], __ATOMIC_ACQUIRE) & (1u << (id % 32))) != 0;
+}
+
+// Index range [*first, *last) for the addresses of reg_type in [start_addr, end_addr).
+static void index_range(uint8_t reg_type, uint16_t start_addr, uint32_t end_addr,
+                        size_t *first, size_t *last)
+{
+    const uint8_t *hundred = nilan_reg_index_hundred[(reg_type == NILAN_INPUT_REG) ? 0 : 1];
+    size_t h_start = start_addr / 100;
+    size_t h_end = (end_addr + 99) / 100; // hundreds touched, exclusive
+
+    if (h_start >= NILAN_REG_INDEX_HUNDREDS)
+    {
+        *first = *last = 0;
+        return;
+    }
+    if (h_end > NILAN_REG_INDEX_HUNDREDS)
+    {
+        h_end = NILAN_REG_INDEX_HUNDREDS;
+    }
+
+    size_t i = hundred[h_start];
+    size_t end = hundred[h_end];
+
+    // Skip the part of the first hundred below start_addr.
+    while (i < end && nilan_reg_index[i].addr < start_addr)
+    {
+        ++i;
+    }
+    *first = i;
+
+    while (i < end && nilan_reg_index[i].addr < end_addr)
+    {
+        ++i;
+    }
+    *last = i;
+}
+
+nilan_reg_id_t nilan_reg_find(uint8_t reg_type, uint16_t addr)
+{
+    size_t first, last;
+    index_range(reg_type, addr, (uint32_t)addr + 1, &first, &last);
+    return (first < last) ? (nilan_reg_id_t)nilan_reg_index[first].id : NILAN_REGID_COUNT;
+}
+
+uint32_t nilan_reg_layout_hash(void)
+{
+    uint32_t h = 2166136261u;
+    for (size_t id = 0; id < NILAN_REGID_COUNT; ++id)
+    {
+        uint8_t bytes[3] = {
+            (uint8_t)(nilan_registers[id].addr >> 8),
+            (uint8_t)(nilan_registers[id].addr & 0xFF),
+            nilan_registers[id].reg_type,
+        };
+        for (size_t i = 0; i < sizeof(bytes); ++i)
+        {
+            h = (h ^ bytes[i]) * 16777619u;
+        }
+    }
+    return h;
+}
+
+void nilan_update_state_range(uint8_t reg_type,
+                              uint16_t start_addr,
+                              uint16_t qty,
+                              const uint16_t *regs,
+                              uint32_t timestamp_ms)
+{
+    size_t first, last;
+    index_range(reg_type, start_addr, (uint32_t)start_addr + qty, &first, &last);
+
+    // Only the registers that actually sit in the range, no scan of the whole table.
+    for (size_t i = first; i < last; ++i)
+    {
+        size_t id = nilan_reg_index[i].id;
+        uint16_t offset = nilan_reg_index[i].addr - start_addr;
+        size_t block = nilan_poll_reg_block[id];
+
+        taskENTER_CRITICAL(&store_lock);
+        store_begin(block);
+        store_one(id, regs[offset], timestamp_ms);
+        store_end(block);
+        taskEXIT_CRITICAL(&store_lock);
     }
 }
 
@@ -51,14 +275,15 @@ const nilan_reg_meta_t nilan_registers[NILAN_REGID_COUNT] = {
     [NILAN_REGID_IR_BUS_VERSION] = {
         .addr = 0,
         .reg_type = NILAN_INPUT_REG,
+        .poll_class = NILAN_POLL_STATIC,
         .data_type = NILAN_DTYPE_UINT16,
         .name = "Protocol version"},
 
-    [NILAN_REGID_IR_APP_VERSION_MAJOR] = {.addr = 1, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_UINT16, .name = "SW version - major"},
+    [NILAN_REGID_IR_APP_VERSION_MAJOR] = {.addr = 1, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_STATIC, .data_type = NILAN_DTYPE_UINT16, .name = "SW version - major"},
 
-    [NILAN_REGID_IR_APP_VERSION_MINOR] = {.addr = 2, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_UINT16, .name = "SW version - minor"},
+    [NILAN_REGID_IR_APP_VERSION_MINOR] = {.addr = 2, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_STATIC, .data_type = NILAN_DTYPE_UINT16, .name = "SW version - minor"},
 
-    [NILAN_REGID_IR_APP_VERSION_RELEASE] = {.addr = 3, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_UINT16, .name = "SW version - release"},
+    [NILAN_REGID_IR_APP_VERSION_RELEASE] = {.addr = 3, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_STATIC, .data_type = NILAN_DTYPE_UINT16, .name = "SW version - release"},
 
     // -------------- 1xx Discrete inputs -------------------
     [NILAN_REGID_IR_INPUT_USERFUNC] = {.addr = 100, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_UINT16, .name = "User function"},
@@ -94,29 +319,29 @@ const nilan_reg_meta_t nilan_registers[NILAN_REGID_COUNT] = {
     [NILAN_REGID_IR_INPUT_USERFUNC2] = {.addr = 113, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_UINT16, .name = "User function 2"},
 
     // -------------- 2xx Temps / RH ------------------------
-    [NILAN_REGID_IR_T0_CONTROLLER] = {.addr = 200, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Controller board"},
+    [NILAN_REGID_IR_T0_CONTROLLER] = {.addr = 200, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Controller board"},
 
-    [NILAN_REGID_IR_T2_INLET] = {.addr = 202, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Inlet preheater"},
+    [NILAN_REGID_IR_T2_INLET] = {.addr = 202, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Inlet preheater"},
 
-    [NILAN_REGID_IR_T5_CONDENSOR] = {.addr = 205, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Condenser"},
+    [NILAN_REGID_IR_T5_CONDENSOR] = {.addr = 205, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Condenser"},
 
-    [NILAN_REGID_IR_T6_EVAPORATOR] = {.addr = 206, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Evaporator"},
+    [NILAN_REGID_IR_T6_EVAPORATOR] = {.addr = 206, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Evaporator"},
 
-    [NILAN_REGID_IR_T7_INLET_POSTHEATER] = {.addr = 207, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Inlet postheater"},
+    [NILAN_REGID_IR_T7_INLET_POSTHEATER] = {.addr = 207, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Inlet postheater"},
 
-    [NILAN_REGID_IR_T8_OUTDOOR] = {.addr = 208, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Outdoor"},
+    [NILAN_REGID_IR_T8_OUTDOOR] = {.addr = 208, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Outdoor"},
 
-    [NILAN_REGID_IR_T10_EXTERN_ROOM] = {.addr = 210, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "External room"},
+    [NILAN_REGID_IR_T10_EXTERN_ROOM] = {.addr = 210, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "External room"},
 
-    [NILAN_REGID_IR_T11_TANK_TOP] = {.addr = 211, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Tank top"},
+    [NILAN_REGID_IR_T11_TANK_TOP] = {.addr = 211, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Tank top"},
 
-    [NILAN_REGID_IR_T12_TANK_BOTTOM] = {.addr = 212, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Tank bottom"},
+    [NILAN_REGID_IR_T12_TANK_BOTTOM] = {.addr = 212, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Tank bottom"},
 
-    [NILAN_REGID_IR_T15_ROOM_PANEL] = {.addr = 215, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Room (panel)"},
+    [NILAN_REGID_IR_T15_ROOM_PANEL] = {.addr = 215, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Room (panel)"},
 
-    [NILAN_REGID_IR_T16_AUX] = {.addr = 216, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "AUX / anode"},
+    [NILAN_REGID_IR_T16_AUX] = {.addr = 216, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "AUX / anode"},
 
-    [NILAN_REGID_IR_HUMIDITY] = {.addr = 221, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Humidity"},
+    [NILAN_REGID_IR_HUMIDITY] = {.addr = 221, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST, .data_type = NILAN_DTYPE_UINT16, .name = "Humidity"},
 
     // -------------- 4xx Alarm list ------------------------
     // 400 = alram state bit mask. 0x80: active alarms. 0x03: # of alarms
@@ -147,19 +372,19 @@ const nilan_reg_meta_t nilan_registers[NILAN_REGID_COUNT] = {
     [NILAN_REGID_IR_ALARM_LIST3_TIME] = {.addr = 409, .reg_type = NILAN_INPUT_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Alarm 3 time"},
 
     // ------------- 1000 Operation/Control  ----------------
-    [NILAN_REGID_IR_CONTROL_RUNNING] = {.addr = 1000, .reg_type = NILAN_INPUT_REG,
+    [NILAN_REGID_IR_CONTROL_RUNNING] = {.addr = 1000, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST,
                                         .data_type = NILAN_DTYPE_UINT16, // 0=Off,1=On
                                         .name = "Power State"},
 
-    [NILAN_REGID_IR_CONTROL_MODE] = {.addr = 1001, .reg_type = NILAN_INPUT_REG,
+    [NILAN_REGID_IR_CONTROL_MODE] = {.addr = 1001, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST,
                                      .data_type = NILAN_DTYPE_ENUM16, // use control_modes[]
                                      .name = "Operation Mode"},
 
-    [NILAN_REGID_IR_CONTROL_STATE] = {.addr = 1002, .reg_type = NILAN_INPUT_REG,
+    [NILAN_REGID_IR_CONTROL_STATE] = {.addr = 1002, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST,
                                       .data_type = NILAN_DTYPE_ENUM16, // use control_states[]
                                       .name = "Control State"},
 
-    [NILAN_REGID_IR_CONTROL_SEC_IN_STATE] = {.addr = 1003, .reg_type = NILAN_INPUT_REG,
+    [NILAN_REGID_IR_CONTROL_SEC_IN_STATE] = {.addr = 1003, .reg_type = NILAN_INPUT_REG, .poll_class = NILAN_POLL_FAST,
                                              .data_type = NILAN_DTYPE_UINT16, // seconds in state
                                              .name = "Seconds in state"},
 
@@ -218,7 +443,7 @@ const nilan_reg_meta_t nilan_registers[NILAN_REGID_COUNT] = {
     // =========================================================
 
     // -------------- 00x Device / protocol -----------------
-    [NILAN_REGID_HR_BUS_ADDRESS] = {.addr = 50, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Bus address"},
+    [NILAN_REGID_HR_BUS_ADDRESS] = {.addr = 50, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_STATIC, .data_type = NILAN_DTYPE_UINT16, .name = "Bus address"},
 
     // -------------- 1xx Digital outputs -------------------
     [NILAN_REGID_HR_OUTPUT_AIR_FLAP] = {.addr = 100, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Air flap"},
@@ -304,59 +529,59 @@ const nilan_reg_meta_t nilan_registers[NILAN_REGID_COUNT] = {
     [NILAN_REGID_HR_OUTPUT_PREHEAT_CAP] = {.addr = 205, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Preheat capacity"},
 
     // -------------- 3xx Time & date -----------------------
-    [NILAN_REGID_HR_TIME_SECOND] = {.addr = 300, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Time second"},
+    [NILAN_REGID_HR_TIME_SECOND] = {.addr = 300, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "Time second"},
 
-    [NILAN_REGID_HR_TIME_MINUTE] = {.addr = 301, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Time minute"},
+    [NILAN_REGID_HR_TIME_MINUTE] = {.addr = 301, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "Time minute"},
 
-    [NILAN_REGID_HR_TIME_HOUR] = {.addr = 302, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Time hour"},
+    [NILAN_REGID_HR_TIME_HOUR] = {.addr = 302, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "Time hour"},
 
-    [NILAN_REGID_HR_TIME_DAY] = {.addr = 303, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Date day"},
+    [NILAN_REGID_HR_TIME_DAY] = {.addr = 303, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "Date day"},
 
-    [NILAN_REGID_HR_TIME_MONTH] = {.addr = 304, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Date month"},
+    [NILAN_REGID_HR_TIME_MONTH] = {.addr = 304, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "Date month"},
 
-    [NILAN_REGID_HR_TIME_YEAR] = {.addr = 305, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Date year"},
+    [NILAN_REGID_HR_TIME_YEAR] = {.addr = 305, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "Date year"},
 
     // -------------- 4xx Alarm control ---------------------
-    [NILAN_REGID_HR_ALARM_RESET] = {.addr = 400, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Alarm reset"},
+    [NILAN_REGID_HR_ALARM_RESET] = {.addr = 400, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "Alarm reset"},
 
     // -------------- 50x Week program select ---------------
-    [NILAN_REGID_HR_PROGRAM_SELECT] = {.addr = 500, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_ENUM16, .name = "Program select"},
+    [NILAN_REGID_HR_PROGRAM_SELECT] = {.addr = 500, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_ENUM16, .name = "Program select"},
 
     // -------------- 60x User function 1 -------------------
-    [NILAN_REGID_HR_PROGRAM_USERFUNC_ACT] = {.addr = 600, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "UserFunc1 active"},
+    [NILAN_REGID_HR_PROGRAM_USERFUNC_ACT] = {.addr = 600, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "UserFunc1 active"},
 
-    [NILAN_REGID_HR_PROGRAM_USERFUNC_SET] = {.addr = 601, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_ENUM16, .name = "UserFunc1 select"},
+    [NILAN_REGID_HR_PROGRAM_USERFUNC_SET] = {.addr = 601, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_ENUM16, .name = "UserFunc1 select"},
 
-    [NILAN_REGID_HR_PROGRAM_USER_TIME_SET] = {.addr = 602, .reg_type = NILAN_HOLDING_REG,
+    [NILAN_REGID_HR_PROGRAM_USER_TIME_SET] = {.addr = 602, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW,
                                               .data_type = NILAN_DTYPE_UINT16, // minutes
                                               .name = "UserFunc1 time"},
 
     [NILAN_REGID_HR_PROGRAM_USER_VENT_SET] = {
-        .addr = 603, .reg_type = NILAN_HOLDING_REG,
+        .addr = 603, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW,
         .data_type = NILAN_DTYPE_UINT16, // step
         .name = "UserFunc1 vent step"    // Extend function...)
     },
 
-    [NILAN_REGID_HR_PROGRAM_USER_TEMP_SET] = {.addr = 604, .reg_type = NILAN_HOLDING_REG,
+    [NILAN_REGID_HR_PROGRAM_USER_TEMP_SET] = {.addr = 604, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW,
                                               .data_type = NILAN_DTYPE_INT16, // °C (not x100)
                                               .name = "UserFunc1 temp"},
 
-    [NILAN_REGID_HR_PROGRAM_USER_OFFS_SET] = {.addr = 605, .reg_type = NILAN_HOLDING_REG,
+    [NILAN_REGID_HR_PROGRAM_USER_OFFS_SET] = {.addr = 605, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW,
                                               .data_type = NILAN_DTYPE_INT16, // °C offset
                                               .name = "UserFunc1 offset"},
 
     // -------------- 61x User function 2 -------------------
-    [NILAN_REGID_HR_PROGRAM_USER2_FUNC_ACT] = {.addr = 610, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "UserFunc2 active"},
+    [NILAN_REGID_HR_PROGRAM_USER2_FUNC_ACT] = {.addr = 610, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "UserFunc2 active"},
 
-    [NILAN_REGID_HR_PROGRAM_USER2_FUNC_SET] = {.addr = 611, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_ENUM16, .name = "UserFunc2 select"},
+    [NILAN_REGID_HR_PROGRAM_USER2_FUNC_SET] = {.addr = 611, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_ENUM16, .name = "UserFunc2 select"},
 
-    [NILAN_REGID_HR_PROGRAM_USER2_TIME_SET] = {.addr = 612, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "UserFunc2 time"},
+    [NILAN_REGID_HR_PROGRAM_USER2_TIME_SET] = {.addr = 612, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "UserFunc2 time"},
 
-    [NILAN_REGID_HR_PROGRAM_USER2_VENT_SET] = {.addr = 613, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "UserFunc2 vent step"},
+    [NILAN_REGID_HR_PROGRAM_USER2_VENT_SET] = {.addr = 613, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "UserFunc2 vent step"},
 
-    [NILAN_REGID_HR_PROGRAM_USER2_TEMP_SET] = {.addr = 614, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_INT16, .name = "UserFunc2 temp"},
+    [NILAN_REGID_HR_PROGRAM_USER2_TEMP_SET] = {.addr = 614, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_INT16, .name = "UserFunc2 temp"},
 
-    [NILAN_REGID_HR_PROGRAM_USER2_OFFS_SET] = {.addr = 615, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_INT16, .name = "UserFunc2 offset"},
+    [NILAN_REGID_HR_PROGRAM_USER2_OFFS_SET] = {.addr = 615, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_INT16, .name = "UserFunc2 offset"},
 
     // -------------- 1000 Control (setpoints) --------------
     [NILAN_REGID_HR_CONTROL_RUN_SET] = {.addr = 1001, .reg_type = NILAN_HOLDING_REG,
@@ -380,9 +605,9 @@ const nilan_reg_meta_t nilan_registers[NILAN_REGID_COUNT] = {
                                             .name = "Service mode capacity"},
 
     // -------------- 1100 AirFlow settings -----------------
-    [NILAN_REGID_HR_AIRFLOW_AIR_EXCH_MODE] = {.addr = 1100, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_ENUM16, .name = "Air exchange mode"},
+    [NILAN_REGID_HR_AIRFLOW_AIR_EXCH_MODE] = {.addr = 1100, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_ENUM16, .name = "Air exchange mode"},
 
-    [NILAN_REGID_HR_AIRFLOW_COOL_VENT] = {.addr = 1101, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "Cooling vent step"},
+    [NILAN_REGID_HR_AIRFLOW_COOL_VENT] = {.addr = 1101, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "Cooling vent step"},
 
     // [NILAN_REGID_HR_AIRFLOW_TEST_SELECT] = {
     //     .addr      = 1102,
@@ -413,40 +638,40 @@ const nilan_reg_meta_t nilan_registers[NILAN_REGID_COUNT] = {
     // },
 
     // -------------- 1200 AirTemp settings -----------------
-    [NILAN_REGID_HR_AIRTEMP_COOL_SET] = {.addr = 1200, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_ENUM16, .name = "Cooling temp setpoint"},
+    [NILAN_REGID_HR_AIRTEMP_COOL_SET] = {.addr = 1200, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_ENUM16, .name = "Cooling temp setpoint"},
 
-    [NILAN_REGID_HR_AIRTEMP_TEMP_MIN_SUM] = {.addr = 1201, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Min. summer inlet temp"},
+    [NILAN_REGID_HR_AIRTEMP_TEMP_MIN_SUM] = {.addr = 1201, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Min. summer inlet temp"},
 
-    [NILAN_REGID_HR_AIRTEMP_TEMP_MIN_WIN] = {.addr = 1202, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Min. winter inlet temp"},
+    [NILAN_REGID_HR_AIRTEMP_TEMP_MIN_WIN] = {.addr = 1202, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Min. winter inlet temp"},
 
-    [NILAN_REGID_HR_AIRTEMP_TEMP_MAX_SUM] = {.addr = 1203, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "max. summer inlet temp"},
+    [NILAN_REGID_HR_AIRTEMP_TEMP_MAX_SUM] = {.addr = 1203, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "max. summer inlet temp"},
 
-    [NILAN_REGID_HR_AIRTEMP_TEMP_MAX_WIN] = {.addr = 1204, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "max. winter inlet temp"},
+    [NILAN_REGID_HR_AIRTEMP_TEMP_MAX_WIN] = {.addr = 1204, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "max. winter inlet temp"},
 
-    [NILAN_REGID_HR_AIRTEMP_TEMP_SUMMER] = {.addr = 1205, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Summer/winter limit"},
+    [NILAN_REGID_HR_AIRTEMP_TEMP_SUMMER] = {.addr = 1205, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Summer/winter limit"},
 
-    [NILAN_REGID_HR_AIRTEMP_NIGHT_DAY_LIM] = {.addr = 1206, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Night-cooling day limit"},
+    [NILAN_REGID_HR_AIRTEMP_NIGHT_DAY_LIM] = {.addr = 1206, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Night-cooling day limit"},
 
-    [NILAN_REGID_HR_AIRTEMP_NIGHT_SET] = {.addr = 1207, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Night-cooling setpoint"},
+    [NILAN_REGID_HR_AIRTEMP_NIGHT_SET] = {.addr = 1207, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Night-cooling setpoint"},
 
     // -------------- 1700 HotWater settings ----------------
-    [NILAN_REGID_HR_HOTWATER_TEMPSET_TOP_ELEC] = {.addr = 1700, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Tank Top setpoint (elec.)"},
+    [NILAN_REGID_HR_HOTWATER_TEMPSET_TOP_ELEC] = {.addr = 1700, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Tank Top setpoint (elec.)"},
 
-    [NILAN_REGID_HR_HOTWATER_TEMPSET_BOTTOM_COMPR] = {.addr = 1701, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Tank Bottom setpoint (compr.)"},
+    [NILAN_REGID_HR_HOTWATER_TEMPSET_BOTTOM_COMPR] = {.addr = 1701, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Tank Bottom setpoint (compr.)"},
 
     // -------------- 1800 Central heat settings -----------
-    [NILAN_REGID_HR_CENTHEAT_HEAT_EXTERN] = {.addr = 1800, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Ext. heat offset temp setpoint"},
+    [NILAN_REGID_HR_CENTHEAT_HEAT_EXTERN] = {.addr = 1800, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_TEMP_Cx100, .name = "Ext. heat offset temp setpoint"},
 
     // -------------- 1910 AirQual humidity -----------------
-    [NILAN_REGID_HR_AIRQUAL_RH_VENT_LO] = {.addr = 1910, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "humidity low winter step"},
+    [NILAN_REGID_HR_AIRQUAL_RH_VENT_LO] = {.addr = 1910, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "humidity low winter step"},
 
-    [NILAN_REGID_HR_AIRQUAL_RH_VENT_HI] = {.addr = 1911, .reg_type = NILAN_HOLDING_REG, .data_type = NILAN_DTYPE_UINT16, .name = "humidity high step"},
+    [NILAN_REGID_HR_AIRQUAL_RH_VENT_HI] = {.addr = 1911, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW, .data_type = NILAN_DTYPE_UINT16, .name = "humidity high step"},
 
-    [NILAN_REGID_HR_AIRQUAL_RH_LIM_LO] = {.addr = 1912, .reg_type = NILAN_HOLDING_REG,
+    [NILAN_REGID_HR_AIRQUAL_RH_LIM_LO] = {.addr = 1912, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW,
                                           .data_type = NILAN_DTYPE_UINT16, // % *100
                                           .name = "Humidity limit for low vent"},
 
-    [NILAN_REGID_HR_AIRQUAL_RH_TIMEOUT] = {.addr = 1913, .reg_type = NILAN_HOLDING_REG,
+    [NILAN_REGID_HR_AIRQUAL_RH_TIMEOUT] = {.addr = 1913, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW,
                                            .data_type = NILAN_DTYPE_UINT16, // minutes
                                            .name = "Humidity high vent max time"},
 
@@ -473,7 +698,7 @@ const nilan_reg_meta_t nilan_registers[NILAN_REGID_COUNT] = {
     // },
 
     // -------------- 2000 User panel -----------------------
-    [NILAN_REGID_HR_USER_MENU_OPEN] = {.addr = 2002, .reg_type = NILAN_HOLDING_REG,
+    [NILAN_REGID_HR_USER_MENU_OPEN] = {.addr = 2002, .reg_type = NILAN_HOLDING_REG, .poll_class = NILAN_POLL_SLOW,
                                        .data_type = NILAN_DTYPE_ENUM16, // 0=Closed,1=Open,2=No OFF
                                        .name = "User menu open"},
 };
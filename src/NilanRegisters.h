@@ -1,6 +1,8 @@
 #ifndef NILAN_REGISTERS_H
 #define NILAN_REGISTERS_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -300,16 +302,63 @@ typedef enum
     // later: bitfield, 32-bit, etc.
 } nilan_data_type_t;
 
-// Set up a struct definition for holding the values read from each register, and a timestamp.
+// How fresh a register needs to be. tools/gen_nilan_tables.py reads these (and the
+// .poll_class of every entry in nilan_registers) at build time to derive the poll plan.
+typedef enum
+{
+    NILAN_POLL_NORMAL = 0, // default for entries that don't say otherwise
+    NILAN_POLL_FAST,       // temperatures, control state - what the UI shows
+    NILAN_POLL_SLOW,       // settings that only change when someone edits them
+    NILAN_POLL_STATIC,     // versions, bus address
+
+    NILAN_POLL_CLASS_COUNT
+} nilan_poll_class_t;
+
+#define NILAN_POLL_NORMAL_MS 5000
+#define NILAN_POLL_FAST_MS 2000
+#define NILAN_POLL_SLOW_MS 30000
+#define NILAN_POLL_STATIC_MS 600000
+
+// One register as seen by a reader: value, when it was read, and its generation.
 typedef struct
 {
     uint16_t raw;          // last raw 16-bit Modbus value
-    uint32_t timestamp_ms; // 0 if never updated
-    uint8_t valid;         // 0 = never / invalid, 1 = OK
-} nilan_reg_state_t;
+    uint16_t gen;          // bumps whenever raw changes; 0 = never read
+    uint32_t timestamp_ms; // when raw was last confirmed by a read
+} nilan_reg_value_t;
+
+// ---------------- Register value store ----------------
+//
+// Written only by the Modbus bus task, one poll block at a time. Each block has
+// a sequence lock, so readers on either core get a consistent copy of all the
+// registers in a block without taking a mutex (they retry if a write raced them).
+
+// Consistent copy of one register. Returns false if it has never been read.
+bool nilan_reg_read(nilan_reg_id_t id, nilan_reg_value_t *out);
+
+// Consistent copy of several registers read in the same poll block, e.g. the
+// clock at HR 300-305. Returns false if they span blocks or any is unread.
+bool nilan_reg_read_many(const nilan_reg_id_t *ids, size_t count, nilan_reg_value_t *out);
 
-// Declare the value array.
-extern nilan_reg_state_t nilan_reg_state[NILAN_REGID_COUNT];
+// Just the raw value (0 if never read). A single 16-bit load, always whole.
+uint16_t nilan_reg_raw(nilan_reg_id_t id);
+
+// Changes every time the value changes; 0 = never read. Keep the last one you
+// saw and compare to find out cheaply whether there is anything new.
+uint16_t nilan_reg_gen(nilan_reg_id_t id);
+
+// Writer side, bus task only: store a freshly read poll block (regs holds the
+// whole block, gap registers included).
+void nilan_reg_store_block(size_t block_index, const uint16_t *regs, uint32_t timestamp_ms);
+
+// Boot only, before the bus task starts: seed a register with a value saved
+// before the last reboot (see nilan_snapshot.h). It reads like any other value
+// (gen != 0, timestamp 0) but counts as stale until the first real read, which
+// always bumps its generation so change subscribers redraw it.
+void nilan_reg_restore(nilan_reg_id_t id, uint16_t raw);
+
+// True while the value is a restored one that hasn't been read on the bus yet.
+bool nilan_reg_is_stale(nilan_reg_id_t id);
 
 //////////////////////////////////////////////////
 
@@ -318,13 +367,24 @@ typedef struct
 {
     uint16_t addr;               // Modbus register
     uint8_t reg_type;            // 3 = holding, 4 = input
+    nilan_poll_class_t poll_class; // refresh class, NILAN_POLL_NORMAL if omitted
     nilan_data_type_t data_type; // how to interpret raw value
     const char *name;            // "Tank top T11", for UI
 } nilan_reg_meta_t;
 
 extern const nilan_reg_meta_t nilan_registers[NILAN_REGID_COUNT];
 
-// Update a contiguous block [start_addr ... start_addr + qty - 1] into the state array.
+// Register id for a Modbus address, or NILAN_REGID_COUNT if we don't know it.
+// Uses the generated flash index: scans at most one hundred of the map.
+nilan_reg_id_t nilan_reg_find(uint8_t reg_type, uint16_t addr);
+
+// FNV-1a over the addresses and types of nilan_registers[]. Anything saved by
+// register id stores it, so data from firmware with a different table is
+// ignored rather than read back into the wrong registers.
+uint32_t nilan_reg_layout_hash(void);
+
+// Update a contiguous block [start_addr ... start_addr + qty - 1] into the store.
+// Bus task only, like nilan_reg_store_block().
 void nilan_update_state_range(uint8_t reg_type,
                               uint16_t start_addr,
                               uint16_t qty,
@@ -332,7 +392,4 @@ void nilan_update_state_range(uint8_t reg_type,
                               uint32_t timestamp_ms);
 
 
-// Init lookup tables
-void nilan_registers_init();
-
 #endif /* NILAN_REGISTERS_H */
\ No newline at end of file
@@ -7,6 +7,9 @@
 
 // Time/date registers (PCF8563/BM8563 map) :contentReference[oaicite:3]{index=3}
 #define BM8563_REG 0x02
+
+// A wedged bus fails the transfer instead of hanging the caller.
+#define BM8563_I2C_TIMEOUT_MS 100
 // #define BM8563_REG_SECONDS   0x02
 // #define BM8563_REG_MINUTES   0x03
 // #define BM8563_REG_HOURS     0x04
@@ -20,6 +23,7 @@ bool rtc_initialized = false;
 
 static inline uint8_t bcd_to_bin(uint8_t bcd);
 static inline uint8_t bin_to_bcd(uint8_t bin);
+static int64_t days_from_civil(int y, unsigned m, unsigned d);
 // static inline esp_err_t rtc_read(uint8_t reg, uint8_t *data, size_t len);
 // static inline esp_err_t rtc_write(uint8_t reg, const uint8_t *data, size_t len);
 
@@ -52,7 +56,7 @@ bool rtc_get_time(rtc_time_t *time_ptr)
     uint8_t bm8563_reg = BM8563_REG;
     uint8_t buffer[7];
 
-    if (i2c_master_transmit_receive(rtc_handle, &bm8563_reg, 1, buffer, 7, -1) == ESP_OK) // Ignoring errors.
+    if (i2c_master_transmit_receive(rtc_handle, &bm8563_reg, 1, buffer, 7, BM8563_I2C_TIMEOUT_MS) == ESP_OK) // Ignoring errors.
     {
         // Mask out control bits per PCF8563/BM8563 convention
         time_ptr->sec   = bcd_to_bin(buffer[0] & 0x7F);
@@ -84,7 +88,19 @@ bool rtc_set_time(const rtc_time_t *time_ptr)
     tx_buffer[6] = bin_to_bcd(time_ptr->month);               // century bit left 0 => 2000+
     tx_buffer[7] = bin_to_bcd((uint8_t)(time_ptr->year - 2000));
 
-    return i2c_master_transmit(rtc_handle, tx_buffer, 8, -1);
+    return i2c_master_transmit(rtc_handle, tx_buffer, 8, BM8563_I2C_TIMEOUT_MS) == ESP_OK;
+}
+
+bool rtc_get_epoch(int64_t *epoch)
+{
+    rtc_time_t rt;
+
+    if (!rtc_get_time(&rt) || rt.year < RTC_MIN_VALID_YEAR)
+        return false;
+
+    *epoch = days_from_civil(rt.year, rt.month, rt.day) * 86400 +
+             rt.hour * 3600 + rt.min * 60 + rt.sec;
+    return true;
 }
 
 
@@ -101,6 +117,17 @@ static inline uint8_t bin_to_bcd(uint8_t bin)
     return (uint8_t)(((bin / 10) << 4) | (bin % 10));
 }
 
+// Days since 1970-01-01 for a proleptic Gregorian date (H. Hinnant's algorithm).
+static int64_t days_from_civil(int y, unsigned m, unsigned d)
+{
+    y -= (m <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (int64_t)era * 146097 + (int64_t)doe - 719468;
+}
+
 // static inline esp_err_t rtc_read(uint8_t reg, uint8_t *data, size_t len)
 // {
 //     return i2c_master_transmit_receive(rtc_handle, &reg, 1, data, len, -1);
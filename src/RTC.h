@@ -1,6 +1,7 @@
 #ifndef RTC_H
 #define RTC_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 // --- RTC (BM8563 / PCF8563 compatible) ---
@@ -16,4 +17,15 @@ typedef struct {
 
 void core2_RTC_init();
 
+// Blocking I2C transfers; call after core2_RTC_init(). For the current time
+// use sys_time.h, which reads the RTC once at boot.
+bool rtc_get_time(rtc_time_t *time_ptr);
+bool rtc_set_time(const rtc_time_t *time_ptr);
+
+// Anything the RTC says before this is a flat backup cell, not a time.
+#define RTC_MIN_VALID_YEAR 2024
+
+// RTC time as UTC seconds since 1970. False if it can't be read or isn't set.
+bool rtc_get_epoch(int64_t *epoch);
+
 #endif /* RTC_H */
\ No newline at end of file
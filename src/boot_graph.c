@@ -0,0 +1,127 @@
+#include "boot_graph.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "nilan_transport.h"
+
+static const char *TAG = "boot";
+
+#define BOOT_TASK_PRIO 5
+#define BOOT_DEFAULT_STACK 4096
+
+typedef struct {
+    const boot_component_t *c;
+    uint32_t bit;
+} boot_task_arg_t;
+
+static const char *const s_mark_names[BOOT_MARK_COUNT] = {
+    [BOOT_MARK_FIRST_MODBUS_READ] = "first Modbus read",
+    [BOOT_MARK_FIRST_FRAME] = "first frame",
+};
+
+static EventGroupHandle_t s_done = NULL;
+static boot_task_arg_t s_args[BOOT_MAX_COMPONENTS];
+static int64_t s_mark_us[BOOT_MARK_COUNT] = {-1, -1};
+static volatile bool s_mark_seen[BOOT_MARK_COUNT];
+static portMUX_TYPE s_mark_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static inline uint32_t ms_since_boot(int64_t us)
+{
+    return (uint32_t)(us / 1000);   // same clock as the Modbus stack; from boot on the ESP32
+}
+
+static void boot_task(void *arg)
+{
+    const boot_task_arg_t *a = (const boot_task_arg_t *)arg;
+
+    if (a->c->needs) {
+        xEventGroupWaitBits(s_done, a->c->needs, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    int64_t t0 = nilan_transport_now_us();
+    ESP_LOGI(TAG, "%-8s start %5lu ms", a->c->name, (unsigned long)ms_since_boot(t0));
+
+    a->c->init();
+
+    int64_t t1 = nilan_transport_now_us();
+    ESP_LOGI(TAG, "%-8s done  %5lu ms (%lu ms)", a->c->name,
+             (unsigned long)ms_since_boot(t1), (unsigned long)((t1 - t0) / 1000));
+
+    xEventGroupSetBits(s_done, a->bit);
+    vTaskDelete(NULL);
+}
+
+bool boot_graph_run(const boot_component_t *components, size_t count)
+{
+    if (count == 0 || count > BOOT_MAX_COMPONENTS) {
+        return false;
+    }
+
+    // Needs may only point at earlier entries: that rules out cycles and
+    // unknown components, and keeps the table readable top to bottom.
+    for (size_t i = 0; i < count; i++) {
+        if (components[i].needs & ~(BOOT_NEED(i) - 1u)) {
+            ESP_LOGE(TAG, "%s needs a later or unknown component", components[i].name);
+            return false;
+        }
+    }
+
+    s_done = xEventGroupCreate();
+    if (s_done == NULL) {
+        return false;
+    }
+
+    uint32_t all = 0;
+    for (size_t i = 0; i < count; i++) {
+        s_args[i].c = &components[i];
+        s_args[i].bit = BOOT_NEED(i);
+        all |= s_args[i].bit;
+
+        uint32_t stack = components[i].stack_size ? components[i].stack_size : BOOT_DEFAULT_STACK;
+        if (xTaskCreate(boot_task, components[i].name, stack, &s_args[i], BOOT_TASK_PRIO, NULL) != pdPASS) {
+            ESP_LOGE(TAG, "can't start %s", components[i].name);
+            xEventGroupSetBits(s_done, s_args[i].bit);   // don't hold up the rest forever
+        }
+    }
+
+    xEventGroupWaitBits(s_done, all, pdFALSE, pdTRUE, portMAX_DELAY);
+    ESP_LOGI(TAG, "all components up at %lu ms", (unsigned long)ms_since_boot(nilan_transport_now_us()));
+    return true;
+}
+
+void boot_graph_mark(boot_mark_t mark)
+{
+    if ((unsigned)mark >= BOOT_MARK_COUNT || s_mark_seen[mark]) {
+        return;   // the common case once booted: one load
+    }
+
+    int64_t now = nilan_transport_now_us();
+    bool first = false;
+
+    taskENTER_CRITICAL(&s_mark_lock);
+    if (!s_mark_seen[mark]) {
+        s_mark_us[mark] = now;
+        s_mark_seen[mark] = true;
+        first = true;
+    }
+    taskEXIT_CRITICAL(&s_mark_lock);
+
+    if (first) {
+        ESP_LOGI(TAG, "%s at %lu ms", s_mark_names[mark], (unsigned long)ms_since_boot(now));
+    }
+}
+
+int64_t boot_graph_mark_us(boot_mark_t mark)
+{
+    if ((unsigned)mark >= BOOT_MARK_COUNT) {
+        return -1;
+    }
+
+    taskENTER_CRITICAL(&s_mark_lock);
+    int64_t us = s_mark_us[mark];
+    taskEXIT_CRITICAL(&s_mark_lock);
+    return us;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Boot orchestration: every component declares which others it needs, and each
+ * starts in its own task as soon as those are done. Independent chains (Wi-Fi
+ * association, the Modbus bus, the display) run side by side instead of one
+ * after the other. Start and end of every stage are logged against boot time.
+ */
+
+// Bit for component index i in boot_component_t.needs.
+#define BOOT_NEED(i) (1u << (i))
+
+// Most components a graph may have (one event group bit each).
+#define BOOT_MAX_COMPONENTS 16
+
+typedef struct {
+    const char *name;
+    uint32_t needs;        // BOOT_NEED() of every component that must finish first
+    void (*init)(void);
+    uint32_t stack_size;   // 0 = 4096
+} boot_component_t;
+
+// Start all components and wait until every one of them has finished.
+// Returns false if the table is invalid (too big, or a need that can never be met).
+bool boot_graph_run(const boot_component_t *components, size_t count);
+
+// One-off milestones tracked as boot regression metrics.
+typedef enum {
+    BOOT_MARK_FIRST_MODBUS_READ,   // first successful poll block
+    BOOT_MARK_FIRST_FRAME,         // first LVGL frame flushed to the panel
+    BOOT_MARK_COUNT
+} boot_mark_t;
+
+// Record a milestone; only the first call per mark counts. Any task.
+void boot_graph_mark(boot_mark_t mark);
+
+// Microseconds since boot at which the milestone was reached, or -1 if not yet.
+int64_t boot_graph_mark_us(boot_mark_t mark);
+
+#ifdef __cplusplus
+}
+#endif
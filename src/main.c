@@ -8,8 +8,17 @@
 //#include "core2_bringup.h"
 #include "ui.h"
 
+#include "boot_graph.h"
 #include "wifi_sta.h"
 #include "nilan_modbus.h"
+#include "nilan_history.h"
+#include "nilan_logstore.h"
+#include "nilan_mbtcp.h"
+#include "nilan_snapshot.h"
+#include "nilan_telemetry.h"
+#include "sys_diag.h"
+#include "sys_time.h"
+#include "web_server.h"
 
 #include "bsp/esp-bsp.h"
 
@@ -17,20 +26,105 @@
 // #define WIFI_SSID "YOUR_SSID"
 // #define WIFI_PASS "YOUR_PASS"
 
-void app_main()
+// ---------- Boot graph ----------
+// Each stage lists what it needs; everything else starts at once. The network
+// stages only need the Wi-Fi driver up, not a link: they follow WIFI_STA_EVENT.
+enum {
+    BOOT_AXP192,     // power rails + the shared BSP I2C bus
+    BOOT_RTC,
+    BOOT_CLOCK,      // wall time from the RTC, read once
+    BOOT_DISPLAY,
+    BOOT_SNAPSHOT,   // also brings up NVS
+    BOOT_UI,
+    BOOT_MODBUS,
+    BOOT_WIFI,
+    BOOT_DIAG,
+    BOOT_LOG,        // long-term log on flash, stamped with the wall clock
+    BOOT_WEB,        // HTTP server, once Wi-Fi has brought up the network stack
+    BOOT_MBTCP,      // Modbus TCP slave, served from the register cache
+    BOOT_UPLINK,     // telemetry uploader, stamped with the wall clock
+    BOOT_SNTP,       // clock discipline, RTC write-back and the CTS602 clock
+};
+
+static void boot_clock(void)
 {
-    axp192_init();  // Set up axp192 handle.
-    core2_RTC_init();
+    sys_time_init();
+}
 
+static void boot_display(void)
+{
     display_init();
     display_set_bg_hex(COLOR_BG_DARK);
+}
 
-    ui_init();
+static void boot_snapshot(void)
+{
+    // Last known register values, so the UI has something to show right away.
+    nilan_snapshot_restore();
+}
 
+static void boot_modbus(void)
+{
+    nilan_history_init();
+    nilan_modbus_start();
+    nilan_snapshot_start();
+}
 
+static void boot_wifi(void)
+{
     wifi_sta_start();
-    nilan_modbus_start();
+}
+
+static void boot_diag(void)
+{
+    sys_diag_start();
+}
+
+static void boot_log(void)
+{
+    nilan_logstore_start();
+}
+
+static void boot_web(void)
+{
+    web_server_start();
+}
 
+static void boot_mbtcp(void)
+{
+    nilan_mbtcp_start();
+}
+
+static void boot_uplink(void)
+{
+    nilan_telemetry_start();
+}
+
+static void boot_sntp(void)
+{
+    sys_time_start();
+}
+
+static const boot_component_t s_boot[] = {
+    [BOOT_AXP192]   = {"axp192",   0,                                         axp192_init,     0},
+    [BOOT_RTC]      = {"rtc",      BOOT_NEED(BOOT_AXP192),                    core2_RTC_init,  0},
+    [BOOT_CLOCK]    = {"clock",    BOOT_NEED(BOOT_RTC),                       boot_clock,      0},
+    [BOOT_DISPLAY]  = {"display",  BOOT_NEED(BOOT_AXP192),                    boot_display,    0},
+    [BOOT_SNAPSHOT] = {"snapshot", 0,                                         boot_snapshot,   0},
+    [BOOT_UI]       = {"ui",       BOOT_NEED(BOOT_DISPLAY) | BOOT_NEED(BOOT_SNAPSHOT), ui_init, 6144},
+    [BOOT_MODBUS]   = {"modbus",   BOOT_NEED(BOOT_AXP192) | BOOT_NEED(BOOT_SNAPSHOT),  boot_modbus, 0},
+    [BOOT_WIFI]     = {"wifi",     BOOT_NEED(BOOT_SNAPSHOT),                  boot_wifi,       0},
+    [BOOT_DIAG]     = {"diag",     BOOT_NEED(BOOT_UI),                        boot_diag,       0},
+    [BOOT_LOG]      = {"log",      BOOT_NEED(BOOT_CLOCK),                     boot_log,        0},
+    [BOOT_WEB]      = {"web",      BOOT_NEED(BOOT_WIFI),                      boot_web,        0},
+    [BOOT_MBTCP]    = {"mbtcp",    BOOT_NEED(BOOT_WIFI) | BOOT_NEED(BOOT_MODBUS), boot_mbtcp,  0},
+    [BOOT_UPLINK]   = {"uplink",   BOOT_NEED(BOOT_WIFI) | BOOT_NEED(BOOT_CLOCK), boot_uplink, 0},
+    [BOOT_SNTP]     = {"sntp",     BOOT_NEED(BOOT_WIFI) | BOOT_NEED(BOOT_CLOCK), boot_sntp,   0},
+};
+
+void app_main()
+{
+    boot_graph_run(s_boot, sizeof(s_boot) / sizeof(s_boot[0]));
 
     while (1)
     {
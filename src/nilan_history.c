@@ -0,0 +1,497 @@
+#include "nilan_history.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_heap_caps.h"
+#endif
+
+#include "nilan_poll_plan.h"
+#include "nilan_transport.h"
+
+static const char *TAG = "nilan_hist";
+
+// A reader that keeps losing to the writer backs off after this many tries.
+#define NILAN_HIST_READ_SPINS 8
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+typedef struct
+{
+    uint32_t t_s;
+    uint16_t raw;
+    uint16_t reserved;
+} nilan_hist_raw_t;
+
+// The bucket being filled, per rolled-up tier.
+typedef struct
+{
+    uint32_t bucket; // t_s / bucket width
+    int32_t sum;     // of nilan_history_value()
+    uint16_t min;
+    uint16_t max;
+    uint16_t count;  // 0 = no open bucket
+} nilan_hist_acc_t;
+
+// Everything kept for one register; one of these per register, in PSRAM.
+typedef struct
+{
+    uint16_t head[NILAN_HIST_TIER_COUNT]; // next slot to write
+    uint16_t len[NILAN_HIST_TIER_COUNT];  // slots in use
+    nilan_hist_acc_t acc[NILAN_HIST_TIER_COUNT]; // [NILAN_HIST_RAW] unused
+
+    nilan_hist_raw_t raw[NILAN_HIST_RAW_LEN];
+    nilan_hist_point_t min1[NILAN_HIST_1MIN_LEN];
+    nilan_hist_point_t min15[NILAN_HIST_15MIN_LEN];
+    nilan_hist_point_t h1[NILAN_HIST_1H_LEN];
+} nilan_hist_reg_t;
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static const uint16_t tier_len[NILAN_HIST_TIER_COUNT] = {
+    [NILAN_HIST_RAW] = NILAN_HIST_RAW_LEN,
+    [NILAN_HIST_1MIN] = NILAN_HIST_1MIN_LEN,
+    [NILAN_HIST_15MIN] = NILAN_HIST_15MIN_LEN,
+    [NILAN_HIST_1H] = NILAN_HIST_1H_LEN,
+};
+
+static const uint32_t tier_bucket_s[NILAN_HIST_TIER_COUNT] = {
+    [NILAN_HIST_RAW] = 0,
+    [NILAN_HIST_1MIN] = 60,
+    [NILAN_HIST_15MIN] = 15 * 60,
+    [NILAN_HIST_1H] = 60 * 60,
+};
+
+static nilan_hist_reg_t *hist = NULL;
+
+// Sequence lock per register, odd while the bus task appends to it. Kept in
+// internal RAM, away from the rings.
+static uint32_t hist_seq[NILAN_REGID_COUNT];
+
+// Keeps the writer from being preempted mid-append (see store_lock in NilanRegisters.c).
+static portMUX_TYPE hist_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static bool is_signed(size_t id);
+static bool value_less(size_t id, uint16_t a, uint16_t b);
+static void append_one(size_t id, uint16_t raw, uint32_t t_s);
+static void acc_close(nilan_hist_reg_t *h, nilan_hist_tier_t tier);
+static void acc_point(const nilan_hist_acc_t *acc, nilan_hist_tier_t tier, nilan_hist_point_t *out);
+static uint32_t slot_t_s(const nilan_hist_reg_t *h, nilan_hist_tier_t tier, size_t slot);
+static void slot_point(const nilan_hist_reg_t *h, nilan_hist_tier_t tier, size_t slot, nilan_hist_point_t *out);
+static size_t copy_range(const nilan_hist_reg_t *h, nilan_hist_tier_t tier,
+                         uint32_t from_s, uint32_t to_s, nilan_hist_point_t *out, size_t cap);
+static nilan_hist_tier_t pick_tier(uint32_t from_s, uint32_t to_s, size_t cap);
+static size_t lttb(nilan_reg_id_t id, const nilan_hist_point_t *in, size_t n,
+                   nilan_hist_point_t *out, size_t m);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+bool nilan_history_init(void)
+{
+    if (hist != NULL)
+    {
+        return true;
+    }
+
+    size_t bytes = NILAN_REGID_COUNT * sizeof(nilan_hist_reg_t);
+
+#if CONFIG_IDF_TARGET_LINUX
+    hist = calloc(NILAN_REGID_COUNT, sizeof(nilan_hist_reg_t));
+#else
+    hist = heap_caps_calloc(NILAN_REGID_COUNT, sizeof(nilan_hist_reg_t), MALLOC_CAP_SPIRAM);
+#endif
+
+    if (hist == NULL)
+    {
+        ESP_LOGW(TAG, "no room for %u KB of history, not recording", (unsigned)(bytes / 1024));
+        return false;
+    }
+
+    ESP_LOGI(TAG, "%u registers, %u KB", (unsigned)NILAN_REGID_COUNT, (unsigned)(bytes / 1024));
+    return true;
+}
+
+void nilan_history_append_block(size_t block_index, const uint16_t *regs, uint32_t t_s)
+{
+    if (hist == NULL || block_index >= NILAN_POLL_BLOCK_COUNT)
+    {
+        return;
+    }
+
+    const nilan_poll_block_t *blk = &nilan_poll_blocks[block_index];
+    const nilan_poll_map_entry_t *map = &nilan_poll_map[blk->map_first];
+
+    for (uint8_t i = 0; i < blk->map_count; i++)
+    {
+        append_one(map[i].id, regs[map[i].offset], t_s);
+    }
+}
+
+size_t nilan_history_query(nilan_reg_id_t id,
+                           nilan_hist_tier_t tier,
+                           uint32_t from_s,
+                           uint32_t to_s,
+                           nilan_hist_point_t *out,
+                           size_t cap)
+{
+    if (hist == NULL || (size_t)id >= NILAN_REGID_COUNT || tier >= NILAN_HIST_TIER_COUNT ||
+        out == NULL || cap == 0 || from_s > to_s)
+    {
+        return 0;
+    }
+
+    for (int attempt = 0;; ++attempt)
+    {
+        uint32_t seq = __atomic_load_n(&hist_seq[id], __ATOMIC_ACQUIRE);
+
+        if ((seq & 1u) == 0)
+        {
+            size_t n = copy_range(&hist[id], tier, from_s, to_s, out, cap);
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE); // ring loads before the re-check
+            if (__atomic_load_n(&hist_seq[id], __ATOMIC_RELAXED) == seq)
+            {
+                return n;
+            }
+        }
+
+        if (attempt >= NILAN_HIST_READ_SPINS)
+        {
+            vTaskDelay(1); // writer is busy on the other core; let it finish
+            attempt = 0;
+        }
+    }
+}
+
+size_t nilan_history_query_decimated(nilan_reg_id_t id,
+                                     uint32_t from_s,
+                                     uint32_t to_s,
+                                     nilan_hist_point_t *scratch,
+                                     size_t scratch_cap,
+                                     nilan_hist_point_t *out,
+                                     size_t max_points)
+{
+    if (scratch == NULL || scratch_cap == 0 || out == NULL || max_points == 0 || from_s > to_s)
+    {
+        return 0;
+    }
+
+    nilan_hist_tier_t tier = pick_tier(from_s, to_s, scratch_cap);
+    size_t n = nilan_history_query(id, tier, from_s, to_s, scratch, scratch_cap);
+
+    return lttb(id, scratch, n, out, max_points);
+}
+
+uint32_t nilan_history_bucket_s(nilan_hist_tier_t tier)
+{
+    return (tier < NILAN_HIST_TIER_COUNT) ? tier_bucket_s[tier] : 0;
+}
+
+uint32_t nilan_history_now_s(void)
+{
+    return (uint32_t)(nilan_transport_now_us() / 1000000);
+}
+
+int32_t nilan_history_value(nilan_reg_id_t id, uint16_t raw)
+{
+    return ((size_t)id < NILAN_REGID_COUNT && is_signed(id)) ? (int32_t)(int16_t)raw : (int32_t)raw;
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+static bool is_signed(size_t id)
+{
+    nilan_data_type_t dt = nilan_registers[id].data_type;
+    return dt == NILAN_DTYPE_TEMP_Cx100 || dt == NILAN_DTYPE_INT16;
+}
+
+static bool value_less(size_t id, uint16_t a, uint16_t b)
+{
+    return is_signed(id) ? (int16_t)a < (int16_t)b : a < b;
+}
+
+// Bus task. O(1): one raw slot, and each tier either updates its open bucket
+// or closes it into the ring and opens the next.
+static void append_one(size_t id, uint16_t raw, uint32_t t_s)
+{
+    nilan_hist_reg_t *h = &hist[id];
+
+    taskENTER_CRITICAL(&hist_lock);
+
+    uint32_t seq = __atomic_load_n(&hist_seq[id], __ATOMIC_RELAXED);
+    __atomic_store_n(&hist_seq[id], seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // odd seq is visible before any data
+
+    h->raw[h->head[NILAN_HIST_RAW]] = (nilan_hist_raw_t){.t_s = t_s, .raw = raw};
+    h->head[NILAN_HIST_RAW] = (uint16_t)((h->head[NILAN_HIST_RAW] + 1) % NILAN_HIST_RAW_LEN);
+    if (h->len[NILAN_HIST_RAW] < NILAN_HIST_RAW_LEN)
+    {
+        h->len[NILAN_HIST_RAW]++;
+    }
+
+    int32_t v = nilan_history_value((nilan_reg_id_t)id, raw);
+
+    for (int t = NILAN_HIST_1MIN; t < NILAN_HIST_TIER_COUNT; ++t)
+    {
+        nilan_hist_acc_t *acc = &h->acc[t];
+        uint32_t bucket = t_s / tier_bucket_s[t];
+
+        if (acc->count != 0 && acc->bucket != bucket)
+        {
+            acc_close(h, (nilan_hist_tier_t)t);
+        }
+
+        if (acc->count == 0)
+        {
+            acc->bucket = bucket;
+            acc->sum = 0;
+            acc->min = raw;
+            acc->max = raw;
+        }
+        else
+        {
+            if (value_less(id, raw, acc->min))
+            {
+                acc->min = raw;
+            }
+            if (value_less(id, acc->max, raw))
+            {
+                acc->max = raw;
+            }
+        }
+
+        acc->sum += v;
+        acc->count++;
+    }
+
+    __atomic_store_n(&hist_seq[id], seq + 2, __ATOMIC_RELEASE); // data before even seq
+
+    taskEXIT_CRITICAL(&hist_lock);
+}
+
+static void acc_close(nilan_hist_reg_t *h, nilan_hist_tier_t tier)
+{
+    nilan_hist_point_t *ring = (tier == NILAN_HIST_1MIN) ? h->min1 : (tier == NILAN_HIST_15MIN) ? h->min15 : h->h1;
+
+    acc_point(&h->acc[tier], tier, &ring[h->head[tier]]);
+    h->head[tier] = (uint16_t)((h->head[tier] + 1) % tier_len[tier]);
+    if (h->len[tier] < tier_len[tier])
+    {
+        h->len[tier]++;
+    }
+    h->acc[tier].count = 0;
+}
+
+static void acc_point(const nilan_hist_acc_t *acc, nilan_hist_tier_t tier, nilan_hist_point_t *out)
+{
+    int32_t n = acc->count;
+    int32_t avg = (acc->sum >= 0) ? (acc->sum + n / 2) / n : (acc->sum - n / 2) / n;
+
+    out->t_s = acc->bucket * tier_bucket_s[tier];
+    out->min = acc->min;
+    out->avg = (uint16_t)avg;
+    out->max = acc->max;
+    out->count = acc->count;
+}
+
+static uint32_t slot_t_s(const nilan_hist_reg_t *h, nilan_hist_tier_t tier, size_t slot)
+{
+    switch (tier)
+    {
+    case NILAN_HIST_RAW:
+        return h->raw[slot].t_s;
+    case NILAN_HIST_1MIN:
+        return h->min1[slot].t_s;
+    case NILAN_HIST_15MIN:
+        return h->min15[slot].t_s;
+    default:
+        return h->h1[slot].t_s;
+    }
+}
+
+static void slot_point(const nilan_hist_reg_t *h, nilan_hist_tier_t tier, size_t slot, nilan_hist_point_t *out)
+{
+    switch (tier)
+    {
+    case NILAN_HIST_RAW:
+        out->t_s = h->raw[slot].t_s;
+        out->min = out->avg = out->max = h->raw[slot].raw;
+        out->count = 1;
+        break;
+    case NILAN_HIST_1MIN:
+        *out = h->min1[slot];
+        break;
+    case NILAN_HIST_15MIN:
+        *out = h->min15[slot];
+        break;
+    default:
+        *out = h->h1[slot];
+        break;
+    }
+}
+
+// Reader side, inside the sequence lock. Anything read here may be torn by a
+// racing append; indices are clamped so a torn read can't leave the ring, and
+// the caller throws the result away.
+static size_t copy_range(const nilan_hist_reg_t *h, nilan_hist_tier_t tier,
+                         uint32_t from_s, uint32_t to_s, nilan_hist_point_t *out, size_t cap)
+{
+    size_t ring = tier_len[tier];
+    size_t len = h->len[tier];
+    size_t head = h->head[tier];
+    if (len > ring || head >= ring)
+    {
+        return 0;
+    }
+
+    size_t oldest = (head + ring - len) % ring;
+
+    // First entry at or after from_s; entries are in time order.
+    size_t lo = 0;
+    size_t hi = len;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (slot_t_s(h, tier, (oldest + mid) % ring) < from_s)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    size_t n = 0;
+    for (size_t i = lo; i < len && n < cap; ++i)
+    {
+        size_t slot = (oldest + i) % ring;
+        if (slot_t_s(h, tier, slot) > to_s)
+        {
+            return n;
+        }
+        slot_point(h, tier, slot, &out[n++]);
+    }
+
+    nilan_hist_acc_t acc = h->acc[tier]; // count must not drop to 0 under acc_point()
+    if (tier != NILAN_HIST_RAW && n < cap && acc.count != 0)
+    {
+        nilan_hist_point_t p;
+        acc_point(&acc, tier, &p);
+        if (p.t_s >= from_s && p.t_s <= to_s)
+        {
+            out[n++] = p;
+        }
+    }
+    return n;
+}
+
+// Finest tier that covers from_s and has at most cap points in the range.
+// Raw samples are counted at the fast poll rate, the densest they come.
+static nilan_hist_tier_t pick_tier(uint32_t from_s, uint32_t to_s, size_t cap)
+{
+    uint32_t now_s = nilan_history_now_s();
+    uint32_t back_s = (now_s > from_s) ? now_s - from_s : 0;
+
+    for (int t = NILAN_HIST_RAW; t < NILAN_HIST_1H; ++t)
+    {
+        uint32_t step_s = (t == NILAN_HIST_RAW) ? NILAN_POLL_FAST_MS / 1000 : tier_bucket_s[t];
+        uint32_t reach_s = tier_len[t] * step_s;
+
+        if (back_s <= reach_s && (to_s - from_s) / step_s < cap)
+        {
+            return (nilan_hist_tier_t)t;
+        }
+    }
+    return NILAN_HIST_1H;
+}
+
+// Largest-triangle-three-buckets: keep the first and last point, and from each
+// of the m - 2 buckets in between the point that spans the largest triangle
+// with the point kept before it and the average of the next bucket.
+static size_t lttb(nilan_reg_id_t id, const nilan_hist_point_t *in, size_t n,
+                   nilan_hist_point_t *out, size_t m)
+{
+    if (n <= m || m < 3)
+    {
+        size_t k = (n < m) ? n : m;
+        memcpy(out, in, k * sizeof(out[0]));
+        return k;
+    }
+
+    // Times relative to the first point keep the floats exact enough.
+    uint32_t t0 = in[0].t_s;
+    float every = (float)(n - 2) / (float)(m - 2);
+    size_t a = 0;
+    size_t k = 0;
+
+    out[k++] = in[0];
+
+    for (size_t i = 0; i < m - 2; ++i)
+    {
+        size_t next_start = (size_t)((float)(i + 1) * every) + 1;
+        size_t next_end = (size_t)((float)(i + 2) * every) + 1;
+        if (next_end > n)
+        {
+            next_end = n;
+        }
+
+        float avg_x = 0.0f;
+        float avg_y = 0.0f;
+        for (size_t j = next_start; j < next_end; ++j)
+        {
+            avg_x += (float)(in[j].t_s - t0);
+            avg_y += (float)nilan_history_value(id, in[j].avg);
+        }
+        size_t next_n = next_end - next_start;
+        if (next_n > 0)
+        {
+            avg_x /= (float)next_n;
+            avg_y /= (float)next_n;
+        }
+
+        size_t start = (size_t)((float)i * every) + 1;
+        size_t end = (size_t)((float)(i + 1) * every) + 1;
+        float ax = (float)(in[a].t_s - t0);
+        float ay = (float)nilan_history_value(id, in[a].avg);
+        float best_area = -1.0f;
+        size_t best = start;
+
+        for (size_t j = start; j < end; ++j)
+        {
+            float x = (float)(in[j].t_s - t0);
+            float y = (float)nilan_history_value(id, in[j].avg);
+            float area = fabsf((ax - avg_x) * (y - ay) - (ax - x) * (avg_y - ay));
+            if (area > best_area)
+            {
+                best_area = area;
+                best = j;
+            }
+        }
+
+        out[k++] = in[best];
+        a = best;
+    }
+
+    out[k++] = in[n - 1];
+    return k;
+}
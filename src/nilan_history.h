@@ -0,0 +1,95 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "NilanRegisters.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Register history in PSRAM.
+ *
+ * Every fresh sample of every polled register is appended to a raw ring, and
+ * folded into min/avg/max buckets of 1 minute, 15 minutes and 1 hour, each in
+ * a ring of its own. All rings are allocated once at init, so memory is fixed
+ * (~24 KB per register, ~2.5 MB in all) and an append is a few stores, done by
+ * the bus task right after the poll block lands in the register store.
+ *
+ * Readers copy out of the rings under a sequence lock per register, like the
+ * register store: the bus task never waits for a query.
+ *
+ * Times are seconds since boot (nilan_history_now_s()).
+ */
+
+typedef enum
+{
+    NILAN_HIST_RAW = 0, // every sample; min == avg == max, count 1
+    NILAN_HIST_1MIN,
+    NILAN_HIST_15MIN,
+    NILAN_HIST_1H,
+
+    NILAN_HIST_TIER_COUNT
+} nilan_hist_tier_t;
+
+// Ring lengths: how far back each tier reaches.
+#define NILAN_HIST_RAW_LEN 360   // 12 min at the fast poll rate
+#define NILAN_HIST_1MIN_LEN 720  // 12 h
+#define NILAN_HIST_15MIN_LEN 672 // 7 days
+#define NILAN_HIST_1H_LEN 336    // 14 days
+
+// One point of history. Values are raw register values; use
+// nilan_history_value() to compare or scale them.
+typedef struct
+{
+    uint32_t t_s;   // sample time, or start of the bucket
+    uint16_t min;
+    uint16_t avg;
+    uint16_t max;
+    uint16_t count; // samples in the bucket
+} nilan_hist_point_t;
+
+// Allocate the rings in PSRAM. Call once before nilan_modbus_start().
+// Returns false if there's no room; history is then simply not recorded.
+bool nilan_history_init(void);
+
+// Bus task only: record the registers of a freshly read poll block.
+void nilan_history_append_block(size_t block_index, const uint16_t *regs, uint32_t t_s);
+
+// Copy the points of one tier with t_s in [from_s, to_s], oldest first, at
+// most cap of them (the oldest ones if there are more). The bucket still being
+// filled is included as the last point. Returns the number copied. Any task.
+size_t nilan_history_query(nilan_reg_id_t id,
+                           nilan_hist_tier_t tier,
+                           uint32_t from_s,
+                           uint32_t to_s,
+                           nilan_hist_point_t *out,
+                           size_t cap);
+
+// [from_s, to_s] reduced to at most max_points for plotting. Reads the finest
+// tier that still reaches back to from_s with no more than scratch_cap points
+// in the range, then thins them with largest-triangle-three-buckets on the
+// averages, which keeps peaks and steps where a plain stride would drop them.
+// scratch holds scratch_cap points. Returns the number of points in out.
+size_t nilan_history_query_decimated(nilan_reg_id_t id,
+                                     uint32_t from_s,
+                                     uint32_t to_s,
+                                     nilan_hist_point_t *scratch,
+                                     size_t scratch_cap,
+                                     nilan_hist_point_t *out,
+                                     size_t max_points);
+
+// Bucket width of a tier in seconds (0 for NILAN_HIST_RAW).
+uint32_t nilan_history_bucket_s(nilan_hist_tier_t tier);
+
+// The history clock.
+uint32_t nilan_history_now_s(void);
+
+// Raw value as a number: sign-extended for the signed data types.
+int32_t nilan_history_value(nilan_reg_id_t id, uint16_t raw);
+
+#ifdef __cplusplus
+}
+#endif
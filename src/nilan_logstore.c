@@ -0,0 +1,693 @@
+#include "nilan_logstore.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+
+#include "CRC16.h"
+#include "sys_time.h"
+
+static const char *TAG = "nilan_log";
+
+// The BSP looks for "storage"; this partition is ours and used raw.
+#define NILAN_LOG_PARTITION_LABEL "spiffs"
+
+#define NILAN_LOG_SECTOR 4096
+#define NILAN_LOG_PAGE 256
+#define NILAN_LOG_PAGES_PER_SEG (NILAN_LOG_SECTOR / NILAN_LOG_PAGE) // page 0 is the header
+
+#define NILAN_LOG_MAGIC 0x474F4C4Eu // "NLOG"
+#define NILAN_LOG_VERSION 1
+
+// Page header len of a page that was never programmed (erased flash).
+#define NILAN_LOG_PAGE_FREE 0xFFFF
+
+// id + dt varint + value varint
+#define NILAN_LOG_MAX_RECORD 9
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+// Start of page 0 of every segment.
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reg_count;
+    uint32_t seq;         // +1 per segment opened, never reused
+    uint32_t t_first;     // time of the first record
+    uint32_t layout_hash; // nilan_reg_layout_hash()
+    uint16_t reserved;
+    uint16_t crc;         // Modbus CRC16 over everything above
+} nilan_log_seg_hdr_t;
+
+// Start of pages 1..15.
+typedef struct
+{
+    uint16_t len;    // payload bytes, or NILAN_LOG_PAGE_FREE
+    uint16_t crc;    // over t_base and the payload
+    uint32_t t_base; // time of the first record; the first dt is relative to it
+} nilan_log_page_hdr_t;
+
+#define NILAN_LOG_PAYLOAD (NILAN_LOG_PAGE - sizeof(nilan_log_page_hdr_t))
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static const esp_partition_t *part = NULL;
+static size_t seg_count = 0;
+
+// Segment index: t_first of every segment of the current layout, 0 for the
+// others. Valid segments run oldest_seg .. head_seg around the ring.
+static uint32_t *seg_t_first = NULL;
+static size_t head_seg = 0;
+static size_t oldest_seg = 0;
+static size_t valid_count = 0;
+static uint32_t head_seq = 0;
+static uint32_t flushed_t_last = 0;
+static SemaphoreHandle_t index_lock = NULL;
+
+// Writer state, log task only.
+static size_t next_page = NILAN_LOG_PAGES_PER_SEG; // in head_seg; PAGES_PER_SEG = full
+static uint8_t page_buf[NILAN_LOG_PAGE];
+static size_t page_len = 0;
+static uint32_t page_t_base = 0;
+static uint32_t page_t_last = 0;
+static int64_t page_opened_us = 0;
+static uint16_t page_prev[NILAN_REGID_COUNT];
+static uint32_t page_seen[(NILAN_REGID_COUNT + 31) / 32];
+
+static uint16_t logged_raw[NILAN_REGID_COUNT];
+static uint32_t logged_once[(NILAN_REGID_COUNT + 31) / 32];
+
+static int64_t epoch_at_boot = 0;
+static uint32_t last_t = 0;
+
+static TaskHandle_t log_task = NULL;
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static bool mount(void);
+static bool read_seg_hdr(size_t seg, nilan_log_seg_hdr_t *hdr);
+static bool read_page(size_t seg, size_t page, uint8_t *buf);
+static uint32_t last_record_t(size_t seg);
+static void init_clock(void);
+static uint32_t now_t(void);
+static void log_pass(void);
+static void log_registers(uint32_t t);
+static bool page_fits(size_t id, uint32_t t, uint16_t raw);
+static void append(size_t id, uint32_t t, uint16_t raw);
+static size_t encode(size_t id, uint32_t t, uint16_t raw, uint8_t *out);
+static void flush_page(void);
+static bool open_segment(uint32_t t_first);
+static size_t find_start(uint32_t from_t, size_t *first_seg);
+static bool decode_page(const uint8_t *buf, nilan_reg_id_t id, uint32_t from_t, uint32_t to_t,
+                        nilan_log_visit_t visit, void *user, size_t *visited);
+static size_t put_varint(uint8_t *out, uint32_t v);
+static size_t get_varint(const uint8_t *in, size_t len, uint32_t *v);
+static void nilan_logstore_task(void *arg);
+
+static inline bool bit_get(const uint32_t *bits, size_t i) { return (bits[i / 32] >> (i % 32)) & 1u; }
+static inline void bit_set(uint32_t *bits, size_t i) { bits[i / 32] |= 1u << (i % 32); }
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+bool nilan_logstore_start(void)
+{
+    if (log_task != NULL)
+    {
+        return true;
+    }
+
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS,
+                                    NILAN_LOG_PARTITION_LABEL);
+    if (part == NULL)
+    {
+        ESP_LOGW(TAG, "no \"%s\" partition, not logging", NILAN_LOG_PARTITION_LABEL);
+        return false;
+    }
+
+    seg_count = part->size / NILAN_LOG_SECTOR;
+    seg_t_first = calloc(seg_count, sizeof(uint32_t));
+    index_lock = xSemaphoreCreateMutex();
+    if (seg_t_first == NULL || index_lock == NULL)
+    {
+        return false;
+    }
+
+    // Mounting reads every segment header; do it off the boot path.
+    return xTaskCreate(nilan_logstore_task, "nilan_log", 4096, NULL, 2, &log_task) == pdPASS;
+}
+
+size_t nilan_logstore_query(nilan_reg_id_t id, uint32_t from_t, uint32_t to_t,
+                            nilan_log_visit_t visit, void *user)
+{
+    if (index_lock == NULL || visit == NULL || from_t > to_t)
+    {
+        return 0;
+    }
+
+    size_t seg;
+    size_t remaining = find_start(from_t, &seg);
+    size_t visited = 0;
+    uint8_t buf[NILAN_LOG_PAGE];
+
+    for (; remaining > 0; --remaining, seg = (seg + 1) % seg_count)
+    {
+        // The writer may have recycled the segment since the index was read.
+        nilan_log_seg_hdr_t hdr;
+        if (!read_seg_hdr(seg, &hdr) || hdr.layout_hash != nilan_reg_layout_hash())
+        {
+            continue;
+        }
+        if (hdr.t_first > to_t)
+        {
+            break;
+        }
+
+        for (size_t p = 1; p < NILAN_LOG_PAGES_PER_SEG; ++p)
+        {
+            if (!read_page(seg, p, buf))
+            {
+                const nilan_log_page_hdr_t *ph = (const nilan_log_page_hdr_t *)buf;
+                if (ph->len == NILAN_LOG_PAGE_FREE)
+                {
+                    break; // rest of the segment is unwritten
+                }
+                continue; // torn or corrupt page
+            }
+
+            if (!decode_page(buf, id, from_t, to_t, visit, user, &visited))
+            {
+                return visited;
+            }
+        }
+    }
+    return visited;
+}
+
+bool nilan_logstore_span(uint32_t *first_t, uint32_t *last_t_out)
+{
+    if (index_lock == NULL)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(index_lock, portMAX_DELAY);
+    bool ok = valid_count > 0 && flushed_t_last != 0;
+    if (ok)
+    {
+        *first_t = seg_t_first[oldest_seg];
+        *last_t_out = flushed_t_last;
+    }
+    xSemaphoreGive(index_lock);
+    return ok;
+}
+
+static void nilan_logstore_task(void *arg)
+{
+    (void)arg; // Silence the unused parameter warning.
+
+    mount();
+    init_clock();
+
+    TickType_t last_wake = xTaskGetTickCount();
+
+    while (1)
+    {
+        log_pass();
+
+        if (page_len > 0 && esp_timer_get_time() - page_opened_us >= (int64_t)NILAN_LOG_FLUSH_S * 1000000)
+        {
+            flush_page();
+        }
+
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(NILAN_LOG_PERIOD_S * 1000));
+    }
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+// Rebuild the index from the segment headers and find where writing resumes.
+static bool mount(void)
+{
+    uint32_t layout = nilan_reg_layout_hash();
+    bool have_head = false;
+    bool head_matches = false;
+
+    for (size_t s = 0; s < seg_count; ++s)
+    {
+        nilan_log_seg_hdr_t hdr;
+        if (!read_seg_hdr(s, &hdr))
+        {
+            continue;
+        }
+
+        if (hdr.layout_hash == layout)
+        {
+            seg_t_first[s] = hdr.t_first;
+        }
+
+        if (!have_head || (int32_t)(hdr.seq - head_seq) > 0)
+        {
+            have_head = true;
+            head_seq = hdr.seq;
+            head_seg = s;
+            head_matches = (hdr.layout_hash == layout);
+        }
+    }
+
+    if (!have_head)
+    {
+        head_seg = seg_count - 1; // first segment opened will be 0
+        ESP_LOGI(TAG, "empty log, %u segments", (unsigned)seg_count);
+        return true;
+    }
+
+    // Segments of this layout are a run ending at the head; anything before
+    // it is older firmware's and gets overwritten in turn.
+    if (head_matches)
+    {
+        valid_count = 1;
+        oldest_seg = head_seg;
+        while (valid_count < seg_count)
+        {
+            size_t prev = (oldest_seg + seg_count - 1) % seg_count;
+            if (seg_t_first[prev] == 0)
+            {
+                break;
+            }
+            oldest_seg = prev;
+            valid_count++;
+        }
+    }
+
+    // Continue after the last programmed page of the head segment, torn or not.
+    next_page = NILAN_LOG_PAGES_PER_SEG;
+    for (size_t p = 1; p < NILAN_LOG_PAGES_PER_SEG && head_matches; ++p)
+    {
+        nilan_log_page_hdr_t ph;
+        esp_partition_read(part, head_seg * NILAN_LOG_SECTOR + p * NILAN_LOG_PAGE, &ph, sizeof(ph));
+        if (ph.len == NILAN_LOG_PAGE_FREE)
+        {
+            next_page = p;
+            break;
+        }
+    }
+
+    if (head_matches)
+    {
+        last_t = last_record_t(head_seg);
+        flushed_t_last = last_t;
+    }
+
+    ESP_LOGI(TAG, "%u of %u segments, head %u page %u, last t %lu",
+             (unsigned)valid_count, (unsigned)seg_count, (unsigned)head_seg,
+             (unsigned)next_page, (unsigned long)last_t);
+    return true;
+}
+
+static bool read_seg_hdr(size_t seg, nilan_log_seg_hdr_t *hdr)
+{
+    if (esp_partition_read(part, seg * NILAN_LOG_SECTOR, hdr, sizeof(*hdr)) != ESP_OK)
+    {
+        return false;
+    }
+
+    return hdr->magic == NILAN_LOG_MAGIC && hdr->version == NILAN_LOG_VERSION &&
+           hdr->crc == modbus_crc16((const uint8_t *)hdr, offsetof(nilan_log_seg_hdr_t, crc));
+}
+
+// One whole page into buf. True if it is written and intact.
+static bool read_page(size_t seg, size_t page, uint8_t *buf)
+{
+    if (esp_partition_read(part, seg * NILAN_LOG_SECTOR + page * NILAN_LOG_PAGE, buf, NILAN_LOG_PAGE) != ESP_OK)
+    {
+        memset(buf, 0, sizeof(nilan_log_page_hdr_t));
+        return false;
+    }
+
+    const nilan_log_page_hdr_t *ph = (const nilan_log_page_hdr_t *)buf;
+    if (ph->len == NILAN_LOG_PAGE_FREE || ph->len > NILAN_LOG_PAYLOAD)
+    {
+        return false;
+    }
+
+    uint16_t crc = modbus_crc16((const uint8_t *)&ph->t_base, sizeof(ph->t_base));
+    crc = modbus_crc16_update(crc, buf + sizeof(*ph), ph->len);
+    return crc == ph->crc;
+}
+
+static bool last_t_visit(nilan_reg_id_t id, uint32_t t, uint16_t raw, void *user)
+{
+    (void)id;
+    (void)raw;
+    *(uint32_t *)user = t;
+    return true;
+}
+
+// Time of the newest intact record in a segment.
+static uint32_t last_record_t(size_t seg)
+{
+    uint8_t buf[NILAN_LOG_PAGE];
+    uint32_t t = seg_t_first[seg];
+    size_t visited = 0;
+
+    for (size_t p = NILAN_LOG_PAGES_PER_SEG - 1; p >= 1; --p)
+    {
+        if (read_page(seg, p, buf))
+        {
+            decode_page(buf, NILAN_REGID_COUNT, 0, UINT32_MAX, last_t_visit, &t, &visited);
+            break;
+        }
+    }
+    return t;
+}
+
+// Until the wall clock has a time, carry on from the end of the log so time
+// still only moves forward.
+static void init_clock(void)
+{
+    int64_t up_s = esp_timer_get_time() / 1000000;
+    epoch_at_boot = (int64_t)last_t + 1 - up_s;
+
+    if (sys_time_source() == SYS_TIME_SOURCE_NONE)
+    {
+        ESP_LOGW(TAG, "no wall time yet; log time continues from the last record");
+    }
+}
+
+// Never backwards, also when SNTP steps the clock back a little.
+static uint32_t now_t(void)
+{
+    int64_t t;
+    if (!sys_time_now(&t))
+    {
+        t = epoch_at_boot + esp_timer_get_time() / 1000000;
+    }
+    if (t < (int64_t)last_t)
+    {
+        t = last_t;
+    }
+    last_t = (uint32_t)t;
+    return last_t;
+}
+
+static void log_pass(void)
+{
+    log_registers(now_t());
+}
+
+// Registers that changed since they were last logged. A page that will open
+// a new segment gets all of them instead, once, at the segment's first time.
+static void log_registers(uint32_t t)
+{
+    bool full = page_len == 0 && next_page >= NILAN_LOG_PAGES_PER_SEG;
+
+    size_t id = 0;
+    while (id < NILAN_REGID_COUNT)
+    {
+        nilan_reg_id_t rid = (nilan_reg_id_t)id;
+        if (nilan_reg_gen(rid) == 0 || nilan_reg_is_stale(rid))
+        {
+            id++;
+            continue;
+        }
+
+        uint16_t raw = nilan_reg_raw(rid);
+        if (full || !bit_get(logged_once, id) || logged_raw[id] != raw)
+        {
+            if (!full && !page_fits(id, t, raw))
+            {
+                flush_page();
+                if (next_page >= NILAN_LOG_PAGES_PER_SEG)
+                {
+                    // The rest of this pass would open a segment: start the
+                    // fresh page over with the full set instead.
+                    full = true;
+                    id = 0;
+                    continue;
+                }
+            }
+            append(id, t, raw);
+        }
+        id++;
+    }
+}
+
+static bool page_fits(size_t id, uint32_t t, uint16_t raw)
+{
+    uint8_t rec[NILAN_LOG_MAX_RECORD];
+    return page_len + encode(id, t, raw, rec) <= NILAN_LOG_PAYLOAD;
+}
+
+static void append(size_t id, uint32_t t, uint16_t raw)
+{
+    uint8_t rec[NILAN_LOG_MAX_RECORD];
+    size_t n = encode(id, t, raw, rec);
+
+    if (page_len + n > NILAN_LOG_PAYLOAD)
+    {
+        flush_page();
+        n = encode(id, t, raw, rec); // against the fresh page
+    }
+
+    if (page_len == 0)
+    {
+        page_t_base = t;
+        page_t_last = t;
+        page_opened_us = esp_timer_get_time();
+        memset(page_seen, 0, sizeof(page_seen));
+    }
+
+    memcpy(page_buf + sizeof(nilan_log_page_hdr_t) + page_len, rec, n);
+    page_len += n;
+    page_t_last = t;
+    page_prev[id] = raw;
+    bit_set(page_seen, id);
+
+    logged_raw[id] = raw;
+    bit_set(logged_once, id);
+}
+
+// [id] [dt since the previous record in the page] [zigzag value delta against
+// the previous value of this register in the page, or against 0]
+static size_t encode(size_t id, uint32_t t, uint16_t raw, uint8_t *out)
+{
+    uint32_t dt = (page_len == 0) ? 0 : t - page_t_last;
+    uint16_t prev = bit_get(page_seen, id) && page_len != 0 ? page_prev[id] : 0;
+    int16_t delta = (int16_t)(uint16_t)(raw - prev);
+    uint16_t zz = (uint16_t)(((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15));
+
+    size_t n = 0;
+    out[n++] = (uint8_t)id;
+    n += put_varint(out + n, dt);
+    n += put_varint(out + n, zz);
+    return n;
+}
+
+static void flush_page(void)
+{
+    if (page_len == 0)
+    {
+        return;
+    }
+
+    if (next_page >= NILAN_LOG_PAGES_PER_SEG && !open_segment(page_t_base))
+    {
+        page_len = 0; // can't write; drop rather than grow
+        return;
+    }
+
+    nilan_log_page_hdr_t *ph = (nilan_log_page_hdr_t *)page_buf;
+    ph->len = (uint16_t)page_len;
+    ph->t_base = page_t_base;
+    ph->crc = modbus_crc16((const uint8_t *)&ph->t_base, sizeof(ph->t_base));
+    ph->crc = modbus_crc16_update(ph->crc, page_buf + sizeof(*ph), (uint16_t)page_len);
+
+    // Only the used part is programmed; the rest of the page stays erased.
+    esp_err_t err = esp_partition_write(part, head_seg * NILAN_LOG_SECTOR + next_page * NILAN_LOG_PAGE,
+                                        page_buf, sizeof(*ph) + page_len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "page write failed: %s", esp_err_to_name(err));
+    }
+
+    next_page++;
+    page_len = 0;
+
+    xSemaphoreTake(index_lock, portMAX_DELAY);
+    flushed_t_last = page_t_last;
+    xSemaphoreGive(index_lock);
+}
+
+// Erase the next sector round the ring (the oldest segment, once the ring has
+// wrapped) and write its header.
+static bool open_segment(uint32_t t_first)
+{
+    size_t seg = (head_seg + 1) % seg_count;
+
+    xSemaphoreTake(index_lock, portMAX_DELAY);
+    if (valid_count > 0 && seg == oldest_seg)
+    {
+        seg_t_first[seg] = 0;
+        oldest_seg = (oldest_seg + 1) % seg_count;
+        valid_count--;
+    }
+    xSemaphoreGive(index_lock);
+
+    if (esp_partition_erase_range(part, seg * NILAN_LOG_SECTOR, NILAN_LOG_SECTOR) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "erase of segment %u failed", (unsigned)seg);
+        return false;
+    }
+
+    nilan_log_seg_hdr_t hdr = {
+        .magic = NILAN_LOG_MAGIC,
+        .version = NILAN_LOG_VERSION,
+        .reg_count = NILAN_REGID_COUNT,
+        .seq = head_seq + 1,
+        .t_first = t_first,
+        .layout_hash = nilan_reg_layout_hash(),
+        .reserved = 0xFFFF,
+    };
+    hdr.crc = modbus_crc16((const uint8_t *)&hdr, offsetof(nilan_log_seg_hdr_t, crc));
+
+    if (esp_partition_write(part, seg * NILAN_LOG_SECTOR, &hdr, sizeof(hdr)) != ESP_OK)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(index_lock, portMAX_DELAY);
+    head_seg = seg;
+    head_seq = hdr.seq;
+    seg_t_first[seg] = t_first;
+    if (valid_count == 0)
+    {
+        oldest_seg = seg;
+    }
+    valid_count++;
+    xSemaphoreGive(index_lock);
+
+    next_page = 1;
+    return true;
+}
+
+// First segment that can hold records at or after from_t: the last one that
+// starts at or before it. Returns how many segments there are from there on.
+static size_t find_start(uint32_t from_t, size_t *first_seg)
+{
+    xSemaphoreTake(index_lock, portMAX_DELAY);
+
+    size_t lo = 0;
+    size_t hi = valid_count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (seg_t_first[(oldest_seg + mid) % seg_count] <= from_t)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    size_t start = (lo > 0) ? lo - 1 : 0;
+
+    *first_seg = (oldest_seg + start) % seg_count;
+    size_t remaining = valid_count - start;
+
+    xSemaphoreGive(index_lock);
+    return remaining;
+}
+
+// Visit the matching records of one intact page. False once past to_t or
+// when the visitor asks to stop.
+static bool decode_page(const uint8_t *buf, nilan_reg_id_t id, uint32_t from_t, uint32_t to_t,
+                        nilan_log_visit_t visit, void *user, size_t *visited)
+{
+    const nilan_log_page_hdr_t *ph = (const nilan_log_page_hdr_t *)buf;
+    const uint8_t *p = buf + sizeof(*ph);
+    size_t left = ph->len;
+
+    uint16_t prev[NILAN_REGID_COUNT];
+    uint32_t seen[(NILAN_REGID_COUNT + 31) / 32] = {0};
+    uint32_t t = ph->t_base;
+
+    while (left > 0)
+    {
+        size_t rid = p[0];
+        uint32_t dt;
+        uint32_t zz;
+        size_t n1 = get_varint(p + 1, left - 1, &dt);
+        size_t n2 = (n1 == 0) ? 0 : get_varint(p + 1 + n1, left - 1 - n1, &zz);
+        if (n2 == 0 || rid >= NILAN_REGID_COUNT)
+        {
+            return true; // malformed tail; the CRC matched, so this is a bug, not a torn write
+        }
+        p += 1 + n1 + n2;
+        left -= 1 + n1 + n2;
+
+        int16_t delta = (int16_t)((zz >> 1) ^ (~(zz & 1) + 1));
+        uint16_t raw = (uint16_t)((bit_get(seen, rid) ? prev[rid] : 0) + (uint16_t)delta);
+        prev[rid] = raw;
+        bit_set(seen, rid);
+        t += dt;
+
+        if (t > to_t)
+        {
+            return false;
+        }
+        if (t >= from_t && (id == NILAN_REGID_COUNT || (size_t)id == rid))
+        {
+            (*visited)++;
+            if (!visit((nilan_reg_id_t)rid, t, raw, user))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static size_t put_varint(uint8_t *out, uint32_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+static size_t get_varint(const uint8_t *in, size_t len, uint32_t *v)
+{
+    uint32_t r = 0;
+    for (size_t i = 0; i < len && i < 5; ++i)
+    {
+        r |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+        if ((in[i] & 0x80) == 0)
+        {
+            *v = r;
+            return i + 1;
+        }
+    }
+    return 0;
+}
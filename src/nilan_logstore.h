@@ -0,0 +1,57 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "NilanRegisters.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Long-term register log on the 3 MB data partition (label "spiffs" in
+ * partitions_core2.csv), used raw: no file system, the partition is a ring of
+ * 4 KB segments, one per flash sector.
+ *
+ * Every NILAN_LOG_PERIOD_S the log task appends the registers whose value
+ * changed since they were last logged. The page that opens a segment starts
+ * with a full set at the segment's first time, so any one segment decodes to
+ * the complete state. GET /log (nilan_metrics.h) exports records.
+ * Records are (register id, time delta, value delta) as varints, packed into
+ * 256-byte flash pages. A page is written once, when it is full or has been
+ * open for NILAN_LOG_FLUSH_S, so each page costs one program and each sector
+ * one erase per trip round the ring.
+ *
+ * Each page carries a CRC, and each segment a header with a sequence number
+ * and the time of its first record. At boot the headers alone rebuild the
+ * segment index (a few KB of RAM). A page torn by a power cut fails its CRC:
+ * it is skipped, and writing carries on with the next free page. Queries
+ * binary-search the index and then stream page by page, never loading more
+ * than one page.
+ *
+ * Times are UTC seconds from the wall clock (sys_time.h), and never go
+ * backwards within the log.
+ */
+
+#define NILAN_LOG_PERIOD_S 300      // sample interval
+#define NILAN_LOG_FLUSH_S (30 * 60) // most data a power cut can lose
+
+// Called for each matching record, oldest first. Return false to stop.
+typedef bool (*nilan_log_visit_t)(nilan_reg_id_t id, uint32_t t, uint16_t raw, void *user);
+
+// Mount the partition and start the log task. Call after sys_time_init().
+bool nilan_logstore_start(void);
+
+// Visit the records of one register (or all of them, with NILAN_REGID_COUNT)
+// with t in [from_t, to_t]. Records still in the open page aren't included.
+// Returns the number visited. Any task except the log task.
+size_t nilan_logstore_query(nilan_reg_id_t id, uint32_t from_t, uint32_t to_t,
+                            nilan_log_visit_t visit, void *user);
+
+// Time range held, in UTC seconds. False if the log is empty.
+bool nilan_logstore_span(uint32_t *first_t, uint32_t *last_t);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,281 @@
+#include "nilan_mb_stats.h"
+
+#include <string.h>
+
+#include "nilan_transport.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "nilan_poll_plan.h"
+#include "nilan_rtu.h"
+
+// Rolling bus utilization: busy time per one-second slot, over this many slots.
+#define NILAN_MB_UTIL_SLOTS 10
+#define NILAN_MB_UTIL_SLOT_US 1000000
+
+// Function codes with their own histograms.
+#define NILAN_MB_FC_COUNT 4
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+typedef struct
+{
+    uint16_t total_hist[NILAN_MB_HIST_BUCKETS];
+    uint32_t samples[NILAN_MB_PHASE_COUNT];
+    uint64_t sum_us[NILAN_MB_PHASE_COUNT];
+    uint32_t max_us[NILAN_MB_PHASE_COUNT];
+} nilan_mb_block_timing_t;
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+// Written by the bus task only. Readers may see a count mid-update across
+// fields, never a torn 32-bit value, which is fine for statistics.
+static uint32_t err_counts[NILAN_MB_ERR_COUNT];
+static uint32_t exception_counts[NILAN_MB_EXCEPTION_CODES];
+
+// Per poll block breakdown, 16-bit to keep it small
+// (NILAN_POLL_BLOCK_COUNT x NILAN_MB_ERR_COUNT).
+static uint16_t block_err_counts[NILAN_POLL_BLOCK_COUNT][NILAN_MB_ERR_COUNT];
+
+// Phase histograms per function code (03, 04, 06, 10), and per poll block timing.
+// The 64-bit sums are two words on this CPU, so both tables are updated and
+// read under timing_lock.
+static nilan_mb_hist_t fc_hist[NILAN_MB_FC_COUNT][NILAN_MB_PHASE_COUNT];
+static nilan_mb_block_timing_t block_timing[NILAN_POLL_BLOCK_COUNT];
+static portMUX_TYPE timing_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Bus busy time per slot; util_slot_start is the start of the newest slot.
+static uint32_t util_busy_us[NILAN_MB_UTIL_SLOTS];
+static int64_t util_slot_start_us = 0;
+static size_t util_head = 0;
+static portMUX_TYPE util_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static int fc_index(uint8_t func);
+static size_t hist_bucket(uint32_t us);
+static void util_advance(int64_t now_us);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+void nilan_mb_stats_record(nilan_mb_err_t err, uint8_t func, size_t block, uint32_t queue_wait_us)
+{
+    if ((unsigned)err >= NILAN_MB_ERR_COUNT)
+    {
+        err = NILAN_MB_ERR_INTERNAL;
+    }
+
+    err_counts[err]++;
+
+    if (block < NILAN_POLL_BLOCK_COUNT && block_err_counts[block][err] != UINT16_MAX)
+    {
+        block_err_counts[block][err]++;
+    }
+
+    // ---- Timing: fixed arrays only, nothing allocated here ----
+    nilan_rtu_timing_t t;
+    nilan_rtu_get_last_timing(&t);
+
+    uint32_t phase_us[NILAN_MB_PHASE_COUNT] = {
+        [NILAN_MB_PHASE_QUEUE] = queue_wait_us,
+        [NILAN_MB_PHASE_TX] = t.tx_us,
+        [NILAN_MB_PHASE_TURNAROUND] = t.turnaround_us,
+        [NILAN_MB_PHASE_RX] = t.rx_us,
+        [NILAN_MB_PHASE_TOTAL] = t.total_us,
+    };
+
+    int fc = fc_index(func);
+    nilan_mb_block_timing_t *bt = (block < NILAN_POLL_BLOCK_COUNT) ? &block_timing[block] : NULL;
+
+    taskENTER_CRITICAL(&timing_lock);
+    for (size_t p = 0; p < NILAN_MB_PHASE_COUNT; ++p)
+    {
+        uint32_t us = phase_us[p];
+        if (us == NILAN_RTU_NO_TIME)
+        {
+            continue;
+        }
+
+        size_t b = hist_bucket(us);
+        if (fc >= 0)
+        {
+            fc_hist[fc][p].count[b]++;
+            fc_hist[fc][p].sum_us += us;
+        }
+
+        if (bt != NULL)
+        {
+            bt->samples[p]++;
+            bt->sum_us[p] += us;
+            if (us > bt->max_us[p])
+            {
+                bt->max_us[p] = us;
+            }
+            if (p == NILAN_MB_PHASE_TOTAL && bt->total_hist[b] != UINT16_MAX)
+            {
+                bt->total_hist[b]++;
+            }
+        }
+    }
+    taskEXIT_CRITICAL(&timing_lock);
+
+    if (t.total_us != NILAN_RTU_NO_TIME)
+    {
+        taskENTER_CRITICAL(&util_lock);
+        util_advance(nilan_transport_now_us());
+        util_busy_us[util_head] += t.total_us;
+        taskEXIT_CRITICAL(&util_lock);
+    }
+}
+
+void nilan_mb_stats_exception(uint8_t code)
+{
+    exception_counts[(code < NILAN_MB_EXCEPTION_CODES) ? code : 0]++;
+}
+
+void nilan_modbus_get_line_stats(nilan_mb_line_stats_t *out)
+{
+    if (out == NULL)
+    {
+        return;
+    }
+
+    memcpy(out->by_err, err_counts, sizeof(out->by_err));
+    memcpy(out->exception_codes, exception_counts, sizeof(out->exception_codes));
+
+    nilan_rtu_line_counters_t line;
+    nilan_rtu_get_line_counters(&line);
+    out->parity_errors = line.parity_errors;
+    out->frame_errors = line.frame_errors;
+    out->breaks = line.breaks;
+    out->fifo_overflows = line.fifo_overflows;
+    out->buffer_full = line.buffer_full;
+}
+
+bool nilan_modbus_get_fc_histogram(uint8_t func, nilan_mb_phase_t phase, nilan_mb_hist_t *out)
+{
+    int fc = fc_index(func);
+    if (fc < 0 || (unsigned)phase >= NILAN_MB_PHASE_COUNT || out == NULL)
+    {
+        return false;
+    }
+
+    taskENTER_CRITICAL(&timing_lock);
+    *out = fc_hist[fc][phase];
+    taskEXIT_CRITICAL(&timing_lock);
+    return true;
+}
+
+bool nilan_modbus_get_poll_group_timing(size_t index, nilan_poll_group_timing_t *out)
+{
+    if (index >= NILAN_POLL_BLOCK_COUNT || out == NULL)
+    {
+        return false;
+    }
+
+    nilan_mb_block_timing_t bt;
+    taskENTER_CRITICAL(&timing_lock);
+    bt = block_timing[index];
+    taskEXIT_CRITICAL(&timing_lock);
+
+    memcpy(out->total_hist, bt.total_hist, sizeof(out->total_hist));
+    for (size_t p = 0; p < NILAN_MB_PHASE_COUNT; ++p)
+    {
+        uint32_t n = bt.samples[p];
+        out->mean_us[p] = (n == 0) ? 0 : (uint32_t)(bt.sum_us[p] / n);
+        out->max_us[p] = bt.max_us[p];
+    }
+    return true;
+}
+
+float nilan_modbus_get_bus_utilization(void)
+{
+    uint64_t busy = 0;
+
+    taskENTER_CRITICAL(&util_lock);
+    util_advance(nilan_transport_now_us());
+    for (size_t i = 0; i < NILAN_MB_UTIL_SLOTS; ++i)
+    {
+        busy += util_busy_us[i];
+    }
+    taskEXIT_CRITICAL(&util_lock);
+
+    // The newest slot is still filling; it's part of the window anyway, which
+    // makes this read a little low for the first second after a slot turns over.
+    return 100.0f * (float)busy / (float)((uint64_t)NILAN_MB_UTIL_SLOTS * NILAN_MB_UTIL_SLOT_US);
+}
+
+bool nilan_modbus_get_poll_group_errors(size_t index, uint16_t out[NILAN_MB_ERR_COUNT])
+{
+    if (index >= NILAN_POLL_BLOCK_COUNT || out == NULL)
+    {
+        return false;
+    }
+
+    memcpy(out, block_err_counts[index], sizeof(block_err_counts[index]));
+    return true;
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+static int fc_index(uint8_t func)
+{
+    switch (func)
+    {
+    case 0x03:
+        return 0;
+    case 0x04:
+        return 1;
+    case 0x06:
+        return 2;
+    case 0x10:
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+static size_t hist_bucket(uint32_t us)
+{
+    if (us < (1u << NILAN_MB_HIST_FIRST_SHIFT))
+    {
+        return 0;
+    }
+
+    size_t msb = 31 - (size_t)__builtin_clz(us); // us >= 512, so clz is defined
+    size_t b = msb - (NILAN_MB_HIST_FIRST_SHIFT - 1);
+    return (b < NILAN_MB_HIST_BUCKETS) ? b : NILAN_MB_HIST_BUCKETS - 1;
+}
+
+// Rotate the utilization ring up to now, clearing the slots we skipped.
+static void util_advance(int64_t now_us)
+{
+    if (util_slot_start_us == 0)
+    {
+        util_slot_start_us = now_us;
+        return;
+    }
+
+    size_t steps = 0;
+    while (now_us - util_slot_start_us >= NILAN_MB_UTIL_SLOT_US && steps < NILAN_MB_UTIL_SLOTS)
+    {
+        util_head = (util_head + 1) % NILAN_MB_UTIL_SLOTS;
+        util_busy_us[util_head] = 0;
+        util_slot_start_us += NILAN_MB_UTIL_SLOT_US;
+        steps++;
+    }
+
+    if (now_us - util_slot_start_us >= NILAN_MB_UTIL_SLOT_US)
+    {
+        util_slot_start_us = now_us; // idle for a whole window: everything was cleared
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nilan_modbus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Transaction outcome bookkeeping for the Modbus bus task. The public getters
+// (nilan_modbus_get_line_stats() and friends) live in nilan_mb_stats.c too.
+
+// Not a poll block: a submitted request or a write.
+#define NILAN_MB_STATS_NO_BLOCK SIZE_MAX
+
+// No queue wait to report (polls, writes).
+#define NILAN_MB_STATS_NO_WAIT UINT32_MAX
+
+// Count one finished transaction and file its phase timings (taken from
+// nilan_rtu_get_last_timing(), so call it right after the transaction).
+// block is the poll block it read, or NILAN_MB_STATS_NO_BLOCK.
+void nilan_mb_stats_record(nilan_mb_err_t err, uint8_t func, size_t block, uint32_t queue_wait_us);
+
+// Count the exception code of an exception reply.
+void nilan_mb_stats_exception(uint8_t code);
+
+#ifdef __cplusplus
+}
+#endif
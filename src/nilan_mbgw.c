@@ -0,0 +1,290 @@
+#include "nilan_mbgw.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Largest read in one Modbus frame.
+#define MB_READ_MAX 125
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+typedef enum
+{
+    GW_FREE = 0,
+    GW_IN_FLIGHT, // submitted; the bus task owns regs/err until it sets GW_DONE
+    GW_DONE,
+} gw_state_t;
+
+typedef struct
+{
+    uint8_t func;
+    uint16_t start;
+    uint16_t qty;
+    gw_state_t state;
+    nilan_mb_err_t err;
+    uint32_t done_ms;
+    size_t waiter_count;
+    nilan_mbgw_waiter_t waiters[NILAN_MBGW_WAITERS];
+    uint16_t regs[MB_READ_MAX];
+} gw_slot_t;
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static gw_slot_t slots[NILAN_MBGW_SLOTS];
+static portMUX_TYPE gw_lock = portMUX_INITIALIZER_UNLOCKED; // slot state vs. the bus task
+
+static volatile uint32_t ttl_ms = NILAN_MBGW_DEFAULT_TTL_MS;
+static nilan_mbgw_stats_t stats;
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static void gw_done_cb(const nilan_mb_request_t *req, nilan_mb_err_t err, const uint16_t *regs);
+static gw_state_t slot_state(const gw_slot_t *s);
+static bool slot_cached(const gw_slot_t *s, uint32_t now);
+static gw_slot_t *claim_slot(uint32_t now);
+static size_t conn_outstanding(uint32_t conn);
+static inline uint32_t get_time_ms(void);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+nilan_mbgw_status_t nilan_mbgw_read(uint8_t func, uint16_t start, uint16_t qty,
+                                    const nilan_mbgw_waiter_t *w, uint16_t *regs)
+{
+    uint32_t now = get_time_ms();
+    gw_slot_t *same = NULL;
+
+    for (size_t i = 0; i < NILAN_MBGW_SLOTS; ++i)
+    {
+        gw_slot_t *s = &slots[i];
+        if (s->state != GW_FREE && s->func == func && s->start == start && s->qty == qty)
+        {
+            same = s;
+            break;
+        }
+    }
+
+    if (same != NULL && slot_cached(same, now))
+    {
+        memcpy(regs, same->regs, qty * sizeof(uint16_t));
+        stats.cache_hits++;
+        return NILAN_MBGW_CACHED;
+    }
+
+    if (conn_outstanding(w->conn) >= NILAN_MBGW_PER_CONN)
+    {
+        stats.busy++;
+        return NILAN_MBGW_BUSY;
+    }
+
+    // Identical read still on the bus (or done, but not yet handed out): ride along.
+    if (same != NULL && (slot_state(same) == GW_IN_FLIGHT || same->waiter_count > 0))
+    {
+        if (same->waiter_count >= NILAN_MBGW_WAITERS)
+        {
+            stats.busy++;
+            return NILAN_MBGW_BUSY;
+        }
+        same->waiters[same->waiter_count++] = *w;
+        stats.joined++;
+        return NILAN_MBGW_QUEUED;
+    }
+
+    if (same != NULL)
+    {
+        same->state = GW_FREE; // expired copy of this answer; nobody waits on it
+    }
+
+    gw_slot_t *s = claim_slot(now);
+    if (s == NULL)
+    {
+        stats.busy++;
+        return NILAN_MBGW_BUSY;
+    }
+
+    s->func = func;
+    s->start = start;
+    s->qty = qty;
+    s->waiter_count = 1;
+    s->waiters[0] = *w;
+
+    taskENTER_CRITICAL(&gw_lock);
+    s->state = GW_IN_FLIGHT;
+    taskEXIT_CRITICAL(&gw_lock);
+
+    nilan_mb_request_t req = {
+        .func = func,
+        .start = start,
+        .qty = qty,
+        .done = gw_done_cb,
+        .user = s,
+    };
+
+    if (!nilan_modbus_submit(&req, NILAN_MB_PRIO_NORMAL))
+    {
+        taskENTER_CRITICAL(&gw_lock);
+        s->state = GW_FREE;
+        taskEXIT_CRITICAL(&gw_lock);
+        s->waiter_count = 0;
+        stats.busy++;
+        return NILAN_MBGW_BUSY;
+    }
+
+    stats.submitted++;
+    return NILAN_MBGW_QUEUED;
+}
+
+bool nilan_mbgw_deliver(nilan_mbgw_answer_t answer)
+{
+    uint32_t now = get_time_ms();
+    bool in_flight = false;
+
+    for (size_t i = 0; i < NILAN_MBGW_SLOTS; ++i)
+    {
+        gw_slot_t *s = &slots[i];
+        gw_state_t state = slot_state(s);
+
+        if (state == GW_IN_FLIGHT)
+        {
+            in_flight = true;
+            continue;
+        }
+        if (state != GW_DONE)
+        {
+            continue;
+        }
+
+        for (size_t k = 0; k < s->waiter_count; ++k)
+        {
+            answer(&s->waiters[k], s->func, s->err, s->regs, s->qty);
+        }
+        if (s->waiter_count > 0 && s->err != NILAN_MB_ERR_NONE)
+        {
+            stats.failed++;
+        }
+        s->waiter_count = 0;
+
+        // Only good answers are worth repeating; errors go straight back to the bus.
+        if (!slot_cached(s, now))
+        {
+            s->state = GW_FREE;
+        }
+    }
+
+    return in_flight;
+}
+
+void nilan_mbgw_set_ttl_ms(uint32_t ttl)
+{
+    ttl_ms = ttl;
+}
+
+void nilan_mbgw_get_stats(nilan_mbgw_stats_t *out)
+{
+    if (out != NULL)
+    {
+        *out = stats;
+    }
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+// Bus task: keep the answer and mark the slot done. The server task hands it
+// out on its next pass.
+static void gw_done_cb(const nilan_mb_request_t *req, nilan_mb_err_t err, const uint16_t *regs)
+{
+    gw_slot_t *s = (gw_slot_t *)req->user;
+
+    if (err == NILAN_MB_ERR_NONE)
+    {
+        memcpy(s->regs, regs, req->qty * sizeof(uint16_t));
+    }
+    else if (err == NILAN_MB_ERR_EXCEPTION)
+    {
+        s->regs[0] = regs[0];
+    }
+
+    taskENTER_CRITICAL(&gw_lock);
+    s->err = err;
+    s->done_ms = get_time_ms();
+    s->state = GW_DONE;
+    taskEXIT_CRITICAL(&gw_lock);
+}
+
+static gw_state_t slot_state(const gw_slot_t *s)
+{
+    taskENTER_CRITICAL(&gw_lock);
+    gw_state_t state = s->state;
+    taskEXIT_CRITICAL(&gw_lock);
+    return state;
+}
+
+static bool slot_cached(const gw_slot_t *s, uint32_t now)
+{
+    return slot_state(s) == GW_DONE && s->err == NILAN_MB_ERR_NONE && now - s->done_ms < ttl_ms;
+}
+
+// A free slot, or failing that the cached answer that's been kept longest.
+static gw_slot_t *claim_slot(uint32_t now)
+{
+    gw_slot_t *oldest = NULL;
+    size_t in_flight = 0;
+
+    for (size_t i = 0; i < NILAN_MBGW_SLOTS; ++i)
+    {
+        gw_slot_t *s = &slots[i];
+        gw_state_t state = slot_state(s);
+
+        if (state == GW_IN_FLIGHT)
+        {
+            in_flight++;
+        }
+        else if (state == GW_DONE && s->waiter_count == 0 &&
+                 (oldest == NULL || (now - s->done_ms) > (now - oldest->done_ms)))
+        {
+            oldest = s;
+        }
+    }
+
+    if (in_flight >= NILAN_MBGW_MAX_IN_FLIGHT)
+    {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < NILAN_MBGW_SLOTS; ++i)
+    {
+        if (slot_state(&slots[i]) == GW_FREE)
+        {
+            return &slots[i];
+        }
+    }
+    return oldest;
+}
+
+static size_t conn_outstanding(uint32_t conn)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < NILAN_MBGW_SLOTS; ++i)
+    {
+        for (size_t k = 0; k < slots[i].waiter_count; ++k)
+        {
+            n += (slots[i].waiters[k].conn == conn);
+        }
+    }
+    return n;
+}
+
+static inline uint32_t get_time_ms(void)
+{
+    return (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
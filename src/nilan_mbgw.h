@@ -0,0 +1,79 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nilan_modbus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Pass-through reads for the Modbus TCP server (nilan_mbtcp.c): ranges the
+ * register table doesn't cover go to the CTS602 itself, as normal priority
+ * requests on the bus task, where they take turns with polling.
+ *
+ * A fixed table of slots bounds what's outstanding, with a cap per TCP
+ * connection so one client can't take every slot. A request identical to one
+ * already on its way (same function, start and quantity) joins it instead of
+ * going on the wire again, and a successful answer is kept for a short TTL to
+ * serve repeats.
+ *
+ * Everything except the bus task's completion callback runs in the TCP
+ * server task.
+ */
+
+#define NILAN_MBGW_SLOTS 6          // distinct transactions outstanding or cached
+#define NILAN_MBGW_MAX_IN_FLIGHT 4  // of them on the bus queue at once (it holds 8)
+#define NILAN_MBGW_WAITERS 4        // TCP requests sharing one transaction
+#define NILAN_MBGW_PER_CONN 2       // outstanding gateway reads per connection
+
+#ifndef NILAN_MBGW_DEFAULT_TTL_MS
+#define NILAN_MBGW_DEFAULT_TTL_MS 1000
+#endif
+
+// Who a response goes to.
+typedef struct
+{
+    uint32_t conn; // connection id, never reused
+    uint16_t tid;  // MBAP transaction id
+    uint8_t unit;
+} nilan_mbgw_waiter_t;
+
+typedef enum
+{
+    NILAN_MBGW_CACHED = 0, // answered from the cache: regs filled in
+    NILAN_MBGW_QUEUED,     // on its way; the answer comes through nilan_mbgw_deliver()
+    NILAN_MBGW_BUSY,       // no slot free, or this connection has too many outstanding
+} nilan_mbgw_status_t;
+
+// Gets every finished transaction's answer, once per waiter. regs holds qty
+// values on NILAN_MB_ERR_NONE, the exception code in regs[0] on
+// NILAN_MB_ERR_EXCEPTION.
+typedef void (*nilan_mbgw_answer_t)(const nilan_mbgw_waiter_t *w, uint8_t func, nilan_mb_err_t err,
+                                    const uint16_t *regs, uint16_t qty);
+
+typedef struct
+{
+    uint32_t submitted; // transactions put on the bus
+    uint32_t joined;    // requests that rode along with an identical one in flight
+    uint32_t cache_hits;
+    uint32_t busy;      // refused with exception 0x06
+    uint32_t failed;    // bus errors and exceptions passed back
+} nilan_mbgw_stats_t;
+
+nilan_mbgw_status_t nilan_mbgw_read(uint8_t func, uint16_t start, uint16_t qty,
+                                    const nilan_mbgw_waiter_t *w, uint16_t *regs);
+
+// Hand out finished answers and expire the cache. Returns true while any
+// transaction is still on the bus, i.e. the caller should come back soon.
+bool nilan_mbgw_deliver(nilan_mbgw_answer_t answer);
+
+// How long a successful answer is served again; 0 disables the cache.
+void nilan_mbgw_set_ttl_ms(uint32_t ttl_ms);
+
+void nilan_mbgw_get_stats(nilan_mbgw_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
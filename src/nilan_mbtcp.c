@@ -0,0 +1,574 @@
+#include "nilan_mbtcp.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+
+#include "nilan_mbgw.h"
+#include "nilan_modbus.h"
+
+static const char *TAG = "nilan_mbtcp";
+
+// MBAP header (transaction, protocol, length, unit) and the largest PDU.
+#define MBAP_LEN 7
+#define PDU_MAX 253
+#define ADU_MAX (MBAP_LEN + PDU_MAX)
+
+#define MB_READ_MAX 125
+
+#define MB_EX_ILLEGAL_FUNCTION 0x01
+#define MB_EX_ILLEGAL_ADDRESS 0x02
+#define MB_EX_ILLEGAL_VALUE 0x03
+#define MB_EX_BUSY 0x06
+#define MB_EX_TARGET_FAILED 0x0B
+
+// select() timeout: short while gateway reads are on the bus, so their
+// answers go out promptly; otherwise just often enough to drop idle clients.
+#define POLL_GATEWAY_MS 10
+#define POLL_IDLE_MS 1000
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+typedef struct
+{
+    int fd;        // -1 = free slot
+    uint32_t conn; // id of the connection in this slot, never reused
+    uint32_t last_rx_ms;
+    size_t len;
+    uint8_t rx[ADU_MAX];
+} mbtcp_client_t;
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static mbtcp_client_t clients[NILAN_MBTCP_MAX_CLIENTS];
+static int listen_fd = -1;
+static TaskHandle_t server_task = NULL;
+static uint32_t next_conn = 1;
+static volatile bool gateway = NILAN_MBTCP_GATEWAY;
+
+// Per poll class; 32-bit, so set and read whole from any task.
+static volatile uint32_t max_age_ms[NILAN_POLL_CLASS_COUNT] = {
+    [NILAN_POLL_NORMAL] = NILAN_MBTCP_DEFAULT_AGE_PERIODS * NILAN_POLL_NORMAL_MS,
+    [NILAN_POLL_FAST] = NILAN_MBTCP_DEFAULT_AGE_PERIODS * NILAN_POLL_FAST_MS,
+    [NILAN_POLL_SLOW] = NILAN_MBTCP_DEFAULT_AGE_PERIODS * NILAN_POLL_SLOW_MS,
+    [NILAN_POLL_STATIC] = NILAN_MBTCP_DEFAULT_AGE_PERIODS * NILAN_POLL_STATIC_MS,
+};
+
+// Server task only writes these; readers may see them mid-update, like the bus stats.
+static nilan_mbtcp_stats_t stats;
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static void nilan_mbtcp_task(void *arg);
+static bool open_listener(void);
+static void accept_client(uint32_t now);
+static void client_receive(mbtcp_client_t *c, uint32_t now);
+static void client_close(mbtcp_client_t *c);
+static bool send_frame(mbtcp_client_t *c, uint16_t tid, uint8_t unit, uint8_t *resp, size_t pdu_len);
+static void gateway_answer(const nilan_mbgw_waiter_t *w, uint8_t func, nilan_mb_err_t err,
+                           const uint16_t *regs, uint16_t qty);
+static size_t handle_pdu(const nilan_mbgw_waiter_t *w, const uint8_t *pdu, size_t len, uint8_t *resp);
+static size_t read_regs(const nilan_mbgw_waiter_t *w, uint8_t func, const uint8_t *pdu, size_t len, uint8_t *resp);
+static size_t put_regs(uint8_t func, const uint16_t *regs, uint16_t qty, uint8_t *resp);
+static size_t write_single(const uint8_t *pdu, size_t len, uint8_t *resp);
+static size_t write_multiple(const uint8_t *pdu, size_t len, uint8_t *resp);
+static size_t exception(uint8_t func, uint8_t code, uint8_t *resp);
+static bool send_all(int fd, const uint8_t *buf, size_t len);
+static inline uint16_t get_u16(const uint8_t *p);
+static inline void put_u16(uint8_t *p, uint16_t v);
+static inline uint32_t get_time_ms(void);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+bool nilan_mbtcp_start(void)
+{
+    if (server_task != NULL)
+    {
+        return true;
+    }
+
+    for (size_t i = 0; i < NILAN_MBTCP_MAX_CLIENTS; ++i)
+    {
+        clients[i].fd = -1;
+    }
+
+    if (!open_listener())
+    {
+        return false;
+    }
+
+    return xTaskCreate(nilan_mbtcp_task, "nilan_mbtcp", 4096, NULL, 3, &server_task) == pdPASS;
+}
+
+void nilan_mbtcp_set_max_age_ms(nilan_poll_class_t poll_class, uint32_t max_age)
+{
+    if ((unsigned)poll_class < NILAN_POLL_CLASS_COUNT)
+    {
+        max_age_ms[poll_class] = max_age;
+    }
+}
+
+void nilan_mbtcp_set_gateway(bool enable)
+{
+    gateway = enable;
+}
+
+void nilan_mbtcp_get_stats(nilan_mbtcp_stats_t *out)
+{
+    if (out != NULL)
+    {
+        *out = stats;
+    }
+}
+
+static void nilan_mbtcp_task(void *arg)
+{
+    (void)arg; // Silence the unused parameter warning.
+
+    bool gateway_busy = false;
+
+    while (1)
+    {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(listen_fd, &rfds);
+        int max_fd = listen_fd;
+
+        for (size_t i = 0; i < NILAN_MBTCP_MAX_CLIENTS; ++i)
+        {
+            if (clients[i].fd >= 0)
+            {
+                FD_SET(clients[i].fd, &rfds);
+                if (clients[i].fd > max_fd)
+                {
+                    max_fd = clients[i].fd;
+                }
+            }
+        }
+
+        uint32_t wait_ms = gateway_busy ? POLL_GATEWAY_MS : POLL_IDLE_MS;
+        struct timeval tv = {.tv_sec = wait_ms / 1000, .tv_usec = (wait_ms % 1000) * 1000};
+        int n = select(max_fd + 1, &rfds, NULL, NULL, &tv);
+        uint32_t now = get_time_ms();
+
+        if (n < 0)
+        {
+            ESP_LOGW(TAG, "select failed: errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+
+        if (n > 0 && FD_ISSET(listen_fd, &rfds))
+        {
+            accept_client(now);
+        }
+
+        for (size_t i = 0; i < NILAN_MBTCP_MAX_CLIENTS; ++i)
+        {
+            mbtcp_client_t *c = &clients[i];
+            if (c->fd < 0)
+            {
+                continue;
+            }
+
+            if (n > 0 && FD_ISSET(c->fd, &rfds))
+            {
+                client_receive(c, now);
+            }
+            else if (now - c->last_rx_ms >= NILAN_MBTCP_IDLE_MS)
+            {
+                client_close(c);
+            }
+        }
+
+        // Answers for gateway reads the bus task has finished since the last pass.
+        gateway_busy = nilan_mbgw_deliver(gateway_answer);
+    }
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+static bool open_listener(void)
+{
+    listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listen_fd < 0)
+    {
+        ESP_LOGW(TAG, "socket failed: errno %d", errno);
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(NILAN_MBTCP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 2) != 0)
+    {
+        ESP_LOGW(TAG, "bind/listen on port %u failed: errno %d", (unsigned)NILAN_MBTCP_PORT, errno);
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Modbus TCP on port %u", (unsigned)NILAN_MBTCP_PORT);
+    return true;
+}
+
+static void accept_client(uint32_t now)
+{
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < NILAN_MBTCP_MAX_CLIENTS; ++i)
+    {
+        if (clients[i].fd < 0)
+        {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            clients[i].fd = fd;
+            clients[i].conn = next_conn++;
+            clients[i].len = 0;
+            clients[i].last_rx_ms = now;
+            stats.connections++;
+            stats.clients++;
+            return;
+        }
+    }
+
+    stats.rejected++;
+    close(fd);
+}
+
+// Take what the socket has, and answer every complete frame in it. A client
+// may pipeline several requests in one segment, or split one across two.
+static void client_receive(mbtcp_client_t *c, uint32_t now)
+{
+    ssize_t got = recv(c->fd, c->rx + c->len, sizeof(c->rx) - c->len, 0);
+    if (got <= 0)
+    {
+        client_close(c);
+        return;
+    }
+    c->len += (size_t)got;
+    c->last_rx_ms = now;
+
+    while (c->len >= MBAP_LEN)
+    {
+        uint16_t protocol = get_u16(c->rx + 2);
+        uint16_t length = get_u16(c->rx + 4); // unit id + PDU
+        if (protocol != 0 || length < 2 || length > PDU_MAX + 1)
+        {
+            client_close(c); // not Modbus, or out of sync: nothing sane to answer
+            return;
+        }
+
+        size_t frame_len = 6 + (size_t)length;
+        if (c->len < frame_len)
+        {
+            return;
+        }
+
+        nilan_mbgw_waiter_t w = {.conn = c->conn, .tid = get_u16(c->rx), .unit = c->rx[6]};
+        uint8_t resp[ADU_MAX];
+        size_t resp_pdu = handle_pdu(&w, c->rx + MBAP_LEN, frame_len - MBAP_LEN, resp + MBAP_LEN);
+
+        stats.requests++;
+
+        // 0: a gateway read, answered later, possibly after requests behind it.
+        if (resp_pdu > 0 && !send_frame(c, w.tid, w.unit, resp, resp_pdu))
+        {
+            return;
+        }
+
+        memmove(c->rx, c->rx + frame_len, c->len - frame_len);
+        c->len -= frame_len;
+    }
+}
+
+static void client_close(mbtcp_client_t *c)
+{
+    close(c->fd);
+    c->fd = -1;
+    c->len = 0;
+    stats.clients--;
+}
+
+// resp has room for the MBAP header in front of the PDU. Closes the
+// connection and returns false if the send fails.
+static bool send_frame(mbtcp_client_t *c, uint16_t tid, uint8_t unit, uint8_t *resp, size_t pdu_len)
+{
+    put_u16(resp, tid);
+    put_u16(resp + 2, 0); // protocol id
+    put_u16(resp + 4, (uint16_t)(pdu_len + 1));
+    resp[6] = unit;
+
+    if (resp[MBAP_LEN] & 0x80)
+    {
+        stats.exceptions++;
+    }
+
+    if (!send_all(c->fd, resp, MBAP_LEN + pdu_len))
+    {
+        client_close(c);
+        return false;
+    }
+    return true;
+}
+
+static void gateway_answer(const nilan_mbgw_waiter_t *w, uint8_t func, nilan_mb_err_t err,
+                           const uint16_t *regs, uint16_t qty)
+{
+    for (size_t i = 0; i < NILAN_MBTCP_MAX_CLIENTS; ++i)
+    {
+        mbtcp_client_t *c = &clients[i];
+        if (c->fd < 0 || c->conn != w->conn)
+        {
+            continue;
+        }
+
+        uint8_t resp[ADU_MAX];
+        size_t pdu_len;
+        if (err == NILAN_MB_ERR_NONE)
+        {
+            pdu_len = put_regs(func, regs, qty, resp + MBAP_LEN);
+        }
+        else if (err == NILAN_MB_ERR_EXCEPTION)
+        {
+            pdu_len = exception(func, (uint8_t)regs[0], resp + MBAP_LEN); // the CTS602's own code
+        }
+        else
+        {
+            pdu_len = exception(func, MB_EX_TARGET_FAILED, resp + MBAP_LEN);
+        }
+
+        send_frame(c, w->tid, w->unit, resp, pdu_len);
+        return;
+    }
+    // Client has gone meanwhile: nobody to answer.
+}
+
+// Response PDU into resp; returns its length, or 0 if the answer comes later
+// through gateway_answer().
+static size_t handle_pdu(const nilan_mbgw_waiter_t *w, const uint8_t *pdu, size_t len, uint8_t *resp)
+{
+    uint8_t func = pdu[0];
+
+    switch (func)
+    {
+    case NILAN_HOLDING_REG:
+    case NILAN_INPUT_REG:
+        return read_regs(w, func, pdu, len, resp);
+    case 0x06:
+        return write_single(pdu, len, resp);
+    case 0x10:
+        return write_multiple(pdu, len, resp);
+    default:
+        return exception(func, MB_EX_ILLEGAL_FUNCTION, resp);
+    }
+}
+
+static size_t read_regs(const nilan_mbgw_waiter_t *w, uint8_t func, const uint8_t *pdu, size_t len, uint8_t *resp)
+{
+    if (len != 5)
+    {
+        return exception(func, MB_EX_ILLEGAL_VALUE, resp);
+    }
+
+    uint16_t start = get_u16(pdu + 1);
+    uint16_t qty = get_u16(pdu + 3);
+    if (qty == 0 || qty > MB_READ_MAX)
+    {
+        return exception(func, MB_EX_ILLEGAL_VALUE, resp);
+    }
+    if ((uint32_t)start + qty > 0x10000)
+    {
+        return exception(func, MB_EX_ILLEGAL_ADDRESS, resp);
+    }
+
+    // Anything outside the register table can only come from the CTS602 itself.
+    nilan_reg_id_t ids[MB_READ_MAX];
+    for (uint16_t i = 0; i < qty; ++i)
+    {
+        ids[i] = nilan_reg_find(func, (uint16_t)(start + i));
+        if (ids[i] != NILAN_REGID_COUNT)
+        {
+            continue;
+        }
+        if (!gateway)
+        {
+            return exception(func, MB_EX_ILLEGAL_ADDRESS, resp);
+        }
+
+        uint16_t regs[MB_READ_MAX];
+        switch (nilan_mbgw_read(func, start, qty, w, regs))
+        {
+        case NILAN_MBGW_CACHED:
+            return put_regs(func, regs, qty, resp);
+        case NILAN_MBGW_QUEUED:
+            return 0;
+        default:
+            return exception(func, MB_EX_BUSY, resp);
+        }
+    }
+
+    uint32_t now = get_time_ms();
+
+    for (uint16_t i = 0; i < qty; ++i)
+    {
+        nilan_reg_id_t id = ids[i];
+        nilan_reg_value_t v;
+        uint32_t limit = max_age_ms[nilan_registers[id].poll_class];
+        if (!nilan_reg_read(id, &v) || nilan_reg_is_stale(id) ||
+            (limit != 0 && now - v.timestamp_ms > limit))
+        {
+            stats.stale_refusals++;
+            return exception(func, MB_EX_TARGET_FAILED, resp);
+        }
+
+        put_u16(resp + 2 + 2 * i, v.raw);
+    }
+
+    resp[0] = func;
+    resp[1] = (uint8_t)(2 * qty);
+    return 2 + 2 * (size_t)qty;
+}
+
+static size_t put_regs(uint8_t func, const uint16_t *regs, uint16_t qty, uint8_t *resp)
+{
+    resp[0] = func;
+    resp[1] = (uint8_t)(2 * qty);
+    for (uint16_t i = 0; i < qty; ++i)
+    {
+        put_u16(resp + 2 + 2 * i, regs[i]);
+    }
+    return 2 + 2 * (size_t)qty;
+}
+
+static size_t write_single(const uint8_t *pdu, size_t len, uint8_t *resp)
+{
+    if (len != 5)
+    {
+        return exception(0x06, MB_EX_ILLEGAL_VALUE, resp);
+    }
+
+    uint16_t addr = get_u16(pdu + 1);
+    if (!gateway && nilan_reg_find(NILAN_HOLDING_REG, addr) == NILAN_REGID_COUNT)
+    {
+        return exception(0x06, MB_EX_ILLEGAL_ADDRESS, resp);
+    }
+    if (!nilan_modbus_write_single_holding(addr, get_u16(pdu + 3)))
+    {
+        return exception(0x06, MB_EX_BUSY, resp);
+    }
+
+    stats.writes_queued++;
+    memcpy(resp, pdu, 5); // FC06 reply echoes the request
+    return 5;
+}
+
+// Outside gateway mode every register is checked before any is queued, so an
+// unknown address leaves nothing half written. The registers are queued as one
+// block, all or none; a full write queue answers exception 0x06 and the client
+// may simply repeat the write.
+static size_t write_multiple(const uint8_t *pdu, size_t len, uint8_t *resp)
+{
+    if (len < 6)
+    {
+        return exception(0x10, MB_EX_ILLEGAL_VALUE, resp);
+    }
+
+    uint16_t start = get_u16(pdu + 1);
+    uint16_t qty = get_u16(pdu + 3);
+    uint8_t bytes = pdu[5];
+    if (qty == 0 || qty > NILAN_WRITE_BLOCK_MAX || bytes != 2 * qty || len != 6 + (size_t)bytes)
+    {
+        return exception(0x10, MB_EX_ILLEGAL_VALUE, resp);
+    }
+
+    uint16_t values[NILAN_WRITE_BLOCK_MAX];
+    for (uint16_t i = 0; i < qty; ++i)
+    {
+        if (!gateway && nilan_reg_find(NILAN_HOLDING_REG, (uint16_t)(start + i)) == NILAN_REGID_COUNT)
+        {
+            return exception(0x10, MB_EX_ILLEGAL_ADDRESS, resp);
+        }
+        values[i] = get_u16(pdu + 6 + 2 * i);
+    }
+
+    if (!nilan_modbus_write_holding_block(start, qty, values))
+    {
+        return exception(0x10, MB_EX_BUSY, resp);
+    }
+    stats.writes_queued += qty;
+
+    resp[0] = 0x10;
+    put_u16(resp + 1, start);
+    put_u16(resp + 3, qty);
+    return 5;
+}
+
+static size_t exception(uint8_t func, uint8_t code, uint8_t *resp)
+{
+    resp[0] = func | 0x80;
+    resp[1] = code;
+    return 2;
+}
+
+static bool send_all(int fd, const uint8_t *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t sent = send(fd, buf, len, 0);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        buf += sent;
+        len -= (size_t)sent;
+    }
+    return true;
+}
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)(v & 0xFF);
+}
+
+static inline uint32_t get_time_ms(void)
+{
+    // Same clock as the register store's timestamps.
+    return (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
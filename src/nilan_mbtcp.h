@@ -0,0 +1,81 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "NilanRegisters.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Modbus TCP slave on top of the register cache.
+ *
+ * FC03/FC04 are answered from the register store, never from the RS485 bus,
+ * so any number of TCP clients costs no serial bandwidth: the poll plan keeps
+ * the cache fresh for everyone. A read is refused with exception 0x0B
+ * (gateway target failed to respond) if any register in it is older than the
+ * staleness limit of its poll class, or has only been restored from the last
+ * boot; with exception 0x02 if it covers an address the register table
+ * doesn't know.
+ *
+ * FC06/FC16 writes go into the RTU write queue and are acknowledged once queued;
+ * the bus task sends and verifies them. An FC16 of up to NILAN_WRITE_BLOCK_MAX
+ * registers is queued whole or not at all (nilan_modbus_write_holding_block()),
+ * so the client sees exception 0x06 rather than a partial write.
+ *
+ * In gateway mode (the default), reads that touch any address outside the
+ * register table pass through to the CTS602 instead, via nilan_mbgw.h: queued
+ * on the bus with a bound per connection, merged with identical reads in
+ * flight, and cached for a short TTL. Their answers may overtake later
+ * requests of the same connection, as Modbus TCP allows. Writes to unknown
+ * addresses are queued like any other.
+ *
+ * The unit identifier is echoed and otherwise ignored: there is one slave
+ * behind this gateway.
+ */
+
+#ifndef NILAN_MBTCP_PORT
+#define NILAN_MBTCP_PORT 502
+#endif
+
+#ifndef NILAN_MBTCP_MAX_CLIENTS
+#define NILAN_MBTCP_MAX_CLIENTS 4
+#endif
+
+#ifndef NILAN_MBTCP_GATEWAY
+#define NILAN_MBTCP_GATEWAY 1
+#endif
+
+// Connections idle this long are closed to make room for others.
+#define NILAN_MBTCP_IDLE_MS 60000
+
+// Default staleness limit: this many poll periods of the register's class.
+#define NILAN_MBTCP_DEFAULT_AGE_PERIODS 3
+
+typedef struct
+{
+    uint32_t connections;    // accepted since start
+    uint32_t rejected;       // refused: all client slots taken
+    uint32_t requests;
+    uint32_t exceptions;     // of which answered with an exception
+    uint32_t stale_refusals; // exception 0x0B for old data
+    uint32_t writes_queued;  // registers handed to the write queue
+    uint8_t clients;         // connected now
+} nilan_mbtcp_stats_t;
+
+// Start the server task. Call once the network stack is up.
+bool nilan_mbtcp_start(void);
+
+// Oldest data a read of a register of this class may return; 0 = no limit.
+// Any task, any time.
+void nilan_mbtcp_set_max_age_ms(nilan_poll_class_t poll_class, uint32_t max_age_ms);
+
+// Pass unknown ranges through to the bus (true), or refuse them with 0x02.
+void nilan_mbtcp_set_gateway(bool enable);
+
+void nilan_mbtcp_get_stats(nilan_mbtcp_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
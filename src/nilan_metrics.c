@@ -0,0 +1,671 @@
+#include "nilan_metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "NilanRegisters.h"
+#include "nilan_logstore.h"
+#include "nilan_modbus.h"
+#include "nilan_telemetry.h"
+#include "sys_diag.h"
+#include "sys_time.h"
+#include "wifi_sta.h"
+
+// Body is sent in chunks of at most this much; a line never spans two.
+#define NILAN_METRICS_CHUNK 1024
+
+// GET /log without from= starts this far back from the newest record.
+#define NILAN_METRICS_LOG_DEFAULT_S (24 * 3600)
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+typedef struct
+{
+    httpd_req_t *req;
+    esp_err_t err; // first send error; everything after it is dropped
+    size_t len;
+    char buf[NILAN_METRICS_CHUNK];
+} metrics_out_t;
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static const char *const err_names[NILAN_MB_ERR_COUNT] = {
+    [NILAN_MB_ERR_NONE] = "ok",
+    [NILAN_MB_ERR_TIMEOUT] = "timeout",
+    [NILAN_MB_ERR_CRC] = "crc",
+    [NILAN_MB_ERR_LENGTH] = "length",
+    [NILAN_MB_ERR_ADDR] = "addr",
+    [NILAN_MB_ERR_FUNC] = "func",
+    [NILAN_MB_ERR_EXCEPTION] = "exception",
+    [NILAN_MB_ERR_INTERNAL] = "internal",
+    [NILAN_MB_ERR_VERIFY] = "verify",
+    [NILAN_MB_ERR_LINE] = "line",
+    [NILAN_MB_ERR_OVERRUN] = "overrun",
+};
+
+static const char *const phase_names[NILAN_MB_PHASE_COUNT] = {
+    [NILAN_MB_PHASE_QUEUE] = "queue",
+    [NILAN_MB_PHASE_TX] = "tx",
+    [NILAN_MB_PHASE_TURNAROUND] = "turnaround",
+    [NILAN_MB_PHASE_RX] = "rx",
+    [NILAN_MB_PHASE_TOTAL] = "total",
+};
+
+// Upper bounds of the log2 latency buckets (see NILAN_MB_HIST_BUCKETS), in seconds.
+static const char *const hist_le[NILAN_MB_HIST_BUCKETS] = {
+    "0.000512", "0.001024", "0.002048", "0.004096", "0.008192", "0.016384",
+    "0.032768", "0.065536", "0.131072", "0.262144", "0.524288", "+Inf",
+};
+
+static const uint8_t hist_funcs[] = {0x03, 0x04, 0x06, 0x10};
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static esp_err_t metrics_get(httpd_req_t *req);
+static esp_err_t log_get(httpd_req_t *req);
+static bool log_visit(nilan_reg_id_t id, uint32_t t, uint16_t raw, void *user);
+static nilan_reg_id_t parse_reg_key(const char *key);
+static void write_registers(metrics_out_t *o);
+static void write_line_stats(metrics_out_t *o);
+static void write_poll_groups(metrics_out_t *o);
+static void write_histograms(metrics_out_t *o);
+static void write_telemetry(metrics_out_t *o);
+static void write_wifi(metrics_out_t *o);
+static void write_time(metrics_out_t *o);
+static void write_diag(metrics_out_t *o);
+static void out_family(metrics_out_t *o, const char *name, const char *type, const char *help);
+static void out_printf(metrics_out_t *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void out_flush(metrics_out_t *o);
+static void format_value(nilan_reg_id_t id, uint16_t raw, char *out, size_t cap);
+static void format_labels(nilan_reg_id_t id, char *out, size_t cap);
+static inline uint32_t now_ms(void);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+esp_err_t nilan_metrics_register(httpd_handle_t server)
+{
+    static const httpd_uri_t uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_get,
+    };
+    static const httpd_uri_t log_uri = {
+        .uri = "/log",
+        .method = HTTP_GET,
+        .handler = log_get,
+    };
+
+    esp_err_t err = httpd_register_uri_handler(server, &uri);
+    if (err == ESP_OK)
+    {
+        err = httpd_register_uri_handler(server, &log_uri);
+    }
+    return err;
+}
+
+static esp_err_t metrics_get(httpd_req_t *req)
+{
+    metrics_out_t o = {.req = req, .err = ESP_OK, .len = 0};
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4; charset=utf-8");
+
+    write_registers(&o);
+    write_line_stats(&o);
+    write_poll_groups(&o);
+    write_histograms(&o);
+    write_telemetry(&o);
+    write_wifi(&o);
+    write_time(&o);
+    write_diag(&o);
+
+    out_flush(&o);
+    if (o.err == ESP_OK)
+    {
+        o.err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return o.err; // an error closes the connection
+}
+
+// /log?reg=ir202&from=1760000000&to=1760086400, every parameter optional.
+static esp_err_t log_get(httpd_req_t *req)
+{
+    char query[96] = "";
+    char val[24];
+    nilan_reg_id_t id = NILAN_REGID_COUNT; // all registers
+    uint32_t first_t, last_t;
+
+    if (!nilan_logstore_span(&first_t, &last_t))
+    {
+        first_t = last_t = 0;
+    }
+    uint32_t from_t = (last_t > first_t + NILAN_METRICS_LOG_DEFAULT_S) ? last_t - NILAN_METRICS_LOG_DEFAULT_S : first_t;
+    uint32_t to_t = UINT32_MAX;
+
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    if (httpd_query_key_value(query, "reg", val, sizeof(val)) == ESP_OK)
+    {
+        id = parse_reg_key(val);
+        if (id == NILAN_REGID_COUNT)
+        {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "unknown reg; see /registers");
+        }
+    }
+    if (httpd_query_key_value(query, "from", val, sizeof(val)) == ESP_OK)
+    {
+        from_t = (uint32_t)strtoul(val, NULL, 10);
+    }
+    if (httpd_query_key_value(query, "to", val, sizeof(val)) == ESP_OK)
+    {
+        to_t = (uint32_t)strtoul(val, NULL, 10);
+    }
+
+    metrics_out_t o = {.req = req, .err = ESP_OK, .len = 0};
+
+    httpd_resp_set_type(req, "text/csv; charset=utf-8");
+    out_printf(&o, "t,reg,value\n");
+    nilan_logstore_query(id, from_t, to_t, log_visit, &o);
+
+    out_flush(&o);
+    if (o.err == ESP_OK)
+    {
+        o.err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return o.err;
+}
+
+static bool log_visit(nilan_reg_id_t id, uint32_t t, uint16_t raw, void *user)
+{
+    metrics_out_t *o = (metrics_out_t *)user;
+    const nilan_reg_meta_t *m = &nilan_registers[id];
+    char value[16];
+
+    format_value(id, raw, value, sizeof(value));
+    out_printf(o, "%lu,%s%u,%s\n", (unsigned long)t, (m->reg_type == NILAN_INPUT_REG) ? "ir" : "hr",
+               (unsigned)m->addr, value);
+    return o->err == ESP_OK; // stop reading flash once the client is gone
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+// "ir202" / "hr1001", the keys used by /registers and the uploader.
+static nilan_reg_id_t parse_reg_key(const char *key)
+{
+    uint8_t type;
+    if (key[0] == 'i' && key[1] == 'r')
+    {
+        type = NILAN_INPUT_REG;
+    }
+    else if (key[0] == 'h' && key[1] == 'r')
+    {
+        type = NILAN_HOLDING_REG;
+    }
+    else
+    {
+        return NILAN_REGID_COUNT;
+    }
+
+    char *end;
+    unsigned long addr = strtoul(key + 2, &end, 10);
+    if (end == key + 2 || *end != '\0' || addr > 0xFFFF)
+    {
+        return NILAN_REGID_COUNT;
+    }
+    return nilan_reg_find(type, (uint16_t)addr);
+}
+
+// Registers that were never read, or only restored from the last boot, are
+// left out rather than reported with a made-up value.
+static void write_registers(metrics_out_t *o)
+{
+    char labels[128];
+    char value[16];
+    nilan_reg_value_t v;
+
+    out_family(o, "nilan_register_value", "gauge", "Cached register value, temperatures in degrees C.");
+    for (size_t i = 0; i < NILAN_REGID_COUNT; ++i)
+    {
+        nilan_reg_id_t id = (nilan_reg_id_t)i;
+        if (!nilan_reg_read(id, &v) || nilan_reg_is_stale(id))
+        {
+            continue;
+        }
+        format_labels(id, labels, sizeof(labels));
+        format_value(id, v.raw, value, sizeof(value));
+        out_printf(o, "nilan_register_value{%s} %s\n", labels, value);
+    }
+
+    out_family(o, "nilan_register_age_seconds", "gauge", "Time since the value was last confirmed on the bus.");
+    uint32_t now = now_ms();
+    for (size_t i = 0; i < NILAN_REGID_COUNT; ++i)
+    {
+        nilan_reg_id_t id = (nilan_reg_id_t)i;
+        if (!nilan_reg_read(id, &v) || nilan_reg_is_stale(id))
+        {
+            continue;
+        }
+        uint32_t age = now - v.timestamp_ms;
+        format_labels(id, labels, sizeof(labels));
+        out_printf(o, "nilan_register_age_seconds{%s} %lu.%03lu\n", labels,
+                   (unsigned long)(age / 1000), (unsigned long)(age % 1000));
+    }
+}
+
+static void write_line_stats(metrics_out_t *o)
+{
+    nilan_mb_line_stats_t ls;
+    nilan_write_stats_t ws;
+    nilan_modbus_get_line_stats(&ls);
+    nilan_modbus_get_write_stats(&ws);
+
+    out_family(o, "nilan_modbus_online", "gauge", "1 while the CTS602 answers.");
+    out_printf(o, "nilan_modbus_online %d\n", nilan_modbus_is_online() ? 1 : 0);
+
+    out_family(o, "nilan_modbus_ok_total", "counter", "Successful poll transactions.");
+    out_printf(o, "nilan_modbus_ok_total %lu\n", (unsigned long)nilan_modbus_get_ok_count());
+
+    out_family(o, "nilan_modbus_fail_total", "counter", "Failed poll transactions.");
+    out_printf(o, "nilan_modbus_fail_total %lu\n", (unsigned long)nilan_modbus_get_fail_count());
+
+    float since_ok = nilan_modbus_get_secs_since_last_ok();
+    if (since_ok >= 0.0f)
+    {
+        out_family(o, "nilan_modbus_last_ok_age_seconds", "gauge", "Time since the last successful poll.");
+        out_printf(o, "nilan_modbus_last_ok_age_seconds %.1f\n", (double)since_ok);
+    }
+
+    out_family(o, "nilan_modbus_transactions_total", "counter", "Bus transactions by outcome.");
+    for (size_t e = 0; e < NILAN_MB_ERR_COUNT; ++e)
+    {
+        out_printf(o, "nilan_modbus_transactions_total{result=\"%s\"} %lu\n", err_names[e],
+                   (unsigned long)ls.by_err[e]);
+    }
+
+    out_family(o, "nilan_modbus_exceptions_total", "counter", "Exception replies by exception code.");
+    for (size_t c = 0; c < NILAN_MB_EXCEPTION_CODES; ++c)
+    {
+        if (c == 0)
+        {
+            out_printf(o, "nilan_modbus_exceptions_total{code=\"other\"} %lu\n", (unsigned long)ls.exception_codes[c]);
+        }
+        else
+        {
+            out_printf(o, "nilan_modbus_exceptions_total{code=\"%u\"} %lu\n", (unsigned)c,
+                       (unsigned long)ls.exception_codes[c]);
+        }
+    }
+
+    out_family(o, "nilan_modbus_line_events_total", "counter", "UART receive events.");
+    out_printf(o,
+               "nilan_modbus_line_events_total{event=\"parity\"} %lu\n"
+               "nilan_modbus_line_events_total{event=\"frame\"} %lu\n"
+               "nilan_modbus_line_events_total{event=\"break\"} %lu\n"
+               "nilan_modbus_line_events_total{event=\"fifo_overflow\"} %lu\n"
+               "nilan_modbus_line_events_total{event=\"buffer_full\"} %lu\n",
+               (unsigned long)ls.parity_errors, (unsigned long)ls.frame_errors, (unsigned long)ls.breaks,
+               (unsigned long)ls.fifo_overflows, (unsigned long)ls.buffer_full);
+
+    out_family(o, "nilan_modbus_writes_total", "counter", "Holding register write pipeline.");
+    out_printf(o,
+               "nilan_modbus_writes_total{stage=\"queued\"} %lu\n"
+               "nilan_modbus_writes_total{stage=\"coalesced\"} %lu\n"
+               "nilan_modbus_writes_total{stage=\"suppressed\"} %lu\n"
+               "nilan_modbus_writes_total{stage=\"frames\"} %lu\n"
+               "nilan_modbus_writes_total{stage=\"merged\"} %lu\n"
+               "nilan_modbus_writes_total{stage=\"verify_failed\"} %lu\n"
+               "nilan_modbus_writes_total{stage=\"failed\"} %lu\n",
+               (unsigned long)ws.queued, (unsigned long)ws.coalesced, (unsigned long)ws.suppressed,
+               (unsigned long)ws.frames, (unsigned long)ws.merged, (unsigned long)ws.verify_failed,
+               (unsigned long)ws.failed);
+
+    out_family(o, "nilan_modbus_bus_utilization_ratio", "gauge", "Share of the last 10 s spent in transactions.");
+    out_printf(o, "nilan_modbus_bus_utilization_ratio %.4f\n", (double)(nilan_modbus_get_bus_utilization() / 100.0f));
+}
+
+static void write_poll_groups(metrics_out_t *o)
+{
+    size_t count = nilan_modbus_get_poll_group_count();
+    nilan_poll_group_stats_t st;
+
+    out_family(o, "nilan_poll_group_achieved_seconds", "gauge", "Smoothed interval between reads of a poll group.");
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (nilan_modbus_get_poll_group_stats(i, &st) && st.achieved_ms != 0)
+        {
+            out_printf(o, "nilan_poll_group_achieved_seconds{type=\"%s\",start=\"%u\",qty=\"%u\"} %lu.%03lu\n",
+                       st.reg_type == NILAN_INPUT_REG ? "input" : "holding", (unsigned)st.start_addr,
+                       (unsigned)st.qty, (unsigned long)(st.achieved_ms / 1000),
+                       (unsigned long)(st.achieved_ms % 1000));
+        }
+    }
+
+    out_family(o, "nilan_poll_group_target_seconds", "gauge", "Declared refresh period of a poll group.");
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (nilan_modbus_get_poll_group_stats(i, &st))
+        {
+            out_printf(o, "nilan_poll_group_target_seconds{type=\"%s\",start=\"%u\",qty=\"%u\"} %lu.%03lu\n",
+                       st.reg_type == NILAN_INPUT_REG ? "input" : "holding", (unsigned)st.start_addr,
+                       (unsigned)st.qty, (unsigned long)(st.target_ms / 1000), (unsigned long)(st.target_ms % 1000));
+        }
+    }
+
+    out_family(o, "nilan_poll_group_deadline_misses_total", "counter", "Refreshes later than the target period.");
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (nilan_modbus_get_poll_group_stats(i, &st))
+        {
+            out_printf(o, "nilan_poll_group_deadline_misses_total{type=\"%s\",start=\"%u\",qty=\"%u\"} %lu\n",
+                       st.reg_type == NILAN_INPUT_REG ? "input" : "holding", (unsigned)st.start_addr,
+                       (unsigned)st.qty, (unsigned long)st.deadline_misses);
+        }
+    }
+}
+
+// One histogram per function code and phase; phases a function code never
+// went through (polls don't queue) are left out.
+static void write_histograms(metrics_out_t *o)
+{
+    nilan_mb_hist_t h;
+
+    out_family(o, "nilan_modbus_phase_seconds", "histogram", "Transaction phase durations by function code.");
+    for (size_t f = 0; f < sizeof(hist_funcs); ++f)
+    {
+        for (size_t p = 0; p < NILAN_MB_PHASE_COUNT; ++p)
+        {
+            if (!nilan_modbus_get_fc_histogram(hist_funcs[f], (nilan_mb_phase_t)p, &h))
+            {
+                continue;
+            }
+
+            uint32_t cum = 0;
+            for (size_t b = 0; b < NILAN_MB_HIST_BUCKETS; ++b)
+            {
+                cum += h.count[b];
+            }
+            if (cum == 0)
+            {
+                continue;
+            }
+
+            cum = 0;
+            for (size_t b = 0; b < NILAN_MB_HIST_BUCKETS; ++b)
+            {
+                cum += h.count[b];
+                out_printf(o, "nilan_modbus_phase_seconds_bucket{fc=\"%u\",phase=\"%s\",le=\"%s\"} %lu\n",
+                           (unsigned)hist_funcs[f], phase_names[p], hist_le[b], (unsigned long)cum);
+            }
+            out_printf(o,
+                       "nilan_modbus_phase_seconds_sum{fc=\"%u\",phase=\"%s\"} %llu.%06llu\n"
+                       "nilan_modbus_phase_seconds_count{fc=\"%u\",phase=\"%s\"} %lu\n",
+                       (unsigned)hist_funcs[f], phase_names[p], (unsigned long long)(h.sum_us / 1000000),
+                       (unsigned long long)(h.sum_us % 1000000), (unsigned)hist_funcs[f], phase_names[p],
+                       (unsigned long)cum);
+        }
+    }
+}
+
+static void out_family(metrics_out_t *o, const char *name, const char *type, const char *help)
+{
+    out_printf(o, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Append to the chunk buffer, sending it first if the text doesn't fit.
+static void out_printf(metrics_out_t *o, const char *fmt, ...)
+{
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        size_t room = sizeof(o->buf) - o->len;
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(o->buf + o->len, room, fmt, ap);
+        va_end(ap);
+
+        if (n >= 0 && (size_t)n < room)
+        {
+            o->len += (size_t)n;
+            return;
+        }
+        out_flush(o);
+    }
+    // Longer than a whole chunk: can't happen with the formats above.
+}
+
+static void out_flush(metrics_out_t *o)
+{
+    if (o->len > 0 && o->err == ESP_OK)
+    {
+        o->err = httpd_resp_send_chunk(o->req, o->buf, (ssize_t)o->len);
+    }
+    o->len = 0;
+}
+
+// Integer formatting only: %f on every register would cost more than the rest of the scrape.
+static void format_value(nilan_reg_id_t id, uint16_t raw, char *out, size_t cap)
+{
+    switch (nilan_registers[id].data_type)
+    {
+    case NILAN_DTYPE_TEMP_Cx100:
+    {
+        int32_t v = (int16_t)raw;
+        uint32_t a = (uint32_t)(v < 0 ? -v : v);
+        snprintf(out, cap, "%s%lu.%02lu", v < 0 ? "-" : "", (unsigned long)(a / 100), (unsigned long)(a % 100));
+        break;
+    }
+    case NILAN_DTYPE_INT16:
+        snprintf(out, cap, "%d", (int)(int16_t)raw);
+        break;
+    default:
+        snprintf(out, cap, "%u", (unsigned)raw);
+        break;
+    }
+}
+
+// name="...",type="input",addr="202" with the name escaped for a label value.
+static void format_labels(nilan_reg_id_t id, char *out, size_t cap)
+{
+    const nilan_reg_meta_t *m = &nilan_registers[id];
+    const char *name = (m->name != NULL) ? m->name : "";
+    size_t n = 0;
+
+    n += (size_t)snprintf(out, cap, "name=\"");
+    for (const char *c = name; *c != '\0' && n + 3 < cap; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            out[n++] = '\\';
+            out[n++] = *c;
+        }
+        else if (*c == '\n')
+        {
+            out[n++] = '\\';
+            out[n++] = 'n';
+        }
+        else
+        {
+            out[n++] = *c;
+        }
+    }
+    snprintf(out + n, cap - n, "\",type=\"%s\",addr=\"%u\"", m->reg_type == NILAN_INPUT_REG ? "input" : "holding",
+             (unsigned)m->addr);
+}
+
+static inline uint32_t now_ms(void)
+{
+    // Same clock as the register store's timestamps.
+    return (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+static void write_telemetry(metrics_out_t *o)
+{
+    nilan_telemetry_stats_t ts;
+    nilan_telemetry_get_stats(&ts);
+
+    out_family(o, "nilan_telemetry_batches_total", "counter", "Uploader batches by outcome.");
+    out_printf(o,
+               "nilan_telemetry_batches_total{result=\"posted\"} %lu\n"
+               "nilan_telemetry_batches_total{result=\"drained\"} %lu\n"
+               "nilan_telemetry_batches_total{result=\"spooled\"} %lu\n"
+               "nilan_telemetry_batches_total{result=\"rejected\"} %lu\n"
+               "nilan_telemetry_batches_total{result=\"dropped\"} %lu\n",
+               (unsigned long)ts.posted_batches, (unsigned long)ts.drained_batches, (unsigned long)ts.spooled_batches,
+               (unsigned long)ts.rejected_batches, (unsigned long)ts.dropped_batches);
+
+    out_family(o, "nilan_telemetry_post_failures_total", "counter", "Posts that failed and will be retried.");
+    out_printf(o, "nilan_telemetry_post_failures_total %lu\n", (unsigned long)ts.post_failures);
+
+    out_family(o, "nilan_telemetry_backlog_batches", "gauge", "Batches waiting in the flash spool.");
+    out_printf(o, "nilan_telemetry_backlog_batches %lu\n", (unsigned long)ts.backlog_batches);
+
+    out_family(o, "nilan_telemetry_backlog_bytes", "gauge", "Line protocol bytes waiting in the flash spool.");
+    out_printf(o, "nilan_telemetry_backlog_bytes %lu\n", (unsigned long)ts.backlog_bytes);
+}
+
+static void write_wifi(metrics_out_t *o)
+{
+    wifi_sta_stats_t ws;
+    wifi_sta_get_stats(&ws);
+
+    out_family(o, "nilan_wifi_connected", "gauge", "1 while the station has an IP.");
+    out_printf(o, "nilan_wifi_connected %d\n", ws.state == WIFI_STA_STATE_CONNECTED ? 1 : 0);
+
+    if (ws.rssi != 0)
+    {
+        out_family(o, "nilan_wifi_rssi_dbm", "gauge", "Signal strength of the associated AP.");
+        out_printf(o, "nilan_wifi_rssi_dbm %d\n", (int)ws.rssi);
+    }
+
+    out_family(o, "nilan_wifi_disconnects_total", "counter", "Links lost since boot.");
+    out_printf(o, "nilan_wifi_disconnects_total %lu\n", (unsigned long)ws.disconnects);
+
+    out_family(o, "nilan_wifi_reconnects_total", "counter", "Links re-established since boot.");
+    out_printf(o, "nilan_wifi_reconnects_total %lu\n", (unsigned long)ws.reconnects);
+
+    out_family(o, "nilan_wifi_time_to_ip_seconds", "gauge", "First connect attempt to DHCP lease.");
+    out_printf(o,
+               "nilan_wifi_time_to_ip_seconds{which=\"last\"} %lu.%03lu\n"
+               "nilan_wifi_time_to_ip_seconds{which=\"max\"} %lu.%03lu\n",
+               (unsigned long)(ws.last_time_to_ip_ms / 1000), (unsigned long)(ws.last_time_to_ip_ms % 1000),
+               (unsigned long)(ws.max_time_to_ip_ms / 1000), (unsigned long)(ws.max_time_to_ip_ms % 1000));
+
+    out_family(o, "nilan_wifi_up_seconds", "gauge", "Age of the current link; 0 while down.");
+    out_printf(o, "nilan_wifi_up_seconds %lu\n", (unsigned long)(ws.up_ms / 1000));
+}
+
+static void write_time(metrics_out_t *o)
+{
+    sys_time_stats_t ts;
+    sys_time_get_stats(&ts);
+
+    out_family(o, "nilan_time_source", "gauge", "0 = no time, 1 = RTC since boot, 2 = synced to SNTP.");
+    out_printf(o, "nilan_time_source %d\n", (int)ts.source);
+
+    out_family(o, "nilan_time_syncs_total", "counter", "SNTP syncs since boot.");
+    out_printf(o, "nilan_time_syncs_total %lu\n", (unsigned long)ts.syncs);
+
+    if (ts.syncs > 0)
+    {
+        out_family(o, "nilan_time_offset_ms", "gauge", "Server time minus the local clock at the last sync.");
+        out_printf(o, "nilan_time_offset_ms %ld\n", (long)ts.last_offset_ms);
+
+        out_family(o, "nilan_time_rate_ppb", "gauge", "Learned rate correction of the local clock.");
+        out_printf(o, "nilan_time_rate_ppb %ld\n", (long)ts.rate_ppb);
+
+        out_family(o, "nilan_time_sync_age_seconds", "gauge", "Time since the last SNTP sync.");
+        out_printf(o, "nilan_time_sync_age_seconds %lu\n", (unsigned long)ts.last_sync_age_s);
+    }
+
+    out_family(o, "nilan_time_rtc_writes_total", "counter", "RTC write-backs since boot.");
+    out_printf(o, "nilan_time_rtc_writes_total %lu\n", (unsigned long)ts.rtc_writes);
+
+    out_family(o, "nilan_time_cts602_drift_seconds", "gauge", "CTS602 clock minus ours at the last check.");
+    out_printf(o, "nilan_time_cts602_drift_seconds %ld\n", (long)ts.nilan_drift_s);
+
+    out_family(o, "nilan_time_cts602_writes_total", "counter", "CTS602 clock corrections since boot.");
+    out_printf(o, "nilan_time_cts602_writes_total %lu\n", (unsigned long)ts.nilan_writes);
+}
+
+static void write_diag(metrics_out_t *o)
+{
+    static sys_diag_snapshot_t d; // httpd task only; too big for its stack next to the chunk
+    if (!sys_diag_get(&d))
+    {
+        return;
+    }
+
+    out_family(o, "nilan_sys_core_load_ratio", "gauge", "CPU share per core over the last diagnostics period.");
+    for (size_t c = 0; c < SYS_DIAG_CORES; ++c)
+    {
+        out_printf(o, "nilan_sys_core_load_ratio{core=\"%u\"} %u.%03u\n", (unsigned)c,
+                   (unsigned)(d.core_load_permille[c] / 1000), (unsigned)(d.core_load_permille[c] % 1000));
+    }
+
+    out_family(o, "nilan_sys_task_cpu_ratio", "gauge", "Share of one core per task, busiest first.");
+    for (size_t i = 0; i < d.task_count; ++i)
+    {
+        const sys_diag_task_t *t = &d.tasks[i];
+        out_printf(o, "nilan_sys_task_cpu_ratio{task=\"%s\"} %u.%03u\n", t->name,
+                   (unsigned)(t->cpu_permille / 1000), (unsigned)(t->cpu_permille % 1000));
+    }
+    out_printf(o, "nilan_sys_task_cpu_ratio{task=\"other\"} %u.%03u\n",
+               (unsigned)(d.other_permille / 1000), (unsigned)(d.other_permille % 1000));
+
+    out_family(o, "nilan_sys_task_stack_free_bytes", "gauge", "Stack never touched since the task started.");
+    for (size_t i = 0; i < d.task_count; ++i)
+    {
+        out_printf(o, "nilan_sys_task_stack_free_bytes{task=\"%s\"} %lu\n", d.tasks[i].name,
+                   (unsigned long)d.tasks[i].stack_free);
+    }
+
+    out_family(o, "nilan_sys_tasks", "gauge", "Tasks in the system.");
+    out_printf(o, "nilan_sys_tasks %u\n", (unsigned)d.task_total);
+
+    const struct
+    {
+        const char *caps;
+        const sys_diag_heap_t *h;
+    } heaps[] = {{"internal", &d.heap_internal}, {"dma", &d.heap_dma}};
+
+    out_family(o, "nilan_sys_heap_free_bytes", "gauge", "Free heap per capability.");
+    for (size_t i = 0; i < sizeof(heaps) / sizeof(heaps[0]); ++i)
+    {
+        out_printf(o, "nilan_sys_heap_free_bytes{caps=\"%s\"} %lu\n", heaps[i].caps, (unsigned long)heaps[i].h->free);
+    }
+    out_family(o, "nilan_sys_heap_min_free_bytes", "gauge", "Lowest free heap since boot.");
+    for (size_t i = 0; i < sizeof(heaps) / sizeof(heaps[0]); ++i)
+    {
+        out_printf(o, "nilan_sys_heap_min_free_bytes{caps=\"%s\"} %lu\n", heaps[i].caps,
+                   (unsigned long)heaps[i].h->min_free);
+    }
+    out_family(o, "nilan_sys_heap_largest_block_bytes", "gauge", "Largest free block per capability.");
+    for (size_t i = 0; i < sizeof(heaps) / sizeof(heaps[0]); ++i)
+    {
+        out_printf(o, "nilan_sys_heap_largest_block_bytes{caps=\"%s\"} %lu\n", heaps[i].caps,
+                   (unsigned long)heaps[i].h->largest_block);
+    }
+
+    if (d.lvgl_total != 0)
+    {
+        out_family(o, "nilan_sys_lvgl_pool_bytes", "gauge", "LVGL memory pool.");
+        out_printf(o,
+                   "nilan_sys_lvgl_pool_bytes{which=\"total\"} %lu\n"
+                   "nilan_sys_lvgl_pool_bytes{which=\"free\"} %lu\n",
+                   (unsigned long)d.lvgl_total, (unsigned long)d.lvgl_free);
+
+        out_family(o, "nilan_sys_lvgl_pool_frag_ratio", "gauge", "Fragmentation of the LVGL pool.");
+        out_printf(o, "nilan_sys_lvgl_pool_frag_ratio %u.%02u\n", (unsigned)(d.lvgl_frag_pct / 100),
+                   (unsigned)(d.lvgl_frag_pct % 100));
+    }
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * GET /metrics in the Prometheus text format, and GET /log.
+ *
+ * Every register in nilan_registers[] that has been read on the bus, scaled
+ * (centi-°C to °C, signed types sign-extended), with its age; then the Modbus
+ * counters: transaction outcomes, exceptions, UART line events, write
+ * pipeline, poll group freshness and the per function code phase histograms;
+ * then the latest sys_diag sample: CPU per core and task, stack high-water
+ * marks, heap per capability and the LVGL pool.
+ *
+ * Everything comes from the register store and the statistics counters, so a
+ * scrape never puts a frame on the bus. The body is streamed as chunks of a
+ * small stack buffer; there is no page-sized buffer anywhere.
+ *
+ * GET /log exports the long-term log (nilan_logstore.h) as CSV lines of
+ * "t,reg,value": UTC seconds, the register key as in /registers ("ir202"),
+ * and the value scaled like above. Query parameters, all optional: reg= one
+ * register, from= and to= UTC seconds (default: the last 24 hours logged).
+ * Records still in the log's open page aren't included.
+ */
+
+esp_err_t nilan_metrics_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
@@ -3,64 +3,117 @@
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "freertos/task.h"
 
 #include "esp_err.h"
 #include "esp_log.h"
-#include "esp_timer.h"
-
-#include "driver/gpio.h"
-#include "driver/uart.h"
 
 #include "CRC16.h"
+#include "nilan_rtu.h"
+#include "nilan_transport.h"
 
 #include "NilanRegisters.h"
+#include "boot_graph.h"
+#include "nilan_history.h"
+#include "nilan_mb_stats.h"
+#include "nilan_notify.h"
+#include "nilan_poll_plan.h"
 
 // static const char *TAG = "nilan_modbus";
 
-// ---------------- UART / Modbus configuration ----------------
-//
-// Using Core2 Port A with the RS485 module:
-//
-//   GPIO32 -> Unit RX (Core2 TX)
-//   GPIO33 -> Unit TX (Core2 RX)
-//
-// Arduino sketch used:
-//   Serial2.begin(19200, SERIAL_8E1, RS485_RX_PIN, RS485_TX_PIN);
-//   RS485_RX_PIN = 33, RS485_TX_PIN = 32
-//
-// So here:
-//   TX = GPIO32, RX = GPIO33 on UART1
-//
-#define NILAN_UART_PORT UART_NUM_1
-#define NILAN_UART_TX_GPIO GPIO_NUM_32
-#define NILAN_UART_RX_GPIO GPIO_NUM_33
-#define NILAN_UART_BAUDRATE 19200
-#define NILAN_UART_BUF_SIZE 256
+// Baud rate and frame timing live in nilan_rtu.c, UART pins in nilan_transport_esp32.c.
 
 // Nilan defaults
 #define NILAN_SLAVE_ADDR 30 // CTS 602 default Modbus address
 
-// Background poll: tank top/bottom (input registers 211 / 212)
-#define NILAN_REG_TANK_TOP 211
-#define NILAN_POLL_INTERVAL_MS 3000    // Poll interval in ms
 #define NILAN_OFFLINE_TIMEOUT_MS 10000 // 10 s without OK => OFFLINE
 
+// Poll scheduler.
+// A group becomes eligible once 3/4 of its period has passed, so it can be
+// refreshed before its deadline (last OK + period) rather than after it.
+#define NILAN_SCHED_RELEASE_NUM 3
+#define NILAN_SCHED_RELEASE_DEN 4
+#define NILAN_BUS_GAP_MS 10            // Minimum idle time between two transactions
+#define NILAN_RETRY_BACKOFF_MS 500     // Don't retry a failed group sooner than this
+#define NILAN_SCHED_IDLE_MAX_MS 1000   // Longest nap when nothing is eligible
+
+// Largest read that fits one RTU frame: 5 + 2*125 bytes (Modbus limit).
+#define NILAN_MAX_READ_QTY 125
+
+// Largest FC16 write: 9 + 2*123 bytes (Modbus limit).
+#define NILAN_MAX_WRITE_QTY 123
+
+// Submitted requests waiting for the bus, per priority.
+#define NILAN_MB_QUEUE_LEN 8
+
+// Write pipeline.
+// A write sits in its slot until its value has been left alone for the settle
+// time, so a burst of +/- taps ends up as one frame carrying the final value.
+#define NILAN_WRITE_SLOTS 16
+#define NILAN_WRITE_SETTLE_MS 300
+#define NILAN_WRITE_MAX_RETRIES 3 // transport errors only; an exception is final
+
+_Static_assert(NILAN_WRITE_BLOCK_MAX <= NILAN_WRITE_SLOTS, "a block must fit the write slots");
+
 // ====================================================
 // TYPEDEFS
 // ====================================================
 
+// Refresh target for a poll class (see nilan_poll_class_t in NilanRegisters.h).
+typedef struct
+{
+    uint32_t period_ms;         // target freshness: data should never be older than this
+    nilan_poll_prio_t priority; // who goes first when the bus can't keep up
+} nilan_poll_class_cfg_t;
+
+// Scheduler bookkeeping, one per poll block.
+typedef struct
+{
+    uint32_t last_ok_ms;      // 0 = never read
+    uint32_t last_try_ms;     // last attempt, OK or not
+    uint32_t achieved_ms;     // smoothed interval between successful reads
+    uint32_t worst_age_ms;    // oldest the data got before a refresh
+    uint32_t deadline_misses; // refreshes that came after the period ran out
+} nilan_poll_sched_t;
+
+// One pending holding-register write. A newer value for a register that is
+// still waiting overwrites the old one in place.
 typedef struct
 {
-    uint8_t reg_type;    // 3 = holding, 4 = input (your reg_type)
-    uint16_t start_addr; // Modbus start address for this block
-    uint16_t qty;        // number of registers read in one shot
+    uint16_t addr;
+    uint16_t value;
+    uint32_t changed_ms; // when value was last set
+    uint8_t retries;
+    bool pending;
+    bool block; // part of nilan_modbus_write_holding_block()
+} nilan_write_slot_t;
+
+// A write taken out of the slot table by the bus task.
+typedef struct
+{
+    uint16_t addr;
+    uint16_t value;
+    uint8_t retries;
+    bool block;
+} nilan_write_item_t;
+
+// What actually sits in the request queues: the request plus when it was
+// submitted, so the time spent waiting for the bus can be measured.
+typedef struct
+{
+    nilan_mb_request_t req;
+    int64_t queued_us;
+} nilan_mb_queued_t;
 
-    // Filled at boot:
-    uint8_t id_count; // how many nilan_reg_id in this group
-    uint8_t *id_list; // dynamically allocated [id_count] entries
-} nilan_poll_group_t;
+// State shared between nilan_read_regs() and its completion callback.
+typedef struct
+{
+    TaskHandle_t waiter;
+    uint16_t *regs;
+    nilan_mb_err_t err;
+    volatile bool done;
+} nilan_blocking_call_t;
 
 // ====================================================
 // VARIABLES
@@ -79,43 +132,50 @@ static nilan_mb_err_t last_err = NILAN_MB_ERR_NONE;
 static volatile uint32_t nilan_fault_bitmap = 0;
 
 static bool modbus_started = false;
-static TaskHandle_t poll_task = NULL;
-
-// UART mutex to serialize all Modbus transactions
-static SemaphoreHandle_t uart_mutex = NULL;
-
-// Set up array of poll-group structs. We'll fill 'em out dynamically at runtime.
-static nilan_poll_group_t poll_groups[] = {
-    // Input ranges
-    {NILAN_INPUT_REG, 100, 16, 0, NULL}, // Discrete I/O - on/off's
-    {NILAN_INPUT_REG, 200, 23, 0, NULL}, // Analog I/O - temperatures.
-    {NILAN_INPUT_REG, 400, 10, 0, NULL}, // Alarms
-    {NILAN_INPUT_REG, 1000, 4, 0, NULL}, // System control/state
-    {NILAN_INPUT_REG, 1100, 5, 0, NULL}, // Airflow - fan steps, filters.
-    {NILAN_INPUT_REG, 1200, 7, 0, NULL}, // Air Temperatures
-
-    // Holding ranges
-    {NILAN_HOLDING_REG, 100, 28, 0, NULL},
-    {NILAN_HOLDING_REG, 200, 6, 0, NULL},
-    {NILAN_HOLDING_REG, 300, 6, 0, NULL},   // Time/Clock
-    {NILAN_HOLDING_REG, 600, 6, 0, NULL},   // User function (1)
-    {NILAN_HOLDING_REG, 610, 6, 0, NULL},   // User function (2)
-    {NILAN_HOLDING_REG, 1000, 7, 0, NULL},
-    {NILAN_HOLDING_REG, 1100, 5, 0, NULL},
-    {NILAN_HOLDING_REG, 1200, 8, 0, NULL},
-    {NILAN_HOLDING_REG, 1700, 2, 0, NULL}, // Tank temperature setpoints
-    {NILAN_HOLDING_REG, 1910, 4, 0, NULL}, // Air quality
-};
 
-static const size_t POLL_GROUP_COUNT = sizeof(poll_groups) / sizeof(poll_groups[0]);
+// The bus task is the only code that touches the UART. Everyone else goes
+// through these queues; the bus task serves urgent before normal before polling.
+static TaskHandle_t bus_task = NULL;
+static QueueHandle_t urgent_queue = NULL;
+static QueueHandle_t normal_queue = NULL;
+
+// The blocks themselves (which registers go on the wire in one read, and which
+// known registers sit inside each) are generated into flash from the register
+// table at build time - see nilan_poll_plan.h and tools/gen_nilan_tables.py.
+static const nilan_poll_class_cfg_t poll_classes[NILAN_POLL_CLASS_COUNT] = {
+    [NILAN_POLL_NORMAL] = {NILAN_POLL_NORMAL_MS, NILAN_POLL_PRIO_NORMAL},
+    [NILAN_POLL_FAST] = {NILAN_POLL_FAST_MS, NILAN_POLL_PRIO_HIGH},
+    [NILAN_POLL_SLOW] = {NILAN_POLL_SLOW_MS, NILAN_POLL_PRIO_LOW},
+    [NILAN_POLL_STATIC] = {NILAN_POLL_STATIC_MS, NILAN_POLL_PRIO_LOW},
+};
 
+static nilan_poll_sched_t poll_sched[NILAN_POLL_BLOCK_COUNT];
 
+// Pending writes. Filled from any task, drained by the bus task.
+static nilan_write_slot_t write_slots[NILAN_WRITE_SLOTS];
+static portMUX_TYPE write_lock = portMUX_INITIALIZER_UNLOCKED;
+static nilan_write_stats_t write_stats;
 
 // ====================================================
 // PROTOTYPES
 // ====================================================
 static inline uint32_t get_time_ms();
-static void init_poll_groups();
+static void run_request(const nilan_mb_queued_t *item, uint16_t *regs);
+static nilan_mb_err_t poll_block(size_t block_index, uint16_t *regs);
+static bool run_writes(uint32_t now_ms, uint16_t *regs, uint32_t *wait_ms);
+static size_t take_due_writes(uint32_t now_ms, nilan_write_item_t *items, uint32_t *wait_ms);
+static bool write_matches_shadow(const nilan_write_item_t *item);
+static void write_requeue(const nilan_write_item_t *item);
+static nilan_mb_err_t write_readback(uint16_t start, uint16_t qty, uint16_t *regs);
+static void blocking_done_cb(const nilan_mb_request_t *req, nilan_mb_err_t err, const uint16_t *regs);
+static int sched_pick_block(uint32_t now_ms, uint32_t *sleep_ms);
+static void sched_mark_result(size_t block_index, bool ok, uint32_t now_ms);
+static nilan_mb_err_t read_regs(uint8_t func, uint16_t start, uint16_t qty, uint16_t *regs);
+static nilan_mb_err_t decode_read_response(uint8_t func, uint16_t qty,
+                                           const uint8_t *rx, size_t rx_len,
+                                           uint16_t *regs);
+static nilan_mb_err_t write_regs(uint16_t start, uint16_t qty, const uint16_t *values);
+static nilan_mb_err_t decode_write_response(const uint8_t *tx, const uint8_t *rx, size_t rx_len);
 
 // ====================================================
 // IMPLEMENTATIONS
@@ -123,117 +183,266 @@ static void init_poll_groups();
 
 bool nilan_read_regs(uint8_t reg_type, uint16_t start, uint16_t qty, uint16_t *regs)
 {
-    bool crc_ok = false;
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (self == bus_task)
+    {
+        return false; // would wait on ourselves forever
+    }
 
-    // Build request: [addr][func][start_hi][start_lo][qty_hi][qty_lo][crc_lo][crc_hi]
-    const size_t TX_BYTE_COUNT = 8;
+    nilan_blocking_call_t call = {
+        .waiter = self,
+        .regs = regs,
+        .err = NILAN_MB_ERR_INTERNAL,
+        .done = false,
+    };
 
-    uint8_t tx[TX_BYTE_COUNT];
-    tx[0] = (uint8_t)NILAN_SLAVE_ADDR; // 0x30
-    tx[1] = reg_type;
-    tx[2] = (uint8_t)(start >> 8);
-    tx[3] = (uint8_t)(start & 0xFF);
-    tx[4] = (uint8_t)(qty >> 8);
-    tx[5] = (uint8_t)(qty & 0xFF);
+    nilan_mb_request_t req = {
+        .func = reg_type,
+        .start = start,
+        .qty = qty,
+        .done = blocking_done_cb,
+        .user = &call,
+    };
 
-    uint16_t crc = modbus_crc16(tx, 6);
-    tx[6] = (uint8_t)(crc & 0xFF);        // CRC low
-    tx[7] = (uint8_t)((crc >> 8) & 0xFF); // CRC high
+    if (!nilan_modbus_submit(&req, NILAN_MB_PRIO_NORMAL))
+    {
+        return false;
+    }
 
-    // Expected normal response length:  [addr][func][byte_count][data...][crc_lo][crc_hi]
-    const uint32_t EXPECTED_RESPONSE_LENGTH = 5 + (qty * 2); // addr + func + count + crc = 5 bytes. Each register is 16 bit, hence the *2
-    int response_length = 0;
+    // The bus task completes every request it accepts, and 'call' lives on our
+    // stack, so we can't give up early. The loop ignores stray notifications.
+    while (!call.done)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
 
-    uint8_t rx[NILAN_UART_BUF_SIZE];
+    return (call.err == NILAN_MB_ERR_NONE);
+}
 
-    if (xSemaphoreTake(uart_mutex, pdMS_TO_TICKS(1000)) == pdTRUE)
+bool nilan_modbus_submit(const nilan_mb_request_t *req, nilan_mb_prio_t prio)
+{
+    if (!modbus_started || req == NULL)
     {
-        // Clear any stale data and send request
-        // uart_flush_input(NILAN_UART_PORT);
+        return false;
+    }
 
-        // Send data.
-        uart_write_bytes(NILAN_UART_PORT, (const char *)tx, TX_BYTE_COUNT);
+    if ((req->func != 0x03 && req->func != 0x04) || req->qty == 0 || req->qty > NILAN_MAX_READ_QTY)
+    {
+        return false;
+    }
 
-        response_length = uart_read_bytes(NILAN_UART_PORT, rx, EXPECTED_RESPONSE_LENGTH, pdMS_TO_TICKS(500)); // 500 ms timeout
+    nilan_mb_queued_t item = {
+        .req = *req,
+        .queued_us = nilan_transport_now_us(),
+    };
 
-        xSemaphoreGive(uart_mutex);
+    QueueHandle_t q = (prio == NILAN_MB_PRIO_URGENT) ? urgent_queue : normal_queue;
+    if (xQueueSend(q, &item, 0) != pdTRUE)
+    {
+        return false;
     }
 
-    if (response_length == EXPECTED_RESPONSE_LENGTH)
+    // Cut the bus task's nap short if it's waiting for the next poll.
+    xTaskNotifyGive(bus_task);
+    return true;
+}
+
+bool nilan_modbus_write_single_holding(uint16_t reg, uint16_t value)
+{
+    if (!modbus_started)
     {
-        // Verify CRC on full frame minus last 2 bytes
-        uint16_t rx_crc = (uint16_t)rx[response_length - 2] | ((uint16_t)rx[response_length - 1] << 8);
-        uint16_t calc_crc = modbus_crc16(rx, (uint16_t)(response_length - 2));
+        return false;
+    }
 
-        crc_ok = (rx_crc == calc_crc);
-        if (crc_ok)
+    uint32_t now_ms = get_time_ms();
+    nilan_write_slot_t *slot = NULL;
+    bool coalesced = false;
+
+    taskENTER_CRITICAL(&write_lock);
+
+    for (size_t i = 0; i < NILAN_WRITE_SLOTS; ++i)
+    {
+        if (write_slots[i].pending && write_slots[i].addr == reg)
+        {
+            slot = &write_slots[i];
+            coalesced = true;
+            break;
+        }
+        if (slot == NULL && !write_slots[i].pending)
+        {
+            slot = &write_slots[i];
+        }
+    }
+
+    if (slot != NULL)
+    {
+        slot->addr = reg;
+        slot->value = value;
+        slot->changed_ms = now_ms;
+        slot->retries = 0;
+        slot->pending = true;
+        slot->block = false;
+
+        write_stats.queued++;
+        if (coalesced)
         {
-            // Extract registers
-            for (uint16_t i = 0; i < qty; ++i)
+            write_stats.coalesced++;
+        }
+    }
+
+    taskEXIT_CRITICAL(&write_lock);
+
+    if (slot == NULL)
+    {
+        return false; // every slot busy with a different register
+    }
+
+    xTaskNotifyGive(bus_task);
+    return true;
+}
+
+bool nilan_modbus_write_holding_block(uint16_t start, uint16_t qty, const uint16_t *values)
+{
+    if (!modbus_started || qty == 0 || qty > NILAN_WRITE_BLOCK_MAX || values == NULL)
+    {
+        return false;
+    }
+
+    uint32_t now_ms = get_time_ms();
+    nilan_write_slot_t *slots[NILAN_WRITE_SLOTS];
+    size_t found = 0;
+    size_t coalesced = 0;
+
+    taskENTER_CRITICAL(&write_lock);
+
+    // A slot for every register, or nothing is queued at all.
+    for (uint16_t n = 0; n < qty; ++n)
+    {
+        uint16_t reg = (uint16_t)(start + n);
+        nilan_write_slot_t *slot = NULL;
+
+        for (size_t i = 0; i < NILAN_WRITE_SLOTS; ++i)
+        {
+            if (write_slots[i].pending && write_slots[i].addr == reg)
+            {
+                slot = &write_slots[i];
+                coalesced++;
+                break;
+            }
+        }
+        for (size_t i = 0; slot == NULL && i < NILAN_WRITE_SLOTS; ++i)
+        {
+            bool taken = write_slots[i].pending;
+            for (size_t k = 0; k < found && !taken; ++k)
             {
-                uint16_t hi = rx[3 + (i * 2)];
-                uint16_t lo = rx[4 + (i * 2)];
-                regs[i] = (uint16_t)((hi << 8) | lo);
+                taken = (slots[k] == &write_slots[i]);
+            }
+            if (!taken)
+            {
+                slot = &write_slots[i];
             }
         }
+        if (slot == NULL)
+        {
+            break;
+        }
+        slots[found++] = slot;
+    }
+
+    if (found == qty)
+    {
+        // Same settle time for all, so they are taken, and sent, together.
+        for (uint16_t n = 0; n < qty; ++n)
+        {
+            slots[n]->addr = (uint16_t)(start + n);
+            slots[n]->value = values[n];
+            slots[n]->changed_ms = now_ms;
+            slots[n]->retries = 0;
+            slots[n]->pending = true;
+            slots[n]->block = true;
+        }
+        write_stats.queued += qty;
+        write_stats.coalesced += (uint32_t)coalesced;
     }
 
-    return crc_ok;
+    taskEXIT_CRITICAL(&write_lock);
+
+    if (found < qty)
+    {
+        return false;
+    }
+
+    xTaskNotifyGive(bus_task);
+    return true;
 }
 
-// ---------------- Polling task ----------------
+// ---------------- Bus task ----------------
 
-static void nilan_poll_task(void *arg)
+static void nilan_bus_task(void *arg)
 {
     (void)arg; // Silence the unused parameter warning.
 
-    uint16_t regs_data[36];  // [addr][func][byte_count][data...][crc_lo][crc_hi] - arbitrarily large(36) to hold enough registers.
-    size_t group_index = 0;
+    uint16_t regs_data[NILAN_MAX_READ_QTY]; // fits any submitted read and every poll block
+    bool poll_turn = false;                 // a normal request just ran: a due block goes next
 
     while (1)
     {
-        nilan_poll_group_t *grp = &poll_groups[group_index];    // pointer to the (next) poll group.
+        nilan_mb_queued_t item;
 
-        // Read all registers in group, and place their raw value in the regs array.
-        bool crc_ok = nilan_read_regs(grp->reg_type, grp->start_addr, grp->qty, regs_data);  // Read all consecutive registers in group range.
+        uint32_t write_wait_ms = NILAN_SCHED_IDLE_MAX_MS;
 
-        if (crc_ok)
+        // Urgent reads and settled writes always go ahead of background polling.
+        // Normal reads take turns with due poll blocks, so a steady stream of
+        // them (the Modbus TCP gateway) can slow polling down but never stall it.
+        if (xQueueReceive(urgent_queue, &item, 0) == pdTRUE)
         {
-            uint32_t now_ms = get_time_ms();
-
-            // iterate through each known ID in group, and update its state.
-            for (uint8_t i = 0; i < grp->id_count; i++)
-            {
-                uint8_t index = grp->id_list[i];
-                const nilan_reg_meta_t *register_meta = &nilan_registers[index];
-
-                // Calculate offset to index into the regs_data array.
-                uint16_t offset = (uint16_t)(register_meta->addr - grp->start_addr);
-
-                // Update the state array struct for this register.
-                nilan_reg_state[index].raw = regs_data[offset];
-                nilan_reg_state[index].timestamp_ms = now_ms;
-                nilan_reg_state[index].valid = 1;
-            }
-
-            ok_count++;
-            last_ok_ms = now_ms;
-            last_err = NILAN_MB_ERR_NONE;
+            run_request(&item, regs_data);
         }
-        else
+        else if (run_writes(get_time_ms(), regs_data, &write_wait_ms))
         {
-            fail_count++;
-            last_err = NILAN_MB_ERR_CRC;
+            // done, writes did their own pacing
         }
-
-        // Rotate to next group.
-        group_index++;
-        if (group_index >= POLL_GROUP_COUNT)
+        else
         {
-            group_index = 0;
+            uint32_t sleep_ms = 0;
+            int block_index = -1;
+
+            if (poll_turn)
+            {
+                block_index = sched_pick_block(get_time_ms(), &sleep_ms);
+                poll_turn = false;
+            }
+
+            if (block_index < 0 && xQueueReceive(normal_queue, &item, 0) == pdTRUE)
+            {
+                run_request(&item, regs_data);
+                poll_turn = true;
+            }
+            else
+            {
+                // Pick the block closest to missing its deadline, or nap until one is
+                // due or a write settles. Submitting anything wakes us early.
+                if (block_index < 0)
+                {
+                    block_index = sched_pick_block(get_time_ms(), &sleep_ms);
+                }
+                if (block_index < 0)
+                {
+                    if (write_wait_ms < sleep_ms)
+                    {
+                        sleep_ms = write_wait_ms;
+                    }
+                    TickType_t ticks = pdMS_TO_TICKS(sleep_ms);
+                    ulTaskNotifyTake(pdTRUE, (ticks > 0) ? ticks : 1); // a 0-tick wait would just spin
+                    continue;
+                }
+
+                (void)poll_block((size_t)block_index, regs_data);
+            }
         }
 
-        vTaskDelay(pdMS_TO_TICKS(NILAN_POLL_INTERVAL_MS));
+        // Keep the bus busy, but give the CTS602 a short breather between frames.
+        vTaskDelay(pdMS_TO_TICKS(NILAN_BUS_GAP_MS));
     }
 }
 
@@ -246,43 +455,27 @@ bool nilan_modbus_start(void)
         return true;
     }
 
-    // Mutex first
-    uart_mutex = xSemaphoreCreateMutex();
-
-    // Configure UART
-    uart_config_t cfg = {
-        .baud_rate = NILAN_UART_BAUDRATE,
-        .data_bits = UART_DATA_8_BITS,
-        .parity = UART_PARITY_EVEN, // 8E1 matches Arduino SERIAL_8E1
-        .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-        .source_clk = UART_SCLK_APB,
-    };
-
-    uart_param_config(NILAN_UART_PORT, &cfg);
-    uart_set_pin(NILAN_UART_PORT,
-                 NILAN_UART_TX_GPIO,
-                 NILAN_UART_RX_GPIO,
-                 UART_PIN_NO_CHANGE,
-                 UART_PIN_NO_CHANGE);
-
-    uart_driver_install(NILAN_UART_PORT,
-                        NILAN_UART_BUF_SIZE,
-                        NILAN_UART_BUF_SIZE,
-                        0,
-                        NULL,
-                        0);
+    urgent_queue = xQueueCreate(NILAN_MB_QUEUE_LEN, sizeof(nilan_mb_queued_t));
+    normal_queue = xQueueCreate(NILAN_MB_QUEUE_LEN, sizeof(nilan_mb_queued_t));
+    if (urgent_queue == NULL || normal_queue == NULL)
+    {
+        return false;
+    }
 
-    init_poll_groups();
+    // The RS485 line (nilan_transport.h)
+    if (!nilan_rtu_init())
+    {
+        return false;
+    }
 
-    // Create polling task
+    // Create the bus task: owns the UART, serves requests and polls
     xTaskCreate(
-        nilan_poll_task,
-        "nilan_poll",
+        nilan_bus_task,
+        "nilan_bus",
         4096,
         NULL,
         8,
-        &poll_task);
+        &bus_task);
 
     modbus_started = true;
     // ESP_LOGI(TAG, "Nilan Modbus started (UART1 on GPIO32/33, 19200 8E1)");
@@ -305,14 +498,12 @@ bool nilan_modbus_is_online(void)
 
 int16_t nilan_get_tank_top_cC()
 {
-    // uint16_t raw_value = nilan_reg_state[NILAN_REGID_IR_T11_TANK_TOP].raw;
-
-    return nilan_reg_state[NILAN_REGID_IR_T11_TANK_TOP].raw;
+    return (int16_t)nilan_reg_raw(NILAN_REGID_IR_T11_TANK_TOP);
 }
 
 int16_t nilan_get_tank_bottom_cC(void)
 {
-    return nilan_reg_state[NILAN_REGID_IR_T12_TANK_BOTTOM].raw;
+    return (int16_t)nilan_reg_raw(NILAN_REGID_IR_T12_TANK_BOTTOM);
 }
 
 // Extra debug helpers
@@ -342,6 +533,47 @@ float nilan_modbus_get_secs_since_last_ok(void)
     return (float)diff / 1000.0f;
 }
 
+size_t nilan_modbus_get_poll_group_count(void)
+{
+    return NILAN_POLL_BLOCK_COUNT;
+}
+
+bool nilan_modbus_get_poll_group_stats(size_t index, nilan_poll_group_stats_t *out)
+{
+    if (index >= NILAN_POLL_BLOCK_COUNT || out == NULL)
+    {
+        return false;
+    }
+
+    const nilan_poll_block_t *blk = &nilan_poll_blocks[index];
+    const nilan_poll_class_cfg_t *cls = &poll_classes[blk->poll_class];
+    const nilan_poll_sched_t *sch = &poll_sched[index];
+    uint32_t last_ok = sch->last_ok_ms;
+
+    out->reg_type = blk->reg_type;
+    out->start_addr = blk->start_addr;
+    out->qty = blk->qty;
+    out->priority = cls->priority;
+    out->target_ms = cls->period_ms;
+    out->achieved_ms = sch->achieved_ms;
+    out->age_ms = (last_ok == 0) ? UINT32_MAX : (get_time_ms() - last_ok);
+    out->worst_age_ms = sch->worst_age_ms;
+    out->deadline_misses = sch->deadline_misses;
+    return true;
+}
+
+void nilan_modbus_get_write_stats(nilan_write_stats_t *out)
+{
+    if (out == NULL)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&write_lock);
+    *out = write_stats;
+    taskEXIT_CRITICAL(&write_lock);
+}
+
 // --------- Generic access wrappers (public API) ----------
 
 bool nilan_modbus_read_input_block(uint16_t start_reg, uint16_t qty, uint16_t *out_regs)
@@ -354,16 +586,6 @@ bool nilan_modbus_read_holding_block(uint16_t start_reg, uint16_t qty, uint16_t
     return nilan_read_regs(0x03, start_reg, qty, out_regs);
 }
 
-// bool nilan_modbus_write_single_holding(uint16_t reg,
-//                                        uint16_t value)
-// {
-//     if (xSemaphoreTake(s_uart_mutex, pdMS_TO_TICKS(1000)) == pdTRUE)
-//     {
-//         nilan_write_single_reg(reg, value);
-//         xSemaphoreGive(s_uart_mutex);
-//     }
-// }
-
 // ===============================================================
 // HELPERS
 // ===============================================================
@@ -373,66 +595,594 @@ static inline uint32_t get_time_ms()
     return (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
 }
 
-static void init_poll_groups()
+// Serve one submitted request and hand the result to its callback.
+static void run_request(const nilan_mb_queued_t *item, uint16_t *regs)
+{
+    const nilan_mb_request_t *req = &item->req;
+    int64_t wait_us = nilan_transport_now_us() - item->queued_us;
+
+    nilan_mb_err_t err = read_regs(req->func, req->start, req->qty, regs);
+    nilan_mb_stats_record(err, req->func, NILAN_MB_STATS_NO_BLOCK,
+                          (wait_us < (int64_t)UINT32_MAX) ? (uint32_t)wait_us : UINT32_MAX - 1);
+    last_err = err;
+
+    if (req->done != NULL)
+    {
+        req->done(req, err, regs);
+    }
+}
+
+// Read one block of the poll plan and scatter it into the register store.
+// regs is left holding the whole block on success.
+static nilan_mb_err_t poll_block(size_t block_index, uint16_t *regs)
 {
-    // Iterate over all the groups we set up above.
-    for (size_t grp_id = 0; grp_id < POLL_GROUP_COUNT; ++grp_id)    
-    {   
-        nilan_poll_group_t *grp = &poll_groups[grp_id]; // pointer/alias to the group for shorter lines.
+    const nilan_poll_block_t *blk = &nilan_poll_blocks[block_index];
+
+    // One read covers the whole block, gap registers included.
+    nilan_mb_err_t err = read_regs(blk->reg_type, blk->start_addr, blk->qty, regs);
+    nilan_mb_stats_record(err, blk->reg_type, block_index, NILAN_MB_STATS_NO_WAIT);
+
+    if (err == NILAN_MB_ERR_NONE)
+    {
+        uint32_t now_ms = get_time_ms();
+
+        // Readers see either the old block or the new one, never a mix.
+        nilan_reg_store_block(block_index, regs, now_ms);
+        nilan_history_append_block(block_index, regs, nilan_history_now_s());
+        nilan_notify_publish_block(block_index);
+        boot_graph_mark(BOOT_MARK_FIRST_MODBUS_READ);
+
+        sched_mark_result(block_index, true, now_ms);
+
+        ok_count++;
+        last_ok_ms = now_ms;
+        last_err = NILAN_MB_ERR_NONE;
+    }
+    else
+    {
+        sched_mark_result(block_index, false, get_time_ms());
+
+        fail_count++;
+        last_err = err;
+    }
+
+    return err;
+}
 
-        uint16_t start = grp->start_addr;
-        uint16_t end   = (uint16_t)(start + grp->qty); // exclusive
+// ---------------- Write pipeline (bus task) ----------------
 
-        // First pass: count how many registers fall in this range
-        uint8_t count = 0;
-        bool found_first_reg_id = false;
-        size_t first_reg_id = 0;
-        size_t last_reg_id = 0;
+// Send every settled write: drop the ones the device already has, merge
+// neighbours into FC16 frames, and read each frame's registers back.
+// Returns true if anything went on the wire; *wait_ms is the time until the
+// next pending write settles.
+static bool run_writes(uint32_t now_ms, uint16_t *regs, uint32_t *wait_ms)
+{
+    nilan_write_item_t items[NILAN_WRITE_SLOTS];
+    size_t count = take_due_writes(now_ms, items, wait_ms);
 
-        for (size_t reg_id = 0; reg_id < NILAN_REGID_COUNT; ++reg_id)
+    // Shadow-state suppression: no frame for a value the last poll already saw.
+    // Not for blocks: dropping one register would split the frame.
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!items[i].block && write_matches_shadow(&items[i]))
         {
-            const nilan_reg_meta_t *reg_meta = &nilan_registers[reg_id];   // pointer/alias to the register meta data struct
+            write_stats.suppressed++;
+            continue;
+        }
+        items[kept++] = items[i];
+    }
+    count = kept;
 
-            if (reg_meta->reg_type != grp->reg_type)
-                continue;
+    if (count == 0)
+    {
+        return false;
+    }
 
-            if (reg_meta->addr < start || reg_meta->addr >= end)
-                continue;
+    // Sort by address (insertion sort, at most NILAN_WRITE_SLOTS items).
+    for (size_t i = 1; i < count; ++i)
+    {
+        nilan_write_item_t tmp = items[i];
+        size_t j = i;
+        while (j > 0 && items[j - 1].addr > tmp.addr)
+        {
+            items[j] = items[j - 1];
+            --j;
+        }
+        items[j] = tmp;
+    }
+
+    size_t first = 0;
+    while (first < count)
+    {
+        // Extend the run while addresses stay contiguous.
+        size_t end = first + 1;
+        while (end < count && items[end].addr == items[end - 1].addr + 1 &&
+               (end - first) < NILAN_MAX_WRITE_QTY)
+        {
+            ++end;
+        }
+
+        uint16_t qty = (uint16_t)(end - first);
+        uint16_t start = items[first].addr;
+        uint16_t values[NILAN_WRITE_SLOTS];
+        for (size_t i = 0; i < qty; ++i)
+        {
+            values[i] = items[first + i].value;
+        }
+
+        nilan_mb_err_t err = write_regs(start, qty, values);
+        nilan_mb_stats_record(err, (qty == 1) ? 0x06 : 0x10, NILAN_MB_STATS_NO_BLOCK, NILAN_MB_STATS_NO_WAIT);
+        write_stats.frames++;
+        write_stats.merged += (uint32_t)(qty - 1);
 
-            if (!found_first_reg_id)
+        if (err == NILAN_MB_ERR_NONE)
+        {
+            vTaskDelay(pdMS_TO_TICKS(NILAN_BUS_GAP_MS));
+
+            // Confirm what the controller actually stored (it may clamp or refuse).
+            err = write_readback(start, qty, regs);
+            if (err == NILAN_MB_ERR_NONE)
             {
-                first_reg_id = reg_id;
-                found_first_reg_id = true;
+                for (size_t i = 0; i < qty; ++i)
+                {
+                    if (regs[i] != values[i])
+                    {
+                        write_stats.verify_failed++;
+                        err = NILAN_MB_ERR_VERIFY;
+                    }
+                }
             }
+            // A failed read-back says nothing about the write itself: don't resend.
+        }
+        else if (err != NILAN_MB_ERR_EXCEPTION)
+        {
+            // Transport trouble: try again later, unless a newer value is already waiting.
+            for (size_t i = first; i < end; ++i)
+            {
+                write_requeue(&items[i]);
+            }
+        }
+        else
+        {
+            write_stats.failed += qty;
+        }
+
+        last_err = err;
+        first = end;
 
-            last_reg_id = reg_id;
-            ++count;
+        if (first < count)
+        {
+            vTaskDelay(pdMS_TO_TICKS(NILAN_BUS_GAP_MS));
         }
+    }
 
-        grp->id_count = count;
+    return true;
+}
+
+// Move every write that has settled out of the slot table.
+static size_t take_due_writes(uint32_t now_ms, nilan_write_item_t *items, uint32_t *wait_ms)
+{
+    size_t count = 0;
+    uint32_t min_wait = NILAN_SCHED_IDLE_MAX_MS;
+
+    taskENTER_CRITICAL(&write_lock);
+
+    for (size_t i = 0; i < NILAN_WRITE_SLOTS; ++i)
+    {
+        nilan_write_slot_t *slot = &write_slots[i];
+        if (!slot->pending)
+        {
+            continue;
+        }
+
+        uint32_t age = now_ms - slot->changed_ms;
+        if (age < NILAN_WRITE_SETTLE_MS)
+        {
+            if (NILAN_WRITE_SETTLE_MS - age < min_wait)
+            {
+                min_wait = NILAN_WRITE_SETTLE_MS - age;
+            }
+            continue;
+        }
+
+        items[count].addr = slot->addr;
+        items[count].value = slot->value;
+        items[count].retries = slot->retries;
+        items[count].block = slot->block;
+        count++;
+        slot->pending = false;
+    }
+
+    taskEXIT_CRITICAL(&write_lock);
+
+    *wait_ms = min_wait;
+    return count;
+}
+
+// Does the cached holding register already hold this value? A value restored
+// from the last boot's snapshot proves nothing about the controller.
+static bool write_matches_shadow(const nilan_write_item_t *item)
+{
+    nilan_reg_id_t id = nilan_reg_find(NILAN_HOLDING_REG, item->addr);
+    if (id == NILAN_REGID_COUNT || nilan_reg_is_stale(id))
+    {
+        return false; // unknown or unconfirmed register: always write
+    }
+
+    nilan_reg_value_t cur;
+    return nilan_reg_read(id, &cur) && cur.raw == item->value;
+}
+
+// Put a failed write back, unless it has used up its retries or was superseded.
+static void write_requeue(const nilan_write_item_t *item)
+{
+    // A block goes out whole or not at all; the caller sends a fresh one.
+    if (item->block || item->retries >= NILAN_WRITE_MAX_RETRIES)
+    {
+        write_stats.failed++;
+        return;
+    }
+
+    uint32_t now_ms = get_time_ms();
+
+    taskENTER_CRITICAL(&write_lock);
+
+    nilan_write_slot_t *free_slot = NULL;
+    bool superseded = false;
+    for (size_t i = 0; i < NILAN_WRITE_SLOTS; ++i)
+    {
+        if (write_slots[i].pending && write_slots[i].addr == item->addr)
+        {
+            superseded = true;
+            break;
+        }
+        if (free_slot == NULL && !write_slots[i].pending)
+        {
+            free_slot = &write_slots[i];
+        }
+    }
+
+    if (!superseded && free_slot != NULL)
+    {
+        free_slot->addr = item->addr;
+        free_slot->value = item->value;
+        free_slot->changed_ms = now_ms; // waits out the settle time again as back-off
+        free_slot->retries = (uint8_t)(item->retries + 1);
+        free_slot->pending = true;
+        free_slot->block = false;
+    }
+    else if (!superseded)
+    {
+        write_stats.failed++;
+    }
+
+    taskEXIT_CRITICAL(&write_lock);
+}
+
+// Read written registers back into regs[0..qty-1]. If they sit inside a poll
+// block, the whole block is refreshed instead, which also updates the state
+// array and the block's freshness.
+static nilan_mb_err_t write_readback(uint16_t start, uint16_t qty, uint16_t *regs)
+{
+    for (size_t b = 0; b < NILAN_POLL_BLOCK_COUNT; ++b)
+    {
+        const nilan_poll_block_t *blk = &nilan_poll_blocks[b];
+        if (blk->reg_type != NILAN_HOLDING_REG || start < blk->start_addr ||
+            start + qty > blk->start_addr + blk->qty)
+        {
+            continue;
+        }
+
+        nilan_mb_err_t err = poll_block(b, regs);
+        if (err == NILAN_MB_ERR_NONE)
+        {
+            memmove(regs, &regs[start - blk->start_addr], qty * sizeof(uint16_t));
+        }
+        return err;
+    }
+
+    nilan_mb_err_t err = read_regs(NILAN_HOLDING_REG, start, qty, regs);
+    nilan_mb_stats_record(err, NILAN_HOLDING_REG, NILAN_MB_STATS_NO_BLOCK, NILAN_MB_STATS_NO_WAIT);
+    return err;
+}
+
+// Completion for nilan_read_regs(): copy the reply out and wake the waiting task.
+static void blocking_done_cb(const nilan_mb_request_t *req, nilan_mb_err_t err, const uint16_t *regs)
+{
+    nilan_blocking_call_t *call = (nilan_blocking_call_t *)req->user;
+
+    if (err == NILAN_MB_ERR_NONE)
+    {
+        memcpy(call->regs, regs, req->qty * sizeof(uint16_t));
+    }
+    call->err = err;
+
+    TaskHandle_t waiter = call->waiter; // 'call' may be gone once done is seen
+    call->done = true;
+    xTaskNotifyGive(waiter);
+}
+
+static nilan_mb_err_t read_regs(uint8_t func, uint16_t start, uint16_t qty, uint16_t *regs)
+{
+    if (qty == 0 || qty > NILAN_MAX_READ_QTY)
+    {
+        return NILAN_MB_ERR_INTERNAL;
+    }
+
+    // Build request: [addr][func][start_hi][start_lo][qty_hi][qty_lo][crc_lo][crc_hi]
+    uint8_t tx[8];
+    tx[0] = (uint8_t)NILAN_SLAVE_ADDR;
+    tx[1] = func;
+    tx[2] = (uint8_t)(start >> 8);
+    tx[3] = (uint8_t)(start & 0xFF);
+    tx[4] = (uint8_t)(qty >> 8);
+    tx[5] = (uint8_t)(qty & 0xFF);
+
+    uint16_t crc = modbus_crc16(tx, 6);
+    tx[6] = (uint8_t)(crc & 0xFF);        // CRC low
+    tx[7] = (uint8_t)((crc >> 8) & 0xFF); // CRC high
+
+    uint8_t rx[NILAN_RTU_MAX_FRAME];
+    size_t rx_len = 0;
+
+    // Returns as soon as the reply (or an exception) is complete, not after a fixed wait.
+    nilan_mb_err_t err = nilan_rtu_transact(tx, sizeof(tx), rx, sizeof(rx), &rx_len);
+
+    if (err != NILAN_MB_ERR_NONE)
+    {
+        return err;
+    }
+
+    return decode_read_response(func, qty, rx, rx_len, regs);
+}
+
+// Check a CRC-verified reply against the request and extract the registers.
+static nilan_mb_err_t decode_read_response(uint8_t func, uint16_t qty,
+                                           const uint8_t *rx, size_t rx_len,
+                                           uint16_t *regs)
+{
+    if (rx[0] != NILAN_SLAVE_ADDR)
+    {
+        return NILAN_MB_ERR_ADDR;
+    }
+
+    if (rx[1] == (uint8_t)(func | 0x80))
+    {
+        nilan_mb_stats_exception(rx[2]);
+        regs[0] = rx[2]; // for whoever submitted the request (see nilan_mb_done_cb_t)
+        return NILAN_MB_ERR_EXCEPTION;
+    }
+
+    if (rx[1] != func)
+    {
+        return NILAN_MB_ERR_FUNC;
+    }
+
+    // [addr][func][byte_count][data...][crc_lo][crc_hi]
+    if (rx[2] != qty * 2 || rx_len != (size_t)(5 + qty * 2))
+    {
+        return NILAN_MB_ERR_LENGTH;
+    }
+
+    for (uint16_t i = 0; i < qty; ++i)
+    {
+        uint16_t hi = rx[3 + (i * 2)];
+        uint16_t lo = rx[4 + (i * 2)];
+        regs[i] = (uint16_t)((hi << 8) | lo);
+    }
+
+    return NILAN_MB_ERR_NONE;
+}
+
+// Write holding registers: FC06 for one register, FC16 for a contiguous run.
+static nilan_mb_err_t write_regs(uint16_t start, uint16_t qty, const uint16_t *values)
+{
+    if (qty == 0 || qty > NILAN_MAX_WRITE_QTY)
+    {
+        return NILAN_MB_ERR_INTERNAL;
+    }
+
+    uint8_t tx[NILAN_RTU_MAX_FRAME];
+    size_t len = 0;
+
+    tx[len++] = (uint8_t)NILAN_SLAVE_ADDR;
+    tx[len++] = (qty == 1) ? 0x06 : 0x10;
+    tx[len++] = (uint8_t)(start >> 8);
+    tx[len++] = (uint8_t)(start & 0xFF);
+
+    if (qty == 1)
+    {
+        // [addr][06][reg_hi][reg_lo][val_hi][val_lo][crc_lo][crc_hi]
+        tx[len++] = (uint8_t)(values[0] >> 8);
+        tx[len++] = (uint8_t)(values[0] & 0xFF);
+    }
+    else
+    {
+        // [addr][10][start_hi][start_lo][qty_hi][qty_lo][byte_count][data...][crc_lo][crc_hi]
+        tx[len++] = (uint8_t)(qty >> 8);
+        tx[len++] = (uint8_t)(qty & 0xFF);
+        tx[len++] = (uint8_t)(qty * 2);
+        for (uint16_t i = 0; i < qty; ++i)
+        {
+            tx[len++] = (uint8_t)(values[i] >> 8);
+            tx[len++] = (uint8_t)(values[i] & 0xFF);
+        }
+    }
+
+    uint16_t crc = modbus_crc16(tx, (uint16_t)len);
+    tx[len++] = (uint8_t)(crc & 0xFF);        // CRC low
+    tx[len++] = (uint8_t)((crc >> 8) & 0xFF); // CRC high
+
+    uint8_t rx[NILAN_RTU_MAX_FRAME];
+    size_t rx_len = 0;
+
+    nilan_mb_err_t err = nilan_rtu_transact(tx, len, rx, sizeof(rx), &rx_len);
+
+    if (err != NILAN_MB_ERR_NONE)
+    {
+        return err;
+    }
+
+    return decode_write_response(tx, rx, rx_len);
+}
+
+// Both FC06 and FC16 answer by echoing the first six bytes of the request.
+static nilan_mb_err_t decode_write_response(const uint8_t *tx, const uint8_t *rx, size_t rx_len)
+{
+    if (rx[0] != NILAN_SLAVE_ADDR)
+    {
+        return NILAN_MB_ERR_ADDR;
+    }
+
+    if (rx[1] == (uint8_t)(tx[1] | 0x80))
+    {
+        nilan_mb_stats_exception(rx[2]);
+        return NILAN_MB_ERR_EXCEPTION;
+    }
+
+    if (rx[1] != tx[1])
+    {
+        return NILAN_MB_ERR_FUNC;
+    }
+
+    if (rx_len != 8 || memcmp(&rx[2], &tx[2], 4) != 0)
+    {
+        return NILAN_MB_ERR_LENGTH;
+    }
+
+    return NILAN_MB_ERR_NONE;
+}
+
+// Earliest-deadline-first over the poll blocks.
+// Returns the block to read now, or -1 with *sleep_ms set to the time until one is eligible.
+static int sched_pick_block(uint32_t now_ms, uint32_t *sleep_ms)
+{
+    int best = -1;
+    nilan_poll_prio_t best_prio = NILAN_POLL_PRIO_LOW;
+    bool best_late = false;
+    int32_t best_slack = 0;
+    uint32_t min_wait = NILAN_SCHED_IDLE_MAX_MS;
+
+    for (size_t i = 0; i < NILAN_POLL_BLOCK_COUNT; ++i)
+    {
+        const nilan_poll_class_cfg_t *cls = &poll_classes[nilan_poll_blocks[i].poll_class];
+        const nilan_poll_sched_t *sch = &poll_sched[i];
 
-        if (count == 0)
+        // Never read: overdue from the start, so boot fills everything by priority.
+        int32_t slack = -(int32_t)cls->period_ms;
+        uint32_t wait = 0;
+
+        if (sch->last_ok_ms != 0)
+        {
+            uint32_t age = now_ms - sch->last_ok_ms;
+            uint32_t release = cls->period_ms * NILAN_SCHED_RELEASE_NUM / NILAN_SCHED_RELEASE_DEN;
+
+            slack = (int32_t)(cls->period_ms - age); // time left until the deadline
+            wait = (age < release) ? (release - age) : 0;
+        }
+
+        // Back off from a block that just failed, so a dead bus isn't hammered.
+        if (sch->last_try_ms != 0 && sch->last_try_ms != sch->last_ok_ms)
         {
-            grp->id_list = NULL;
-            continue;  // nothing to track in this group (still OK to read on wire)
+            uint32_t since_try = now_ms - sch->last_try_ms;
+            if (since_try < NILAN_RETRY_BACKOFF_MS && (NILAN_RETRY_BACKOFF_MS - since_try) > wait)
+            {
+                wait = NILAN_RETRY_BACKOFF_MS - since_try;
+            }
         }
 
+        if (wait > 0)
+        {
+            if (wait < min_wait)
+            {
+                min_wait = wait;
+            }
+            continue;
+        }
 
-        // Second pass: actually fill the ID list
-        grp->id_list = malloc(count);   // Allocate space for the array.
-        uint8_t idx = 0;
+        // Past-deadline groups are served by priority first, so an overloaded
+        // bus sheds the low-priority data; otherwise it's plain EDF.
+        bool late = (slack < 0);
+        bool better = false;
 
-        for (size_t reg_id = first_reg_id; reg_id <= last_reg_id; ++reg_id)
+        if (best < 0)
+        {
+            better = true;
+        }
+        else if (late != best_late)
+        {
+            better = late;
+        }
+        else if (late && cls->priority != best_prio)
+        {
+            better = (cls->priority > best_prio);
+        }
+        else if (slack != best_slack)
+        {
+            better = (slack < best_slack);
+        }
+        else
         {
-            const nilan_reg_meta_t *reg_meta = &nilan_registers[reg_id];
+            better = (cls->priority > best_prio);
+        }
 
-            if (reg_meta->reg_type != grp->reg_type)
-                continue;
+        if (better)
+        {
+            best = (int)i;
+            best_prio = cls->priority;
+            best_late = late;
+            best_slack = slack;
+        }
+    }
 
-            if (reg_meta->addr < start || reg_meta->addr >= end)
-                continue;
+    *sleep_ms = (min_wait > 0) ? min_wait : 1;
+    return best;
+}
+
+// Update a block's freshness bookkeeping after a read attempt.
+static void sched_mark_result(size_t block_index, bool ok, uint32_t now_ms)
+{
+    const nilan_poll_class_cfg_t *cls = &poll_classes[nilan_poll_blocks[block_index].poll_class];
+    nilan_poll_sched_t *sch = &poll_sched[block_index];
+
+    // 0 means "never" in the timestamps below.
+    if (now_ms == 0)
+    {
+        now_ms = 1;
+    }
+
+    sch->last_try_ms = now_ms;
+
+    if (!ok)
+    {
+        return;
+    }
+
+    if (sch->last_ok_ms != 0)
+    {
+        uint32_t interval = now_ms - sch->last_ok_ms;
 
-            grp->id_list[idx++] = (uint8_t)reg_id;
+        // EWMA with 1/8 weight: smooth enough for a UI, still tracks load changes.
+        if (sch->achieved_ms == 0)
+        {
+            sch->achieved_ms = interval;
+        }
+        else
+        {
+            sch->achieved_ms = sch->achieved_ms - (sch->achieved_ms / 8) + (interval / 8);
+        }
+
+        if (interval > sch->worst_age_ms)
+        {
+            sch->worst_age_ms = interval;
+        }
+
+        if (interval > cls->period_ms)
+        {
+            sch->deadline_misses++;
         }
     }
+
+    sch->last_ok_ms = now_ms;
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -7,17 +8,127 @@ extern "C" {
 #endif
 
 // Simple Modbus / Nilan status code for debugging purposes.
+// Also the failure classes counted by the line statistics below.
 typedef enum {
     NILAN_MB_ERR_NONE = 0,
-    NILAN_MB_ERR_TIMEOUT,
-    NILAN_MB_ERR_CRC,
-    NILAN_MB_ERR_LENGTH,
-    NILAN_MB_ERR_ADDR,
-    NILAN_MB_ERR_FUNC,
-    NILAN_MB_ERR_EXCEPTION,
-    NILAN_MB_ERR_INTERNAL
+    NILAN_MB_ERR_TIMEOUT,     // slave never started answering
+    NILAN_MB_ERR_CRC,         // full-length reply, bad CRC, no UART errors seen
+    NILAN_MB_ERR_LENGTH,      // short or over-long frame
+    NILAN_MB_ERR_ADDR,        // reply from another slave address
+    NILAN_MB_ERR_FUNC,        // reply to another function code
+    NILAN_MB_ERR_EXCEPTION,   // slave answered with an exception code
+    NILAN_MB_ERR_INTERNAL,
+    NILAN_MB_ERR_VERIFY,      // write accepted, but read-back shows a different value
+    NILAN_MB_ERR_LINE,        // bad frame with parity/framing errors or a break: noisy line
+    NILAN_MB_ERR_OVERRUN,     // bytes lost in our own RX path
+
+    NILAN_MB_ERR_COUNT
 } nilan_mb_err_t;
 
+// Modbus exception codes 1..11 are counted individually; anything else lands in [0].
+#define NILAN_MB_EXCEPTION_CODES 12
+
+// Bus-wide line quality: outcome of every transaction, plus raw UART events.
+// Many LINE/CRC with few TIMEOUTs points at the cable; many TIMEOUTs or
+// exceptions (code 6 = busy) at the CTS602.
+typedef struct {
+    uint32_t by_err[NILAN_MB_ERR_COUNT];              // [NILAN_MB_ERR_NONE] = good transactions
+    uint32_t exception_codes[NILAN_MB_EXCEPTION_CODES];
+    uint32_t parity_errors;
+    uint32_t frame_errors;
+    uint32_t breaks;
+    uint32_t fifo_overflows;
+    uint32_t buffer_full;
+} nilan_mb_line_stats_t;
+
+// Poll group priority. Only matters when the bus can't meet every deadline:
+// overdue high-priority groups are then served before overdue low-priority ones.
+typedef enum {
+    NILAN_POLL_PRIO_LOW = 0,
+    NILAN_POLL_PRIO_NORMAL,
+    NILAN_POLL_PRIO_HIGH
+} nilan_poll_prio_t;
+
+// Freshness of one poll group (a generated read block, see nilan_poll_plan.h):
+// declared target vs. what the bus actually achieves.
+typedef struct {
+    uint8_t  reg_type;        // 3 = holding, 4 = input
+    uint16_t start_addr;
+    uint16_t qty;
+    nilan_poll_prio_t priority;
+    uint32_t target_ms;       // declared freshness period
+    uint32_t achieved_ms;     // smoothed interval between successful reads; 0 until two reads
+    uint32_t age_ms;          // age of the cached data now; UINT32_MAX if never read
+    uint32_t worst_age_ms;    // oldest the data has been at refresh time
+    uint32_t deadline_misses; // refreshes that came later than target_ms
+} nilan_poll_group_stats_t;
+
+// Transaction phases timed by the bus task (esp_timer, microseconds).
+typedef enum {
+    NILAN_MB_PHASE_QUEUE = 0,   // submitted request waiting for the bus (polls don't queue)
+    NILAN_MB_PHASE_TX,          // request on the wire
+    NILAN_MB_PHASE_TURNAROUND,  // end of request until the slave's first byte
+    NILAN_MB_PHASE_RX,          // first reply byte until the frame is complete
+    NILAN_MB_PHASE_TOTAL,       // TX + turnaround + RX: bus time of the transaction
+
+    NILAN_MB_PHASE_COUNT
+} nilan_mb_phase_t;
+
+// Log2 histogram buckets: bucket 0 counts < 512 us, bucket i (1..10) counts
+// [2^(i+8), 2^(i+9)) us, and the last bucket everything from ~524 ms up.
+#define NILAN_MB_HIST_BUCKETS 12
+#define NILAN_MB_HIST_FIRST_SHIFT 9
+
+typedef struct {
+    uint32_t count[NILAN_MB_HIST_BUCKETS];
+    uint64_t sum_us; // all samples counted, for the mean
+} nilan_mb_hist_t;
+
+// Per poll group timing: histogram of total bus time, plus mean and worst per phase.
+typedef struct {
+    uint16_t total_hist[NILAN_MB_HIST_BUCKETS]; // counts stop at 65535
+    uint32_t mean_us[NILAN_MB_PHASE_COUNT];     // 0 for phases never measured
+    uint32_t max_us[NILAN_MB_PHASE_COUNT];
+} nilan_poll_group_timing_t;
+
+// Priority of a submitted bus request. Urgent requests (user-initiated, e.g. the
+// debug screen) are served before normal ones and before background polling.
+// Normal requests take turns with poll blocks that are due.
+typedef enum {
+    NILAN_MB_PRIO_NORMAL = 0,
+    NILAN_MB_PRIO_URGENT
+} nilan_mb_prio_t;
+
+typedef struct nilan_mb_request nilan_mb_request_t;
+
+// Completion callback. Runs in the bus task once the transaction is done:
+// keep it short and never block in it. regs holds req->qty values on
+// NILAN_MB_ERR_NONE, the exception code in regs[0] on NILAN_MB_ERR_EXCEPTION,
+// and is only valid for the duration of the call.
+typedef void (*nilan_mb_done_cb_t)(const nilan_mb_request_t *req,
+                                   nilan_mb_err_t err,
+                                   const uint16_t *regs);
+
+struct nilan_mb_request {
+    uint8_t  func;            // 0x03 = read holding, 0x04 = read input
+    uint16_t start;
+    uint16_t qty;             // 1..125
+    nilan_mb_done_cb_t done;  // may be NULL (fire and forget)
+    void    *user;            // passed back untouched in req->user
+};
+
+// Write pipeline counters. frames vs. queued shows how much coalescing,
+// suppression and FC16 merging saved on the bus.
+typedef struct {
+    uint32_t queued;        // registers accepted by the write functions
+    uint32_t coalesced;     // replaced a value that hadn't gone out yet
+    uint32_t suppressed;    // dropped: cached state already held the value
+    uint32_t frames;        // FC06/FC16 frames sent
+    uint32_t merged;        // registers that rode along in another register's FC16 frame
+    uint32_t verify_failed; // read-back differed from what was written
+    uint32_t failed;        // given up on (exception, or out of retries)
+} nilan_write_stats_t;
+
 // Start Nilan Modbus RTU master.
 // Returns true if UART was configured and polling task started.
 bool nilan_modbus_start(void);
@@ -36,8 +147,31 @@ nilan_mb_err_t nilan_modbus_get_last_error(void);
 // Seconds since last successful poll; -1.0f if never
 float          nilan_modbus_get_secs_since_last_ok(void);
 
+// Per-group scheduler stats. achieved_ms persistently above target_ms (or a growing
+// deadline_misses) means the RS485 link is oversubscribed.
+size_t nilan_modbus_get_poll_group_count(void);
+bool   nilan_modbus_get_poll_group_stats(size_t index, nilan_poll_group_stats_t *out);
+
+// Line quality, bus-wide and per poll group (the per-group counts stop at 65535).
+void nilan_modbus_get_line_stats(nilan_mb_line_stats_t *out);
+bool nilan_modbus_get_poll_group_errors(size_t index, uint16_t out[NILAN_MB_ERR_COUNT]);
+
+// Phase histogram for one function code (0x03, 0x04, 0x06 or 0x10).
+bool nilan_modbus_get_fc_histogram(uint8_t func, nilan_mb_phase_t phase, nilan_mb_hist_t *out);
+bool nilan_modbus_get_poll_group_timing(size_t index, nilan_poll_group_timing_t *out);
+
+// Share of the last 10 s the bus spent in transactions, in percent.
+float nilan_modbus_get_bus_utilization(void);
+
 // -------- Generic, optimized access ----------
 
+// Queue a transaction for the bus task, which is the only owner of the UART.
+// Never blocks; returns false if the queue is full or Modbus isn't started.
+// The request is copied, so it may live on the caller's stack.
+bool nilan_modbus_submit(const nilan_mb_request_t *req, nilan_mb_prio_t prio);
+
+// Blocking convenience wrapper around nilan_modbus_submit(): waits for the reply.
+// Can take several hundred ms on a dead bus - never call it from the LVGL task.
 bool nilan_read_regs(uint8_t func, uint16_t start, uint16_t qty, uint16_t *regs);
 
 // Read "qty" input registers (function 0x04) starting at "start_reg".
@@ -47,9 +181,23 @@ bool nilan_read_regs(uint8_t func, uint16_t start, uint16_t qty, uint16_t *regs)
 // Read "qty" holding registers (function 0x03) starting at "start_reg".
 //bool nilan_modbus_read_holding_block(uint16_t start_reg, uint16_t qty, uint16_t *out_regs);
 
-// // Write single holding register (function 0x06).
-// bool nilan_modbus_write_single_holding(uint16_t reg,
-//                                        uint16_t value);
+// Queue a holding register write. Never blocks.
+// Repeated writes to one register are coalesced, and the value goes out once it
+// has been left alone for a moment; neighbouring registers share one FC16 frame.
+// Nothing is sent if the cached state already holds the value. Every write is
+// read back to confirm it. Returns false if the write queue is full.
+bool nilan_modbus_write_single_holding(uint16_t reg, uint16_t value);
+
+// Most registers nilan_modbus_write_holding_block() takes in one call.
+#define NILAN_WRITE_BLOCK_MAX 16
+
+// Queue qty (at most NILAN_WRITE_BLOCK_MAX) consecutive holding registers that must change together,
+// e.g. the controller clock. They go out in one FC16 frame even if some already
+// hold the value, and are read back like any write. A block is not retried after
+// a transport error. Returns false, queuing nothing, if the write queue is full.
+bool nilan_modbus_write_holding_block(uint16_t start, uint16_t qty, const uint16_t *values);
+
+void nilan_modbus_get_write_stats(nilan_write_stats_t *out);
 
 #ifdef __cplusplus
 }
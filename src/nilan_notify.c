@@ -0,0 +1,199 @@
+#include "nilan_notify.h"
+
+#include <string.h>
+
+#include "nilan_poll_plan.h"
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+typedef struct
+{
+    nilan_reg_mask_t interest; // set before 'active', read-only afterwards
+    nilan_reg_mask_t dirty;    // set by the bus task, cleared by nilan_notify_take()
+    nilan_reg_mask_t reported; // bus task only: registers this subscriber has a value for
+    uint16_t last_raw[NILAN_REGID_COUNT]; // bus task only: value last reported
+    uint16_t deadband;
+    TaskHandle_t task;
+    bool active;
+} nilan_subscriber_t;
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static nilan_subscriber_t subscribers[NILAN_NOTIFY_MAX_SUBSCRIBERS];
+static portMUX_TYPE subscribe_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Generation of each register as of the last publish (bus task only).
+static uint16_t seen_gen[NILAN_REGID_COUNT];
+
+// Registers read on the bus since boot, as opposed to restored (bus task only).
+static nilan_reg_mask_t confirmed;
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static bool beyond_deadband(nilan_reg_id_t id, uint16_t old_raw, uint16_t new_raw, uint16_t deadband);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+int nilan_notify_subscribe(const nilan_reg_mask_t *interest, uint16_t deadband, TaskHandle_t task)
+{
+    if (interest == NULL)
+    {
+        return -1;
+    }
+
+    int index = -1;
+
+    taskENTER_CRITICAL(&subscribe_lock);
+
+    for (int i = 0; i < NILAN_NOTIFY_MAX_SUBSCRIBERS; ++i)
+    {
+        nilan_subscriber_t *sub = &subscribers[i];
+        if (sub->active)
+        {
+            continue;
+        }
+
+        sub->interest = *interest;
+        sub->deadband = deadband;
+        sub->task = task;
+        memset(&sub->dirty, 0, sizeof(sub->dirty));
+        memset(&sub->reported, 0, sizeof(sub->reported));
+
+        // Whatever is already known counts as news for a new subscriber.
+        for (size_t id = 0; id < NILAN_REGID_COUNT; ++id)
+        {
+            if (nilan_reg_mask_test(interest, (nilan_reg_id_t)id) && nilan_reg_gen((nilan_reg_id_t)id) != 0)
+            {
+                sub->last_raw[id] = nilan_reg_raw((nilan_reg_id_t)id);
+                nilan_reg_mask_set(&sub->reported, (nilan_reg_id_t)id);
+                nilan_reg_mask_set(&sub->dirty, (nilan_reg_id_t)id);
+            }
+        }
+
+        // The bus task only looks at a slot once it's active.
+        __atomic_store_n(&sub->active, true, __ATOMIC_RELEASE);
+        index = i;
+        break;
+    }
+
+    taskEXIT_CRITICAL(&subscribe_lock);
+
+    return index;
+}
+
+bool nilan_notify_take(int subscriber, nilan_reg_mask_t *dirty)
+{
+    memset(dirty, 0, sizeof(*dirty));
+
+    if (subscriber < 0 || subscriber >= NILAN_NOTIFY_MAX_SUBSCRIBERS)
+    {
+        return false;
+    }
+
+    nilan_subscriber_t *sub = &subscribers[subscriber];
+    bool any = false;
+
+    for (size_t w = 0; w < NILAN_REG_MASK_WORDS; ++w)
+    {
+        dirty->bits[w] = __atomic_exchange_n(&sub->dirty.bits[w], 0, __ATOMIC_ACQ_REL);
+        any |= (dirty->bits[w] != 0);
+    }
+    return any;
+}
+
+void nilan_notify_publish_block(size_t block_index)
+{
+    const nilan_poll_block_t *blk = &nilan_poll_blocks[block_index];
+    const nilan_poll_map_entry_t *map = &nilan_poll_map[blk->map_first];
+    uint32_t wake = 0; // subscribers with new dirty bits, one bit each
+
+    for (uint8_t i = 0; i < blk->map_count; i++)
+    {
+        nilan_reg_id_t id = (nilan_reg_id_t)map[i].id;
+        uint16_t gen = nilan_reg_gen(id);
+
+        if (gen == seen_gen[id])
+        {
+            continue; // refreshed, but same value: the common case
+        }
+        seen_gen[id] = gen;
+
+        uint16_t raw = nilan_reg_raw(id);
+
+        // The first real read replaces a restored value: report it whatever the
+        // deadband, so subscribers learn the value is no longer stale.
+        bool first_read = !nilan_reg_mask_test(&confirmed, id) && !nilan_reg_is_stale(id);
+        if (first_read)
+        {
+            nilan_reg_mask_set(&confirmed, id);
+        }
+
+        for (int s = 0; s < NILAN_NOTIFY_MAX_SUBSCRIBERS; ++s)
+        {
+            nilan_subscriber_t *sub = &subscribers[s];
+
+            if (!__atomic_load_n(&sub->active, __ATOMIC_ACQUIRE) || !nilan_reg_mask_test(&sub->interest, id))
+            {
+                continue;
+            }
+
+            if (!first_read && nilan_reg_mask_test(&sub->reported, id) &&
+                !beyond_deadband(id, sub->last_raw[id], raw, sub->deadband))
+            {
+                continue;
+            }
+
+            nilan_reg_mask_set(&sub->reported, id);
+            sub->last_raw[id] = raw;
+            __atomic_fetch_or(&sub->dirty.bits[id / 32], 1u << (id % 32), __ATOMIC_RELEASE);
+            wake |= (1u << s);
+        }
+    }
+
+    // One wake-up per subscriber per block, however many of its registers moved.
+    for (int s = 0; s < NILAN_NOTIFY_MAX_SUBSCRIBERS; ++s)
+    {
+        if ((wake & (1u << s)) && subscribers[s].task != NULL)
+        {
+            xTaskNotifyGive(subscribers[s].task);
+        }
+    }
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+static bool beyond_deadband(nilan_reg_id_t id, uint16_t old_raw, uint16_t new_raw, uint16_t deadband)
+{
+    if (deadband == 0)
+    {
+        return old_raw != new_raw;
+    }
+
+    int32_t diff;
+    switch (nilan_registers[id].data_type)
+    {
+    case NILAN_DTYPE_TEMP_Cx100:
+    case NILAN_DTYPE_INT16:
+        diff = (int32_t)(int16_t)new_raw - (int32_t)(int16_t)old_raw;
+        break;
+
+    default:
+        diff = (int32_t)new_raw - (int32_t)old_raw;
+        break;
+    }
+
+    if (diff < 0)
+    {
+        diff = -diff;
+    }
+    return diff >= (int32_t)deadband;
+}
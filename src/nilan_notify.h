@@ -0,0 +1,65 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "NilanRegisters.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Register change notifications.
+ *
+ * After every successful poll block the bus task works out which registers got
+ * a new value (via their generation counter) and sets the matching bits in each
+ * interested subscriber's dirty bitmap. A subscriber is only told about a change
+ * bigger than its deadband, measured from the value it was last told about.
+ * The first read of a register restored from the snapshot is always reported,
+ * as it turns a stale value into a confirmed one.
+ * In steady state nothing changes, so nobody is woken and nothing is redrawn.
+ */
+
+#define NILAN_NOTIFY_MAX_SUBSCRIBERS 6
+#define NILAN_REG_MASK_WORDS ((NILAN_REGID_COUNT + 31) / 32)
+
+// One bit per nilan_reg_id_t.
+typedef struct {
+    uint32_t bits[NILAN_REG_MASK_WORDS];
+} nilan_reg_mask_t;
+
+static inline void nilan_reg_mask_set(nilan_reg_mask_t *mask, nilan_reg_id_t id)
+{
+    mask->bits[id / 32] |= (1u << (id % 32));
+}
+
+static inline bool nilan_reg_mask_test(const nilan_reg_mask_t *mask, nilan_reg_id_t id)
+{
+    return (mask->bits[id / 32] & (1u << (id % 32))) != 0;
+}
+
+// Register interest in the registers set in *interest.
+//
+// deadband: smallest change (in raw units, signed for TEMP/INT16 registers) worth
+//           reporting; 0 reports every change.
+// task:     woken with xTaskNotifyGive() when something becomes dirty, or NULL for
+//           subscribers that poll nilan_notify_take() (e.g. from an LVGL timer).
+//
+// Registers that already hold a value start out dirty, so the first take()
+// delivers the current state. Returns the subscriber id, or -1 if all slots are used.
+int nilan_notify_subscribe(const nilan_reg_mask_t *interest, uint16_t deadband, TaskHandle_t task);
+
+// Fetch and clear this subscriber's dirty bits. Lock-free, any task.
+// Returns false (and an empty *dirty) if nothing changed since the last call.
+bool nilan_notify_take(int subscriber, nilan_reg_mask_t *dirty);
+
+// Bus task only: a poll block has just been stored.
+void nilan_notify_publish_block(size_t block_index);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,57 @@
+#ifndef NILAN_POLL_PLAN_H
+#define NILAN_POLL_PLAN_H
+
+#include <stdint.h>
+
+#include "NilanRegisters.h"
+
+// Block and map counts. Generated at build time by tools/gen_nilan_tables.py
+// from the nilan_registers table; run it with --report to see the plan and its
+// bytes-on-wire cost.
+#include "nilan_poll_plan_gen.h"
+
+/**
+ * The poll plan: which register blocks are read on the wire, and where each
+ * known register sits inside its block. Both tables are const and live in flash.
+ */
+
+// One read transaction.
+typedef struct
+{
+    uint8_t reg_type;    // 3 = holding, 4 = input
+    uint16_t start_addr; // first register on the wire
+    uint16_t qty;        // registers read, gaps included
+    uint8_t poll_class;  // nilan_poll_class_t of the fastest member
+    uint8_t map_first;   // first entry of this block in nilan_poll_map
+    uint8_t map_count;   // number of known registers in the block
+} nilan_poll_block_t;
+
+// A known register inside a block.
+typedef struct
+{
+    uint8_t id;     // nilan_reg_id_t
+    uint8_t offset; // addr - block start_addr
+} nilan_poll_map_entry_t;
+
+extern const nilan_poll_block_t nilan_poll_blocks[NILAN_POLL_BLOCK_COUNT];
+extern const nilan_poll_map_entry_t nilan_poll_map[NILAN_POLL_MAP_COUNT];
+
+// Which block each register is read in, indexed by nilan_reg_id_t.
+extern const uint8_t nilan_poll_reg_block[NILAN_REGID_COUNT];
+
+/**
+ * Address -> register id index, also generated into flash. Input registers come
+ * first, then holding, each sorted by address. nilan_reg_index_hundred[t][h] is
+ * where the entries for addresses h*100 .. h*100+99 begin (t: 0 = input,
+ * 1 = holding); [t][h + 1] is where they end.
+ */
+typedef struct
+{
+    uint16_t addr;
+    uint8_t id; // nilan_reg_id_t
+} nilan_reg_index_entry_t;
+
+extern const nilan_reg_index_entry_t nilan_reg_index[NILAN_REG_INDEX_COUNT];
+extern const uint8_t nilan_reg_index_hundred[2][NILAN_REG_INDEX_HUNDREDS + 1];
+
+#endif /* NILAN_POLL_PLAN_H */
@@ -0,0 +1,319 @@
+#include "nilan_rtu.h"
+
+#include <string.h>
+
+#include "nilan_transport.h"
+
+#include "CRC16.h"
+
+// ---------------- Modbus line configuration ----------------
+// The line itself (UART1 on the RS485 unit, or a pty on the host) is behind
+// nilan_transport.h.
+
+#define NILAN_UART_BAUDRATE 19200
+
+// The transport reports the line as idle after this many character times of
+// silence. Modbus RTU ends a frame after 3.5 characters.
+#define NILAN_RTU_T35_SYMBOLS 4
+
+// Time the slave gets to start answering once our request has left the wire.
+#define NILAN_RTU_RESPONSE_TIMEOUT_MS 100
+
+// Once the first byte is in, the whole frame must follow. A max-size frame is
+// ~150 ms at 19200 8E1, so this only trips on a stalled or babbling line.
+#define NILAN_RTU_FRAME_TIMEOUT_MS 200
+
+// Upper bound for pushing our request out (8..~40 bytes at 19200 baud).
+#define NILAN_RTU_TX_TIMEOUT_MS 50
+
+// One character on the wire (start + 8 data + parity + stop), in microseconds.
+#define NILAN_RTU_CHAR_US ((11 * 1000000) / NILAN_UART_BAUDRATE)
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+// Receive-side frame assembler. The CRC is folded in byte by byte as data
+// arrives, so a finished frame is validated without a second pass.
+typedef struct
+{
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    size_t expected; // 0 until the header tells us the frame length
+    uint16_t crc;    // running CRC, 0 over a complete intact frame
+} rtu_rx_frame_t;
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static bool rtu_initialized = false;
+
+static nilan_rtu_line_counters_t line_counters;
+static nilan_rtu_timing_t last_timing;
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static size_t frame_expected_len(const uint8_t *buf, size_t len);
+static bool frame_push(rtu_rx_frame_t *frame, const uint8_t *data, size_t n);
+static inline bool frame_complete(const rtu_rx_frame_t *frame);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+bool nilan_rtu_init(void)
+{
+    if (rtu_initialized)
+    {
+        return true;
+    }
+
+    if (!nilan_transport_open(NILAN_UART_BAUDRATE, NILAN_RTU_T35_SYMBOLS))
+    {
+        return false;
+    }
+
+    rtu_initialized = true;
+    return true;
+}
+
+nilan_mb_err_t nilan_rtu_transact(const uint8_t *tx, size_t tx_len,
+                                  uint8_t *rx, size_t rx_cap, size_t *rx_len)
+{
+    rtu_rx_frame_t frame = {
+        .buf = rx,
+        .cap = rx_cap,
+        .len = 0,
+        .expected = 0,
+        .crc = MODBUS_CRC16_INIT,
+    };
+    *rx_len = 0;
+
+    last_timing.tx_us = NILAN_RTU_NO_TIME;
+    last_timing.turnaround_us = NILAN_RTU_NO_TIME;
+    last_timing.rx_us = NILAN_RTU_NO_TIME;
+    last_timing.total_us = NILAN_RTU_NO_TIME;
+
+    if (!rtu_initialized)
+    {
+        return NILAN_MB_ERR_INTERNAL;
+    }
+
+    // Drop anything left over from an earlier, abandoned reply before we talk.
+    nilan_transport_flush();
+
+    int64_t start_us = nilan_transport_now_us();
+    nilan_transport_write(tx, tx_len, start_us + (int64_t)NILAN_RTU_TX_TIMEOUT_MS * 1000);
+    int64_t tx_done_us = nilan_transport_now_us();
+    int64_t first_byte_us = 0;
+
+    int64_t deadline_us = tx_done_us + (int64_t)NILAN_RTU_RESPONSE_TIMEOUT_MS * 1000;
+    nilan_mb_err_t err = NILAN_MB_ERR_TIMEOUT;
+    bool done = false;
+    bool line_error = false; // parity/framing/break seen during this reply
+
+    while (!done)
+    {
+        if (nilan_transport_now_us() >= deadline_us)
+        {
+            err = (frame.len == 0) ? NILAN_MB_ERR_TIMEOUT : NILAN_MB_ERR_LENGTH;
+            break;
+        }
+
+        uint8_t chunk[64];
+        uint32_t events = 0;
+        size_t got = nilan_transport_read(chunk, sizeof(chunk), deadline_us, &events);
+
+        if (events & (NILAN_TRANSPORT_EVT_FIFO_OVF | NILAN_TRANSPORT_EVT_BUFFER_FULL))
+        {
+            // Bytes were lost (the transport has flushed); the frame can't be trusted.
+            if (events & NILAN_TRANSPORT_EVT_FIFO_OVF)
+            {
+                line_counters.fifo_overflows++;
+            }
+            else
+            {
+                line_counters.buffer_full++;
+            }
+            err = NILAN_MB_ERR_OVERRUN;
+            break;
+        }
+
+        // These still deliver (corrupted) bytes and the CRC catches them;
+        // remembering them tells us why the CRC failed.
+        if (events & NILAN_TRANSPORT_EVT_PARITY)
+        {
+            line_counters.parity_errors++;
+            line_error = true;
+        }
+        if (events & NILAN_TRANSPORT_EVT_FRAME)
+        {
+            line_counters.frame_errors++;
+            line_error = true;
+        }
+        if (events & NILAN_TRANSPORT_EVT_BREAK)
+        {
+            line_counters.breaks++;
+            line_error = true;
+        }
+
+        bool was_empty = (frame.len == 0);
+
+        if (got > 0 && !frame_push(&frame, chunk, got))
+        {
+            err = NILAN_MB_ERR_LENGTH; // reply larger than the caller's buffer
+            break;
+        }
+
+        if (was_empty && frame.len > 0)
+        {
+            // Slave has started talking: switch from turnaround to frame timeout.
+            int64_t now_us = nilan_transport_now_us();
+            deadline_us = now_us + (int64_t)NILAN_RTU_FRAME_TIMEOUT_MS * 1000;
+
+            // The transport hands bytes over once a FIFO threshold fills or the
+            // line goes quiet, so back-date the first byte by the wire time of
+            // what it delivered (and the silence, if that is what released it).
+            int64_t back_us = (int64_t)got * NILAN_RTU_CHAR_US;
+            if (events & NILAN_TRANSPORT_EVT_IDLE)
+            {
+                back_us += (int64_t)NILAN_RTU_T35_SYMBOLS * NILAN_RTU_CHAR_US;
+            }
+            first_byte_us = now_us - back_us;
+            if (first_byte_us < tx_done_us)
+            {
+                first_byte_us = tx_done_us;
+            }
+        }
+
+        if (frame_complete(&frame))
+        {
+            err = (frame.crc == 0) ? NILAN_MB_ERR_NONE : NILAN_MB_ERR_CRC;
+            done = true;
+        }
+        else if (frame.len >= frame.cap)
+        {
+            err = NILAN_MB_ERR_LENGTH;
+            done = true;
+        }
+        else if ((events & NILAN_TRANSPORT_EVT_IDLE) && frame.len > 0)
+        {
+            // t3.5 silence closed the frame before the header-predicted length.
+            // A frame for a function we can't size is still fine if the CRC holds.
+            if (frame.expected == 0 && frame.len >= 4 && frame.crc == 0)
+            {
+                err = NILAN_MB_ERR_NONE;
+            }
+            else
+            {
+                err = NILAN_MB_ERR_LENGTH;
+            }
+            done = true;
+        }
+    }
+
+    if (line_error && (err == NILAN_MB_ERR_CRC || err == NILAN_MB_ERR_LENGTH))
+    {
+        err = NILAN_MB_ERR_LINE;
+    }
+
+    int64_t end_us = nilan_transport_now_us();
+    last_timing.tx_us = (uint32_t)(tx_done_us - start_us);
+    last_timing.total_us = (uint32_t)(end_us - start_us);
+    if (first_byte_us != 0)
+    {
+        last_timing.turnaround_us = (uint32_t)(first_byte_us - tx_done_us);
+        last_timing.rx_us = (uint32_t)(end_us - first_byte_us);
+    }
+
+    *rx_len = frame.len;
+    return err;
+}
+
+void nilan_rtu_get_line_counters(nilan_rtu_line_counters_t *out)
+{
+    *out = line_counters;
+}
+
+void nilan_rtu_get_last_timing(nilan_rtu_timing_t *out)
+{
+    *out = last_timing;
+
+    // Hand each measurement out once, so a transaction that failed before reaching
+    // the wire doesn't get the previous one's timing.
+    last_timing.tx_us = NILAN_RTU_NO_TIME;
+    last_timing.turnaround_us = NILAN_RTU_NO_TIME;
+    last_timing.rx_us = NILAN_RTU_NO_TIME;
+    last_timing.total_us = NILAN_RTU_NO_TIME;
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+// Predict the total frame length from the bytes seen so far; 0 = not known yet.
+static size_t frame_expected_len(const uint8_t *buf, size_t len)
+{
+    if (len < 2)
+    {
+        return 0;
+    }
+
+    uint8_t func = buf[1];
+
+    if (func & 0x80)
+    {
+        return 5; // [addr][func|0x80][exception code][crc_lo][crc_hi]
+    }
+
+    switch (func)
+    {
+    case 0x03:
+    case 0x04:
+        // [addr][func][byte_count][data...][crc_lo][crc_hi]
+        return (len < 3) ? 0 : (size_t)(5 + buf[2]);
+
+    case 0x06:
+    case 0x10:
+        // Echo of [addr][func][reg_hi][reg_lo][val/qty_hi][val/qty_lo][crc_lo][crc_hi]
+        return 8;
+
+    default:
+        return 0; // unknown function: rely on t3.5 silence
+    }
+}
+
+// Append received bytes, folding them into the running CRC.
+// Returns false if the frame no longer fits the buffer.
+static bool frame_push(rtu_rx_frame_t *frame, const uint8_t *data, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (frame_complete(frame))
+        {
+            return true; // trailing noise after a complete frame is ignored
+        }
+        if (frame->len >= frame->cap)
+        {
+            return false;
+        }
+
+        frame->buf[frame->len] = data[i];
+        frame->crc = modbus_crc16_update(frame->crc, &data[i], 1);
+        frame->len++;
+
+        if (frame->expected == 0)
+        {
+            frame->expected = frame_expected_len(frame->buf, frame->len);
+        }
+    }
+    return true;
+}
+
+static inline bool frame_complete(const rtu_rx_frame_t *frame)
+{
+    return (frame->expected != 0) && (frame->len >= frame->expected);
+}
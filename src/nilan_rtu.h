@@ -0,0 +1,61 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "nilan_modbus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest RTU frame allowed by the Modbus spec (addr + PDU 253 + CRC).
+#define NILAN_RTU_MAX_FRAME 256
+
+// Raw UART error events seen since boot. Only the bus task writes these.
+typedef struct {
+    uint32_t parity_errors;
+    uint32_t frame_errors;
+    uint32_t breaks;
+    uint32_t fifo_overflows;  // hardware RX FIFO overran: we were too slow
+    uint32_t buffer_full;     // driver ring buffer full: same, one level up
+} nilan_rtu_line_counters_t;
+
+// Phase timing of the last transaction, in microseconds (nilan_transport_now_us).
+// NILAN_RTU_NO_TIME for phases the transaction never reached.
+#define NILAN_RTU_NO_TIME UINT32_MAX
+typedef struct {
+    uint32_t tx_us;         // request written until the last bit left the UART
+    uint32_t turnaround_us; // end of request until the slave's first byte
+    uint32_t rx_us;         // first reply byte until the frame was complete
+    uint32_t total_us;      // start to finish, i.e. how long we held the bus
+} nilan_rtu_timing_t;
+
+// Open the RS485 line through nilan_transport.h (19200 8E1).
+// Must be called once before nilan_rtu_transact().
+bool nilan_rtu_init(void);
+
+// Send one request frame (CRC already appended) and collect the reply into rx.
+//
+// Returns as soon as a complete frame (normal or exception) has been received and
+// its CRC checked, the line has gone quiet for t3.5 after a partial frame, or the
+// slave did not start answering within the response timeout.
+// *rx_len is always set to the number of bytes actually received.
+// A reply that fails CRC or length checks after the UART flagged a parity or
+// framing error (or a break) is reported as NILAN_MB_ERR_LINE, and one that lost
+// bytes to an RX overflow as NILAN_MB_ERR_OVERRUN, so noise and local overload
+// can be told apart from a slave that answers badly.
+//
+// Not thread-safe: only the Modbus bus task (nilan_modbus.c) may call this.
+nilan_mb_err_t nilan_rtu_transact(const uint8_t *tx, size_t tx_len,
+                                  uint8_t *rx, size_t rx_cap, size_t *rx_len);
+
+void nilan_rtu_get_line_counters(nilan_rtu_line_counters_t *out);
+
+// Timing of the most recent nilan_rtu_transact() call, once: a second call
+// returns NILAN_RTU_NO_TIME everywhere (bus task only).
+void nilan_rtu_get_last_timing(nilan_rtu_timing_t *out);
+
+#ifdef __cplusplus
+}
+#endif
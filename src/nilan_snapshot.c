@@ -0,0 +1,304 @@
+#include "nilan_snapshot.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#include "sys_time.h"
+
+static const char *TAG = "nilan_snap";
+
+#define NILAN_SNAPSHOT_NAMESPACE "nilan"
+#define NILAN_SNAPSHOT_KEY "regs"
+#define NILAN_SNAPSHOT_VERSION 2
+
+// One blob write per period at most, and none when nothing changed: ~680 bytes
+// every 10 minutes is far below what the 24 KB NVS partition can wear-level.
+#define NILAN_SNAPSHOT_PERIOD_MS (10 * 60 * 1000)
+
+// First checkpoint comes sooner, once the whole poll plan has been read a few times.
+#define NILAN_SNAPSHOT_FIRST_MS (2 * 60 * 1000)
+
+// Ages are stored in seconds, saturating; NO_AGE marks "never read".
+#define NILAN_SNAPSHOT_NO_AGE UINT32_MAX
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+typedef struct
+{
+    uint16_t version;
+    uint16_t count;       // NILAN_REGID_COUNT when saved
+    uint32_t layout_hash; // nilan_reg_layout_hash() when saved
+    uint32_t saved_at;    // UTC seconds (sys_time.h), 0 if there was no time yet
+    uint16_t raw[NILAN_REGID_COUNT];
+    uint32_t age_s[NILAN_REGID_COUNT]; // at saved_at
+} nilan_snapshot_blob_t;
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+// Registers that change on every read anyway; a difference there alone
+// doesn't justify a flash write.
+static const nilan_reg_id_t volatile_regs[] = {
+    NILAN_REGID_IR_CONTROL_SEC_IN_STATE,
+    NILAN_REGID_HR_TIME_SECOND,
+    NILAN_REGID_HR_TIME_MINUTE,
+    NILAN_REGID_HR_TIME_HOUR,
+    NILAN_REGID_HR_TIME_DAY,
+    NILAN_REGID_HR_TIME_MONTH,
+    NILAN_REGID_HR_TIME_YEAR,
+};
+
+// Ages at the time the restored snapshot was saved.
+static uint32_t restored_age_s[NILAN_REGID_COUNT];
+static uint32_t restored_saved_at = 0;
+
+// Working copy and what was last written (checkpoint task only).
+static nilan_snapshot_blob_t blob;
+static uint16_t saved_raw[NILAN_REGID_COUNT];
+static bool saved_once = false;
+
+static TaskHandle_t snapshot_task = NULL;
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static bool nvs_ready(void);
+static bool is_volatile(size_t id);
+static bool age_now(size_t id, uint32_t *out);
+static bool worth_saving(void);
+static void snapshot_save(void);
+static void nilan_snapshot_task(void *arg);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+bool nilan_snapshot_restore(void)
+{
+    memset(restored_age_s, 0xFF, sizeof(restored_age_s));
+
+    if (!nvs_ready())
+    {
+        return false;
+    }
+
+    nvs_handle_t h;
+    if (nvs_open(NILAN_SNAPSHOT_NAMESPACE, NVS_READONLY, &h) != ESP_OK)
+    {
+        return false; // first boot
+    }
+
+    size_t len = sizeof(blob);
+    esp_err_t err = nvs_get_blob(h, NILAN_SNAPSHOT_KEY, &blob, &len);
+    nvs_close(h);
+
+    if (err != ESP_OK || len != sizeof(blob) || blob.version != NILAN_SNAPSHOT_VERSION ||
+        blob.count != NILAN_REGID_COUNT || blob.layout_hash != nilan_reg_layout_hash())
+    {
+        ESP_LOGI(TAG, "no usable snapshot (%s)", esp_err_to_name(err));
+        return false;
+    }
+
+    size_t restored = 0;
+    uint32_t oldest_s = 0;
+
+    for (size_t id = 0; id < NILAN_REGID_COUNT; ++id)
+    {
+        if (blob.age_s[id] == NILAN_SNAPSHOT_NO_AGE)
+        {
+            continue;
+        }
+
+        nilan_reg_restore((nilan_reg_id_t)id, blob.raw[id]);
+        restored_age_s[id] = blob.age_s[id];
+        saved_raw[id] = blob.raw[id];
+        restored++;
+
+        if (blob.age_s[id] > oldest_s)
+        {
+            oldest_s = blob.age_s[id];
+        }
+    }
+
+    restored_saved_at = blob.saved_at;
+    saved_once = (restored > 0); // what's in flash is what we just loaded
+    ESP_LOGI(TAG, "restored %u registers, oldest %us old at save", (unsigned)restored, (unsigned)oldest_s);
+    return restored > 0;
+}
+
+bool nilan_snapshot_start(void)
+{
+    if (snapshot_task != NULL)
+    {
+        return true;
+    }
+
+    return xTaskCreate(nilan_snapshot_task, "nilan_snap", 3072, NULL, 2, &snapshot_task) == pdPASS;
+}
+
+bool nilan_snapshot_restored_age_s(nilan_reg_id_t id, uint32_t *out)
+{
+    if (id >= NILAN_REGID_COUNT || out == NULL)
+    {
+        return false;
+    }
+    return age_now(id, out);
+}
+
+static void nilan_snapshot_task(void *arg)
+{
+    (void)arg; // Silence the unused parameter warning.
+
+    vTaskDelay(pdMS_TO_TICKS(NILAN_SNAPSHOT_FIRST_MS));
+
+    while (1)
+    {
+        if (worth_saving())
+        {
+            snapshot_save();
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(NILAN_SNAPSHOT_PERIOD_MS));
+    }
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+static bool nvs_ready(void)
+{
+    // Same recovery as wifi_sta.c; whoever comes first initializes.
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        if (nvs_flash_erase() != ESP_OK)
+        {
+            return false;
+        }
+        ret = nvs_flash_init();
+    }
+    return ret == ESP_OK;
+}
+
+static bool is_volatile(size_t id)
+{
+    for (size_t i = 0; i < sizeof(volatile_regs) / sizeof(volatile_regs[0]); ++i)
+    {
+        if (volatile_regs[i] == id)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Age of a restored value now: its age at save plus the wall-clock time since,
+// the time the device was off included. False if it wasn't restored, or if the
+// snapshot or this boot has no time to measure by.
+static bool age_now(size_t id, uint32_t *out)
+{
+    int64_t now;
+    if (restored_age_s[id] == NILAN_SNAPSHOT_NO_AGE || restored_saved_at == 0 || !sys_time_now(&now) ||
+        now < (int64_t)restored_saved_at)
+    {
+        return false;
+    }
+
+    uint64_t age = (uint64_t)restored_age_s[id] + (uint64_t)(now - restored_saved_at);
+    *out = (age < NILAN_SNAPSHOT_NO_AGE) ? (uint32_t)age : NILAN_SNAPSHOT_NO_AGE - 1;
+    return true;
+}
+
+// Something freshly read differs from what's in flash (clock-like registers aside).
+static bool worth_saving(void)
+{
+    for (size_t id = 0; id < NILAN_REGID_COUNT; ++id)
+    {
+        nilan_reg_id_t rid = (nilan_reg_id_t)id;
+        if (nilan_reg_gen(rid) == 0 || nilan_reg_is_stale(rid))
+        {
+            continue;
+        }
+
+        if (!saved_once || (!is_volatile(id) && nilan_reg_raw(rid) != saved_raw[id]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void snapshot_save(void)
+{
+    uint32_t now_ms = (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+    int64_t now;
+
+    blob.version = NILAN_SNAPSHOT_VERSION;
+    blob.count = NILAN_REGID_COUNT;
+    blob.layout_hash = nilan_reg_layout_hash();
+    blob.saved_at = sys_time_now(&now) ? (uint32_t)now : 0;
+
+    for (size_t id = 0; id < NILAN_REGID_COUNT; ++id)
+    {
+        nilan_reg_id_t rid = (nilan_reg_id_t)id;
+        nilan_reg_value_t v;
+        uint32_t age_s;
+
+        if (!nilan_reg_read(rid, &v))
+        {
+            blob.raw[id] = 0;
+            blob.age_s[id] = NILAN_SNAPSHOT_NO_AGE;
+            continue;
+        }
+
+        if (nilan_reg_is_stale(rid))
+        {
+            // Still the restored value. Without wall-clock times, count at
+            // least our uptime since.
+            if (!age_now(id, &age_s))
+            {
+                uint64_t a = (uint64_t)restored_age_s[id] + now_ms / 1000;
+                age_s = (a < NILAN_SNAPSHOT_NO_AGE) ? (uint32_t)a : NILAN_SNAPSHOT_NO_AGE - 1;
+            }
+        }
+        else
+        {
+            age_s = (now_ms - v.timestamp_ms) / 1000;
+        }
+
+        blob.raw[id] = v.raw;
+        blob.age_s[id] = (age_s < NILAN_SNAPSHOT_NO_AGE) ? age_s : NILAN_SNAPSHOT_NO_AGE - 1;
+    }
+
+    nvs_handle_t h;
+    if (nvs_open(NILAN_SNAPSHOT_NAMESPACE, NVS_READWRITE, &h) != ESP_OK)
+    {
+        return;
+    }
+
+    esp_err_t err = nvs_set_blob(h, NILAN_SNAPSHOT_KEY, &blob, sizeof(blob));
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(h);
+    }
+    nvs_close(h);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "checkpoint failed: %s", esp_err_to_name(err));
+        return;
+    }
+
+    memcpy(saved_raw, blob.raw, sizeof(saved_raw));
+    saved_once = true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "NilanRegisters.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Register snapshot in NVS, so the UI has something to show right after boot.
+ *
+ * A low-priority task checkpoints the register store (values and their ages,
+ * with the wall-clock time of the save from sys_time.h) to one NVS blob, at most every NILAN_SNAPSHOT_PERIOD_MS and only when a value
+ * other than the clock-like registers has changed since the last save. On boot,
+ * nilan_snapshot_restore() puts the saved values back into the store as stale
+ * (nilan_reg_is_stale()) before the UI is built; the first real read of each
+ * register replaces it.
+ */
+
+// Load the last snapshot into the register store. Call once at boot, before
+// ui_init() and nilan_modbus_start(). Initializes NVS if nobody has yet.
+// Returns false if there was no usable snapshot (first boot, register table changed).
+bool nilan_snapshot_restore(void);
+
+// Start the checkpoint task. Call after nilan_modbus_start().
+bool nilan_snapshot_start(void);
+
+// Age of a restored value now, in seconds, the time the device was off included.
+// False if it wasn't restored, or if there is no wall-clock time to measure by
+// (no time when the snapshot was saved, or none yet on this boot).
+bool nilan_snapshot_restored_age_s(nilan_reg_id_t id, uint32_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,375 @@
+#include "nilan_spool.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+
+#include "CRC16.h"
+
+static const char *TAG = "nilan_spool";
+
+#define NILAN_SPOOL_SECTOR 4096
+#define NILAN_SPOOL_MAGIC 0x5053544Eu // "NTSP"
+#define NILAN_SPOOL_VERSION 1
+
+// Record header states. Sending only clears bits, so it needs no erase.
+#define NILAN_SPOOL_UNSENT 0xFF
+#define NILAN_SPOOL_SENT 0x00
+#define NILAN_SPOOL_FREE 0xFFFF // len of a record that was never written
+
+#define NILAN_SPOOL_FIRST_REC 16 // sector header, rounded up
+#define NILAN_SPOOL_NONE SIZE_MAX
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+// Start of every sector.
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq; // +1 per sector opened
+    uint16_t version;
+    uint16_t crc; // Modbus CRC16 over everything above
+} nilan_spool_sec_hdr_t;
+
+typedef struct
+{
+    uint16_t len;   // payload bytes, or NILAN_SPOOL_FREE
+    uint16_t crc;   // over the payload
+    uint8_t state;  // NILAN_SPOOL_UNSENT / NILAN_SPOOL_SENT
+    uint8_t reserved[3];
+} nilan_spool_rec_hdr_t;
+
+_Static_assert(sizeof(nilan_spool_sec_hdr_t) <= NILAN_SPOOL_FIRST_REC, "sector header too big");
+_Static_assert(NILAN_SPOOL_FIRST_REC + sizeof(nilan_spool_rec_hdr_t) + NILAN_SPOOL_MAX_RECORD <= NILAN_SPOOL_SECTOR,
+               "a record must fit an empty sector");
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static const esp_partition_t *part = NULL;
+static size_t sec_count = 0;
+
+// Sectors in use run from tail (oldest) to head (being filled), round the ring.
+static size_t used = 0;
+static size_t tail = 0;
+static size_t head = 0;
+static uint32_t head_seq = 0;
+static size_t head_off = NILAN_SPOOL_SECTOR; // next write in head
+static size_t rd_off = NILAN_SPOOL_FIRST_REC; // next record to look at in tail
+
+static size_t peek_off = NILAN_SPOOL_NONE; // record handed out by the last peek
+static size_t peek_len = 0;
+
+static nilan_spool_stats_t stats;
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static bool open_sector(void);
+static void release_tail(void);
+static bool read_sec_hdr(size_t sec, nilan_spool_sec_hdr_t *hdr);
+static bool read_rec_hdr(size_t sec, size_t off, nilan_spool_rec_hdr_t *rh);
+static size_t scan_sector(size_t sec, uint32_t *unsent, uint32_t *bytes);
+static void mark_sent(size_t sec, size_t off);
+static inline size_t rec_size(size_t len) { return (sizeof(nilan_spool_rec_hdr_t) + len + 3) & ~(size_t)3; }
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+bool nilan_spool_open(const char *label)
+{
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (part == NULL)
+    {
+        ESP_LOGW(TAG, "no \"%s\" partition", label);
+        return false;
+    }
+    sec_count = part->size / NILAN_SPOOL_SECTOR;
+
+    // Head is the newest sector; the ones before it with consecutive
+    // sequence numbers are still waiting to be sent.
+    nilan_spool_sec_hdr_t hdr;
+    bool found = false;
+    for (size_t s = 0; s < sec_count; ++s)
+    {
+        if (read_sec_hdr(s, &hdr) && (!found || (int32_t)(hdr.seq - head_seq) > 0))
+        {
+            head = s;
+            head_seq = hdr.seq;
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        used = 0;
+        ESP_LOGI(TAG, "%u sectors, empty", (unsigned)sec_count);
+        return true;
+    }
+
+    used = 1;
+    tail = head;
+    while (used < sec_count)
+    {
+        size_t prev = (tail + sec_count - 1) % sec_count;
+        if (!read_sec_hdr(prev, &hdr) || hdr.seq != head_seq - used)
+        {
+            break;
+        }
+        tail = prev;
+        used++;
+    }
+
+    for (size_t i = 0; i < used; ++i)
+    {
+        size_t s = (tail + i) % sec_count;
+        size_t end = scan_sector(s, &stats.records, &stats.bytes);
+        if (s == head)
+        {
+            head_off = end;
+        }
+    }
+    rd_off = NILAN_SPOOL_FIRST_REC;
+
+    ESP_LOGI(TAG, "%u of %u sectors in use, %lu records waiting", (unsigned)used, (unsigned)sec_count,
+             (unsigned long)stats.records);
+    return true;
+}
+
+bool nilan_spool_push(const void *data, size_t len)
+{
+    if (part == NULL || len == 0 || len > NILAN_SPOOL_MAX_RECORD)
+    {
+        return false;
+    }
+
+    if ((used == 0 || head_off + rec_size(len) > NILAN_SPOOL_SECTOR) && !open_sector())
+    {
+        stats.flash_errors++;
+        return false;
+    }
+
+    nilan_spool_rec_hdr_t rh = {
+        .len = (uint16_t)len,
+        .crc = modbus_crc16((const uint8_t *)data, len),
+        .state = NILAN_SPOOL_UNSENT,
+        .reserved = {0xFF, 0xFF, 0xFF},
+    };
+
+    // Header first: a cut before the payload is complete leaves a CRC mismatch,
+    // never a free-looking slot with data after it.
+    size_t addr = head * NILAN_SPOOL_SECTOR + head_off;
+    head_off += rec_size(len);
+    if (esp_partition_write(part, addr, &rh, sizeof(rh)) != ESP_OK ||
+        esp_partition_write(part, addr + sizeof(rh), data, len) != ESP_OK)
+    {
+        stats.flash_errors++;
+        return false;
+    }
+
+    stats.records++;
+    stats.bytes += len;
+    stats.pushed++;
+    return true;
+}
+
+size_t nilan_spool_peek(void *buf, size_t cap)
+{
+    peek_off = NILAN_SPOOL_NONE;
+
+    while (used > 0)
+    {
+        nilan_spool_rec_hdr_t rh;
+        bool in_head = (tail == head);
+
+        if ((in_head && rd_off >= head_off) || !read_rec_hdr(tail, rd_off, &rh))
+        {
+            if (in_head)
+            {
+                return 0; // all sent; head stays open for writing
+            }
+            release_tail();
+            continue;
+        }
+
+        if (rh.state != NILAN_SPOOL_UNSENT)
+        {
+            rd_off += rec_size(rh.len);
+            continue;
+        }
+
+        if (rh.len > cap ||
+            esp_partition_read(part, tail * NILAN_SPOOL_SECTOR + rd_off + sizeof(rh), buf, rh.len) != ESP_OK ||
+            modbus_crc16((const uint8_t *)buf, rh.len) != rh.crc)
+        {
+            stats.torn_records++;
+            stats.records--;
+            stats.bytes -= rh.len;
+            mark_sent(tail, rd_off); // don't trip over it again after a reboot
+            rd_off += rec_size(rh.len);
+            continue;
+        }
+
+        // rd_off stays put until pop(): an unsent record is peeked again.
+        peek_off = rd_off;
+        peek_len = rh.len;
+        return rh.len;
+    }
+    return 0;
+}
+
+void nilan_spool_pop(void)
+{
+    if (peek_off == NILAN_SPOOL_NONE)
+    {
+        return;
+    }
+
+    mark_sent(tail, peek_off);
+    rd_off = peek_off + rec_size(peek_len);
+    stats.records--;
+    stats.bytes -= peek_len;
+    stats.popped++;
+    peek_off = NILAN_SPOOL_NONE;
+}
+
+void nilan_spool_get_stats(nilan_spool_stats_t *out)
+{
+    if (out != NULL)
+    {
+        *out = stats;
+    }
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+// Erase the sector after head and make it the new head. A full ring first
+// gives up its oldest sector.
+static bool open_sector(void)
+{
+    size_t next = (used == 0) ? head : (head + 1) % sec_count;
+
+    if (used == sec_count)
+    {
+        uint32_t unsent = 0;
+        uint32_t bytes = 0;
+        scan_sector(tail, &unsent, &bytes);
+        stats.dropped_records += unsent;
+        stats.records -= unsent;
+        stats.bytes -= bytes;
+
+        tail = (tail + 1) % sec_count;
+        rd_off = NILAN_SPOOL_FIRST_REC;
+        peek_off = NILAN_SPOOL_NONE;
+        used--;
+        ESP_LOGW(TAG, "spool full, dropped %lu records", (unsigned long)unsent);
+    }
+
+    if (esp_partition_erase_range(part, next * NILAN_SPOOL_SECTOR, NILAN_SPOOL_SECTOR) != ESP_OK)
+    {
+        return false;
+    }
+
+    nilan_spool_sec_hdr_t hdr = {
+        .magic = NILAN_SPOOL_MAGIC,
+        .seq = head_seq + 1,
+        .version = NILAN_SPOOL_VERSION,
+    };
+    hdr.crc = modbus_crc16((const uint8_t *)&hdr, offsetof(nilan_spool_sec_hdr_t, crc));
+
+    if (esp_partition_write(part, next * NILAN_SPOOL_SECTOR, &hdr, sizeof(hdr)) != ESP_OK)
+    {
+        return false;
+    }
+
+    if (used == 0)
+    {
+        tail = next;
+        rd_off = NILAN_SPOOL_FIRST_REC;
+    }
+    head = next;
+    head_seq = hdr.seq;
+    head_off = NILAN_SPOOL_FIRST_REC;
+    used++;
+    return true;
+}
+
+// Everything in the oldest sector has been sent: free it.
+static void release_tail(void)
+{
+    if (esp_partition_erase_range(part, tail * NILAN_SPOOL_SECTOR, NILAN_SPOOL_SECTOR) != ESP_OK)
+    {
+        stats.flash_errors++; // its header stays; the next boot re-reads it as sent
+    }
+    tail = (tail + 1) % sec_count;
+    rd_off = NILAN_SPOOL_FIRST_REC;
+    used--;
+}
+
+static bool read_sec_hdr(size_t sec, nilan_spool_sec_hdr_t *hdr)
+{
+    if (esp_partition_read(part, sec * NILAN_SPOOL_SECTOR, hdr, sizeof(*hdr)) != ESP_OK)
+    {
+        return false;
+    }
+
+    return hdr->magic == NILAN_SPOOL_MAGIC && hdr->version == NILAN_SPOOL_VERSION &&
+           hdr->crc == modbus_crc16((const uint8_t *)hdr, offsetof(nilan_spool_sec_hdr_t, crc));
+}
+
+// True if a written record that fits the sector starts at off.
+static bool read_rec_hdr(size_t sec, size_t off, nilan_spool_rec_hdr_t *rh)
+{
+    if (off + sizeof(*rh) > NILAN_SPOOL_SECTOR ||
+        esp_partition_read(part, sec * NILAN_SPOOL_SECTOR + off, rh, sizeof(*rh)) != ESP_OK)
+    {
+        return false;
+    }
+
+    return rh->len != NILAN_SPOOL_FREE && rh->len <= NILAN_SPOOL_MAX_RECORD &&
+           off + rec_size(rh->len) <= NILAN_SPOOL_SECTOR;
+}
+
+// Add up the unsent records of a sector. Returns where the next record would
+// go; a garbled header closes the sector.
+static size_t scan_sector(size_t sec, uint32_t *unsent, uint32_t *bytes)
+{
+    nilan_spool_rec_hdr_t rh;
+    size_t off = NILAN_SPOOL_FIRST_REC;
+
+    while (read_rec_hdr(sec, off, &rh))
+    {
+        if (rh.state == NILAN_SPOOL_UNSENT)
+        {
+            (*unsent)++;
+            *bytes += rh.len;
+        }
+        off += rec_size(rh.len);
+    }
+
+    if (off + sizeof(rh) <= NILAN_SPOOL_SECTOR &&
+        esp_partition_read(part, sec * NILAN_SPOOL_SECTOR + off, &rh, sizeof(rh)) == ESP_OK &&
+        rh.len != NILAN_SPOOL_FREE)
+    {
+        return NILAN_SPOOL_SECTOR;
+    }
+    return off;
+}
+
+static void mark_sent(size_t sec, size_t off)
+{
+    uint8_t sent = NILAN_SPOOL_SENT;
+    if (esp_partition_write(part, sec * NILAN_SPOOL_SECTOR + off + offsetof(nilan_spool_rec_hdr_t, state), &sent,
+                            sizeof(sent)) != ESP_OK)
+    {
+        stats.flash_errors++;
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * First-in first-out queue of opaque records on a raw data partition (label
+ * "tlmspool" in partitions_core2.csv), for data that has to wait for the
+ * network.
+ *
+ * The partition is a ring of 4 KB sectors, each with a header carrying a
+ * sequence number, filled with records of up to NILAN_SPOOL_MAX_RECORD bytes.
+ * A record is written once, with a CRC, and marked sent in place by clearing
+ * a flag byte. A sector is erased once everything in it has been sent. When
+ * the ring is full the oldest sector is erased to make room, and its unsent
+ * records are counted as dropped.
+ *
+ * At boot the sector headers and record headers rebuild the queue. A record
+ * torn by a power cut fails its CRC and is skipped. Delivery is at least
+ * once: a power cut between sending a record and marking it can repeat it.
+ *
+ * Not thread-safe: one task owns the spool. Only the stats getter may be
+ * called from elsewhere.
+ */
+
+#define NILAN_SPOOL_MAX_RECORD 4000
+
+typedef struct
+{
+    uint32_t records;         // waiting to be sent
+    uint32_t bytes;           // payload bytes waiting
+    uint32_t pushed;
+    uint32_t popped;
+    uint32_t dropped_records; // overwritten before they were sent
+    uint32_t torn_records;    // failed their CRC
+    uint32_t flash_errors;
+} nilan_spool_stats_t;
+
+// Find the partition and rebuild the queue from flash.
+bool nilan_spool_open(const char *label);
+
+// Append a record. Makes room by dropping the oldest sector if needed.
+bool nilan_spool_push(const void *data, size_t len);
+
+// Copy the oldest unsent record into buf. Returns its length, 0 when empty.
+size_t nilan_spool_peek(void *buf, size_t cap);
+
+// Mark the record returned by the last peek as sent.
+void nilan_spool_pop(void);
+
+void nilan_spool_get_stats(nilan_spool_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,408 @@
+#include "nilan_telemetry.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_http_client.h"
+#include "esp_log.h"
+
+#include "NilanRegisters.h"
+#include "nilan_spool.h"
+#include "sys_time.h"
+#include "wifi_sta.h"
+
+static const char *TAG = "nilan_tlm";
+
+#define NILAN_TELEMETRY_SPOOL_LABEL "tlmspool"
+#define NILAN_TELEMETRY_TICK_MS 1000
+#define NILAN_TELEMETRY_HTTP_TIMEOUT_MS 5000
+
+// Longest field: "hr65535=-327.68,"
+#define NILAN_TELEMETRY_MAX_FIELD 24
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+typedef enum
+{
+    POST_OK = 0,
+    POST_FAILED,   // worth another try later
+    POST_REJECTED, // the server won't ever take it
+} post_result_t;
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static TaskHandle_t tlm_task = NULL;
+static esp_http_client_handle_t client = NULL;
+static bool spool_ok = false;
+
+static bool have_time = false; // as of the current sample
+
+static uint16_t last_gen[NILAN_REGID_COUNT]; // generation last sent, per register
+static uint32_t last_full_ms = 0;
+static bool full_due = true;
+
+static char batch[NILAN_TELEMETRY_BATCH_BYTES];
+static size_t batch_len = 0;
+static uint32_t batch_opened_ms = 0;
+static bool batch_timeless = false; // holds lines without a timestamp
+
+static char line[NILAN_TELEMETRY_BATCH_BYTES];
+static char drain_buf[NILAN_TELEMETRY_BATCH_BYTES];
+
+static volatile bool link_ok = false; // follows WIFI_STA_EVENT
+static volatile bool retry_pending = false; // hold off posting until retry_at_ms
+static volatile uint32_t retry_at_ms = 0;
+static uint32_t last_drain_ms = 0;
+
+static nilan_telemetry_stats_t stats;
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static void nilan_telemetry_task(void *arg);
+static void sample(uint32_t now);
+static size_t build_line(bool full);
+static void flush_batch(uint32_t now);
+static void drain_one(uint32_t now);
+static post_result_t post(const char *body, size_t len, uint32_t now);
+static bool link_up(uint32_t now);
+static void link_event(void *arg, esp_event_base_t base, int32_t id, void *data);
+static size_t format_field(nilan_reg_id_t id, uint16_t raw, char *out, size_t cap);
+static inline uint32_t get_time_ms(void);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+bool nilan_telemetry_start(void)
+{
+    if (tlm_task != NULL)
+    {
+        return true;
+    }
+
+    if (NILAN_TELEMETRY_URL[0] == '\0')
+    {
+        ESP_LOGI(TAG, "no NILAN_TELEMETRY_URL, not uploading");
+        return false;
+    }
+
+    esp_http_client_config_t cfg = {
+        .url = NILAN_TELEMETRY_URL,
+        .method = HTTP_METHOD_POST,
+        .timeout_ms = NILAN_TELEMETRY_HTTP_TIMEOUT_MS,
+        .keep_alive_enable = true,
+    };
+    client = esp_http_client_init(&cfg);
+    if (client == NULL)
+    {
+        return false;
+    }
+    esp_http_client_set_header(client, "Content-Type", "text/plain; charset=utf-8");
+    if (NILAN_TELEMETRY_TOKEN[0] != '\0')
+    {
+        esp_http_client_set_header(client, "Authorization", "Token " NILAN_TELEMETRY_TOKEN);
+    }
+
+    spool_ok = nilan_spool_open(NILAN_TELEMETRY_SPOOL_LABEL);
+
+    esp_event_handler_register(WIFI_STA_EVENT, ESP_EVENT_ANY_ID, link_event, NULL);
+    link_ok = wifi_sta_is_connected();
+
+    if (xTaskCreate(nilan_telemetry_task, "nilan_tlm", 6144, NULL, 2, &tlm_task) != pdPASS)
+    {
+        esp_http_client_cleanup(client);
+        client = NULL;
+        return false;
+    }
+    return true;
+}
+
+void nilan_telemetry_get_stats(nilan_telemetry_stats_t *out)
+{
+    if (out == NULL)
+    {
+        return;
+    }
+
+    nilan_spool_stats_t sp;
+    nilan_spool_get_stats(&sp);
+
+    *out = stats;
+    out->dropped_batches += sp.dropped_records + sp.torn_records;
+    out->backlog_batches = sp.records;
+    out->backlog_bytes = sp.bytes;
+}
+
+static void nilan_telemetry_task(void *arg)
+{
+    (void)arg; // Silence the unused parameter warning.
+
+    TickType_t last_wake = xTaskGetTickCount();
+    uint32_t last_sample_ms = get_time_ms();
+
+    while (1)
+    {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(NILAN_TELEMETRY_TICK_MS));
+        uint32_t now = get_time_ms();
+
+        if (now - last_sample_ms >= NILAN_TELEMETRY_SAMPLE_S * 1000)
+        {
+            last_sample_ms = now;
+            sample(now);
+        }
+
+        // Live data first; the backlog gets what's left of the link.
+        if (batch_len > 0 && now - batch_opened_ms >= NILAN_TELEMETRY_POST_S * 1000)
+        {
+            flush_batch(now);
+        }
+        else if (spool_ok && link_up(now) && now - last_drain_ms >= NILAN_TELEMETRY_DRAIN_MS)
+        {
+            last_drain_ms = now;
+            drain_one(now);
+        }
+    }
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+static void sample(uint32_t now)
+{
+    have_time = (sys_time_source() != SYS_TIME_SOURCE_NONE);
+
+    if (now - last_full_ms >= NILAN_TELEMETRY_FULL_S * 1000)
+    {
+        full_due = true;
+    }
+
+    size_t len = build_line(full_due);
+    if (len == 0)
+    {
+        return;
+    }
+    if (full_due)
+    {
+        full_due = false;
+        last_full_ms = now;
+    }
+
+    // A batch holds either stamped or unstamped lines, never both.
+    if (batch_len > 0 && (batch_len + len > sizeof(batch) || batch_timeless != !have_time))
+    {
+        flush_batch(now);
+    }
+    if (batch_len == 0)
+    {
+        batch_opened_ms = now;
+        batch_timeless = !have_time;
+    }
+
+    memcpy(batch + batch_len, line, len);
+    batch_len += len;
+    stats.lines++;
+}
+
+// One line into line[]: the registers with a value read since the last
+// sample, or all read ones. Returns its length, 0 if nothing changed.
+static size_t build_line(bool full)
+{
+    size_t len = (size_t)snprintf(line, sizeof(line), "nilan ");
+    size_t fields_at = len;
+
+    for (size_t i = 0; i < NILAN_REGID_COUNT; ++i)
+    {
+        nilan_reg_id_t id = (nilan_reg_id_t)i;
+        uint16_t gen = nilan_reg_gen(id);
+
+        if (gen == 0 || nilan_reg_is_stale(id) || (!full && gen == last_gen[i]))
+        {
+            continue;
+        }
+        if (len + NILAN_TELEMETRY_MAX_FIELD + 16 > sizeof(line))
+        {
+            break; // the rest goes with the next sample
+        }
+
+        nilan_reg_value_t v;
+        if (!nilan_reg_read(id, &v))
+        {
+            continue;
+        }
+        if (len > fields_at)
+        {
+            line[len++] = ',';
+        }
+        len += format_field(id, v.raw, line + len, sizeof(line) - len);
+        last_gen[i] = gen;
+    }
+
+    if (len == fields_at)
+    {
+        return 0;
+    }
+
+    int64_t t;
+    if (have_time && sys_time_now(&t))
+    {
+        len += (size_t)snprintf(line + len, sizeof(line) - len, " %lld\n", (long long)t);
+    }
+    else
+    {
+        line[len++] = '\n';
+    }
+    return len;
+}
+
+static void flush_batch(uint32_t now)
+{
+    post_result_t r = POST_FAILED;
+
+    if (link_up(now))
+    {
+        r = post(batch, batch_len, now);
+    }
+
+    if (r == POST_OK)
+    {
+        stats.posted_batches++;
+    }
+    else if (r == POST_REJECTED)
+    {
+        stats.rejected_batches++;
+    }
+    else if (!batch_timeless && spool_ok && nilan_spool_push(batch, batch_len))
+    {
+        stats.spooled_batches++;
+    }
+    else
+    {
+        stats.dropped_batches++;
+    }
+    batch_len = 0;
+}
+
+static void drain_one(uint32_t now)
+{
+    size_t len = nilan_spool_peek(drain_buf, sizeof(drain_buf));
+    if (len == 0)
+    {
+        return;
+    }
+
+    post_result_t r = post(drain_buf, len, now);
+    if (r == POST_FAILED)
+    {
+        return; // stays first in line
+    }
+
+    nilan_spool_pop();
+    if (r == POST_OK)
+    {
+        stats.drained_batches++;
+    }
+    else
+    {
+        stats.rejected_batches++;
+    }
+}
+
+static post_result_t post(const char *body, size_t len, uint32_t now)
+{
+    esp_http_client_set_post_field(client, body, (int)len);
+    esp_err_t err = esp_http_client_perform(client);
+    int status = (err == ESP_OK) ? esp_http_client_get_status_code(client) : 0;
+    stats.last_status = status;
+
+    if (status >= 200 && status < 300)
+    {
+        return POST_OK;
+    }
+
+    // 408 and 429 mean "later", not "never".
+    if (status >= 400 && status < 500 && status != 408 && status != 429)
+    {
+        ESP_LOGW(TAG, "batch rejected, HTTP %d", status);
+        return POST_REJECTED;
+    }
+
+    ESP_LOGW(TAG, "post failed (%s, HTTP %d), spooling for %d s", esp_err_to_name(err), status,
+             NILAN_TELEMETRY_RETRY_S);
+    esp_http_client_close(client);
+    stats.post_failures++;
+    retry_at_ms = now + NILAN_TELEMETRY_RETRY_S * 1000;
+    retry_pending = true;
+    return POST_FAILED;
+}
+
+// The deadline is dropped once it has passed, so the wrapping compare only
+// ever sees a recent one.
+static bool link_up(uint32_t now)
+{
+    if (retry_pending && (int32_t)(now - retry_at_ms) >= 0)
+    {
+        retry_pending = false;
+    }
+    return link_ok && !retry_pending;
+}
+
+// Event loop task. Going down pauses posting at once, coming back resumes it
+// without waiting out a retry delay from the outage.
+static void link_event(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    (void)arg;
+    (void)base;
+    (void)data;
+
+    if (id == WIFI_STA_EVENT_UP)
+    {
+        retry_pending = false;
+        link_ok = true;
+    }
+    else if (id == WIFI_STA_EVENT_DOWN)
+    {
+        link_ok = false;
+    }
+}
+
+// "ir202=48.50": integer formatting only, like the /metrics values.
+static size_t format_field(nilan_reg_id_t id, uint16_t raw, char *out, size_t cap)
+{
+    const nilan_reg_meta_t *m = &nilan_registers[id];
+    const char *prefix = (m->reg_type == NILAN_INPUT_REG) ? "ir" : "hr";
+    int n;
+
+    switch (m->data_type)
+    {
+    case NILAN_DTYPE_TEMP_Cx100:
+    {
+        int32_t v = (int16_t)raw;
+        uint32_t a = (uint32_t)(v < 0 ? -v : v);
+        n = snprintf(out, cap, "%s%u=%s%lu.%02lu", prefix, (unsigned)m->addr, v < 0 ? "-" : "",
+                     (unsigned long)(a / 100), (unsigned long)(a % 100));
+        break;
+    }
+    case NILAN_DTYPE_INT16:
+        n = snprintf(out, cap, "%s%u=%di", prefix, (unsigned)m->addr, (int)(int16_t)raw);
+        break;
+    default:
+        n = snprintf(out, cap, "%s%u=%ui", prefix, (unsigned)m->addr, (unsigned)raw);
+        break;
+    }
+
+    return (n > 0 && (size_t)n < cap) ? (size_t)n : 0;
+}
+
+static inline uint32_t get_time_ms(void)
+{
+    return (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Store-and-forward uploader: register samples as InfluxDB line protocol,
+ * POSTed in batches to NILAN_TELEMETRY_URL.
+ *
+ * Every NILAN_TELEMETRY_SAMPLE_S the registers that changed since the last
+ * sample (every register, each NILAN_TELEMETRY_FULL_S) become one line:
+ *
+ *   nilan ir202=48.50,ir203=21.25,hr1001=2i 1760000000
+ *
+ * Field keys are "ir"/"hr" and the Modbus address (GET /registers has the
+ * names), temperatures are degrees C, everything else an integer. Timestamps
+ * are UTC seconds, so the URL must ask for precision=s.
+ *
+ * Lines collect in one batch of up to NILAN_TELEMETRY_BATCH_BYTES, which goes
+ * out after NILAN_TELEMETRY_POST_S. While Wi-Fi is down, or after a failed
+ * post, batches go to the on-flash spool (nilan_spool.h) instead. Once posts
+ * work again the backlog is sent oldest first, one batch per
+ * NILAN_TELEMETRY_DRAIN_MS, so catching up never crowds out live data. A
+ * batch the server rejects with a 4xx is dropped, as resending won't help.
+ *
+ * Until the wall clock (sys_time.h) has a time, lines carry no timestamp and
+ * the server stamps them on arrival; such batches can't be spooled and are
+ * dropped while offline.
+ */
+
+// Set via build_flags in platformio.ini, e.g.
+//   -DNILAN_TELEMETRY_URL=\"http://192.168.1.10:8086/api/v2/write?org=home&bucket=nilan&precision=s\"
+// Empty disables the uploader.
+#ifndef NILAN_TELEMETRY_URL
+#define NILAN_TELEMETRY_URL ""
+#endif
+
+// Sent as "Authorization: Token ..." when not empty.
+#ifndef NILAN_TELEMETRY_TOKEN
+#define NILAN_TELEMETRY_TOKEN ""
+#endif
+
+#define NILAN_TELEMETRY_SAMPLE_S 10
+#define NILAN_TELEMETRY_FULL_S 600
+#define NILAN_TELEMETRY_POST_S 60
+#define NILAN_TELEMETRY_BATCH_BYTES 3072
+#define NILAN_TELEMETRY_DRAIN_MS 2000 // backlog pace once the link is back
+#define NILAN_TELEMETRY_RETRY_S 30    // after a failed post, spool until then
+
+typedef struct
+{
+    uint32_t lines;
+    uint32_t posted_batches;   // live batches accepted
+    uint32_t drained_batches;  // spooled batches accepted
+    uint32_t post_failures;    // network errors and 5xx; the batch is kept
+    uint32_t rejected_batches; // 4xx; the batch is dropped
+    uint32_t spooled_batches;
+    uint32_t dropped_batches;  // lost: spool full or unusable, or no time to stamp them with
+    uint32_t backlog_batches;  // waiting in the spool
+    uint32_t backlog_bytes;
+    int last_status;           // HTTP status of the last post, 0 if it didn't get that far
+} nilan_telemetry_stats_t;
+
+// Open the spool and start the upload task. Call after wifi_sta_start() and
+// sys_time_init().
+bool nilan_telemetry_start(void);
+
+void nilan_telemetry_get_stats(nilan_telemetry_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Byte transport under the Modbus RTU layer.
+ *
+ * nilan_rtu.c only talks to the line through these calls, so the protocol code
+ * above it builds unchanged for the ESP32 (nilan_transport_esp32.c: UART1 on the
+ * RS485 unit) and for the ESP-IDF linux target (nilan_transport_posix.c: a serial
+ * device or pty, e.g. tools/cts602_sim). Exactly one backend is compiled in.
+ */
+
+// Line conditions reported by nilan_transport_read(), one bit each.
+#define NILAN_TRANSPORT_EVT_IDLE        (1u << 0) // line went quiet after the bytes returned
+#define NILAN_TRANSPORT_EVT_PARITY      (1u << 1)
+#define NILAN_TRANSPORT_EVT_FRAME       (1u << 2)
+#define NILAN_TRANSPORT_EVT_BREAK       (1u << 3)
+#define NILAN_TRANSPORT_EVT_FIFO_OVF    (1u << 4) // bytes lost: receive FIFO overran
+#define NILAN_TRANSPORT_EVT_BUFFER_FULL (1u << 5) // bytes lost: driver buffer full
+
+// Open the line at baud, 8E1. idle_symbols is the silence (in character times)
+// that ends a received frame and raises NILAN_TRANSPORT_EVT_IDLE.
+bool nilan_transport_open(uint32_t baud, uint8_t idle_symbols);
+
+// Send len bytes and wait until they have left the wire, or the deadline passes.
+bool nilan_transport_write(const uint8_t *data, size_t len, int64_t deadline_us);
+
+// Wait until bytes arrive, a line condition is seen, or the deadline passes.
+// Returns the number of bytes copied to buf (0 on deadline or a bare event) and
+// the conditions seen in *events. After an overrun the input has been flushed.
+size_t nilan_transport_read(uint8_t *buf, size_t cap, int64_t deadline_us, uint32_t *events);
+
+// Drop anything received but not read yet.
+void nilan_transport_flush(void);
+
+// Monotonic microseconds; all deadlines above are in this clock.
+int64_t nilan_transport_now_us(void);
+
+#ifdef __cplusplus
+}
+#endif
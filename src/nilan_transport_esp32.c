@@ -0,0 +1,189 @@
+#include "sdkconfig.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+
+#include "nilan_transport.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "esp_timer.h"
+
+#include "driver/gpio.h"
+#include "driver/uart.h"
+
+// ---------------- UART configuration ----------------
+//
+// Using Core2 Port A with the RS485 module:
+//
+//   GPIO32 -> Unit RX (Core2 TX)
+//   GPIO33 -> Unit TX (Core2 RX)
+//
+// Arduino sketch used:
+//   Serial2.begin(19200, SERIAL_8E1, RS485_RX_PIN, RS485_TX_PIN);
+//   RS485_RX_PIN = 33, RS485_TX_PIN = 32
+//
+// So here:
+//   TX = GPIO32, RX = GPIO33 on UART1
+//
+#define NILAN_UART_PORT UART_NUM_1
+#define NILAN_UART_TX_GPIO GPIO_NUM_32
+#define NILAN_UART_RX_GPIO GPIO_NUM_33
+#define NILAN_UART_BUF_SIZE 256
+#define NILAN_UART_EVT_QUEUE_LEN 16
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static QueueHandle_t uart_evt_queue = NULL;
+
+// Bytes announced by the last UART_DATA event that haven't been read yet, and
+// whether that event was the driver's RX timeout (line quiet after them).
+static size_t rx_pending = 0;
+static bool rx_pending_idle = false;
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+bool nilan_transport_open(uint32_t baud, uint8_t idle_symbols)
+{
+    uart_config_t cfg = {
+        .baud_rate = (int)baud,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_EVEN, // 8E1 matches Arduino SERIAL_8E1
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_APB,
+    };
+
+    if (uart_param_config(NILAN_UART_PORT, &cfg) != ESP_OK)
+    {
+        return false;
+    }
+
+    uart_set_pin(NILAN_UART_PORT,
+                 NILAN_UART_TX_GPIO,
+                 NILAN_UART_RX_GPIO,
+                 UART_PIN_NO_CHANGE,
+                 UART_PIN_NO_CHANGE);
+
+    // The event queue is what lets us wake on "bytes arrived" / "line went quiet"
+    // instead of blocking for a fixed byte count.
+    if (uart_driver_install(NILAN_UART_PORT,
+                            NILAN_UART_BUF_SIZE,
+                            NILAN_UART_BUF_SIZE,
+                            NILAN_UART_EVT_QUEUE_LEN,
+                            &uart_evt_queue,
+                            0) != ESP_OK)
+    {
+        return false;
+    }
+
+    uart_set_rx_timeout(NILAN_UART_PORT, idle_symbols);
+    return true;
+}
+
+bool nilan_transport_write(const uint8_t *data, size_t len, int64_t deadline_us)
+{
+    uart_write_bytes(NILAN_UART_PORT, (const char *)data, len);
+
+    int64_t left_us = deadline_us - esp_timer_get_time();
+    TickType_t wait = (left_us > 0) ? pdMS_TO_TICKS((left_us + 999) / 1000) : 0;
+    return uart_wait_tx_done(NILAN_UART_PORT, (wait == 0) ? 1 : wait) == ESP_OK;
+}
+
+size_t nilan_transport_read(uint8_t *buf, size_t cap, int64_t deadline_us, uint32_t *events)
+{
+    *events = 0;
+
+    while (1)
+    {
+        if (rx_pending > 0)
+        {
+            size_t n = (cap < rx_pending) ? cap : rx_pending;
+            int got = uart_read_bytes(NILAN_UART_PORT, buf, (uint32_t)n, 0);
+            if (got <= 0)
+            {
+                rx_pending = 0; // flushed under us; wait for the next event
+                continue;
+            }
+
+            rx_pending -= (size_t)got;
+            if (rx_pending == 0 && rx_pending_idle)
+            {
+                *events |= NILAN_TRANSPORT_EVT_IDLE;
+            }
+            return (size_t)got;
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        if (now_us >= deadline_us)
+        {
+            return 0;
+        }
+
+        TickType_t wait = pdMS_TO_TICKS((deadline_us - now_us + 999) / 1000);
+        if (wait == 0)
+        {
+            wait = 1;
+        }
+
+        uart_event_t evt;
+        if (xQueueReceive(uart_evt_queue, &evt, wait) != pdTRUE)
+        {
+            continue; // loop re-checks the deadline
+        }
+
+        switch (evt.type)
+        {
+        case UART_DATA:
+            rx_pending = evt.size;
+            rx_pending_idle = evt.timeout_flag;
+            if (rx_pending == 0 && evt.timeout_flag)
+            {
+                *events |= NILAN_TRANSPORT_EVT_IDLE;
+                return 0;
+            }
+            break;
+
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            *events |= (evt.type == UART_FIFO_OVF) ? NILAN_TRANSPORT_EVT_FIFO_OVF
+                                                   : NILAN_TRANSPORT_EVT_BUFFER_FULL;
+            nilan_transport_flush();
+            return 0;
+
+        case UART_PARITY_ERR:
+            *events |= NILAN_TRANSPORT_EVT_PARITY;
+            return 0;
+
+        case UART_FRAME_ERR:
+            *events |= NILAN_TRANSPORT_EVT_FRAME;
+            return 0;
+
+        case UART_BREAK:
+            *events |= NILAN_TRANSPORT_EVT_BREAK;
+            return 0;
+
+        default:
+            break;
+        }
+    }
+}
+
+void nilan_transport_flush(void)
+{
+    uart_flush_input(NILAN_UART_PORT);
+    xQueueReset(uart_evt_queue);
+    rx_pending = 0;
+    rx_pending_idle = false;
+}
+
+int64_t nilan_transport_now_us(void)
+{
+    return esp_timer_get_time();
+}
+
+#endif // !CONFIG_IDF_TARGET_LINUX
@@ -0,0 +1,167 @@
+#include "sdkconfig.h"
+
+#if CONFIG_IDF_TARGET_LINUX
+
+#include "nilan_transport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Serial device or pty to use, e.g. the --link of tools/cts602_sim/cts602_sim.py.
+#define NILAN_UART_DEV_ENV "NILAN_UART_DEV"
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static int uart_fd = -1;
+static int idle_ms = 3; // idle_symbols at the configured baud, rounded up
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static speed_t baud_to_speed(uint32_t baud);
+static int ms_until(int64_t deadline_us);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+bool nilan_transport_open(uint32_t baud, uint8_t idle_symbols)
+{
+    const char *dev = getenv(NILAN_UART_DEV_ENV);
+    if (dev == NULL)
+    {
+        fprintf(stderr, "nilan_transport: set %s to the serial device or pty\n", NILAN_UART_DEV_ENV);
+        return false;
+    }
+
+    uart_fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (uart_fd < 0)
+    {
+        fprintf(stderr, "nilan_transport: %s: %s\n", dev, strerror(errno));
+        return false;
+    }
+
+    // 8E1, raw. Bytes with parity errors are dropped by the tty (IGNPAR) and the
+    // CRC catches the gap, so no line events are reported on this backend.
+    struct termios tio;
+    if (tcgetattr(uart_fd, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tio.c_cflag |= PARENB | CLOCAL | CREAD;
+        tio.c_cflag &= ~(PARODD | CSTOPB);
+        tio.c_iflag |= INPCK | IGNPAR;
+        cfsetspeed(&tio, baud_to_speed(baud));
+        tcsetattr(uart_fd, TCSANOW, &tio); // a pty takes what it can and ignores the rest
+    }
+
+    uint32_t idle_us = (uint32_t)idle_symbols * 11u * 1000000u / baud;
+    idle_ms = (int)((idle_us + 999) / 1000);
+    return true;
+}
+
+bool nilan_transport_write(const uint8_t *data, size_t len, int64_t deadline_us)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = write(uart_fd, data + done, len - done);
+        if (n > 0)
+        {
+            done += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR)
+        {
+            return false;
+        }
+
+        struct pollfd pfd = {.fd = uart_fd, .events = POLLOUT};
+        if (poll(&pfd, 1, ms_until(deadline_us)) <= 0)
+        {
+            return false;
+        }
+    }
+
+    // Waits for the last bit on a real UART; returns at once on a pty.
+    tcdrain(uart_fd);
+    return nilan_transport_now_us() < deadline_us;
+}
+
+size_t nilan_transport_read(uint8_t *buf, size_t cap, int64_t deadline_us, uint32_t *events)
+{
+    *events = 0;
+
+    struct pollfd pfd = {.fd = uart_fd, .events = POLLIN};
+    if (poll(&pfd, 1, ms_until(deadline_us)) <= 0)
+    {
+        return 0;
+    }
+
+    ssize_t n = read(uart_fd, buf, cap);
+    if (n <= 0)
+    {
+        // Hung-up pty or EAGAIN: don't spin until the deadline.
+        usleep(1000);
+        return 0;
+    }
+
+    // Same contract as the ESP32 RX timeout: flag the bytes if the line stays
+    // quiet for idle_symbols after them.
+    pfd.revents = 0;
+    if (poll(&pfd, 1, idle_ms) == 0)
+    {
+        *events |= NILAN_TRANSPORT_EVT_IDLE;
+    }
+    return (size_t)n;
+}
+
+void nilan_transport_flush(void)
+{
+    tcflush(uart_fd, TCIFLUSH);
+}
+
+int64_t nilan_transport_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+static speed_t baud_to_speed(uint32_t baud)
+{
+    switch (baud)
+    {
+    case 9600:
+        return B9600;
+    case 38400:
+        return B38400;
+    case 57600:
+        return B57600;
+    case 115200:
+        return B115200;
+    case 19200:
+    default:
+        return B19200;
+    }
+}
+
+static int ms_until(int64_t deadline_us)
+{
+    int64_t left_us = deadline_us - nilan_transport_now_us();
+    return (left_us <= 0) ? 0 : (int)((left_us + 999) / 1000);
+}
+
+#endif // CONFIG_IDF_TARGET_LINUX
@@ -0,0 +1,507 @@
+#include "nilan_ws.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+
+#include "NilanRegisters.h"
+#include "nilan_notify.h"
+
+static const char *TAG = "nilan_ws";
+
+#define WS_FRAME_SNAPSHOT 1
+#define WS_FRAME_DELTA 2
+
+#define WS_HEADER_LEN 6   // type, count, t_ms
+#define WS_ENTRY_LEN 5    // reg_id, raw, age
+#define WS_LEN_PREFIX 2   // queued frames are stored as [u16 len][frame]
+
+// Largest frame: a snapshot of every register.
+#define WS_FRAME_MAX (WS_HEADER_LEN + 4 + NILAN_REGID_COUNT * WS_ENTRY_LEN)
+
+_Static_assert(NILAN_REGID_COUNT <= UINT8_MAX, "reg_id and count are one byte on the wire");
+_Static_assert(WS_LEN_PREFIX + WS_FRAME_MAX <= NILAN_WS_QUEUE_BYTES, "a snapshot must fit a client queue");
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+typedef struct
+{
+    int fd;            // -1 = free
+    bool resync;       // next frame is a snapshot; nothing is queued meanwhile
+    bool work_pending; // a send_work() for this client is queued on the server
+    size_t queued;
+    uint8_t queue[NILAN_WS_QUEUE_BYTES];
+} ws_client_t;
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static httpd_handle_t server = NULL;
+static TaskHandle_t stream_task = NULL;
+static int notify_sub = -1;
+
+// Guards clients[]. Frames are built under it too, so a delta can never be
+// queued behind a snapshot that already holds newer values.
+static SemaphoreHandle_t clients_lock = NULL;
+static ws_client_t clients[NILAN_WS_MAX_CLIENTS];
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static esp_err_t ws_handler(httpd_req_t *req);
+static esp_err_t registers_get(httpd_req_t *req);
+static void nilan_ws_task(void *arg);
+static void queue_delta(const nilan_reg_mask_t *dirty);
+static void send_work(void *arg);
+static void schedule_send(ws_client_t *c);
+static ws_client_t *find_client(int fd);
+static void drop_client(int fd);
+static size_t build_frame(uint8_t type, const nilan_reg_mask_t *which, uint8_t *out);
+static inline void put_u16le(uint8_t *p, uint16_t v);
+static inline void put_u32le(uint8_t *p, uint32_t v);
+static inline uint32_t get_time_ms(void);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+esp_err_t nilan_ws_register(httpd_handle_t srv)
+{
+    static const httpd_uri_t ws_uri = {
+        .uri = "/ws",
+        .method = HTTP_GET,
+        .handler = ws_handler,
+        .is_websocket = true,
+    };
+    static const httpd_uri_t registers_uri = {
+        .uri = "/registers",
+        .method = HTTP_GET,
+        .handler = registers_get,
+    };
+
+    if (stream_task != NULL)
+    {
+        return ESP_OK;
+    }
+
+    server = srv;
+    for (size_t i = 0; i < NILAN_WS_MAX_CLIENTS; ++i)
+    {
+        clients[i].fd = -1;
+    }
+
+    clients_lock = xSemaphoreCreateMutex();
+    if (clients_lock == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = httpd_register_uri_handler(server, &ws_uri);
+    if (err == ESP_OK)
+    {
+        err = httpd_register_uri_handler(server, &registers_uri);
+    }
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    if (xTaskCreate(nilan_ws_task, "nilan_ws", 3072, NULL, 2, &stream_task) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void nilan_ws_sock_closed(int fd)
+{
+    if (clients_lock != NULL)
+    {
+        drop_client(fd);
+    }
+}
+
+// Server task. Called once with HTTP_GET after the handshake, then for every
+// data frame the client sends.
+static esp_err_t ws_handler(httpd_req_t *req)
+{
+    int fd = httpd_req_to_sockfd(req);
+
+    if (req->method == HTTP_GET)
+    {
+        xSemaphoreTake(clients_lock, portMAX_DELAY);
+        // A slot still holding this fd belongs to a closed client whose
+        // number the socket layer has handed out again.
+        ws_client_t *c = find_client(fd);
+        if (c == NULL)
+        {
+            c = find_client(-1);
+        }
+        if (c != NULL)
+        {
+            c->fd = fd;
+            c->resync = true; // starts with a snapshot
+            c->work_pending = false;
+            c->queued = 0;
+            schedule_send(c);
+        }
+        xSemaphoreGive(clients_lock);
+
+        if (c == NULL)
+        {
+            ESP_LOGW(TAG, "all %d stream slots in use", NILAN_WS_MAX_CLIENTS);
+            return ESP_FAIL; // closes the connection
+        }
+        return ESP_OK;
+    }
+
+    httpd_ws_frame_t frame = {0};
+    uint8_t buf[16];
+
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0); // length only
+    if (err != ESP_OK || frame.len >= sizeof(buf))
+    {
+        drop_client(fd);
+        return ESP_FAIL; // clients have nothing long to say
+    }
+
+    frame.payload = buf;
+    err = httpd_ws_recv_frame(req, &frame, sizeof(buf));
+    if (err != ESP_OK)
+    {
+        drop_client(fd);
+        return err;
+    }
+
+    if (frame.type == HTTPD_WS_TYPE_TEXT && frame.len == 6 && memcmp(buf, "resync", 6) == 0)
+    {
+        xSemaphoreTake(clients_lock, portMAX_DELAY);
+        ws_client_t *c = find_client(fd);
+        if (c != NULL)
+        {
+            c->resync = true;
+            c->queued = 0;
+            schedule_send(c);
+        }
+        xSemaphoreGive(clients_lock);
+    }
+    return ESP_OK;
+}
+
+// JSON list of the register table, streamed like /metrics.
+static esp_err_t registers_get(httpd_req_t *req)
+{
+    static const char *const dtypes[] = {
+        [NILAN_DTYPE_TEMP_Cx100] = "temp_cx100",
+        [NILAN_DTYPE_UINT16] = "uint16",
+        [NILAN_DTYPE_INT16] = "int16",
+        [NILAN_DTYPE_ENUM16] = "enum16",
+    };
+
+    char buf[512];
+    size_t len = 0;
+    esp_err_t err = ESP_OK;
+
+    httpd_resp_set_type(req, "application/json");
+
+    for (size_t id = 0; id <= NILAN_REGID_COUNT + 1 && err == ESP_OK; ++id)
+    {
+        char line[160];
+        int n;
+
+        if (id == 0)
+        {
+            n = snprintf(line, sizeof(line), "{\"layout\":%lu,\"registers\":[",
+                         (unsigned long)nilan_reg_layout_hash());
+        }
+        else if (id == NILAN_REGID_COUNT + 1)
+        {
+            n = snprintf(line, sizeof(line), "]}\n");
+        }
+        else
+        {
+            const nilan_reg_meta_t *m = &nilan_registers[id - 1];
+            char name[64];
+            size_t k = 0;
+            for (const char *c = (m->name != NULL) ? m->name : ""; *c != '\0' && k + 2 < sizeof(name); ++c)
+            {
+                if (*c == '"' || *c == '\\')
+                {
+                    name[k++] = '\\';
+                }
+                name[k++] = *c;
+            }
+            name[k] = '\0';
+
+            n = snprintf(line, sizeof(line), "%s{\"id\":%u,\"addr\":%u,\"type\":\"%s\",\"dtype\":\"%s\",\"name\":\"%s\"}",
+                         (id == 1) ? "" : ",", (unsigned)(id - 1), (unsigned)m->addr,
+                         m->reg_type == NILAN_INPUT_REG ? "input" : "holding", dtypes[m->data_type], name);
+        }
+
+        if (n < 0 || (size_t)n >= sizeof(line))
+        {
+            continue;
+        }
+        if (len + (size_t)n > sizeof(buf))
+        {
+            err = httpd_resp_send_chunk(req, buf, (ssize_t)len);
+            len = 0;
+        }
+        memcpy(buf + len, line, (size_t)n);
+        len += (size_t)n;
+    }
+
+    if (err == ESP_OK && len > 0)
+    {
+        err = httpd_resp_send_chunk(req, buf, (ssize_t)len);
+    }
+    if (err == ESP_OK)
+    {
+        err = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return err;
+}
+
+static void nilan_ws_task(void *arg)
+{
+    (void)arg; // Silence the unused parameter warning.
+
+    nilan_reg_mask_t all = {0};
+    for (size_t id = 0; id < NILAN_REGID_COUNT; ++id)
+    {
+        nilan_reg_mask_set(&all, (nilan_reg_id_t)id);
+    }
+    notify_sub = nilan_notify_subscribe(&all, 0, xTaskGetCurrentTaskHandle());
+    if (notify_sub < 0)
+    {
+        ESP_LOGW(TAG, "no notify slot left; live stream disabled");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // The bus task publishes per poll block; let the rest of the cycle land.
+        vTaskDelay(pdMS_TO_TICKS(NILAN_WS_BATCH_MS));
+
+        nilan_reg_mask_t dirty;
+        if (nilan_notify_take(notify_sub, &dirty))
+        {
+            queue_delta(&dirty);
+        }
+    }
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+static void queue_delta(const nilan_reg_mask_t *dirty)
+{
+    static uint8_t frame[WS_FRAME_MAX]; // stream task only
+
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+
+    size_t len = 0;
+    for (size_t i = 0; i < NILAN_WS_MAX_CLIENTS; ++i)
+    {
+        ws_client_t *c = &clients[i];
+        if (c->fd < 0 || c->resync)
+        {
+            continue; // a snapshot is coming anyway
+        }
+
+        if (len == 0)
+        {
+            len = build_frame(WS_FRAME_DELTA, dirty, frame);
+            if (len == 0)
+            {
+                break; // only stale registers changed
+            }
+        }
+
+        if (c->queued + WS_LEN_PREFIX + len > sizeof(c->queue))
+        {
+            // Not keeping up: forget what's queued, catch up with a snapshot.
+            c->resync = true;
+            c->queued = 0;
+        }
+        else
+        {
+            put_u16le(c->queue + c->queued, (uint16_t)len);
+            memcpy(c->queue + c->queued + WS_LEN_PREFIX, frame, len);
+            c->queued += WS_LEN_PREFIX + len;
+        }
+        schedule_send(c);
+    }
+
+    xSemaphoreGive(clients_lock);
+}
+
+// Runs in the server task, which owns the sockets: send the client's next
+// frame. One frame per work item, and the next one queued behind it, so a slow
+// client lets the server handle other sockets in between.
+static void send_work(void *arg)
+{
+    static uint8_t out[WS_FRAME_MAX]; // server task only
+    int fd = (int)(intptr_t)arg;
+    size_t out_len = 0;
+
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    ws_client_t *c = find_client(fd);
+    if (c != NULL)
+    {
+        c->work_pending = false;
+        if (c->resync)
+        {
+            out_len = build_frame(WS_FRAME_SNAPSHOT, NULL, out);
+            c->resync = false;
+            c->queued = 0;
+        }
+        else if (c->queued >= WS_LEN_PREFIX)
+        {
+            out_len = (size_t)c->queue[0] | ((size_t)c->queue[1] << 8);
+            memcpy(out, c->queue + WS_LEN_PREFIX, out_len);
+            c->queued -= WS_LEN_PREFIX + out_len;
+            memmove(c->queue, c->queue + WS_LEN_PREFIX + out_len, c->queued);
+        }
+        if (c->queued > 0)
+        {
+            schedule_send(c);
+        }
+    }
+    xSemaphoreGive(clients_lock);
+
+    if (out_len == 0)
+    {
+        return;
+    }
+
+    if (httpd_ws_get_fd_info(server, fd) != HTTPD_WS_CLIENT_WEBSOCKET)
+    {
+        drop_client(fd); // closed meanwhile
+        return;
+    }
+
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_BINARY,
+        .payload = out,
+        .len = out_len,
+    };
+    if (httpd_ws_send_frame_async(server, fd, &frame) != ESP_OK)
+    {
+        drop_client(fd);
+    }
+}
+
+// Caller holds clients_lock.
+static void schedule_send(ws_client_t *c)
+{
+    if (c->work_pending)
+    {
+        return;
+    }
+    if (httpd_queue_work(server, send_work, (void *)(intptr_t)c->fd) == ESP_OK)
+    {
+        c->work_pending = true;
+    }
+}
+
+// Caller holds clients_lock. fd -1 finds a free slot.
+static ws_client_t *find_client(int fd)
+{
+    for (size_t i = 0; i < NILAN_WS_MAX_CLIENTS; ++i)
+    {
+        if (clients[i].fd == fd)
+        {
+            return &clients[i];
+        }
+    }
+    return NULL;
+}
+
+static void drop_client(int fd)
+{
+    xSemaphoreTake(clients_lock, portMAX_DELAY);
+    ws_client_t *c = find_client(fd);
+    if (c != NULL)
+    {
+        c->fd = -1;
+        c->queued = 0;
+    }
+    xSemaphoreGive(clients_lock);
+}
+
+// Registers in which (all when NULL) that have a value read on the bus.
+// Returns the frame length, or 0 if there was nothing to put in it.
+static size_t build_frame(uint8_t type, const nilan_reg_mask_t *which, uint8_t *out)
+{
+    uint32_t now = get_time_ms();
+    size_t pos = WS_HEADER_LEN;
+    uint8_t count = 0;
+
+    if (type == WS_FRAME_SNAPSHOT)
+    {
+        put_u32le(out + pos, nilan_reg_layout_hash());
+        pos += 4;
+    }
+
+    for (size_t i = 0; i < NILAN_REGID_COUNT; ++i)
+    {
+        nilan_reg_id_t id = (nilan_reg_id_t)i;
+        nilan_reg_value_t v;
+
+        if ((which != NULL && !nilan_reg_mask_test(which, id)) || !nilan_reg_read(id, &v) ||
+            nilan_reg_is_stale(id))
+        {
+            continue;
+        }
+
+        uint32_t age_ds = (now - v.timestamp_ms) / 100;
+        out[pos] = (uint8_t)id;
+        put_u16le(out + pos + 1, v.raw);
+        put_u16le(out + pos + 3, (uint16_t)((age_ds > UINT16_MAX) ? UINT16_MAX : age_ds));
+        pos += WS_ENTRY_LEN;
+        count++;
+    }
+
+    if (count == 0 && type == WS_FRAME_DELTA)
+    {
+        return 0;
+    }
+
+    out[0] = type;
+    out[1] = count;
+    put_u32le(out + 2, now);
+    return pos;
+}
+
+static inline void put_u16le(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v & 0xFF);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void put_u32le(uint8_t *p, uint32_t v)
+{
+    put_u16le(p, (uint16_t)(v & 0xFFFF));
+    put_u16le(p + 2, (uint16_t)(v >> 16));
+}
+
+static inline uint32_t get_time_ms(void)
+{
+    // Same clock as the register store's timestamps.
+    return (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
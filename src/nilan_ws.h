@@ -0,0 +1,43 @@
+#pragma once
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Live register stream over a WebSocket at /ws.
+ *
+ * On connect a client gets one snapshot of every register that holds a value,
+ * then deltas: the registers that changed, batched over NILAN_WS_BATCH_MS
+ * after the bus task reports a change, so one poll cycle is one frame. Both
+ * are binary frames, little-endian:
+ *
+ *   u8  type        1 = snapshot, 2 = delta
+ *   u8  count       entries that follow
+ *   u32 t_ms        ms since boot when the frame was built
+ *   u32 layout      snapshot only: nilan_reg_layout_hash()
+ *   count x { u8 reg_id, u16 raw, u16 age }   age in 0.1 s before t_ms, capped at 65535
+ *
+ * GET /registers lists id, address, type, data type and name of every
+ * register as JSON, with the same layout hash, for turning reg_id and raw
+ * into something to show.
+ *
+ * Each client has a bounded send queue. A client that can't keep up doesn't
+ * make it grow: its queue is dropped, and the next frame it gets is a fresh
+ * snapshot. A client can also ask for one by sending the text "resync".
+ */
+
+#define NILAN_WS_MAX_CLIENTS 3
+#define NILAN_WS_QUEUE_BYTES 1024 // per client
+#define NILAN_WS_BATCH_MS 200     // poll blocks read back to back share a frame
+
+// Register /ws and /registers and start the stream task.
+esp_err_t nilan_ws_register(httpd_handle_t server);
+
+// The server closed a socket (httpd_config_t.close_fn): free its stream slot.
+void nilan_ws_sock_closed(int fd);
+
+#ifdef __cplusplus
+}
+#endif
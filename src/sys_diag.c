@@ -0,0 +1,256 @@
+#include "sys_diag.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_lvgl_port.h"
+#include "lvgl.h"
+
+#include "nilan_modbus.h"
+
+static const char *TAG = "sys_diag";
+
+#define SYS_DIAG_TASK_PRIO 1
+#define SYS_DIAG_TASK_STACK 3072
+
+// Room for every task in the system; a sample is skipped if there are more.
+#define SYS_DIAG_STATUS_SLOTS 32
+
+// Don't hold up the sampler behind a long LVGL render; skip the pool instead.
+#define SYS_DIAG_LVGL_LOCK_MS 20
+
+// One summary line in the log every this many samples (a minute).
+#define SYS_DIAG_LOG_EVERY (60000 / SYS_DIAG_PERIOD_MS)
+
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t run_time;
+} task_prev_t;
+
+// Sampler task only.
+static TaskStatus_t s_status[SYS_DIAG_STATUS_SLOTS];
+static task_prev_t s_prev[SYS_DIAG_STATUS_SLOTS];
+static size_t s_prev_count = 0;
+static uint32_t s_prev_total = 0;
+static sys_diag_snapshot_t s_work;
+
+// Latest published sample.
+static sys_diag_snapshot_t s_snap;
+static SemaphoreHandle_t s_snap_lock = NULL;
+static volatile uint32_t s_seq = 0;
+
+static TaskHandle_t s_task = NULL;
+
+static uint32_t prev_run_time(TaskHandle_t handle, bool *found)
+{
+    for (size_t i = 0; i < s_prev_count; ++i) {
+        if (s_prev[i].handle == handle) {
+            *found = true;
+            return s_prev[i].run_time;
+        }
+    }
+    *found = false;
+    return 0;
+}
+
+static uint16_t permille(uint32_t part, uint32_t whole)
+{
+    if (whole == 0) {
+        return 0;
+    }
+    uint64_t p = (uint64_t)part * 1000u / whole;
+    return (p > 1000) ? 1000 : (uint16_t)p;
+}
+
+// Busiest first; the list is short enough that insertion is the cheap option.
+static void insert_task(sys_diag_snapshot_t *s, const sys_diag_task_t *t)
+{
+    size_t pos = s->task_count;
+    while (pos > 0 && s->tasks[pos - 1].cpu_permille < t->cpu_permille) {
+        pos--;
+    }
+
+    if (pos >= SYS_DIAG_MAX_TASKS) {
+        s->other_permille += t->cpu_permille;
+        return;
+    }
+
+    if (s->task_count == SYS_DIAG_MAX_TASKS) {
+        s->other_permille += s->tasks[SYS_DIAG_MAX_TASKS - 1].cpu_permille;
+    } else {
+        s->task_count++;
+    }
+
+    memmove(&s->tasks[pos + 1], &s->tasks[pos], (s->task_count - 1 - pos) * sizeof(s->tasks[0]));
+    s->tasks[pos] = *t;
+}
+
+static bool sample_tasks(sys_diag_snapshot_t *s)
+{
+    uint32_t total = 0;
+    UBaseType_t n = uxTaskGetSystemState(s_status, SYS_DIAG_STATUS_SLOTS, &total);
+    if (n == 0) {
+        return false; // more tasks than slots
+    }
+
+    // The run-time counter is esp_timer based, so the total is wall time and
+    // each task's share of it is its load on one core.
+    uint32_t elapsed = total - s_prev_total;
+    bool have_prev = (s_prev_total != 0);
+
+    TaskHandle_t idle[SYS_DIAG_CORES];
+    for (int c = 0; c < SYS_DIAG_CORES; ++c) {
+        idle[c] = xTaskGetIdleTaskHandleForCore(c);
+        s->core_load_permille[c] = 0;
+    }
+
+    s->task_total = (uint8_t)n;
+    s->task_count = 0;
+    s->other_permille = 0;
+
+    for (UBaseType_t i = 0; i < n; ++i) {
+        const TaskStatus_t *st = &s_status[i];
+        bool found;
+        uint32_t before = prev_run_time(st->xHandle, &found);
+        // A task born during the period only ran since then.
+        uint16_t cpu = (have_prev && found) ? permille(st->ulRunTimeCounter - before, elapsed) : 0;
+
+        for (int c = 0; c < SYS_DIAG_CORES; ++c) {
+            if (st->xHandle == idle[c]) {
+                s->core_load_permille[c] = have_prev ? (uint16_t)(1000 - cpu) : 0;
+            }
+        }
+
+        BaseType_t core = xTaskGetCoreID(st->xHandle);
+        sys_diag_task_t t = {
+            .core = (core >= 0 && core < SYS_DIAG_CORES) ? (uint8_t)core : SYS_DIAG_CORE_ANY,
+            .prio = (uint8_t)st->uxCurrentPriority,
+            .cpu_permille = cpu,
+            .stack_free = st->usStackHighWaterMark, // bytes on ESP-IDF
+        };
+        strlcpy(t.name, st->pcTaskName, sizeof(t.name));
+        insert_task(s, &t);
+    }
+
+    for (UBaseType_t i = 0; i < n; ++i) {
+        s_prev[i].handle = s_status[i].xHandle;
+        s_prev[i].run_time = s_status[i].ulRunTimeCounter;
+    }
+    s_prev_count = n;
+    s_prev_total = total;
+
+    s->period_ms = have_prev ? elapsed / 1000 : 0;
+    return true;
+}
+
+static void sample_heap(sys_diag_heap_t *h, uint32_t caps)
+{
+    h->free = heap_caps_get_free_size(caps);
+    h->min_free = heap_caps_get_minimum_free_size(caps);
+    h->largest_block = heap_caps_get_largest_free_block(caps);
+}
+
+static void sample_lvgl(sys_diag_snapshot_t *s)
+{
+    s->lvgl_total = 0;
+
+    if (!lvgl_port_lock(SYS_DIAG_LVGL_LOCK_MS)) {
+        return;
+    }
+    lv_mem_monitor_t mon;
+    lv_mem_monitor(&mon);
+    lvgl_port_unlock();
+
+    s->lvgl_total = mon.total_size;
+    s->lvgl_free = mon.free_size;
+    s->lvgl_used_pct = mon.used_pct;
+    s->lvgl_frag_pct = mon.frag_pct;
+}
+
+static void log_summary(const sys_diag_snapshot_t *s)
+{
+    ESP_LOGI(TAG, "cpu0 %u.%u%% cpu1 %u.%u%% bus %u.%u%% | int %luk (min %luk) dma %luk (min %luk) | lvgl %u%% frag %u%%",
+             s->core_load_permille[0] / 10, s->core_load_permille[0] % 10,
+             s->core_load_permille[1] / 10, s->core_load_permille[1] % 10,
+             s->bus_util_permille / 10, s->bus_util_permille % 10,
+             (unsigned long)(s->heap_internal.free / 1024), (unsigned long)(s->heap_internal.min_free / 1024),
+             (unsigned long)(s->heap_dma.free / 1024), (unsigned long)(s->heap_dma.min_free / 1024),
+             s->lvgl_used_pct, s->lvgl_frag_pct);
+
+    for (size_t i = 0; i < s->task_count && i < 4; ++i) {
+        const sys_diag_task_t *t = &s->tasks[i];
+        ESP_LOGI(TAG, "  %-16s core %c %3u.%u%% stack free %lu",
+                 t->name, (t->core == SYS_DIAG_CORE_ANY) ? '*' : (char)('0' + t->core),
+                 t->cpu_permille / 10, t->cpu_permille % 10, (unsigned long)t->stack_free);
+    }
+}
+
+static void sys_diag_task(void *arg)
+{
+    (void)arg;
+    TickType_t last = xTaskGetTickCount();
+    uint32_t samples = 0;
+
+    while (1) {
+        sys_diag_snapshot_t *s = &s_work;
+
+        if (sample_tasks(s)) {
+            sample_heap(&s->heap_internal, MALLOC_CAP_INTERNAL);
+            sample_heap(&s->heap_dma, MALLOC_CAP_DMA);
+            sample_lvgl(s);
+
+            float util = nilan_modbus_get_bus_utilization();
+            s->bus_util_permille = (uint16_t)(util * 10.0f);
+            s->uptime_s = (uint32_t)(xTaskGetTickCount() / configTICK_RATE_HZ);
+            s->seq = s_seq + 1;
+
+            xSemaphoreTake(s_snap_lock, portMAX_DELAY);
+            s_snap = *s;
+            xSemaphoreGive(s_snap_lock);
+            __atomic_store_n(&s_seq, s->seq, __ATOMIC_RELEASE);
+
+            // The first sample has no period behind it; don't log zeros.
+            if (s->period_ms != 0 && (++samples % SYS_DIAG_LOG_EVERY) == 0) {
+                log_summary(s);
+            }
+        }
+
+        vTaskDelayUntil(&last, pdMS_TO_TICKS(SYS_DIAG_PERIOD_MS));
+    }
+}
+
+bool sys_diag_start(void)
+{
+    if (s_task) {
+        return true;
+    }
+
+    s_snap_lock = xSemaphoreCreateMutex();
+    if (!s_snap_lock) {
+        return false;
+    }
+
+    return xTaskCreate(sys_diag_task, "sys_diag", SYS_DIAG_TASK_STACK, NULL, SYS_DIAG_TASK_PRIO, &s_task) == pdPASS;
+}
+
+bool sys_diag_get(sys_diag_snapshot_t *out)
+{
+    if (!s_snap_lock || sys_diag_seq() == 0) {
+        return false;
+    }
+
+    xSemaphoreTake(s_snap_lock, portMAX_DELAY);
+    *out = s_snap;
+    xSemaphoreGive(s_snap_lock);
+    return true;
+}
+
+uint32_t sys_diag_seq(void)
+{
+    return __atomic_load_n(&s_seq, __ATOMIC_ACQUIRE);
+}
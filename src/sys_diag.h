@@ -0,0 +1,76 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Diagnostics service: a low-priority task samples the FreeRTOS run-time stats
+ * (per-task CPU share and stack high-water mark), heap headroom per capability,
+ * the LVGL memory pool and the Modbus bus utilization every SYS_DIAG_PERIOD_MS,
+ * and keeps the latest sample for the diagnostics tile and the export paths.
+ * Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.
+ */
+
+#define SYS_DIAG_PERIOD_MS 2000
+
+// Tasks kept per sample, busiest first; the rest are summed into other_permille.
+#define SYS_DIAG_MAX_TASKS 12
+
+#define SYS_DIAG_CORES 2
+
+// Task is not pinned to a core.
+#define SYS_DIAG_CORE_ANY 0xFF
+
+typedef struct {
+    char name[16];
+    uint8_t core;             // 0, 1 or SYS_DIAG_CORE_ANY
+    uint8_t prio;
+    uint16_t cpu_permille;    // share of one core over the last period
+    uint32_t stack_free;      // bytes never touched since the task started
+} sys_diag_task_t;
+
+typedef struct {
+    uint32_t free;
+    uint32_t min_free;        // low-water mark since boot
+    uint32_t largest_block;
+} sys_diag_heap_t;
+
+typedef struct {
+    uint32_t seq;             // bumped by every sample; 0 = nothing sampled yet
+    uint32_t uptime_s;
+    uint32_t period_ms;       // what the CPU shares were measured over
+
+    uint16_t core_load_permille[SYS_DIAG_CORES]; // 1000 - the core's idle task
+    uint16_t other_permille;  // tasks beyond SYS_DIAG_MAX_TASKS
+    uint8_t task_total;       // tasks that exist, listed or not
+    uint8_t task_count;       // entries in tasks[]
+    sys_diag_task_t tasks[SYS_DIAG_MAX_TASKS];
+
+    sys_diag_heap_t heap_internal;
+    sys_diag_heap_t heap_dma;
+
+    uint32_t lvgl_total;      // 0 if the pool couldn't be sampled this time
+    uint32_t lvgl_free;
+    uint8_t lvgl_used_pct;
+    uint8_t lvgl_frag_pct;
+
+    uint16_t bus_util_permille;
+} sys_diag_snapshot_t;
+
+// Start the sampling task. Call after ui_init(): it reads the LVGL pool
+// under the LVGL port lock.
+bool sys_diag_start(void);
+
+// Copy the latest sample. Returns false if there is none yet. Any task.
+bool sys_diag_get(sys_diag_snapshot_t *out);
+
+// Sequence number of the latest sample, to skip work when nothing changed.
+uint32_t sys_diag_seq(void);
+
+#ifdef __cplusplus
+}
+#endif
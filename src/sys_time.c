@@ -0,0 +1,417 @@
+#include "sys_time.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "esp_timer.h"
+
+#include "NilanRegisters.h"
+#include "RTC.h"
+#include "nilan_modbus.h"
+#include "wifi_sta.h"
+
+static const char *TAG = "sys_time";
+
+#define SYS_TIME_TASK_PRIO 2
+#define SYS_TIME_TASK_STACK 3072
+#define SYS_TIME_TICK_MS 10000
+
+// Syncs closer together than this only step the offset: the server's jitter
+// would swamp the drift over such a short interval.
+#define SYS_TIME_RATE_MIN_INTERVAL_S 900
+
+// A crystal that needs more than this is broken; and an error far beyond what
+// the rate could explain is a step on the server side, not drift.
+#define SYS_TIME_RATE_MAX_PPB 500000
+#define SYS_TIME_RATE_MAX_STEP_MS 2000
+
+// The clock write waits out the write pipeline's settle time on the way.
+#define SYS_TIME_NILAN_LEAD_US 500000
+
+// The published clock: time = epoch_us + (now - mono_us) * (1 + rate_ppb / 1e9).
+typedef struct {
+    int64_t epoch_us;
+    int64_t mono_us;
+    int32_t rate_ppb;
+    sys_time_source_t source;
+} clock_base_t;
+
+// Sequence lock: odd while the base is being replaced. Written by
+// sys_time_init() and then only by the time task; readers never lock.
+static clock_base_t s_base;
+static uint32_t s_seq = 0;
+
+// Keeps the writer from being preempted mid-update, so a reader on the same
+// core never spins on an odd sequence.
+static portMUX_TYPE s_base_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Handed over from the SNTP callback (tcpip task) to the time task.
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_sntp_epoch_us = 0;
+static int64_t s_sntp_mono_us = 0;
+static bool s_sntp_pending = false;
+static volatile bool s_link_up = false;
+
+// Time task only, apart from the copy in sys_time_get_stats().
+static sys_time_stats_t s_stats;
+static int64_t s_last_sync_mono_us = 0;
+static int64_t s_rtc_written_us = 0;     // mono; 0 = not since boot
+static int64_t s_nilan_checked_us = 0;
+static int64_t s_nilan_written_us = 0;
+
+static TaskHandle_t s_task = NULL;
+
+// ---------------- Clock base ----------------
+
+static void publish(const clock_base_t *b)
+{
+    taskENTER_CRITICAL(&s_base_lock);
+    uint32_t seq = __atomic_load_n(&s_seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&s_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // odd seq is visible before any data
+    s_base = *b;
+    __atomic_store_n(&s_seq, seq + 2, __ATOMIC_RELEASE); // data before even seq
+    taskEXIT_CRITICAL(&s_base_lock);
+}
+
+static void load(clock_base_t *out)
+{
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&s_seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1u) == 0) {
+            *out = s_base;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE); // data loads before the re-check
+            if (__atomic_load_n(&s_seq, __ATOMIC_RELAXED) == seq) {
+                return;
+            }
+        }
+        // The writer holds a critical section for a handful of stores on the
+        // other core; spinning is cheaper than anything else here.
+    }
+}
+
+static int64_t base_at(const clock_base_t *b, int64_t mono_us)
+{
+    int64_t el = mono_us - b->mono_us;
+    // Whole seconds and the rest apart: el * rate_ppb alone overflows after
+    // some 200 days without a sync at the rate clamp.
+    int64_t s = el / 1000000;
+    int64_t us = el % 1000000;
+    return b->epoch_us + el + s * b->rate_ppb / 1000 + us * b->rate_ppb / 1000000000;
+}
+
+static void set_system_time(int64_t epoch_us)
+{
+    struct timeval tv = {
+        .tv_sec = (time_t)(epoch_us / 1000000),
+        .tv_usec = (suseconds_t)(epoch_us % 1000000),
+    };
+    settimeofday(&tv, NULL);
+}
+
+// ---------------- SNTP discipline ----------------
+
+// tcpip task. IDF has already set the system time; we only note when.
+static void sntp_sync_cb(struct timeval *tv)
+{
+    int64_t mono = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&s_lock);
+    s_sntp_epoch_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    s_sntp_mono_us = mono;
+    s_sntp_pending = true;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (s_task != NULL) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+static void link_event(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    (void)arg;
+    (void)base;
+    (void)data;
+
+    s_link_up = (id == WIFI_STA_EVENT_UP);
+    if (s_link_up && s_task != NULL) {
+        xTaskNotifyGive(s_task);
+    }
+}
+
+static void apply_sync(int64_t server_us, int64_t mono_us)
+{
+    clock_base_t b;
+    load(&b);
+
+    int64_t err_us = server_us - base_at(&b, mono_us);
+
+    if (b.source == SYS_TIME_SOURCE_SNTP) {
+        int64_t interval_us = mono_us - s_last_sync_mono_us;
+
+        if (llabs(err_us) > SYS_TIME_RATE_MAX_STEP_MS * 1000LL) {
+            ESP_LOGW(TAG, "server time jumped %lld ms, keeping the rate", (long long)(err_us / 1000));
+        } else if (interval_us >= SYS_TIME_RATE_MIN_INTERVAL_S * 1000000LL) {
+            // Half the measured error per sync: enough to converge in a few
+            // hours, little enough that one noisy reply doesn't throw it off.
+            int64_t rate = b.rate_ppb + err_us * 1000000000 / interval_us / 2;
+            if (rate > SYS_TIME_RATE_MAX_PPB) rate = SYS_TIME_RATE_MAX_PPB;
+            if (rate < -SYS_TIME_RATE_MAX_PPB) rate = -SYS_TIME_RATE_MAX_PPB;
+            b.rate_ppb = (int32_t)rate;
+        }
+    } else if (b.source == SYS_TIME_SOURCE_RTC) {
+        ESP_LOGI(TAG, "first SNTP sync, RTC time was %lld ms off", (long long)(err_us / 1000));
+    } else {
+        err_us = 0; // nothing to compare with
+        ESP_LOGI(TAG, "first SNTP sync");
+    }
+
+    b.epoch_us = server_us;
+    b.mono_us = mono_us;
+    b.source = SYS_TIME_SOURCE_SNTP;
+    publish(&b);
+
+    s_last_sync_mono_us = mono_us;
+    s_stats.syncs++;
+    s_stats.last_offset_ms = (int32_t)(err_us / 1000);
+    s_stats.rate_ppb = b.rate_ppb;
+}
+
+// ---------------- RTC holdover ----------------
+
+// The BM8563 counts whole seconds, so write on a second boundary.
+static void write_rtc(void)
+{
+    int64_t now_us;
+    if (!sys_time_now_us(&now_us)) {
+        return;
+    }
+    vTaskDelay(pdMS_TO_TICKS((1000000 - now_us % 1000000) / 1000));
+    if (!sys_time_now_us(&now_us)) {
+        return;
+    }
+
+    time_t t = (time_t)((now_us + 500000) / 1000000);
+    struct tm tm;
+    gmtime_r(&t, &tm);
+
+    rtc_time_t rt = {
+        .year = (uint16_t)(tm.tm_year + 1900),
+        .month = (uint8_t)(tm.tm_mon + 1),
+        .day = (uint8_t)tm.tm_mday,
+        .hour = (uint8_t)tm.tm_hour,
+        .min = (uint8_t)tm.tm_min,
+        .sec = (uint8_t)tm.tm_sec,
+        .wday = (uint8_t)tm.tm_wday,
+    };
+
+    if (rtc_set_time(&rt)) {
+        s_stats.rtc_writes++;
+    } else {
+        ESP_LOGW(TAG, "RTC write failed");
+    }
+}
+
+// ---------------- CTS602 clock ----------------
+
+static void check_nilan(int64_t mono_us)
+{
+    static const nilan_reg_id_t ids[] = {
+        NILAN_REGID_HR_TIME_SECOND, NILAN_REGID_HR_TIME_MINUTE, NILAN_REGID_HR_TIME_HOUR,
+        NILAN_REGID_HR_TIME_DAY,    NILAN_REGID_HR_TIME_MONTH,  NILAN_REGID_HR_TIME_YEAR,
+    };
+    nilan_reg_value_t v[6];
+
+    if (!nilan_modbus_is_online() || !nilan_reg_read_many(ids, 6, v) ||
+        nilan_reg_is_stale(NILAN_REGID_HR_TIME_SECOND)) {
+        return;
+    }
+
+    // The controller shows local time and a four digit year.
+    struct tm tm = {
+        .tm_sec = v[0].raw,
+        .tm_min = v[1].raw,
+        .tm_hour = v[2].raw,
+        .tm_mday = v[3].raw,
+        .tm_mon = (int)v[4].raw - 1,
+        .tm_year = (int)v[5].raw - 1900,
+        .tm_isdst = -1,
+    };
+    uint32_t age_ms = (uint32_t)xTaskGetTickCount() * portTICK_PERIOD_MS - v[0].timestamp_ms;
+
+    int64_t now_s;
+    if (!sys_time_now(&now_s)) {
+        return;
+    }
+    int64_t nilan_s = (int64_t)mktime(&tm) + age_ms / 1000;
+    int64_t drift = nilan_s - now_s;
+
+    s_stats.nilan_drift_s = (int32_t)drift;
+    if (llabs(drift) <= SYS_TIME_NILAN_MAX_DRIFT_S) {
+        return;
+    }
+    if (s_nilan_written_us != 0 && mono_us - s_nilan_written_us < SYS_TIME_NILAN_WRITE_GAP_S * 1000000LL) {
+        return;
+    }
+
+    int64_t now_us;
+    sys_time_now_us(&now_us);
+    time_t t = (time_t)((now_us + SYS_TIME_NILAN_LEAD_US) / 1000000);
+    localtime_r(&t, &tm);
+
+    uint16_t values[6] = {
+        (uint16_t)tm.tm_sec, (uint16_t)tm.tm_min,       (uint16_t)tm.tm_hour,
+        (uint16_t)tm.tm_mday, (uint16_t)(tm.tm_mon + 1), (uint16_t)(tm.tm_year + 1900),
+    };
+
+    if (nilan_modbus_write_holding_block(nilan_registers[NILAN_REGID_HR_TIME_SECOND].addr, 6, values)) {
+        ESP_LOGI(TAG, "CTS602 clock was %lld s off, setting it", (long long)drift);
+        s_nilan_written_us = mono_us;
+        s_stats.nilan_writes++;
+    }
+}
+
+// ---------------- Task ----------------
+
+static void sys_time_task(void *arg)
+{
+    (void)arg;
+
+    bool sntp_started = false;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SYS_TIME_TICK_MS));
+        int64_t mono = esp_timer_get_time();
+
+        // Ask right away on every new link instead of waiting out the poll interval.
+        if (s_link_up && !sntp_started) {
+            sntp_started = (esp_netif_sntp_start() == ESP_OK);
+        } else if (!s_link_up) {
+            sntp_started = false;
+        }
+
+        taskENTER_CRITICAL(&s_lock);
+        bool pending = s_sntp_pending;
+        int64_t server_us = s_sntp_epoch_us;
+        int64_t server_mono = s_sntp_mono_us;
+        s_sntp_pending = false;
+        taskEXIT_CRITICAL(&s_lock);
+
+        if (pending) {
+            apply_sync(server_us, server_mono);
+        }
+
+        if (sys_time_source() != SYS_TIME_SOURCE_SNTP) {
+            continue;
+        }
+
+        if (s_rtc_written_us == 0 || mono - s_rtc_written_us >= SYS_TIME_RTC_WRITE_S * 1000000LL) {
+            s_rtc_written_us = mono;
+            write_rtc();
+        }
+
+        if (mono - s_nilan_checked_us >= SYS_TIME_NILAN_CHECK_S * 1000000LL) {
+            s_nilan_checked_us = mono;
+            check_nilan(mono);
+        }
+    }
+}
+
+// ---------------- Public API ----------------
+
+void sys_time_init(void)
+{
+    setenv("TZ", SYS_TIME_TZ, 1);
+    tzset();
+
+    int64_t epoch;
+    int64_t mono = esp_timer_get_time();
+
+    if (!rtc_get_epoch(&epoch)) {
+        ESP_LOGW(TAG, "RTC not set; no wall time until SNTP syncs");
+        return;
+    }
+
+    clock_base_t b = {
+        .epoch_us = epoch * 1000000,
+        .mono_us = mono,
+        .rate_ppb = 0,
+        .source = SYS_TIME_SOURCE_RTC,
+    };
+    publish(&b);
+    set_system_time(b.epoch_us);
+}
+
+bool sys_time_start(void)
+{
+    if (s_task != NULL) {
+        return true;
+    }
+
+    esp_sntp_config_t cfg = ESP_NETIF_SNTP_DEFAULT_CONFIG(SYS_TIME_NTP_SERVER);
+    cfg.start = false; // on the first link up
+    cfg.wait_for_sync = false;
+    cfg.sync_cb = sntp_sync_cb;
+    if (esp_netif_sntp_init(&cfg) != ESP_OK) {
+        ESP_LOGE(TAG, "SNTP init failed");
+        return false;
+    }
+
+    if (xTaskCreate(sys_time_task, "sys_time", SYS_TIME_TASK_STACK, NULL, SYS_TIME_TASK_PRIO, &s_task) != pdPASS) {
+        esp_netif_sntp_deinit();
+        return false;
+    }
+
+    esp_event_handler_register(WIFI_STA_EVENT, ESP_EVENT_ANY_ID, link_event, NULL);
+    s_link_up = wifi_sta_is_connected();
+    xTaskNotifyGive(s_task);
+    return true;
+}
+
+bool sys_time_now_us(int64_t *out)
+{
+    clock_base_t b;
+    load(&b);
+    if (b.source == SYS_TIME_SOURCE_NONE) {
+        return false;
+    }
+    *out = base_at(&b, esp_timer_get_time());
+    return true;
+}
+
+bool sys_time_now(int64_t *out)
+{
+    int64_t us;
+    if (!sys_time_now_us(&us)) {
+        return false;
+    }
+    *out = us / 1000000;
+    return true;
+}
+
+sys_time_source_t sys_time_source(void)
+{
+    clock_base_t b;
+    load(&b);
+    return b.source;
+}
+
+void sys_time_get_stats(sys_time_stats_t *out)
+{
+    if (out == NULL) {
+        return;
+    }
+
+    *out = s_stats;
+    out->source = sys_time_source();
+    if (s_stats.syncs > 0) {
+        out->last_sync_age_s = (uint32_t)((esp_timer_get_time() - s_last_sync_mono_us) / 1000000);
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Wall clock service. The BM8563 RTC is read once, at boot; from then on the
+ * time is the monotonic esp_timer plus an offset, scaled by a learned rate
+ * correction for the crystal. While Wi-Fi is up SNTP disciplines both: each
+ * sync steps the offset to the server time, and the error accumulated since
+ * the previous sync trims the rate. The RTC only keeps time across power loss
+ * and is written back after the first sync and then every SYS_TIME_RTC_WRITE_S.
+ *
+ * Readers never block: sys_time_now_us() is a few loads under a sequence lock,
+ * callable from any task, the LVGL timer included.
+ *
+ * The CTS602 clock (HR 300-305, local time) is compared with ours every
+ * SYS_TIME_NILAN_CHECK_S once SNTP has synced, and set with one FC16 write
+ * when it is more than SYS_TIME_NILAN_MAX_DRIFT_S off.
+ */
+
+// Set via build_flags in platformio.ini, e.g. -DSYS_TIME_NTP_SERVER=\"192.168.1.1\"
+#ifndef SYS_TIME_NTP_SERVER
+#define SYS_TIME_NTP_SERVER "pool.ntp.org"
+#endif
+
+// POSIX TZ for localtime(): the UI clock and the CTS602, which both show local time.
+#ifndef SYS_TIME_TZ
+#define SYS_TIME_TZ "CET-1CEST,M3.5.0,M10.5.0/3"
+#endif
+
+#define SYS_TIME_RTC_WRITE_S (6 * 3600)
+#define SYS_TIME_NILAN_CHECK_S 600
+#define SYS_TIME_NILAN_MAX_DRIFT_S 10
+#define SYS_TIME_NILAN_WRITE_GAP_S 3600 // at most one clock write per this
+
+typedef enum {
+    SYS_TIME_SOURCE_NONE, // no plausible time yet
+    SYS_TIME_SOURCE_RTC,  // free-running since boot from the RTC
+    SYS_TIME_SOURCE_SNTP, // synced at least once since boot
+} sys_time_source_t;
+
+typedef struct {
+    sys_time_source_t source;
+    uint32_t syncs;             // SNTP syncs since boot
+    int32_t  last_offset_ms;    // server minus our prediction at the last sync
+    int32_t  rate_ppb;          // learned correction; positive = esp_timer runs slow
+    uint32_t last_sync_age_s;   // 0 before the first sync
+    uint32_t rtc_writes;
+    int32_t  nilan_drift_s;     // CTS602 minus us at the last check
+    uint32_t nilan_writes;
+} sys_time_stats_t;
+
+// Read the RTC once and set the system time (and TZ) from it. After core2_RTC_init().
+void sys_time_init(void);
+
+// Start SNTP and the discipline task. After sys_time_init() and wifi_sta_start().
+bool sys_time_start(void);
+
+// UTC microseconds since 1970. False, *out untouched, while there is no time yet.
+bool sys_time_now_us(int64_t *out);
+
+// UTC seconds since 1970. False while there is no time yet.
+bool sys_time_now(int64_t *out);
+
+sys_time_source_t sys_time_source(void);
+
+void sys_time_get_stats(sys_time_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -5,9 +5,21 @@
 
 #include "ui_screens/ui_main.h"
 #include "ui_screens/ui_modbus_debug.h"
+#include "ui_screens/ui_diag.h"
+#include "ui_screens/ui_trend.h"
+
+#include "boot_graph.h"
 
 static lv_obj_t *s_tv = NULL;
 
+// Boot metric: the first frame that actually reached the panel. Stays
+// registered; after the first call boot_graph_mark() is a single load.
+static void first_flush_cb(lv_event_t *e)
+{
+    (void)e;
+    boot_graph_mark(BOOT_MARK_FIRST_FRAME);
+}
+
 void ui_init(void)
 {
     lvgl_port_lock(0);
@@ -19,10 +31,11 @@ void ui_init(void)
     lv_obj_set_style_bg_opa(s_tv, LV_OPA_COVER, 0);
     // NOTE: do NOT clear LV_OBJ_FLAG_SCROLLABLE -> we want swiping
 
-    // Three horizontal tiles: 0, 1, 2
+    // Four horizontal tiles: 0, 1, 2, 3
     lv_obj_t *t0 = lv_tileview_add_tile(s_tv, 0, 0, LV_DIR_HOR);
     lv_obj_t *t1 = lv_tileview_add_tile(s_tv, 1, 0, LV_DIR_HOR);
     lv_obj_t *t2 = lv_tileview_add_tile(s_tv, 2, 0, LV_DIR_HOR);
+    lv_obj_t *t3 = lv_tileview_add_tile(s_tv, 3, 0, LV_DIR_HOR);
 
     // Screen 1: main VP18 UI (leave implementation in ui_main.c)
     ui_main_create(t0);
@@ -30,15 +43,16 @@ void ui_init(void)
     // Screen 2: Modbus / Nilan debug UI
     ui_modbus_debug_create(t1);
 
-    // Screen 3: simple placeholder for now
-    lv_obj_set_style_bg_color(t2, lv_color_hex(0x202020), 0);
-    lv_obj_set_style_bg_opa(t2, LV_OPA_COVER, 0);
-    lv_obj_t *lbl = lv_label_create(t2);
-    lv_label_set_text(lbl, "Screen 3");
-    lv_obj_center(lbl);
+    // Screen 3: CPU, stack and heap diagnostics
+    ui_diag_create(t2);
+
+    // Screen 4: register history trend chart
+    ui_trend_create(t3);
 
     // Start on screen 1
     lv_obj_set_tile_id(s_tv, 0, 0, LV_ANIM_OFF);
 
+    lv_display_add_event_cb(lv_display_get_default(), first_flush_cb, LV_EVENT_FLUSH_FINISH, NULL);
+
     lvgl_port_unlock();
 }
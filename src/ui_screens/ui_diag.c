@@ -0,0 +1,147 @@
+#include "ui_diag.h"
+
+#include <string.h>
+
+#include "lvgl.h"
+#include "sys_diag.h"
+
+// Task rows shown; the sample keeps more for the log and export paths.
+#define DIAG_ROWS 8
+
+#define DIAG_TIMER_MS 1000
+#define DIAG_ROW_H 17
+#define DIAG_TABLE_Y 62
+
+// One label per column, one line per task: four redraw areas instead of
+// thirty-two, and each is only touched when its text changed.
+enum {
+    COL_NAME,
+    COL_CORE,
+    COL_CPU,
+    COL_STACK,
+    COL_COUNT
+};
+
+static const lv_coord_t s_col_x[COL_COUNT] = {6, 150, 196, 256};
+
+static lv_obj_t *s_tile = NULL;
+static lv_obj_t *s_lbl_cpu = NULL;
+static lv_obj_t *s_lbl_heap = NULL;
+static lv_obj_t *s_lbl_lvgl = NULL;
+static lv_obj_t *s_col[COL_COUNT];
+
+static uint32_t s_seq_shown = 0;
+static sys_diag_snapshot_t s_snap; // LVGL task only; kept off its stack
+
+// lv_label_set_text() invalidates even for identical text.
+static void set_text_if_changed(lv_obj_t *lbl, const char *text)
+{
+    if (strcmp(lv_label_get_text(lbl), text) != 0) {
+        lv_label_set_text(lbl, text);
+    }
+}
+
+static void fmt_permille(char *buf, size_t size, uint16_t pm)
+{
+    lv_snprintf(buf, size, "%u.%u%%", pm / 10, pm % 10);
+}
+
+static void render(const sys_diag_snapshot_t *s)
+{
+    char text[96];
+    char a[12], b[12], c[12];
+
+    fmt_permille(a, sizeof(a), s->core_load_permille[0]);
+    fmt_permille(b, sizeof(b), s->core_load_permille[1]);
+    fmt_permille(c, sizeof(c), s->bus_util_permille);
+    lv_snprintf(text, sizeof(text), "CPU0 %s  CPU1 %s  Bus %s", a, b, c);
+    set_text_if_changed(s_lbl_cpu, text);
+
+    lv_snprintf(text, sizeof(text), "Int %luk (min %luk)  DMA %luk (min %luk)",
+                (unsigned long)(s->heap_internal.free / 1024), (unsigned long)(s->heap_internal.min_free / 1024),
+                (unsigned long)(s->heap_dma.free / 1024), (unsigned long)(s->heap_dma.min_free / 1024));
+    set_text_if_changed(s_lbl_heap, text);
+
+    if (s->lvgl_total) {
+        lv_snprintf(text, sizeof(text), "LVGL %u%% of %luk, frag %u%%  Tasks %u",
+                    s->lvgl_used_pct, (unsigned long)(s->lvgl_total / 1024), s->lvgl_frag_pct, s->task_total);
+        set_text_if_changed(s_lbl_lvgl, text);
+    }
+
+    // Columns, one line per task.
+    char col[COL_COUNT][DIAG_ROWS * 20];
+    size_t len[COL_COUNT] = {0};
+    size_t rows = (s->task_count < DIAG_ROWS) ? s->task_count : DIAG_ROWS;
+
+    for (size_t i = 0; i < rows; ++i) {
+        const sys_diag_task_t *t = &s->tasks[i];
+        const char *nl = (i + 1 < rows) ? "\n" : "";
+        char pm[12];
+        fmt_permille(pm, sizeof(pm), t->cpu_permille);
+
+        len[COL_NAME] += lv_snprintf(col[COL_NAME] + len[COL_NAME], sizeof(col[0]) - len[COL_NAME],
+                                     "%s%s", t->name, nl);
+        len[COL_CORE] += lv_snprintf(col[COL_CORE] + len[COL_CORE], sizeof(col[0]) - len[COL_CORE],
+                                     "%c%s", (t->core == SYS_DIAG_CORE_ANY) ? '*' : (char)('0' + t->core), nl);
+        len[COL_CPU] += lv_snprintf(col[COL_CPU] + len[COL_CPU], sizeof(col[0]) - len[COL_CPU],
+                                    "%s%s", pm, nl);
+        len[COL_STACK] += lv_snprintf(col[COL_STACK] + len[COL_STACK], sizeof(col[0]) - len[COL_STACK],
+                                      "%lu%s", (unsigned long)t->stack_free, nl);
+    }
+
+    for (int k = 0; k < COL_COUNT; ++k) {
+        col[k][len[k]] = '\0';
+        set_text_if_changed(s_col[k], col[k]);
+    }
+}
+
+// Redraws only while the tile is on screen and only after a new sample.
+static void diag_timer_cb(lv_timer_t *t)
+{
+    (void)t;
+
+    lv_obj_t *tv = lv_obj_get_parent(s_tile);
+    if (lv_tileview_get_tile_active(tv) != s_tile) {
+        return;
+    }
+
+    uint32_t seq = sys_diag_seq();
+    if (seq == s_seq_shown || !sys_diag_get(&s_snap)) {
+        return;
+    }
+
+    s_seq_shown = s_snap.seq;
+    render(&s_snap);
+}
+
+static lv_obj_t *make_label(lv_obj_t *parent, lv_coord_t x, lv_coord_t y, uint32_t color_hex)
+{
+    lv_obj_t *lbl = lv_label_create(parent);
+    lv_label_set_text(lbl, "");
+    lv_obj_set_style_text_color(lbl, lv_color_hex(color_hex), 0);
+    lv_obj_set_style_text_line_space(lbl, DIAG_ROW_H - 16, 0);
+    lv_obj_set_pos(lbl, x, y);
+    return lbl;
+}
+
+void ui_diag_create(lv_obj_t *tile)
+{
+    s_tile = tile;
+
+    lv_obj_set_style_bg_color(tile, lv_color_hex(0x202020), 0);
+    lv_obj_set_style_bg_opa(tile, LV_OPA_COVER, 0);
+    lv_obj_clear_flag(tile, LV_OBJ_FLAG_SCROLLABLE);
+
+    s_lbl_cpu = make_label(tile, 6, 4, 0xFFFFFF);
+    s_lbl_heap = make_label(tile, 6, 22, 0xC0C0C0);
+    s_lbl_lvgl = make_label(tile, 6, 40, 0xC0C0C0);
+    lv_label_set_text(s_lbl_cpu, "Diagnostics: sampling...");
+
+    for (int k = 0; k < COL_COUNT; ++k) {
+        s_col[k] = make_label(tile, s_col_x[k], DIAG_TABLE_Y, 0xFFFFFF);
+    }
+    lv_obj_set_style_text_color(s_col[COL_CORE], lv_color_hex(0xC0C0C0), 0);
+    lv_obj_set_style_text_color(s_col[COL_STACK], lv_color_hex(0xC0C0C0), 0);
+
+    lv_timer_create(diag_timer_cb, DIAG_TIMER_MS, NULL);
+}
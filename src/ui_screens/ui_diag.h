@@ -0,0 +1,5 @@
+#pragma once
+#include "lvgl.h"
+
+// Build the diagnostics screen into the given tile (Tile 2).
+void ui_diag_create(lv_obj_t *tile);
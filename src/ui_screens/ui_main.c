@@ -1,6 +1,12 @@
 #include "ui_main.h"
+#include <time.h>
 #include "lvgl.h"
 #include "nilan_modbus.h"
+#include "nilan_notify.h"
+#include "nilan_snapshot.h"
+#include "NilanRegisters.h"
+#include "sys_time.h"
+#include "wifi_sta.h"
 
 // ---------- Layout constants for 320x240 ----------
 #define TOP_BAR_H     20
@@ -25,6 +31,7 @@
 #define COL_TANK_BORDER  0x6A6A6A
 
 // ---------- State ----------
+// Shown until the CTS602's own settings have been read (see control_timer_cb).
 static int s_vent_step = 3;
 static bool s_power_on = true;
 
@@ -32,13 +39,25 @@ static bool s_power_on = true;
 static lv_obj_t *s_lbl_step     = NULL;
 static lv_obj_t *s_lbl_tank_top = NULL;
 static lv_obj_t *s_lbl_tank_bot = NULL;
+static lv_obj_t *s_lbl_tank_age = NULL;    // how old the restored tank values are
 static lv_obj_t *s_lbl_power    = NULL;
+static lv_obj_t *s_lbl_clock    = NULL;
 
 // Popup handle (lazy-created)
 static lv_obj_t *s_step_popup = NULL;
 
 static lv_obj_t *s_tank_water = NULL;   // water gradient rect
 
+// Change notifications for the registers this screen shows, and what's on screen now.
+#define TANK_DEADBAND_cC 10                 // ignore sensor jitter below 0.1 °C
+static int s_notify_sub = -1;
+static int s_control_sub = -1;              // RUN_SET / VENT_SET, every change
+static int s_shown_top_c = -1000;           // impossible value: forces the first draw
+static int s_shown_bot_c = -1000;
+static bool s_shown_stale = false;          // tank values restored from the last boot
+static int s_shown_age_min = -2;            // -1 = hidden; forces the first draw
+static int s_shown_clock = -2;              // minute of the day, -1 = no time; forces the first draw
+
 
 // ---------- Helpers ----------
 static void set_label_u8(lv_obj_t *lbl, int v)
@@ -55,6 +74,49 @@ static void set_label_temp(lv_obj_t *lbl, int t_c)
     lv_label_set_text(lbl, b);
 }
 
+// Restored-but-not-yet-read values are drawn dimmed.
+static bool tank_is_stale(void)
+{
+    return nilan_reg_is_stale(NILAN_REGID_IR_T11_TANK_TOP) ||
+           nilan_reg_is_stale(NILAN_REGID_IR_T12_TANK_BOTTOM);
+}
+
+static void set_tank_labels_stale(bool stale)
+{
+    uint32_t col = stale ? COL_TEXT_DIM : COL_TEXT;
+    lv_obj_set_style_text_color(s_lbl_tank_top, lv_color_hex(col), 0);
+    lv_obj_set_style_text_color(s_lbl_tank_bot, lv_color_hex(col), 0);
+}
+
+// Next to dimmed values: how old the older of the two is, device-off time
+// included. Hidden once they're read, or while there is no clock to tell.
+static void tank_age_update(bool stale)
+{
+    uint32_t top_s, bot_s;
+    int age_min = -1;
+    if (stale &&
+        nilan_snapshot_restored_age_s(NILAN_REGID_IR_T11_TANK_TOP, &top_s) &&
+        nilan_snapshot_restored_age_s(NILAN_REGID_IR_T12_TANK_BOTTOM, &bot_s)) {
+        uint32_t age_s = (top_s > bot_s) ? top_s : bot_s;
+        age_min = (age_s / 60 > INT32_MAX) ? INT32_MAX : (int)(age_s / 60);
+    }
+
+    if (age_min == s_shown_age_min) return;
+    s_shown_age_min = age_min;
+
+    if (age_min < 0) {
+        lv_obj_add_flag(s_lbl_tank_age, LV_OBJ_FLAG_HIDDEN);
+        return;
+    }
+
+    char b[16];
+    if (age_min < 60)            lv_snprintf(b, sizeof(b), "%d min old", age_min);
+    else if (age_min < 48 * 60)  lv_snprintf(b, sizeof(b), "%d h old", age_min / 60);
+    else                         lv_snprintf(b, sizeof(b), "%d d old", age_min / (24 * 60));
+    lv_label_set_text(s_lbl_tank_age, b);
+    lv_obj_clear_flag(s_lbl_tank_age, LV_OBJ_FLAG_HIDDEN);
+}
+
 // --- small RGB hex lerp (8-bit per channel) ---
 static uint32_t lerp_rgb(uint32_t a, uint32_t b, uint8_t t /*0..255*/)
 {
@@ -92,7 +154,9 @@ static void tank_water_set_gradient(lv_obj_t *water, int top_c, int bot_c)
     lv_obj_set_style_bg_opa(water, LV_OPA_COVER, 0);
 }
 
-// Periodic main-screen status update (tank temps)
+// Periodic main-screen status update (tank temps).
+// Touches the widgets only when the tank registers changed and the shown
+// whole degrees moved; otherwise nothing is invalidated and nothing redrawn.
 static void main_status_timer_cb(lv_timer_t *t)
 {
     (void)t;
@@ -101,16 +165,102 @@ static void main_status_timer_cb(lv_timer_t *t)
         return;
     }
 
+    // The age keeps growing, and the clock may only come after the UI.
+    if (s_shown_stale) tank_age_update(true);
+
+    nilan_reg_mask_t dirty;
+    if (!nilan_notify_take(s_notify_sub, &dirty)) {
+        return;
+    }
+
     // Values from Modbus are in centi-degrees C (x100)
-    int16_t top_cC = nilan_get_tank_top_cC();
-    int16_t bot_cC = nilan_get_tank_bottom_cC();
+    int top_c = nilan_get_tank_top_cC() / 100;
+    int bot_c = nilan_get_tank_bottom_cC() / 100;
+
+    bool stale = tank_is_stale();
+    if (stale != s_shown_stale) {
+        set_tank_labels_stale(stale);
+        tank_age_update(stale);
+        s_shown_stale = stale;
+    }
 
-    int top_c = top_cC / 100;
-    int bot_c = bot_cC / 100;
+    if (top_c == s_shown_top_c && bot_c == s_shown_bot_c) {
+        return;
+    }
 
-    set_label_temp(s_lbl_tank_top, top_c);
-    set_label_temp(s_lbl_tank_bot, bot_c);
+    if (top_c != s_shown_top_c) set_label_temp(s_lbl_tank_top, top_c);
+    if (bot_c != s_shown_bot_c) set_label_temp(s_lbl_tank_bot, bot_c);
     tank_water_set_gradient(s_tank_water, top_c, bot_c);
+
+    s_shown_top_c = top_c;
+    s_shown_bot_c = bot_c;
+}
+
+
+// Top bar clock and link state. Reading the time is a memory read (sys_time.h),
+// so checking every second costs nothing; the label changes once a minute.
+static void clock_timer_cb(lv_timer_t *t)
+{
+    (void)t;
+
+    int64_t now;
+    int minute = -1;
+    struct tm tm;
+    if (sys_time_now(&now)) {
+        time_t tt = (time_t)now;
+        localtime_r(&tt, &tm);
+        minute = tm.tm_hour * 60 + tm.tm_min;
+    }
+
+    bool wifi = wifi_sta_is_connected();
+    int shown = minute * 2 + (wifi ? 1 : 0);
+    if (shown == s_shown_clock) {
+        return;
+    }
+    s_shown_clock = shown;
+
+    char b[16];
+    if (minute < 0) {
+        lv_snprintf(b, sizeof(b), "--:--  %s", wifi ? "WiFi" : "--");
+    } else {
+        lv_snprintf(b, sizeof(b), "%02d:%02d  %s", tm.tm_hour, tm.tm_min, wifi ? "WiFi" : "--");
+    }
+    lv_label_set_text(s_lbl_clock, b);
+}
+
+
+static void power_btn_update(void);
+
+// Follow the power and step settings on the controller, including changes
+// made on its own panel. Restored values aren't trusted: a tap would be
+// computed from them.
+static void control_timer_cb(lv_timer_t *t)
+{
+    (void)t;
+
+    nilan_reg_mask_t dirty;
+    if (!nilan_notify_take(s_control_sub, &dirty)) {
+        return;
+    }
+
+    if (nilan_reg_mask_test(&dirty, NILAN_REGID_HR_CONTROL_RUN_SET) &&
+        !nilan_reg_is_stale(NILAN_REGID_HR_CONTROL_RUN_SET)) {
+        bool on = nilan_reg_raw(NILAN_REGID_HR_CONTROL_RUN_SET) != 0;
+        if (on != s_power_on) {
+            s_power_on = on;
+            power_btn_update();
+        }
+    }
+
+    if (nilan_reg_mask_test(&dirty, NILAN_REGID_HR_CONTROL_VENT_SET) &&
+        !nilan_reg_is_stale(NILAN_REGID_HR_CONTROL_VENT_SET)) {
+        int step = nilan_reg_raw(NILAN_REGID_HR_CONTROL_VENT_SET);
+        if (step > 4) step = 4;
+        if (step != s_vent_step) {
+            s_vent_step = step;
+            if (s_lbl_step) set_label_u8(s_lbl_step, s_vent_step);
+        }
+    }
 }
 
 
@@ -179,6 +329,13 @@ static lv_obj_t* fan_icon_create(lv_obj_t *parent, int size_px, uint32_t outline
     return cont;
 }
 
+// A setting read from the controller this boot. Taps before that would be
+// computed from the defaults or a restored value, so they are ignored.
+static bool control_known(nilan_reg_id_t id)
+{
+    return nilan_reg_gen(id) != 0 && !nilan_reg_is_stale(id);
+}
+
 // ---------- Power button ----------
 static void power_btn_update(void)
 {
@@ -192,8 +349,21 @@ static void power_btn_update(void)
 static void on_power_tapped(lv_event_t *e)
 {
     (void)e;
+    if (!control_known(NILAN_REGID_HR_CONTROL_RUN_SET)) return;
+
     s_power_on = !s_power_on;
     power_btn_update();
+
+    // Queued, never blocks the UI; the bus task sends it once taps settle.
+    nilan_modbus_write_single_holding(nilan_registers[NILAN_REGID_HR_CONTROL_RUN_SET].addr,
+                                      s_power_on ? 1 : 0);
+}
+
+// Push the current step to the CTS602. Rapid +/- taps coalesce into one write.
+static void vent_step_send(void)
+{
+    nilan_modbus_write_single_holding(nilan_registers[NILAN_REGID_HR_CONTROL_VENT_SET].addr,
+                                      (uint16_t)s_vent_step);
 }
 
 // ---------- Popup internals ----------
@@ -207,8 +377,11 @@ static void popup_close(void)
 
 static void popup_step_minus(lv_event_t *e)
 {
+    if (!control_known(NILAN_REGID_HR_CONTROL_VENT_SET)) return;
+
     if (s_vent_step > 0) s_vent_step--;
     set_label_u8(s_lbl_step, s_vent_step);
+    vent_step_send();
 
     lv_obj_t *lbl = (lv_obj_t *)lv_event_get_user_data(e);
     if (lbl) set_label_u8(lbl, s_vent_step);
@@ -216,8 +389,11 @@ static void popup_step_minus(lv_event_t *e)
 
 static void popup_step_plus(lv_event_t *e)
 {
+    if (!control_known(NILAN_REGID_HR_CONTROL_VENT_SET)) return;
+
     if (s_vent_step < 4) s_vent_step++;
     set_label_u8(s_lbl_step, s_vent_step);
+    vent_step_send();
 
     lv_obj_t *lbl = (lv_obj_t *)lv_event_get_user_data(e);
     if (lbl) set_label_u8(lbl, s_vent_step);
@@ -300,10 +476,10 @@ void ui_main_create(lv_obj_t *tile)
     lv_obj_set_style_border_width(top, 0, 0);
     lv_obj_clear_flag(top, LV_OBJ_FLAG_SCROLLABLE);
 
-    lv_obj_t *lbl_time = lv_label_create(top);
-    lv_label_set_text(lbl_time, "22:45  WiFi");
-    lv_obj_set_style_text_color(lbl_time, lv_color_hex(COL_TEXT_DIM), 0);
-    lv_obj_align(lbl_time, LV_ALIGN_LEFT_MID, 6, 0);
+    s_lbl_clock = lv_label_create(top);
+    lv_obj_set_style_text_color(s_lbl_clock, lv_color_hex(COL_TEXT_DIM), 0);
+    lv_obj_align(s_lbl_clock, LV_ALIGN_LEFT_MID, 6, 0);
+    clock_timer_cb(NULL);
 
     lv_obj_t *lbl_mode = lv_label_create(top);
     lv_label_set_text(lbl_mode, "Mode: Auto");
@@ -386,7 +562,7 @@ void ui_main_create(lv_obj_t *tile)
     lv_obj_align(s_lbl_tank_bot, LV_ALIGN_BOTTOM_MID, 0, -6);
     //set_label_temp(s_lbl_tank_bot, 35);
 
-    // Initial values from Modbus (will be 0 until first poll)
+    // Initial values: restored from the last boot (dimmed) or 0 until the first poll
     int16_t init_top_cC = nilan_get_tank_top_cC();
     int16_t init_bot_cC = nilan_get_tank_bottom_cC();
     int init_top_c = init_top_cC / 100;
@@ -396,6 +572,14 @@ void ui_main_create(lv_obj_t *tile)
     set_label_temp(s_lbl_tank_top, init_top_c);
     set_label_temp(s_lbl_tank_bot, init_bot_c);
     tank_water_set_gradient(water, init_top_c, init_bot_c);
+    s_lbl_tank_age = lv_label_create(tank_wrap);
+    lv_obj_set_style_text_color(s_lbl_tank_age, lv_color_hex(COL_TEXT_DIM), 0);
+    lv_obj_set_style_text_font(s_lbl_tank_age, &lv_font_montserrat_14, 0);
+    lv_obj_align(s_lbl_tank_age, LV_ALIGN_LEFT_MID, 0, 0);   // beside the tank
+
+    s_shown_stale = tank_is_stale();
+    set_tank_labels_stale(s_shown_stale);
+    tank_age_update(s_shown_stale);
 
     lv_obj_t *div = lv_obj_create(water);
     lv_obj_set_size(div, 56, 1);
@@ -423,5 +607,19 @@ void ui_main_create(lv_obj_t *tile)
     lv_obj_add_event_cb(pwr_btn, on_power_tapped, LV_EVENT_CLICKED, NULL);
 
     s_tank_water = water;
-    lv_timer_create(main_status_timer_cb, 1000, NULL);  // 1Hz UI update
+
+    nilan_reg_mask_t tank_regs = {0};
+    nilan_reg_mask_set(&tank_regs, NILAN_REGID_IR_T11_TANK_TOP);
+    nilan_reg_mask_set(&tank_regs, NILAN_REGID_IR_T12_TANK_BOTTOM);
+    s_notify_sub = nilan_notify_subscribe(&tank_regs, TANK_DEADBAND_cC, NULL);
+
+    nilan_reg_mask_t control_regs = {0};
+    nilan_reg_mask_set(&control_regs, NILAN_REGID_HR_CONTROL_RUN_SET);
+    nilan_reg_mask_set(&control_regs, NILAN_REGID_HR_CONTROL_VENT_SET);
+    s_control_sub = nilan_notify_subscribe(&control_regs, 0, NULL);
+    control_timer_cb(NULL);
+
+    lv_timer_create(main_status_timer_cb, 1000, NULL);  // 1Hz check, redraws only on change
+    lv_timer_create(clock_timer_cb, 1000, NULL);        // likewise
+    lv_timer_create(control_timer_cb, 1000, NULL);      // likewise
 }
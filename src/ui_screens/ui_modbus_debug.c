@@ -1,4 +1,7 @@
 #include "ui_modbus_debug.h"
+
+#include <string.h>
+
 #include "lvgl.h"
 #include "nilan_modbus.h"
 
@@ -42,6 +45,26 @@ static lv_obj_t *s_overlay = NULL;
 
 static int s_current_index = 0;
 
+// Read results come back on the Modbus bus task and are handed to the LVGL task
+// through this single-slot mailbox: the bus task fills the slot, then bumps seq
+// (release); the poll timer below sees seq move (acquire) and renders the slot.
+// Only one read is in flight at a time, so the slot is never rewritten while
+// the LVGL side is reading it.
+#define READ_MAX_REGS 4
+#define READ_POLL_MS 20
+
+static struct
+{
+    uint16_t raw[READ_MAX_REGS];
+    nilan_mb_err_t err;
+    uint32_t seq;
+} s_read_box;
+
+static uint32_t s_read_seq_seen = 0;
+static bool s_read_pending = false;
+static int s_read_index = 0;            // table entry the pending read is for
+static lv_timer_t *s_read_timer = NULL; // runs only while a read is pending
+
 // ---------- Helpers ----------
 
 static void format_value(char *buf,
@@ -119,18 +142,25 @@ static void dbg_status_timer_cb(lv_timer_t *timer)
     (void)timer;
     if (!s_lbl_status) return;
 
-    bool online = nilan_modbus_is_online();
+    // Whole seconds, and only set when the text differs: a label that is set
+    // to the same text every tick still gets invalidated and redrawn.
+    static char s_shown[48] = "";
+    char text[48];
 
-    if (online)
+    if (nilan_modbus_is_online())
     {
         float age = nilan_modbus_get_secs_since_last_ok();
-        lv_label_set_text_fmt(s_lbl_status,
-                              "Status: ONLINE (last OK %.1fs ago)",
-                              (double)age);
+        lv_snprintf(text, sizeof(text), "Status: ONLINE (last OK %us ago)", (unsigned)age);
     }
     else
     {
-        lv_label_set_text(s_lbl_status, "Status: offline");
+        lv_snprintf(text, sizeof(text), "Status: offline");
+    }
+
+    if (strcmp(text, s_shown) != 0)
+    {
+        lv_label_set_text(s_lbl_status, text);
+        strcpy(s_shown, text);
     }
 }
 
@@ -202,32 +232,74 @@ static void select_btn_event_cb(lv_event_t *e)
 
 // ---------- Read button ----------
 
-static void read_btn_event_cb(lv_event_t *e)
+// Bus task context: fill the mailbox, then publish it.
+static void read_done_cb(const nilan_mb_request_t *req, nilan_mb_err_t err, const uint16_t *regs)
 {
-    (void)e;
-    if (!s_lbl_value) return;
+    if (err == NILAN_MB_ERR_NONE)
+    {
+        memcpy(s_read_box.raw, regs, req->qty * sizeof(uint16_t));
+    }
+    s_read_box.err = err;
+    __atomic_fetch_add(&s_read_box.seq, 1, __ATOMIC_RELEASE);
+}
 
-    const reg_desc_t *d = &s_reg_table[s_current_index];
+// LVGL context: pick up a finished read.
+static void read_result_timer_cb(lv_timer_t *timer)
+{
+    uint32_t seq = __atomic_load_n(&s_read_box.seq, __ATOMIC_ACQUIRE);
+    if (seq == s_read_seq_seen)
+    {
+        return; // still on the bus
+    }
 
-    uint16_t raw[4] = {0};
-    //nilan_mb_err_t err = NILAN_MB_ERR_NONE;
-    bool modbus_read_ok = false;
+    s_read_seq_seen = seq;
+    s_read_pending = false;
+    lv_timer_pause(timer);
 
-    modbus_read_ok = nilan_read_regs(d->reg_type, d->addr, d->count, raw);
+    // The selection may have changed while the read was queued.
+    if (!s_lbl_value || s_read_index != s_current_index) return;
 
+    const reg_desc_t *d = &s_reg_table[s_read_index];
 
-    if (modbus_read_ok == false)
+    if (s_read_box.err != NILAN_MB_ERR_NONE)
     {
-        lv_label_set_text_fmt(s_lbl_value, "Read CRC error");
-        return;     
+        lv_label_set_text_fmt(s_lbl_value, "Read failed (err %d)", (int)s_read_box.err);
+        return;
     }
 
-
     char buf[64];
-    format_value(buf, sizeof(buf), d, raw, d->count);
+    format_value(buf, sizeof(buf), d, s_read_box.raw, d->count);
     lv_label_set_text_fmt(s_lbl_value, "Value: %s", buf);
 }
 
+static void read_btn_event_cb(lv_event_t *e)
+{
+    (void)e;
+    if (!s_lbl_value || s_read_pending) return;
+
+    const reg_desc_t *d = &s_reg_table[s_current_index];
+
+    nilan_mb_request_t req = {
+        .func = d->reg_type,
+        .start = d->addr,
+        .qty = (d->count <= READ_MAX_REGS) ? d->count : READ_MAX_REGS,
+        .done = read_done_cb,
+        .user = NULL,
+    };
+
+    // Never wait on the bus here: the LVGL task would stop drawing and taking touches.
+    if (!nilan_modbus_submit(&req, NILAN_MB_PRIO_URGENT))
+    {
+        lv_label_set_text(s_lbl_value, "Value: bus busy, try again");
+        return;
+    }
+
+    s_read_pending = true;
+    s_read_index = s_current_index;
+    lv_label_set_text(s_lbl_value, "Value: reading...");
+    lv_timer_resume(s_read_timer);
+}
+
 // ---------- Screen creation ----------
 
 void ui_modbus_debug_create(lv_obj_t *tile)
@@ -278,4 +350,8 @@ void ui_modbus_debug_create(lv_obj_t *tile)
 
     // Periodic status update timer (500 ms, only uses cached data)
     lv_timer_create(dbg_status_timer_cb, 500, NULL);
+
+    // Read result pickup; paused until the Read button submits something
+    s_read_timer = lv_timer_create(read_result_timer_cb, READ_POLL_MS, NULL);
+    lv_timer_pause(s_read_timer);
 }
@@ -0,0 +1,289 @@
+#include "ui_trend.h"
+
+#include <stdlib.h>
+
+#include "lvgl.h"
+#include "NilanRegisters.h"
+#include "nilan_history.h"
+
+// Every series is decimated to at most one point per pixel column of the
+// plot before it reaches lv_chart, whatever the span.
+
+#define TREND_CHART_H 196
+#define TREND_BTN_W 44
+#define TREND_BTN_H 34
+
+// History points read per series before decimation (12 bytes each; the
+// buffer is big enough that malloc puts it in PSRAM).
+#define TREND_SCRATCH_POINTS 2048
+
+// Live view re-reads the history this often while the tile is shown.
+#define TREND_LIVE_REFRESH_MS 10000
+
+typedef struct {
+    nilan_reg_id_t id;
+    const char *label;
+    uint32_t color;
+    lv_chart_axis_t axis;   // temperatures left, capacity in percent right
+} trend_series_t;
+
+static const trend_series_t s_series[] = {
+    {NILAN_REGID_IR_T11_TANK_TOP,           "Top",  0xFF8C00, LV_CHART_AXIS_PRIMARY_Y},
+    {NILAN_REGID_IR_T12_TANK_BOTTOM,        "Bot",  0x3A7BD5, LV_CHART_AXIS_PRIMARY_Y},
+    {NILAN_REGID_IR_T8_OUTDOOR,             "Out",  0x00BCD4, LV_CHART_AXIS_PRIMARY_Y},
+    {NILAN_REGID_IR_T15_ROOM_PANEL,         "Room", 0x7CB342, LV_CHART_AXIS_PRIMARY_Y},
+    {NILAN_REGID_HR_OUTPUT_COMPR_CAPAPACITY, "Comp%", 0xC060C0, LV_CHART_AXIS_SECONDARY_Y},
+};
+
+#define TREND_SERIES_COUNT (sizeof(s_series) / sizeof(s_series[0]))
+
+static const uint32_t s_spans_s[] = {
+    15 * 60, 60 * 60, 6 * 3600, 24 * 3600, 3 * 86400, 7 * 86400, 14 * 86400,
+};
+
+#define TREND_SPAN_COUNT (sizeof(s_spans_s) / sizeof(s_spans_s[0]))
+
+static lv_obj_t *s_tile = NULL;
+static lv_obj_t *s_chart = NULL;
+static lv_obj_t *s_lbl_span = NULL;
+static lv_obj_t *s_lbl_range = NULL;
+static lv_chart_series_t *s_ser[TREND_SERIES_COUNT];
+
+// One x and y array per series, handed to lv_chart as external buffers.
+static int32_t *s_x[TREND_SERIES_COUNT];
+static int32_t *s_y[TREND_SERIES_COUNT];
+static uint32_t s_points = 0;          // plot width in pixels = chart point count
+
+static nilan_hist_point_t *s_scratch = NULL;
+static nilan_hist_point_t *s_decimated = NULL;
+
+static size_t s_span_idx = 1;          // 1 h
+static uint32_t s_back_s = 0;          // right edge this far before now; 0 = live
+
+static void fmt_span(char *buf, size_t size, uint32_t s)
+{
+    if (s >= 86400) {
+        lv_snprintf(buf, size, "%lu d", (unsigned long)(s / 86400));
+    } else if (s >= 3600) {
+        lv_snprintf(buf, size, "%lu h", (unsigned long)(s / 3600));
+    } else {
+        lv_snprintf(buf, size, "%lu min", (unsigned long)(s / 60));
+    }
+}
+
+static void update_span_label(void)
+{
+    char span[16];
+    char back[16];
+    fmt_span(span, sizeof(span), s_spans_s[s_span_idx]);
+
+    if (s_back_s == 0) {
+        lv_label_set_text_fmt(s_lbl_span, "%s  live", span);
+    } else {
+        fmt_span(back, sizeof(back), s_back_s);
+        lv_label_set_text_fmt(s_lbl_span, "%s  -%s", span, back);
+    }
+}
+
+// Re-read and re-decimate every series for the current window.
+static void trend_refresh(void)
+{
+    if (!s_scratch || s_points == 0) {
+        return;
+    }
+
+    uint32_t span_s = s_spans_s[s_span_idx];
+    uint32_t now_s = nilan_history_now_s();
+    uint32_t to_s = (now_s > s_back_s) ? now_s - s_back_s : 0;
+    uint32_t from_s = (to_s > span_s) ? to_s - span_s : 0;
+
+    int32_t tmin = INT32_MAX;
+    int32_t tmax = INT32_MIN;
+
+    for (size_t k = 0; k < TREND_SERIES_COUNT; ++k) {
+        const trend_series_t *sd = &s_series[k];
+        size_t n = nilan_history_query_decimated(sd->id, from_s, to_s,
+                                                 s_scratch, TREND_SCRATCH_POINTS,
+                                                 s_decimated, s_points);
+
+        for (size_t i = 0; i < n; ++i) {
+            int32_t v = nilan_history_value(sd->id, s_decimated[i].avg);
+            // Buckets start before from_s at the left edge; clamp into the plot.
+            s_x[k][i] = (s_decimated[i].t_s > from_s) ? (int32_t)(s_decimated[i].t_s - from_s) : 0;
+            s_y[k][i] = v;
+
+            if (sd->axis == LV_CHART_AXIS_PRIMARY_Y) {
+                if (v < tmin) tmin = v;
+                if (v > tmax) tmax = v;
+            }
+        }
+        for (size_t i = n; i < s_points; ++i) {
+            s_y[k][i] = LV_CHART_POINT_NONE;
+        }
+    }
+
+    lv_chart_set_axis_range(s_chart, LV_CHART_AXIS_PRIMARY_X, 0, (int32_t)span_s);
+
+    // Temperatures in centi-degrees: whole degrees with a degree of margin.
+    if (tmin <= tmax) {
+        int32_t lo = (tmin / 100 - 1) * 100;
+        int32_t hi = (tmax / 100 + 1) * 100;
+        lv_chart_set_axis_range(s_chart, LV_CHART_AXIS_PRIMARY_Y, lo, hi);
+        lv_label_set_text_fmt(s_lbl_range, "%ld..%ld C", (long)(lo / 100), (long)(hi / 100));
+    } else {
+        lv_label_set_text(s_lbl_range, "no history yet");
+    }
+
+    lv_chart_refresh(s_chart);
+}
+
+static void trend_timer_cb(lv_timer_t *t)
+{
+    (void)t;
+
+    if (s_back_s != 0 || lv_tileview_get_tile_active(lv_obj_get_parent(s_tile)) != s_tile) {
+        return;
+    }
+    trend_refresh();
+}
+
+// The tile may be swiped to with a stale view; catch up at once.
+static void tile_shown_cb(lv_event_t *e)
+{
+    (void)e;
+    if (lv_tileview_get_tile_active(lv_obj_get_parent(s_tile)) == s_tile) {
+        trend_refresh();
+    }
+}
+
+typedef enum {
+    TREND_BTN_BACK,
+    TREND_BTN_FWD,
+    TREND_BTN_ZOOM_OUT,
+    TREND_BTN_ZOOM_IN,
+} trend_btn_t;
+
+static void btn_event_cb(lv_event_t *e)
+{
+    trend_btn_t which = (trend_btn_t)(intptr_t)lv_event_get_user_data(e);
+    uint32_t half = s_spans_s[s_span_idx] / 2;
+
+    switch (which) {
+    case TREND_BTN_BACK:
+        s_back_s += half;
+        break;
+    case TREND_BTN_FWD:
+        s_back_s = (s_back_s > half) ? s_back_s - half : 0;
+        break;
+    case TREND_BTN_ZOOM_OUT:
+        if (s_span_idx + 1 < TREND_SPAN_COUNT) s_span_idx++;
+        break;
+    case TREND_BTN_ZOOM_IN:
+        if (s_span_idx > 0) s_span_idx--;
+        break;
+    }
+
+    update_span_label();
+    trend_refresh();
+}
+
+static lv_obj_t *make_btn(lv_obj_t *parent, const char *text, lv_coord_t x, trend_btn_t which)
+{
+    lv_obj_t *btn = lv_btn_create(parent);
+    lv_obj_set_size(btn, TREND_BTN_W, TREND_BTN_H);
+    lv_obj_align(btn, LV_ALIGN_BOTTOM_LEFT, x, -4);
+    lv_obj_t *lbl = lv_label_create(btn);
+    lv_label_set_text(lbl, text);
+    lv_obj_center(lbl);
+    lv_obj_add_event_cb(btn, btn_event_cb, LV_EVENT_CLICKED, (void *)(intptr_t)which);
+    return btn;
+}
+
+static bool alloc_buffers(void)
+{
+    s_scratch = malloc(TREND_SCRATCH_POINTS * sizeof(nilan_hist_point_t));
+    s_decimated = malloc(s_points * sizeof(nilan_hist_point_t));
+    if (!s_scratch || !s_decimated) {
+        return false;
+    }
+
+    for (size_t k = 0; k < TREND_SERIES_COUNT; ++k) {
+        s_x[k] = malloc(s_points * sizeof(int32_t));
+        s_y[k] = malloc(s_points * sizeof(int32_t));
+        if (!s_x[k] || !s_y[k]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ui_trend_create(lv_obj_t *tile)
+{
+    s_tile = tile;
+
+    lv_obj_set_style_bg_color(tile, lv_color_hex(0x202020), 0);
+    lv_obj_set_style_bg_opa(tile, LV_OPA_COVER, 0);
+    lv_obj_clear_flag(tile, LV_OBJ_FLAG_SCROLLABLE);
+
+    s_chart = lv_chart_create(tile);
+    lv_obj_set_size(s_chart, 320, TREND_CHART_H);
+    lv_obj_align(s_chart, LV_ALIGN_TOP_MID, 0, 0);
+    lv_obj_set_style_bg_color(s_chart, lv_color_hex(0x101010), 0);
+    lv_obj_set_style_border_width(s_chart, 0, 0);
+    lv_obj_set_style_radius(s_chart, 0, 0);
+    lv_obj_set_style_pad_all(s_chart, 4, 0);
+    lv_obj_set_style_line_color(s_chart, lv_color_hex(0x303030), LV_PART_MAIN);
+    lv_obj_set_style_size(s_chart, 0, 0, LV_PART_INDICATOR); // lines only, no point dots
+    lv_obj_clear_flag(s_chart, LV_OBJ_FLAG_CLICKABLE);
+    lv_chart_set_type(s_chart, LV_CHART_TYPE_SCATTER);
+    lv_chart_set_update_mode(s_chart, LV_CHART_UPDATE_MODE_CIRCULAR);
+    lv_chart_set_div_line_count(s_chart, 5, 7);
+    lv_chart_set_axis_range(s_chart, LV_CHART_AXIS_SECONDARY_Y, 0, 100);
+
+    lv_obj_update_layout(s_chart);
+    s_points = (uint32_t)lv_obj_get_content_width(s_chart);
+
+    if (!alloc_buffers()) {
+        lv_obj_t *lbl = lv_label_create(tile);
+        lv_label_set_text(lbl, "Trend: out of memory");
+        lv_obj_center(lbl);
+        s_points = 0;
+        return;
+    }
+
+    lv_chart_set_point_count(s_chart, s_points);
+
+    for (size_t k = 0; k < TREND_SERIES_COUNT; ++k) {
+        s_ser[k] = lv_chart_add_series(s_chart, lv_color_hex(s_series[k].color), s_series[k].axis);
+        for (size_t i = 0; i < s_points; ++i) {
+            s_y[k][i] = LV_CHART_POINT_NONE;
+            s_x[k][i] = 0;
+        }
+        lv_chart_set_series_ext_x_array(s_chart, s_ser[k], s_x[k]);
+        lv_chart_set_series_ext_y_array(s_chart, s_ser[k], s_y[k]);
+
+        // Legend across the top of the plot.
+        lv_obj_t *lg = lv_label_create(tile);
+        lv_label_set_text(lg, s_series[k].label);
+        lv_obj_set_style_text_color(lg, lv_color_hex(s_series[k].color), 0);
+        lv_obj_set_pos(lg, 6 + (lv_coord_t)k * 50, 4);
+    }
+
+    s_lbl_range = lv_label_create(tile);
+    lv_label_set_text(s_lbl_range, "");
+    lv_obj_set_style_text_color(s_lbl_range, lv_color_hex(0xC0C0C0), 0);
+    lv_obj_align(s_lbl_range, LV_ALIGN_TOP_RIGHT, -6, TREND_CHART_H - 20);
+
+    make_btn(tile, LV_SYMBOL_LEFT, 4, TREND_BTN_BACK);
+    make_btn(tile, LV_SYMBOL_RIGHT, 4 + (TREND_BTN_W + 4), TREND_BTN_FWD);
+    make_btn(tile, LV_SYMBOL_MINUS, 4 + 2 * (TREND_BTN_W + 4), TREND_BTN_ZOOM_OUT);
+    make_btn(tile, LV_SYMBOL_PLUS, 4 + 3 * (TREND_BTN_W + 4), TREND_BTN_ZOOM_IN);
+
+    s_lbl_span = lv_label_create(tile);
+    lv_obj_set_style_text_color(s_lbl_span, lv_color_hex(0xFFFFFF), 0);
+    lv_obj_align(s_lbl_span, LV_ALIGN_BOTTOM_RIGHT, -6, -12);
+    update_span_label();
+
+    lv_obj_add_event_cb(lv_obj_get_parent(tile), tile_shown_cb, LV_EVENT_VALUE_CHANGED, NULL);
+    lv_timer_create(trend_timer_cb, TREND_LIVE_REFRESH_MS, NULL);
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include "lvgl.h"
+
+// Build the trend chart screen into the given tile (Tile 3).
+void ui_trend_create(lv_obj_t *tile);
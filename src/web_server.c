@@ -0,0 +1,49 @@
+#include "web_server.h"
+
+#include <unistd.h>
+
+#include "esp_log.h"
+
+#include "nilan_metrics.h"
+#include "nilan_ws.h"
+
+static const char *TAG = "web";
+
+static httpd_handle_t s_server = NULL;
+
+// Owning close_fn: the server leaves closing the socket to us.
+static void on_sock_close(httpd_handle_t hd, int sockfd)
+{
+    (void)hd;
+    nilan_ws_sock_closed(sockfd);
+    close(sockfd);
+}
+
+bool web_server_start(void)
+{
+    if (s_server) return true;
+
+    httpd_config_t cfg = HTTPD_DEFAULT_CONFIG();
+    cfg.stack_size = 6144;      // handlers format into stack buffers
+    cfg.task_priority = 2;      // below the bus task and LVGL
+    cfg.lru_purge_enable = true;
+    cfg.close_fn = on_sock_close;
+
+    esp_err_t err = httpd_start(&s_server, &cfg);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "httpd_start failed: %s", esp_err_to_name(err));
+        s_server = NULL;
+        return false;
+    }
+
+    nilan_metrics_register(s_server);
+    nilan_ws_register(s_server);
+
+    ESP_LOGI(TAG, "HTTP server on port %u", (unsigned)cfg.server_port);
+    return true;
+}
+
+httpd_handle_t web_server_handle(void)
+{
+    return s_server;
+}
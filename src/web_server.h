@@ -0,0 +1,21 @@
+#pragma once
+#include <stdbool.h>
+
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// HTTP server on port 80. Handlers come from the modules that own the data
+// (nilan_metrics_register() and friends) and must only read cached state:
+// nothing served here may wait for the RS485 bus.
+// Call once the network stack is up (after wifi_sta_start()).
+bool web_server_start(void);
+
+// NULL until web_server_start() succeeded.
+httpd_handle_t web_server_handle(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,18 +4,30 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/task.h"
 
 #include "esp_log.h"
 #include "esp_event.h"
 #include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "nvs_flash.h"
 
 static const char *TAG = "wifi_sta";
 
+ESP_EVENT_DEFINE_BASE(WIFI_STA_EVENT);
+
 #define WIFI_CONNECTED_BIT  BIT0
-#define WIFI_FAIL_BIT       BIT1
-#define WIFI_MAX_RETRY      10
+
+// Reconnect backoff: doubles per failed attempt up to the cap, then each wait
+// is drawn from [half, full] so a room of devices doesn't retry in lockstep
+// after the router comes back.
+#define WIFI_BACKOFF_MIN_MS 500
+#define WIFI_BACKOFF_MAX_MS 60000
+
+// Associated but no DHCP lease by then: drop the link and start over.
+#define WIFI_IP_TIMEOUT_MS  15000
 
 // -------- Defaults live HERE --------
 // Set via build_flags in platformio.ini.
@@ -27,20 +39,92 @@ static const char *TAG = "wifi_sta";
 #define WIFI_STA_DEFAULT_PASS "PASSWD"
 #endif
 
-// How long wifi_sta_start() should wait before giving up (ms)
-#ifndef WIFI_STA_START_TIMEOUT_MS
-#define WIFI_STA_START_TIMEOUT_MS 10000
-#endif
 // -----------------------------------
 
 static EventGroupHandle_t s_evt = NULL;
 static esp_netif_t *s_netif = NULL;
+static esp_timer_handle_t s_timer = NULL; // backoff wait, or the DHCP timeout
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
 
 static volatile bool s_connected = false;
 static volatile uint32_t s_ip_u32 = 0;
-static int s_retry = 0;
 static bool s_inited = false;
 
+// Connection state machine; written by the event loop and the timer, under s_lock.
+static wifi_sta_stats_t s_stats = { .state = WIFI_STA_STATE_IDLE };
+static int64_t s_attempt_start_us = 0; // first attempt of the current (re)connect
+static int64_t s_up_since_us = 0;
+static uint32_t s_links = 0;
+
+static void set_state(wifi_sta_state_t state)
+{
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.state = state;
+    taskEXIT_CRITICAL(&s_lock);
+}
+
+static wifi_sta_state_t get_state(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    wifi_sta_state_t state = s_stats.state;
+    taskEXIT_CRITICAL(&s_lock);
+    return state;
+}
+
+static void link_down(void)
+{
+    s_connected = false;
+    s_ip_u32 = 0;
+    xEventGroupClearBits(s_evt, WIFI_CONNECTED_BIT);
+    esp_event_post(WIFI_STA_EVENT, WIFI_STA_EVENT_DOWN, NULL, 0, 0);
+}
+
+// Schedule the next attempt. Never gives up.
+static void schedule_retry(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    uint32_t n = s_stats.attempts < 16 ? s_stats.attempts : 16;
+    uint32_t cap = (uint32_t)WIFI_BACKOFF_MIN_MS << n;
+    if (cap > WIFI_BACKOFF_MAX_MS) cap = WIFI_BACKOFF_MAX_MS;
+    uint32_t wait = cap / 2 + esp_random() % (cap / 2 + 1);
+    s_stats.backoff_ms = wait;
+    s_stats.state = WIFI_STA_STATE_BACKOFF;
+    taskEXIT_CRITICAL(&s_lock);
+
+    esp_timer_stop(s_timer);
+    esp_timer_start_once(s_timer, (uint64_t)wait * 1000);
+}
+
+static void start_attempt(void)
+{
+    taskENTER_CRITICAL(&s_lock);
+    s_stats.attempts++;
+    s_stats.state = WIFI_STA_STATE_CONNECTING;
+    taskEXIT_CRITICAL(&s_lock);
+
+    if (esp_wifi_connect() != ESP_OK) {
+        schedule_retry();
+    }
+}
+
+// esp_timer task: end of a backoff wait, or DHCP never answered.
+static void wifi_timer_cb(void *arg)
+{
+    (void)arg;
+
+    switch (get_state()) {
+    case WIFI_STA_STATE_BACKOFF:
+        start_attempt();
+        break;
+    case WIFI_STA_STATE_WAIT_IP:
+        ESP_LOGW(TAG, "no IP after %d ms, reconnecting", WIFI_IP_TIMEOUT_MS);
+        esp_wifi_disconnect(); // the DISCONNECTED event schedules the retry
+        break;
+    default:
+        break;
+    }
+}
+
 static void wifi_event_handler(void *arg,
                                esp_event_base_t event_base,
                                int32_t event_id,
@@ -49,31 +133,82 @@ static void wifi_event_handler(void *arg,
     (void)arg;
 
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
+        s_attempt_start_us = esp_timer_get_time();
+        start_attempt();
+        return;
+    }
+
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        set_state(WIFI_STA_STATE_WAIT_IP);
+        esp_timer_stop(s_timer);
+        esp_timer_start_once(s_timer, (uint64_t)WIFI_IP_TIMEOUT_MS * 1000);
         return;
     }
 
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        s_connected = false;
-        s_ip_u32 = 0;
-
-        if (s_retry < WIFI_MAX_RETRY) {
-            s_retry++;
-            esp_wifi_connect();
-        } else {
-            xEventGroupSetBits(s_evt, WIFI_FAIL_BIT);
+        const wifi_event_sta_disconnected_t *e = (const wifi_event_sta_disconnected_t *)event_data;
+        bool was_up = s_connected;
+
+        taskENTER_CRITICAL(&s_lock);
+        s_stats.last_reason = e->reason;
+        if (was_up) {
+            s_stats.disconnects++;
+            s_stats.attempts = 0; // first retry comes quickly
+        }
+        taskEXIT_CRITICAL(&s_lock);
+
+        if (was_up) {
+            ESP_LOGW(TAG, "link lost (reason %u)", (unsigned)e->reason);
+            s_attempt_start_us = esp_timer_get_time();
+            link_down();
         }
+        schedule_retry();
         return;
     }
 
     if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         const ip_event_got_ip_t *e = (const ip_event_got_ip_t *)event_data;
+        int64_t now = esp_timer_get_time();
+        uint32_t tti = (uint32_t)((now - s_attempt_start_us) / 1000);
+
+        esp_timer_stop(s_timer);
+
+        taskENTER_CRITICAL(&s_lock);
+        if (s_links++ > 0) s_stats.reconnects++;
+        s_stats.state = WIFI_STA_STATE_CONNECTED;
+        s_stats.attempts = 0;
+        s_stats.backoff_ms = 0;
+        s_stats.last_time_to_ip_ms = tti;
+        if (tti > s_stats.max_time_to_ip_ms) s_stats.max_time_to_ip_ms = tti;
+        taskEXIT_CRITICAL(&s_lock);
+
+        s_up_since_us = now;
         s_ip_u32 = e->ip_info.ip.addr;
         s_connected = true;
-        s_retry = 0;
         xEventGroupSetBits(s_evt, WIFI_CONNECTED_BIT);
 
-        ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&e->ip_info.ip));
+        wifi_sta_up_event_t up = {
+            .ip = s_ip_u32,
+            .time_to_ip_ms = tti,
+            .reconnects = s_stats.reconnects,
+        };
+        esp_event_post(WIFI_STA_EVENT, WIFI_STA_EVENT_UP, &up, sizeof(up), 0);
+
+        ESP_LOGI(TAG, "Got IP: " IPSTR " after %u ms", IP2STR(&e->ip_info.ip), (unsigned)tti);
+        return;
+    }
+
+    // Still associated, lease gone: DHCP gets WIFI_IP_TIMEOUT_MS to renew it.
+    if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP) {
+        if (s_connected) {
+            s_attempt_start_us = esp_timer_get_time();
+            link_down();
+        }
+        if (get_state() == WIFI_STA_STATE_CONNECTED) {
+            set_state(WIFI_STA_STATE_WAIT_IP);
+            esp_timer_stop(s_timer);
+            esp_timer_start_once(s_timer, (uint64_t)WIFI_IP_TIMEOUT_MS * 1000);
+        }
         return;
     }
 }
@@ -85,6 +220,12 @@ static void wifi_sta_init_internal(const char *ssid, const char *pass)
 
     s_evt = xEventGroupCreate();
 
+    const esp_timer_create_args_t timer_args = {
+        .callback = wifi_timer_cb,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &s_timer));
+
     // --- NVS required by Wi-Fi ---
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -112,6 +253,8 @@ static void wifi_sta_init_internal(const char *ssid, const char *pass)
                                                &wifi_event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP,
                                                &wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_LOST_IP,
+                                               &wifi_event_handler, NULL));
 
     // --- STA config ---
     wifi_config_t wifi_cfg = {0};
@@ -131,17 +274,9 @@ static void wifi_sta_init_internal(const char *ssid, const char *pass)
 
 bool wifi_sta_start(void)
 {
+    // Doesn't wait for the link: consumers follow WIFI_STA_EVENT instead.
     wifi_sta_init_internal(WIFI_STA_DEFAULT_SSID, WIFI_STA_DEFAULT_PASS);
-
-    bool ok = wifi_sta_wait_connected(WIFI_STA_START_TIMEOUT_MS);
-
-    if (ok) {
-        ESP_LOGI(TAG, "Wi-Fi connected");
-    } else {
-        ESP_LOGW(TAG, "Wi-Fi NOT connected (timeout %u ms)",
-                 (unsigned)WIFI_STA_START_TIMEOUT_MS);
-    }
-    return ok;
+    return true;
 }
 
 bool wifi_sta_wait_connected(uint32_t timeout_ms)
@@ -151,7 +286,7 @@ bool wifi_sta_wait_connected(uint32_t timeout_ms)
     const TickType_t to = pdMS_TO_TICKS(timeout_ms);
     EventBits_t bits = xEventGroupWaitBits(
         s_evt,
-        WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
+        WIFI_CONNECTED_BIT,
         pdFALSE,
         pdFALSE,
         to
@@ -169,3 +304,20 @@ uint32_t wifi_sta_get_ip_u32(void)
 {
     return s_ip_u32;
 }
+
+void wifi_sta_get_stats(wifi_sta_stats_t *out)
+{
+    if (!out) return;
+
+    taskENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    taskEXIT_CRITICAL(&s_lock);
+
+    out->rssi = 0;
+    out->up_ms = 0;
+    if (s_connected) {
+        wifi_ap_record_t ap;
+        if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) out->rssi = ap.rssi;
+        out->up_ms = (uint32_t)((esp_timer_get_time() - s_up_since_us) / 1000);
+    }
+}
@@ -2,12 +2,55 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "esp_event.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Start Wi-Fi STA using module defaults (SSID/PASS/timeout live in wifi_sta.c).
-// Returns true if connected within timeout, false otherwise.
+// Link events, posted on the default event loop. Network consumers register
+// for these (esp_event_handler_register(WIFI_STA_EVENT, ...)) and pause or
+// resume on them instead of polling. Register after wifi_sta_start(), then
+// check wifi_sta_is_connected() once for the state you missed.
+ESP_EVENT_DECLARE_BASE(WIFI_STA_EVENT);
+
+typedef enum {
+    WIFI_STA_EVENT_UP,   // got an IP; data: wifi_sta_up_event_t
+    WIFI_STA_EVENT_DOWN, // lost it; no data
+} wifi_sta_event_id_t;
+
+typedef struct {
+    uint32_t ip;            // IPv4, network byte order
+    uint32_t time_to_ip_ms; // from the first attempt of this (re)connect
+    uint32_t reconnects;    // links after the first since boot
+} wifi_sta_up_event_t;
+
+typedef enum {
+    WIFI_STA_STATE_IDLE,
+    WIFI_STA_STATE_CONNECTING, // associating with the AP
+    WIFI_STA_STATE_WAIT_IP,    // associated, waiting for DHCP
+    WIFI_STA_STATE_CONNECTED,
+    WIFI_STA_STATE_BACKOFF,    // waiting before the next attempt
+} wifi_sta_state_t;
+
+typedef struct {
+    wifi_sta_state_t state;
+    int8_t   rssi;               // dBm; 0 while not associated
+    uint8_t  last_reason;        // wifi_err_reason_t of the last disconnect
+    uint32_t attempts;           // since the link was lost; 0 while connected
+    uint32_t backoff_ms;         // current wait between attempts
+    uint32_t reconnects;         // links after the first since boot
+    uint32_t disconnects;
+    uint32_t last_time_to_ip_ms;
+    uint32_t max_time_to_ip_ms;
+    uint32_t up_ms;              // how long the current link has been up
+} wifi_sta_stats_t;
+
+// Start Wi-Fi STA using module defaults (SSID/PASS live in wifi_sta.c).
+// Returns as soon as the driver and the network stack are up, without waiting
+// for a link; WIFI_STA_EVENT_UP says when there is one. The connection manager
+// keeps trying in the background, with jittered exponential backoff, for as
+// long as the device runs.
 bool wifi_sta_start(void);
 
 // Query state later (e.g. UI)
@@ -19,6 +62,9 @@ bool wifi_sta_wait_connected(uint32_t timeout_ms);
 // Get IPv4 (network byte order). 0 if not connected.
 uint32_t wifi_sta_get_ip_u32(void);
 
+// Link quality and reconnect statistics. Reads the RSSI from the driver.
+void wifi_sta_get_stats(wifi_sta_stats_t *out);
+
 #ifdef __cplusplus
 }
 #endif
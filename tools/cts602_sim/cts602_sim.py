@@ -0,0 +1,306 @@
+#!/usr/bin/env python3
+"""
+CTS602 Modbus RTU slave simulator on a Linux pseudo-terminal.
+
+Serves the input (FC04) and holding (FC03/06/16) register spaces of the
+`nilan_registers[]` table in src/NilanRegisters.c as slave address 30, so the
+Modbus master (src/nilan_rtu.c on the POSIX transport, nilan_transport_posix.c)
+can be run and benchmarked without a VP18 on the RS485 port.
+
+Every address in a hundred-range that holds a known register is served; unknown
+addresses inside such a range read as 0, which is what the poll plan's gap
+registers get from the real controller. Addresses outside return exception 02.
+Writes to holding registers stick and are read back by later FC03 reads.
+
+Faults are drawn from a seeded RNG, so a run is repeatable:
+
+    --turnaround-ms / --jitter-ms   delay before the first reply byte
+    --crc-rate                      flip a bit in the reply CRC
+    --drop-rate                     drop one byte from the middle of the reply
+    --exception-rate                answer with --exception-code instead
+    --silent-rate                   don't answer at all (master times out)
+
+Replies are paced at --baud (8E1, 11 bits per character) so the master sees
+realistic wire times; --baud 0 sends them as fast as the pty allows.
+
+Usage:
+    tools/cts602_sim/cts602_sim.py --link /tmp/cts602 [--seed 1] [--crc-rate 0.01] ...
+    NILAN_UART_DEV=/tmp/cts602 ./rtu_bench -n 1000      # see rtu_bench.c
+"""
+
+import argparse
+import os
+import random
+import select
+import signal
+import sys
+import termios
+import time
+import tty
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+import gen_nilan_tables as tables  # noqa: E402
+
+SLAVE_ADDR = 30
+BITS_PER_CHAR = 11
+T35_CHARS = 4             # matches NILAN_RTU_T35_SYMBOLS in nilan_rtu.c
+MAX_READ_QTY = 125
+MAX_WRITE_QTY = 123
+
+EXC_ILLEGAL_FUNCTION = 0x01
+EXC_ILLEGAL_ADDRESS = 0x02
+EXC_ILLEGAL_VALUE = 0x03
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def with_crc(pdu):
+    crc = crc16(pdu)
+    return bytes(pdu) + bytes((crc & 0xFF, crc >> 8))
+
+
+# ---------------- Register model ----------------
+
+class RegisterSpace:
+    """Both register spaces, seeded with plausible values from the register table."""
+
+    def __init__(self, regs, rng):
+        self.values = {4: {}, 3: {}}
+        self.served = {4: set(), 3: set()}  # hundreds that answer
+        self.temps = []                     # (type, addr) of TEMP_Cx100 registers
+        self.rng = rng
+
+        for r in regs:
+            t, a = r["type"], r["addr"]
+            self.served[t].add(a // 100)
+            if r["dtype"] == "NILAN_DTYPE_TEMP_Cx100":
+                self.values[t][a] = 1800 + (a * 37) % 1200  # 18.00 .. 29.99 C
+                self.temps.append((t, a))
+            else:
+                self.values[t][a] = 0
+
+    def readable(self, t, start, qty):
+        return all((a // 100) in self.served[t] for a in (start, start + qty - 1))
+
+    def read(self, t, start, qty):
+        return [self.values[t].get(a, 0) for a in range(start, start + qty)]
+
+    def write(self, start, values):
+        for i, v in enumerate(values):
+            self.values[3][start + i] = v
+
+    def drift(self):
+        """Random-walk the temperatures a little, like a running unit."""
+        for t, a in self.temps:
+            v = self.values[t][a] + self.rng.choice((-10, 0, 0, 0, 10))
+            self.values[t][a] = v & 0xFFFF
+
+
+# ---------------- Request handling ----------------
+
+def request_len(buf):
+    """Expected length of the request in buf, 0 while the header is incomplete."""
+    if len(buf) < 2:
+        return 0
+    func = buf[1]
+    if func in (0x03, 0x04, 0x06):
+        return 8
+    if func == 0x10:
+        return 0 if len(buf) < 7 else 9 + buf[6]
+    return 0  # unknown function: the t3.5 gap ends it
+
+
+def exception(func, code):
+    return with_crc((SLAVE_ADDR, func | 0x80, code))
+
+
+def handle(space, req):
+    """Reply frame for one intact request addressed to us."""
+    func = req[1]
+
+    if func in (0x03, 0x04):
+        start = (req[2] << 8) | req[3]
+        qty = (req[4] << 8) | req[5]
+        if qty == 0 or qty > MAX_READ_QTY:
+            return exception(func, EXC_ILLEGAL_VALUE)
+        t = 3 if func == 0x03 else 4
+        if not space.readable(t, start, qty):
+            return exception(func, EXC_ILLEGAL_ADDRESS)
+        pdu = bytearray((SLAVE_ADDR, func, 2 * qty))
+        for v in space.read(t, start, qty):
+            pdu += bytes((v >> 8, v & 0xFF))
+        return with_crc(pdu)
+
+    if func == 0x06:
+        addr = (req[2] << 8) | req[3]
+        if not space.readable(3, addr, 1):
+            return exception(func, EXC_ILLEGAL_ADDRESS)
+        space.write(addr, [(req[4] << 8) | req[5]])
+        return with_crc(req[:6])
+
+    if func == 0x10:
+        start = (req[2] << 8) | req[3]
+        qty = (req[4] << 8) | req[5]
+        if qty == 0 or qty > MAX_WRITE_QTY or req[6] != 2 * qty:
+            return exception(func, EXC_ILLEGAL_VALUE)
+        if not space.readable(3, start, qty):
+            return exception(func, EXC_ILLEGAL_ADDRESS)
+        space.write(start, [(req[7 + 2 * i] << 8) | req[8 + 2 * i] for i in range(qty)])
+        return with_crc(req[:6])
+
+    return exception(func, EXC_ILLEGAL_FUNCTION)
+
+
+# ---------------- Simulator ----------------
+
+class Simulator:
+    def __init__(self, args, space, rng):
+        self.args = args
+        self.space = space
+        self.rng = rng
+        self.char_s = BITS_PER_CHAR / args.baud if args.baud else 0.0
+        self.gap_s = max(T35_CHARS * BITS_PER_CHAR / (args.baud or 19200), 0.002)
+        self.stats = dict(requests=0, bad_requests=0, other_slave=0, replies=0,
+                          crc=0, dropped=0, exceptions=0, silent=0)
+
+        self.master, slave = os.openpty()
+        tty.setraw(slave)
+        attrs = termios.tcgetattr(slave)
+        attrs[3] &= ~termios.ECHO
+        termios.tcsetattr(slave, termios.TCSANOW, attrs)
+        self.slave_name = os.ttyname(slave)
+        # Keep the slave end open so the pty survives masters coming and going.
+        self.slave_fd = slave
+
+    def send(self, frame):
+        if not self.char_s:
+            os.write(self.master, frame)
+            return
+        # Pace the reply character by character, like the UART would.
+        t0 = time.monotonic()
+        for i, b in enumerate(frame):
+            os.write(self.master, bytes((b,)))
+            delay = t0 + (i + 1) * self.char_s - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+
+    def serve(self, req):
+        st = self.stats
+        if len(req) < 4 or crc16(req) != 0:
+            st["bad_requests"] += 1
+            return
+        if req[0] != SLAVE_ADDR:
+            st["other_slave"] += 1
+            return
+        st["requests"] += 1
+
+        a, rng = self.args, self.rng
+        if rng.random() < a.silent_rate:
+            st["silent"] += 1
+            return
+
+        if rng.random() < a.exception_rate:
+            reply = exception(req[1], a.exception_code)
+            st["exceptions"] += 1
+        else:
+            reply = bytearray(handle(self.space, req))
+            if reply[1] & 0x80:
+                st["exceptions"] += 1
+            if rng.random() < a.crc_rate:
+                reply[-1] ^= 1 << rng.randrange(8)
+                st["crc"] += 1
+            if len(reply) > 3 and rng.random() < a.drop_rate:
+                del reply[rng.randrange(2, len(reply) - 1)]
+                st["dropped"] += 1
+
+        turnaround = a.turnaround_ms + (rng.uniform(-a.jitter_ms, a.jitter_ms) if a.jitter_ms else 0)
+        time.sleep(max(turnaround, 0.0) / 1000.0)
+        self.send(bytes(reply))
+        st["replies"] += 1
+
+    def run(self):
+        buf = bytearray()
+        last_drift = time.monotonic()
+
+        while True:
+            ready, _, _ = select.select([self.master], [], [], self.gap_s if buf else 1.0)
+            now = time.monotonic()
+            if self.args.drift and now - last_drift >= 1.0:
+                self.space.drift()
+                last_drift = now
+
+            if not ready:
+                if buf:
+                    self.serve(bytes(buf))  # t3.5 silence ends the frame
+                    buf.clear()
+                continue
+
+            try:
+                buf += os.read(self.master, 512)
+            except OSError:
+                continue
+
+            want = request_len(buf)
+            while want and len(buf) >= want:
+                self.serve(bytes(buf[:want]))
+                del buf[:want]
+                want = request_len(buf)
+
+    def print_stats(self):
+        print("cts602_sim: " + " ".join("%s=%d" % kv for kv in self.stats.items()), file=sys.stderr)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    ap.add_argument("--src", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "src"),
+                    help="directory holding NilanRegisters.c/.h")
+    ap.add_argument("--link", help="create this symlink to the pty slave device")
+    ap.add_argument("--seed", type=int, default=1, help="RNG seed for values and faults")
+    ap.add_argument("--baud", type=int, default=19200, help="reply pacing, 0 = unpaced")
+    ap.add_argument("--turnaround-ms", type=float, default=20.0, help="request -> first reply byte")
+    ap.add_argument("--jitter-ms", type=float, default=0.0, help="+/- uniform jitter on the turnaround")
+    ap.add_argument("--crc-rate", type=float, default=0.0, help="share of replies with a bad CRC")
+    ap.add_argument("--drop-rate", type=float, default=0.0, help="share of replies missing a byte")
+    ap.add_argument("--exception-rate", type=float, default=0.0, help="share of requests answered with an exception")
+    ap.add_argument("--exception-code", type=int, default=0x06, help="code for injected exceptions (default 6, busy)")
+    ap.add_argument("--silent-rate", type=float, default=0.0, help="share of requests not answered")
+    ap.add_argument("--drift", action="store_true", help="random-walk the temperatures once a second")
+    args = ap.parse_args()
+
+    with open(os.path.join(args.src, "NilanRegisters.h")) as f:
+        periods = tables.parse_periods(f.read())
+    with open(os.path.join(args.src, "NilanRegisters.c")) as f:
+        regs = tables.parse_registers(f.read(), periods)
+
+    rng = random.Random(args.seed)
+    sim = Simulator(args, RegisterSpace(regs, rng), rng)
+
+    if args.link:
+        if os.path.islink(args.link):
+            os.unlink(args.link)
+        os.symlink(sim.slave_name, args.link)
+
+    print("cts602_sim: slave %d on %s (%d registers)%s"
+          % (SLAVE_ADDR, sim.slave_name, len(regs), " -> " + args.link if args.link else ""),
+          file=sys.stderr)
+
+    signal.signal(signal.SIGTERM, lambda *_: sys.exit(0))
+    try:
+        sim.run()
+    except (KeyboardInterrupt, SystemExit):
+        pass
+    finally:
+        sim.print_stats()
+        if args.link and os.path.islink(args.link):
+            os.unlink(args.link)
+
+
+if __name__ == "__main__":
+    main()
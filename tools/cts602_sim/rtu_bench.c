@@ -0,0 +1,201 @@
+/**
+ * Host benchmark for the RTU layer against the CTS602 simulator.
+ *
+ * Builds src/nilan_rtu.c unchanged on the POSIX transport (shim/ only holds
+ * the sdkconfig.h that selects it) and reads the poll plan's blocks
+ * round-robin, like the bus task does, as fast as the line allows. Prints the outcome classes and the phase timings, so changes to
+ * the receiver or the poll plan can be compared run against run (same --seed
+ * on the simulator gives the same faults).
+ *
+ *   python3 tools/gen_nilan_tables.py --src src --out /tmp/nilan_gen
+ *   cc -O2 -Itools/cts602_sim/shim -Isrc -I/tmp/nilan_gen \
+ *      tools/cts602_sim/rtu_bench.c src/nilan_transport_posix.c \
+ *      src/nilan_rtu.c /tmp/nilan_gen/nilan_poll_plan_gen.c -o /tmp/rtu_bench
+ *
+ *   tools/cts602_sim/cts602_sim.py --link /tmp/cts602 --jitter-ms 5 --crc-rate 0.02 &
+ *   NILAN_UART_DEV=/tmp/cts602 /tmp/rtu_bench -n 1000
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "CRC16.h"
+#include "nilan_poll_plan.h"
+#include "nilan_rtu.h"
+#include "nilan_transport.h"
+
+#define NILAN_SLAVE_ADDR 30
+#define BENCH_GAP_US 10000 // NILAN_BUS_GAP_MS in nilan_modbus.c
+
+// ====================================================
+// TYPEDEFS
+// ====================================================
+
+typedef struct
+{
+    uint32_t samples;
+    uint64_t sum_us;
+    uint32_t max_us;
+} phase_acc_t;
+
+// ====================================================
+// VARIABLES
+// ====================================================
+
+static const char *const err_names[NILAN_MB_ERR_COUNT] = {
+    [NILAN_MB_ERR_NONE] = "ok",
+    [NILAN_MB_ERR_TIMEOUT] = "timeout",
+    [NILAN_MB_ERR_CRC] = "crc",
+    [NILAN_MB_ERR_LENGTH] = "length",
+    [NILAN_MB_ERR_ADDR] = "addr",
+    [NILAN_MB_ERR_FUNC] = "func",
+    [NILAN_MB_ERR_EXCEPTION] = "exception",
+    [NILAN_MB_ERR_INTERNAL] = "internal",
+    [NILAN_MB_ERR_VERIFY] = "verify",
+    [NILAN_MB_ERR_LINE] = "line",
+    [NILAN_MB_ERR_OVERRUN] = "overrun",
+};
+
+static uint32_t err_counts[NILAN_MB_ERR_COUNT];
+static phase_acc_t acc_tx, acc_turnaround, acc_rx, acc_total;
+
+// ====================================================
+// PROTOTYPES
+// ====================================================
+static nilan_mb_err_t read_block(const nilan_poll_block_t *blk);
+static void acc_add(phase_acc_t *acc, uint32_t us);
+static void acc_print(const char *name, const phase_acc_t *acc);
+
+// ====================================================
+// IMPLEMENTATIONS
+// ====================================================
+
+int main(int argc, char **argv)
+{
+    long count = 500;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        if (opt == 'n')
+        {
+            count = strtol(optarg, NULL, 10);
+        }
+        else
+        {
+            fprintf(stderr, "usage: NILAN_UART_DEV=<pty> %s [-n transactions]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (!nilan_rtu_init())
+    {
+        return 1;
+    }
+
+    int64_t t0 = nilan_transport_now_us();
+
+    for (long i = 0; i < count; ++i)
+    {
+        nilan_mb_err_t err = read_block(&nilan_poll_blocks[i % NILAN_POLL_BLOCK_COUNT]);
+        err_counts[err]++;
+
+        nilan_rtu_timing_t t;
+        nilan_rtu_get_last_timing(&t);
+        acc_add(&acc_tx, t.tx_us);
+        acc_add(&acc_turnaround, t.turnaround_us);
+        acc_add(&acc_rx, t.rx_us);
+        acc_add(&acc_total, t.total_us);
+
+        usleep(BENCH_GAP_US);
+    }
+
+    double secs = (double)(nilan_transport_now_us() - t0) / 1e6;
+    printf("%ld transactions in %.2f s (%.1f/s)\n", count, secs, (double)count / secs);
+
+    for (size_t e = 0; e < NILAN_MB_ERR_COUNT; ++e)
+    {
+        if (err_counts[e] != 0)
+        {
+            printf("  %-10s %u\n", err_names[e], (unsigned)err_counts[e]);
+        }
+    }
+
+    acc_print("tx", &acc_tx);
+    acc_print("turnaround", &acc_turnaround);
+    acc_print("rx", &acc_rx);
+    acc_print("total", &acc_total);
+    return 0;
+}
+
+// ===============================================================
+// HELPERS
+// ===============================================================
+
+// The same FC03/FC04 exchange and reply checks as read_regs() in nilan_modbus.c.
+static nilan_mb_err_t read_block(const nilan_poll_block_t *blk)
+{
+    uint8_t tx[8] = {
+        NILAN_SLAVE_ADDR,
+        blk->reg_type,
+        (uint8_t)(blk->start_addr >> 8),
+        (uint8_t)(blk->start_addr & 0xFF),
+        (uint8_t)(blk->qty >> 8),
+        (uint8_t)(blk->qty & 0xFF),
+    };
+    uint16_t crc = modbus_crc16(tx, 6);
+    tx[6] = (uint8_t)(crc & 0xFF);
+    tx[7] = (uint8_t)(crc >> 8);
+
+    uint8_t rx[NILAN_RTU_MAX_FRAME];
+    size_t rx_len = 0;
+    nilan_mb_err_t err = nilan_rtu_transact(tx, sizeof(tx), rx, sizeof(rx), &rx_len);
+    if (err != NILAN_MB_ERR_NONE)
+    {
+        return err;
+    }
+
+    if (rx[0] != NILAN_SLAVE_ADDR)
+    {
+        return NILAN_MB_ERR_ADDR;
+    }
+    if (rx[1] == (blk->reg_type | 0x80))
+    {
+        return NILAN_MB_ERR_EXCEPTION;
+    }
+    if (rx[1] != blk->reg_type)
+    {
+        return NILAN_MB_ERR_FUNC;
+    }
+    if (rx[2] != 2 * blk->qty)
+    {
+        return NILAN_MB_ERR_LENGTH;
+    }
+    return NILAN_MB_ERR_NONE;
+}
+
+static void acc_add(phase_acc_t *acc, uint32_t us)
+{
+    if (us == NILAN_RTU_NO_TIME)
+    {
+        return;
+    }
+    acc->samples++;
+    acc->sum_us += us;
+    if (us > acc->max_us)
+    {
+        acc->max_us = us;
+    }
+}
+
+static void acc_print(const char *name, const phase_acc_t *acc)
+{
+    if (acc->samples == 0)
+    {
+        printf("  %-10s -\n", name);
+        return;
+    }
+    printf("  %-10s mean %7.2f ms  max %7.2f ms  (%u samples)\n", name,
+           (double)acc->sum_us / acc->samples / 1000.0, acc->max_us / 1000.0, (unsigned)acc->samples);
+}
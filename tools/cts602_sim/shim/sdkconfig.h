@@ -0,0 +1,6 @@
+#pragma once
+
+// Stand-in for the generated sdkconfig.h when building the RTU layer straight
+// on the host (rtu_bench.c): selects nilan_transport_posix.c.
+
+#define CONFIG_IDF_TARGET_LINUX 1
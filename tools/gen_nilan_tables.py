@@ -0,0 +1,312 @@
+#!/usr/bin/env python3
+"""
+Build-time generator for the Nilan poll plan.
+
+Reads the single register table (src/NilanRegisters.c, `nilan_registers[]`) and the
+poll-class periods (src/NilanRegisters.h, `NILAN_POLL_<CLASS>_MS`) and emits constant
+tables that the firmware links straight from flash:
+
+    nilan_poll_plan_gen.h   block / map counts
+    nilan_poll_plan_gen.c   nilan_poll_blocks[], nilan_poll_map[] (id -> offset),
+                            nilan_poll_reg_block[] (id -> block) and the
+                            (reg_type, addr) -> id index
+
+Block selection is an exact dynamic program over contiguous runs of registers. A run
+costs one transaction (request, reply header, turnaround, inter-frame gap) plus two
+bytes per register carried, and is refreshed at the period of its fastest member.
+The plan minimizes total wire time per second, so gap registers are only carried
+when they are cheaper than a separate frame.
+
+Usage:
+    gen_nilan_tables.py --src src --out <build dir>   # generate (called from CMake)
+    gen_nilan_tables.py --src src --report            # bytes-on-wire report, no output files
+"""
+
+import argparse
+import os
+import re
+import sys
+
+# ---------------- Bus cost model ----------------
+BAUD = 19200
+BITS_PER_CHAR = 11          # 8E1: start + 8 data + parity + stop
+CHAR_MS = 1000.0 * BITS_PER_CHAR / BAUD
+REQ_BYTES = 8               # [addr][func][start x2][qty x2][crc x2]
+RESP_OVERHEAD_BYTES = 5     # [addr][func][byte_count] ... [crc x2]
+T35_CHARS = 2 * 3.5         # silence closing the request and the reply
+TURNAROUND_MS = 20.0        # CTS602 request->first reply byte (estimate)
+BUS_GAP_MS = 10.0           # NILAN_BUS_GAP_MS in nilan_modbus.c
+MAX_QTY = 125               # Modbus limit for FC03/FC04
+
+REG_TYPES = {"NILAN_INPUT_REG": 4, "NILAN_HOLDING_REG": 3}
+TYPE_TAG = {4: "IR", 3: "HR"}
+
+# The CTS602 map is organised in hundreds (100 = inputs, 200 = temperatures, ...).
+# Blocks never cross a hundred, and these extra split points mark holes inside one
+# that answer with an exception (user function 1 at 600.., user function 2 at 610..).
+SPLIT_BEFORE = {(3, 610)}
+
+
+def strip_comments(text):
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    return re.sub(r"//[^\n]*", "", text)
+
+
+def parse_periods(header_text):
+    periods = {}
+    for name, ms in re.findall(r"#define\s+NILAN_POLL_(\w+)_MS\s+(\d+)", header_text):
+        periods["NILAN_POLL_" + name] = int(ms)
+    if "NILAN_POLL_NORMAL" not in periods:
+        sys.exit("gen_nilan_tables: NILAN_POLL_NORMAL_MS not found in NilanRegisters.h")
+    return periods
+
+
+def parse_registers(source_text, periods):
+    text = strip_comments(source_text)
+    start = text.find("nilan_registers[NILAN_REGID_COUNT]")
+    if start < 0:
+        sys.exit("gen_nilan_tables: nilan_registers[] not found in NilanRegisters.c")
+    text = text[start:]
+
+    regs = []
+    for regid, body in re.findall(r"\[(NILAN_REGID_\w+)\]\s*=\s*\{([^{}]*)\}", text):
+        addr = re.search(r"\.addr\s*=\s*(\d+)", body)
+        rtype = re.search(r"\.reg_type\s*=\s*(\w+)", body)
+        pclass = re.search(r"\.poll_class\s*=\s*(\w+)", body)
+        dtype = re.search(r"\.data_type\s*=\s*(\w+)", body)
+        if not addr or not rtype or rtype.group(1) not in REG_TYPES:
+            sys.exit("gen_nilan_tables: can't parse entry %s" % regid)
+        pclass = pclass.group(1) if pclass else "NILAN_POLL_NORMAL"
+        if pclass not in periods:
+            sys.exit("gen_nilan_tables: %s uses unknown poll class %s" % (regid, pclass))
+        regs.append({
+            "id": regid,
+            "addr": int(addr.group(1)),
+            "type": REG_TYPES[rtype.group(1)],
+            "class": pclass,
+            "period": periods[pclass],
+            "dtype": dtype.group(1) if dtype else "NILAN_DTYPE_UINT16",
+        })
+
+    seen = {}
+    for r in regs:
+        key = (r["type"], r["addr"])
+        if key in seen:
+            sys.exit("gen_nilan_tables: %s and %s share %s %d"
+                     % (seen[key], r["id"], TYPE_TAG[r["type"]], r["addr"]))
+        seen[key] = r["id"]
+    return regs
+
+
+def txn_ms(qty):
+    chars = REQ_BYTES + RESP_OVERHEAD_BYTES + 2 * qty + T35_CHARS
+    return chars * CHAR_MS + TURNAROUND_MS + BUS_GAP_MS
+
+
+def wire_bytes(qty):
+    return REQ_BYTES + RESP_OVERHEAD_BYTES + 2 * qty
+
+
+def section_key(reg):
+    splits = sum(1 for (t, a) in SPLIT_BEFORE
+                 if t == reg["type"] and a // 100 == reg["addr"] // 100 and a <= reg["addr"])
+    return (reg["type"], reg["addr"] // 100, splits)
+
+
+def plan_section(regs):
+    """Exact DP: split the sorted registers of one section into contiguous blocks."""
+    n = len(regs)
+    best = [0.0] + [float("inf")] * n
+    cut = [0] * (n + 1)
+    for j in range(1, n + 1):
+        period = float("inf")
+        for i in range(j - 1, -1, -1):
+            qty = regs[j - 1]["addr"] - regs[i]["addr"] + 1
+            if qty > MAX_QTY:
+                break
+            period = min(period, regs[i]["period"])
+            cost = best[i] + txn_ms(qty) / period
+            if cost < best[j]:
+                best[j] = cost
+                cut[j] = i
+    blocks = []
+    j = n
+    while j > 0:
+        i = cut[j]
+        blocks.append(regs[i:j])
+        j = i
+    return list(reversed(blocks))
+
+
+def build_plan(regs):
+    sections = {}
+    for r in regs:
+        sections.setdefault(section_key(r), []).append(r)
+
+    blocks = []
+    # Input registers first, then holding, each by address (matches the old hand plan).
+    for key in sorted(sections, key=lambda k: (-k[0], k[1], k[2])):
+        members = sorted(sections[key], key=lambda r: r["addr"])
+        for run in plan_section(members):
+            fastest = min(run, key=lambda r: r["period"])
+            blocks.append({
+                "type": run[0]["type"],
+                "start": run[0]["addr"],
+                "qty": run[-1]["addr"] - run[0]["addr"] + 1,
+                "class": fastest["class"],
+                "period": fastest["period"],
+                "regs": run,
+            })
+    return blocks
+
+
+def emit(blocks, out_dir):
+    os.makedirs(out_dir, exist_ok=True)
+    map_count = sum(len(b["regs"]) for b in blocks)
+    max_qty = max(b["qty"] for b in blocks)
+
+    # Address index: input registers then holding, each sorted by address, plus
+    # where each hundred starts, so a lookup scans one hundred at most.
+    regs = [r for b in blocks for r in b["regs"]]
+    index = sorted(regs, key=lambda r: (-r["type"], r["addr"]))
+    hundreds = max(r["addr"] for r in regs) // 100 + 1
+    starts = {}
+    for slot, rtype in enumerate((4, 3)):
+        row = []
+        for h in range(hundreds + 1):
+            row.append(sum(1 for r in index
+                           if (r["type"] > rtype) or (r["type"] == rtype and r["addr"] // 100 < h)))
+        starts[slot] = row
+
+    header = [
+        "// Generated by tools/gen_nilan_tables.py from NilanRegisters.c - do not edit.",
+        "#pragma once",
+        "",
+        "#define NILAN_POLL_BLOCK_COUNT %d" % len(blocks),
+        "#define NILAN_POLL_MAP_COUNT %d" % map_count,
+        "#define NILAN_POLL_MAX_QTY %d" % max_qty,
+        "",
+        "#define NILAN_REG_INDEX_COUNT %d" % len(index),
+        "#define NILAN_REG_INDEX_HUNDREDS %d" % hundreds,
+        "",
+    ]
+
+    src = [
+        "// Generated by tools/gen_nilan_tables.py from NilanRegisters.c - do not edit.",
+        '#include "nilan_poll_plan.h"',
+        "",
+        '_Static_assert(NILAN_REGID_COUNT <= 256, "nilan_poll_map stores ids as uint8_t");',
+        '_Static_assert(NILAN_POLL_BLOCK_COUNT <= 256, "nilan_poll_reg_block stores blocks as uint8_t");',
+        '_Static_assert(NILAN_REG_INDEX_COUNT < 256, "nilan_reg_index_hundred stores offsets as uint8_t");',
+        "",
+        "const nilan_poll_block_t nilan_poll_blocks[NILAN_POLL_BLOCK_COUNT] = {",
+    ]
+    first = 0
+    for b in blocks:
+        tname = "NILAN_INPUT_REG" if b["type"] == 4 else "NILAN_HOLDING_REG"
+        src.append("    {%s, %d, %d, %s, %d, %d}, // %s %d..%d, %d regs, %d gap"
+                   % (tname, b["start"], b["qty"], b["class"], first, len(b["regs"]),
+                      TYPE_TAG[b["type"]], b["start"], b["start"] + b["qty"] - 1,
+                      len(b["regs"]), b["qty"] - len(b["regs"])))
+        first += len(b["regs"])
+    src += ["};", "", "const nilan_poll_map_entry_t nilan_poll_map[NILAN_POLL_MAP_COUNT] = {"]
+    for b in blocks:
+        for r in b["regs"]:
+            src.append("    {%s, %d}," % (r["id"], r["addr"] - b["start"]))
+    # Every register parsed from the table lands in exactly one block.
+    src += ["};", "", "const uint8_t nilan_poll_reg_block[NILAN_REGID_COUNT] = {"]
+    for bi, b in enumerate(blocks):
+        for r in b["regs"]:
+            src.append("    [%s] = %d," % (r["id"], bi))
+    src += ["};", ""]
+
+    src += ["const nilan_reg_index_entry_t nilan_reg_index[NILAN_REG_INDEX_COUNT] = {"]
+    for r in index:
+        src.append("    {%d, %s}, // %s" % (r["addr"], r["id"], TYPE_TAG[r["type"]]))
+    src += ["};", ""]
+    src += ["const uint8_t nilan_reg_index_hundred[2][NILAN_REG_INDEX_HUNDREDS + 1] = {"]
+    for slot, tag in ((0, "input"), (1, "holding")):
+        src.append("    {%s}, // %s" % (", ".join(str(v) for v in starts[slot]), tag))
+    src += ["};", ""]
+
+    write_if_changed(os.path.join(out_dir, "nilan_poll_plan_gen.h"), "\n".join(header))
+    write_if_changed(os.path.join(out_dir, "nilan_poll_plan_gen.c"), "\n".join(src))
+
+
+def write_if_changed(path, text):
+    # Keep the timestamp when nothing changed so dependants don't rebuild.
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == text:
+                return
+    with open(path, "w") as f:
+        f.write(text)
+
+
+def report(blocks, regs):
+    print("Nilan poll plan - %d registers, %d blocks (19200 8E1, %.3f ms/char, "
+          "%.0f ms turnaround + %.0f ms gap per frame)"
+          % (len(regs), len(blocks), CHAR_MS, TURNAROUND_MS, BUS_GAP_MS))
+    print()
+    print("  %-4s %5s %4s %5s %5s %-18s %8s %7s %8s"
+          % ("type", "start", "qty", "regs", "gap", "class", "period", "bytes", "load"))
+    total_bytes = 0
+    total_load = 0.0
+    for b in blocks:
+        load = txn_ms(b["qty"]) / b["period"]
+        total_bytes += wire_bytes(b["qty"])
+        total_load += load
+        print("  %-4s %5d %4d %5d %5d %-18s %6dms %7d %7.2f%%"
+              % (TYPE_TAG[b["type"]], b["start"], b["qty"], len(b["regs"]),
+                 b["qty"] - len(b["regs"]), b["class"], b["period"],
+                 wire_bytes(b["qty"]), 100.0 * load))
+    print()
+    print("  bytes on wire per full refresh : %d" % total_bytes)
+    print("  wire time per full refresh     : %.0f ms" % sum(txn_ms(b["qty"]) for b in blocks))
+    print("  bus load at the class periods  : %.2f%%" % (100.0 * total_load))
+    print()
+
+    # Reference points: same registers, same periods, different blocking.
+    singles = sum(wire_bytes(1) for _ in regs)
+    singles_load = sum(txn_ms(1) / r["period"] for r in regs)
+    print("  one frame per register         : %d bytes/refresh, %.2f%% load"
+          % (singles, 100.0 * singles_load))
+
+    sections = {}
+    for r in regs:
+        sections.setdefault(section_key(r), []).append(r)
+    spans = [sorted(v, key=lambda r: r["addr"]) for v in sections.values()]
+    span_bytes = sum(wire_bytes(s[-1]["addr"] - s[0]["addr"] + 1) for s in spans)
+    span_load = sum(txn_ms(s[-1]["addr"] - s[0]["addr"] + 1) / min(r["period"] for r in s)
+                    for s in spans)
+    print("  one frame per section          : %d bytes/refresh, %.2f%% load"
+          % (span_bytes, 100.0 * span_load))
+    print()
+    print("  The plan is the exact minimum of bus load over all splits of each section")
+    print("  into contiguous read blocks under the cost model above.")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    ap.add_argument("--src", required=True, help="directory holding NilanRegisters.c/.h")
+    ap.add_argument("--out", help="output directory for the generated tables")
+    ap.add_argument("--report", action="store_true", help="print the bytes-on-wire report")
+    args = ap.parse_args()
+
+    with open(os.path.join(args.src, "NilanRegisters.h")) as f:
+        header_text = f.read()
+    with open(os.path.join(args.src, "NilanRegisters.c")) as f:
+        source_text = f.read()
+
+    periods = parse_periods(header_text)
+    regs = parse_registers(source_text, periods)
+    blocks = build_plan(regs)
+
+    if args.out:
+        emit(blocks, args.out)
+    if args.report or not args.out:
+        report(blocks, regs)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+"""
+Stand-in for the InfluxDB write endpoint that src/nilan_telemetry.c posts to.
+
+Accepts line protocol on any POST path, checks every line parses as
+"measurement fields [timestamp]", and prints one summary per batch. Lines can
+be appended to a file with --out.
+
+Outages for exercising the on-flash spool:
+
+    --status CODE    answer every post with CODE (e.g. 503, or 400 for a reject)
+    kill -USR1 PID   toggle between answering 204 and 503
+
+Usage:
+    tools/influx_sink.py --port 8086 [--out lines.txt]
+    -DNILAN_TELEMETRY_URL=\\"http://<pc>:8086/api/v2/write?bucket=nilan&precision=s\\"
+"""
+
+import argparse
+import signal
+import sys
+import time
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+state = {"down": False, "batches": 0, "lines": 0}
+
+
+def check_line(line):
+    parts = line.split(" ")
+    if len(parts) not in (2, 3) or not parts[0]:
+        return False
+    for field in parts[1].split(","):
+        key, _, value = field.partition("=")
+        if not key or not value:
+            return False
+    return len(parts) == 2 or parts[2].isdigit()
+
+
+class Handler(BaseHTTPRequestHandler):
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0))).decode("utf-8", "replace")
+        status = args.status or (503 if state["down"] else 204)
+
+        lines = [l for l in body.split("\n") if l]
+        bad = [l for l in lines if not check_line(l)]
+        if bad and status < 300:
+            status = 400
+
+        stamps = [int(l.rsplit(" ", 1)[1]) for l in lines if l.count(" ") == 2]
+        span = ""
+        if stamps:
+            span = " %s .. %s" % (time.strftime("%H:%M:%S", time.gmtime(min(stamps))),
+                                  time.strftime("%H:%M:%S", time.gmtime(max(stamps))))
+        print("%s %3d  %2d lines %5d bytes%s%s" % (time.strftime("%H:%M:%S"), status, len(lines),
+                                                   len(body), span, "  BAD: %r" % bad[0] if bad else ""))
+
+        if status < 300:
+            state["batches"] += 1
+            state["lines"] += len(lines)
+            if args.out:
+                with open(args.out, "a") as f:
+                    f.write(body if body.endswith("\n") else body + "\n")
+
+        self.send_response(status)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def log_message(self, fmt, *a):
+        pass
+
+
+def toggle(signum, frame):
+    state["down"] = not state["down"]
+    print("-- now %s" % ("DOWN (503)" if state["down"] else "up"), flush=True)
+
+
+if __name__ == "__main__":
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--port", type=int, default=8086)
+    ap.add_argument("--status", type=int, default=0, help="answer every post with this status")
+    ap.add_argument("--out", help="append accepted lines to this file")
+    args = ap.parse_args()
+
+    signal.signal(signal.SIGUSR1, toggle)
+    server = HTTPServer(("", args.port), Handler)
+    print("listening on :%d" % args.port, flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        print("\n%d batches, %d lines" % (state["batches"], state["lines"]))
+        sys.exit(0)